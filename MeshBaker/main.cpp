@@ -0,0 +1,60 @@
+#include "../MyVulkan/core/Resource/Model.h"
+#include "../MyVulkan/core/Resource/SkinnedModel.h"
+
+#include <chrono>
+#include <cstdio>
+
+/*把FBX/OBJ等模型离线转换为.cmesh，运行时直接映射加载，不再经过Assimp
+  用法: MeshBaker [--skinned] <输入模型> [输出文件，默认为输入路径加.cmesh]*/
+int main(int argc, char** argv) {
+	bool skinned = false;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--skinned")
+			skinned = true;
+		else
+			paths.push_back(argument);
+	}
+
+	if (paths.empty() || paths.size() > 2) {
+		printf("Usage: MeshBaker [--skinned] <input> [output]\n");
+		return 1;
+	}
+	std::string outputPath = paths.size() > 1 ? paths[1] : GetBakedMeshPath(paths[0]);
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	bool baked = false;
+	size_t vertexCount = 0, indexCount = 0;
+	if (skinned) {
+		SkinnedModel model;
+		if (model.Import(paths[0])) {
+			for (auto& info : model.renderInfo) {
+				vertexCount += info.vertices.size();
+				indexCount += info.indices.size();
+			}
+			baked = model.SaveBaked(outputPath);
+		}
+	}
+	else {
+		Model model;
+		if (model.Import(paths[0])) {
+			for (auto& info : model.renderInfo) {
+				vertexCount += info.vertices.size();
+				indexCount += info.indices.size();
+			}
+			baked = model.SaveBaked(outputPath);
+		}
+	}
+
+	if (!baked) {
+		printf("Bake %s failed\n", paths[0].c_str());
+		return 1;
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	printf("%s -> %s: %zu vertices, %zu indices, %.1f ms\n", paths[0].c_str(), outputPath.c_str(), vertexCount, indexCount,
+		std::chrono::duration<float, std::milli>(endTime - startTime).count());
+	return 0;
+}
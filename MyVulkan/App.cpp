@@ -3,10 +3,16 @@
 #include <dinput.h>
 #include "core/Render/ParticleSystem.h"
 #include "core/Render/PostProcessing.h"
+#include "core/Resource/AssetImporter.h"
 #include "core/Resource/Model.h"
 #include "imgui/imgui.h"
 #include "Util/GeometryGenerator.h"
 
+#include <chrono>
+
+static const char* pipelineCachePath = "pipeline.cache";
+static const char* shaderLibraryPath = "Shaders\\shaders.pak";
+
 static VKAPI_ATTR vk::Bool32 VKAPI_CALL DebugCallback(
 	vk::DebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 	vk::DebugUtilsMessageTypeFlagsEXT messageType,
@@ -150,8 +156,33 @@ void App::Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HIN
 		MessageBox(0, L"Cannot find graphics queue!!!", 0, 0);
 
 	//Create device
+	//支持时开启BC块压缩纹理
+	vkInfo.textureCompressionBC = vkInfo.gpu.getFeatures().textureCompressionBC == VK_TRUE;
+	//网格簇剔除后每个网格的簇用一次间接绘制提交，不支持时逐条提交
+	vkInfo.multiDrawIndirect = vkInfo.gpu.getFeatures().multiDrawIndirect == VK_TRUE;
+	vkInfo.drawIndirectFirstInstance = vkInfo.gpu.getFeatures().drawIndirectFirstInstance == VK_TRUE;
+
 	auto feature = vk::PhysicalDeviceFeatures()
-		.setGeometryShader(VK_TRUE);
+		.setGeometryShader(VK_TRUE)
+		.setTextureCompressionBC(vkInfo.textureCompressionBC)
+		.setMultiDrawIndirect(vkInfo.multiDrawIndirect)
+		.setDrawIndirectFirstInstance(vkInfo.drawIndirectFirstInstance);
+
+	//GPU剔除写入的命令数由GPU给出，支持时每个桶只执行实际写入的命令
+	bool drawIndirectCount = false;
+	if (gpuDrivenRendering) {
+		uint32_t extensionCount = 0;
+		vkInfo.gpu.enumerateDeviceExtensionProperties(nullptr, &extensionCount, static_cast<vk::ExtensionProperties*>(nullptr));
+		std::vector<vk::ExtensionProperties> extensions(extensionCount);
+		vkInfo.gpu.enumerateDeviceExtensionProperties(nullptr, &extensionCount, extensions.data());
+		for (auto& extension : extensions) {
+			if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) {
+				vkInfo.deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				drawIndirectCount = true;
+				break;
+			}
+		}
+	}
 
 	float priorities[1] = { 0.0f };
 	deviceQueueInfo.setQueueCount(1);
@@ -166,6 +197,11 @@ void App::Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HIN
 	if (vkInfo.gpu.createDevice(&deviceInfo, 0, &vkInfo.device) != vk::Result::eSuccess) {
 		MessageBox(0, L"Create device failed!!!", 0, 0);
 	}
+	if (drawIndirectCount)
+		vkInfo.cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkInfo.device.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+
+	memoryAllocator.Init(vkInfo.device, vkInfo.gpu);
+	vkInfo.allocator = &memoryAllocator;
 
 	/*Create a swap chain*/
 
@@ -266,6 +302,16 @@ void App::Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HIN
 	//Get queue
 	vkInfo.device.getQueue(vkInfo.graphicsQueueFamilyIndex, 0, &vkInfo.queue);
 
+	/*Load pipeline cache from disk*/
+	vkInfo.pipelineCache = LoadPipelineCache(vkInfo.device, vkInfo.gpu, pipelineCachePath, pipelineCacheWarm);
+
+	/*Pack the compiled shaders and map the library*/
+	if (!ShaderLibrary::Pack("Shaders", shaderLibraryPath)) {
+		MessageBox(0, L"Pack shader library failed!!!", 0, 0);
+	}
+	shaderLibrary.Open(vkInfo.device, shaderLibraryPath);
+	vkInfo.shaderLibrary = &shaderLibrary;
+
 	/*Create command buffers*/
 
 	//Create command pool
@@ -276,6 +322,13 @@ void App::Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HIN
 		MessageBox(0, L"Create command pool failed!!!", 0, 0);
 	}
 
+	//所有资源上传共用的暂存环形缓冲
+	uploadBatcher.Init(vkInfo.device, vkInfo.gpu.getMemoryProperties(), vkInfo.queue, vkInfo.graphicsQueueFamilyIndex);
+	textureCache.Init(&vkInfo, &uploadBatcher);
+	textureStreamer.Init(&vkInfo, &uploadBatcher, textureBudget);
+	if (streamTextures && vkInfo.textureCompressionBC)
+		textureCache.SetStreamer(&textureStreamer);
+
 	//Allocate Command buffer from the pool
 	vkInfo.cmd.resize(vkInfo.frameCount);
 	vk::CommandBufferAllocateInfo cmdBufferAlloc;
@@ -303,6 +356,8 @@ void App::Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HIN
 }
 
 void App::Start() {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
 	//初始化场景系统
 	scene.vkInfo = &vkInfo;
 
@@ -315,8 +370,7 @@ void App::Start() {
 	//创建一个点光
 	scene.SetPointLight(0, glm::vec3(1.0f, 7.f, 0.0f), glm::vec3(5.0f, 5.0f, 5.0f), 1.0f, 10.0f);
 
-	//利用Texture辅助库加载图片
-	std::vector<std::unique_ptr<Texture>> textures;
+	//所有资源先提交给导入线程，通过纹理缓存加载的图片相同路径只加载一次
 	std::string texturePath[] = {
 		"Assets\\floor.jpg",
 		"Assets\\icon.jpg",
@@ -324,24 +378,37 @@ void App::Start() {
 		"Assets\\SmokeLoop.png",
 		"Assets\\brickTexture_normal.jpg"
 	};
-	for (size_t i = 0; i < 5; i++) {
-		auto texture = std::make_unique<Texture>();
-		LoadPixelWithSTB(texturePath[i].c_str(), 32, *texture, &vkInfo.device, vkInfo.gpu.getMemoryProperties());
-		texture->SetupImage(&vkInfo.device, vkInfo.gpu.getMemoryProperties(), vkInfo.cmdPool, &vkInfo.queue);
-		texture->CleanUploader(&vkInfo.device);
-		textures.push_back(std::move(texture));
-	}
+	TextureUsage textureUsage[] = {
+		TextureUsage::color,
+		TextureUsage::color,
+		TextureUsage::color,
+		TextureUsage::color,
+		compressNormalMaps ? TextureUsage::normal : TextureUsage::color
+	};
+	assetImporter.Init(&textureCache, &uploadBatcher);
+	std::shared_future<std::shared_ptr<Model>> modelFuture = assetImporter.LoadModel("Assets\\model.fbx");
+
+	//导入完成之前使用1x1的占位纹理: 白色、朝向+Z的法线、灰色的天空
+	std::shared_ptr<Texture> whiteTexture = textureCache.GetPlaceholder(0xFFFFFFFF);
+	std::shared_ptr<Texture> flatNormalTexture = textureCache.GetPlaceholder(0xFFFF8080);
+	std::shared_ptr<Texture> skyTexture = textureCache.GetPlaceholder(0xFF808080, true);
+	textures.push_back(whiteTexture);
+	textures.push_back(flatNormalTexture);
+	textures.push_back(skyTexture);
+
+	AssetHandle<Texture> textureHandles[5];
+	for (size_t i = 0; i < 5; i++)
+		textureHandles[i] = AssetHandle<Texture>(assetImporter.LoadTexture(texturePath[i], textureUsage[i]), i == 4 ? flatNormalTexture : whiteTexture);
 	//加载立方体贴图
-	Texture cubeMap;
-	LoadCubeMapWithWIC(L"Assets\\sky.png", GUID_WICPixelFormat32bppRGBA, cubeMap, &vkInfo.device, vkInfo.gpu.getMemoryProperties());
-	cubeMap.SetupImage(&vkInfo.device, vkInfo.gpu.getMemoryProperties(), vkInfo.cmdPool, &vkInfo.queue);
-	cubeMap.CleanUploader(&vkInfo.device);
+	AssetHandle<Texture> cubeMap(assetImporter.LoadCubeMap("Assets\\sky.png"), skyTexture);
+
+	//关闭渐进加载时在这里等待全部导入完成，句柄直接得到真正的纹理
+	if (!progressiveLoading)
+		assetImporter.Wait();
 
-	//创建用于光照的材质
+	//创建用于光照的材质，纹理在加入场景之后绑定
 	Material brick_mat;
 	brick_mat.name = "floor";
-	brick_mat.diffuse = textures[0].get();
-	brick_mat.normal = textures[4].get();
 	brick_mat.shaderModel = ShaderModel::normalMap;
 	brick_mat.diffuseAlbedo = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
 	brick_mat.fresnelR0 = glm::vec3(0.3f, 0.3f, 0.3f);
@@ -350,7 +417,6 @@ void App::Start() {
 
 	Material sphere_mat;
 	sphere_mat.name = "sphere";
-	sphere_mat.diffuse = textures[0].get();
 	sphere_mat.diffuseAlbedo = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
 	sphere_mat.fresnelR0 = glm::vec3(0.9f, 0.9f, 0.9f);
 	sphere_mat.roughness = 0.3f;
@@ -359,6 +425,9 @@ void App::Start() {
 	//将材质添加进场景中
 	scene.AddMaterial(brick_mat);
 	scene.AddMaterial(sphere_mat);
+	scene.SetMaterialTexture(scene.GetMaterial("floor"), textureHandles[0]);
+	scene.SetMaterialTexture(scene.GetMaterial("floor"), textureHandles[4], true);
+	scene.SetMaterialTexture(scene.GetMaterial("sphere"), textureHandles[0]);
 
 	//利用GameObject类创建场景中的物件
 	GameObject plane_obj;
@@ -384,49 +453,74 @@ void App::Start() {
 	GeometryGenerator::MeshData sphere_mesh = geoGen.CreateGeosphere(0.5f, 8);
 	scene.AddMeshRenderer(scene.GetGameObject("sphere"), sphere_mesh.vertices, sphere_mesh.indices);
 	
-	/*使用SkinnedModel类加载带有蒙皮动画的模型*/
-	Model model("Assets\\model.fbx");
+	/*模型导入完成后在SetupModel中创建子物件，之前父物件上显示预估范围的包围盒*/
+	Material placeholder_mat;
+	placeholder_mat.name = "placeholder";
+	placeholder_mat.diffuse = whiteTexture.get();
+	placeholder_mat.diffuseAlbedo = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+	placeholder_mat.roughness = 1.0f;
+	scene.AddMaterial(placeholder_mat);
 
-	//使用图片的文件名称作为GameObject的名称
-	std::vector<std::string> meshNames;
-
-	std::vector<std::unique_ptr<Texture>> modelTextures;
-	for (size_t i = 0; i < model.texturePath.size(); i++) {
-		auto texture = std::make_unique<Texture>();
-		meshNames.push_back(model.texturePath[i].substr(model.texturePath[i].find_last_of('\\') + 1, model.texturePath[i].length() - 1));
-
-		//使用STB库加载模型下的所有贴图并为其创建材质
-		LoadPixelWithSTB(model.texturePath[i].c_str(), 32, *texture, &vkInfo.device, vkInfo.gpu.getMemoryProperties());
-		texture->SetupImage(&vkInfo.device, vkInfo.gpu.getMemoryProperties(), vkInfo.cmdPool, &vkInfo.queue);
-		texture->CleanUploader(&vkInfo.device);
-		modelTextures.push_back(std::move(texture));
-
-		Material material;
-		material.name = meshNames[i];
-		material.samplerType = SamplerType::border;
-		material.diffuse = modelTextures[i].get();
-		material.diffuseAlbedo = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-		material.fresnelR0 = glm::vec3(0.0f, 0.0f, 0.0f);
-		material.matTransform = glm::mat4(1.0f);
-		material.roughness = 0.8f;
-		scene.AddMaterial(material);
-	}
-
-	//创建一个GameObject作为模型的父物件
 	GameObject modelObject;
 	modelObject.name = "marisaModel";
+	modelObject.material = scene.GetMaterial("placeholder");
 	modelObject.transform.position = glm::vec3(-2.0f, -1.0f, 5.0f);
 	modelObject.transform.scale = glm::vec3(0.1f, 0.1f, 0.1f);
 	modelObject.transform.localEulerAngle = glm::vec3(-glm::pi<float>() * 0.5f, 0.0f, 90.0f);
 	scene.AddGameObject(modelObject, 0);
 
-	//加载模型的所有的Mesh并添加到modelObject下
-	for (size_t i = 0; i < model.renderInfo.size(); i++) {
-		GameObject childObject;
-		childObject.name = meshNames[i];
-		childObject.material = scene.GetMaterial(meshNames[i]);
-		scene.AddGameObject(childObject, scene.GetGameObject("marisaModel"));
-		scene.AddMeshRenderer(scene.GetGameObject(meshNames[i]), model.renderInfo[i].vertices, model.renderInfo[i].indices);
+	if (progressiveLoading) {
+		pendingModel = modelFuture;
+
+		//模型空间中Z轴向上，站立在原点
+		GeometryGenerator::MeshData boundsMesh = geoGen.CreateBox(8.0f, 4.0f, 16.0f);
+		for (auto& vertex : boundsMesh.vertices)
+			vertex.position.z += 8.0f;
+		scene.AddMeshRenderer(scene.GetGameObject("marisaModel"), boundsMesh.vertices, boundsMesh.indices);
+	}
+	else if (std::shared_ptr<Model> model = modelFuture.get())
+		SetupModel(*model);
+
+	/*街区测试场景: 16x16的建筑网格，每个街区的建筑后面放4个小物件*/
+	if (cityBlockScene) {
+		Material building_mat;
+		building_mat.name = "building";
+		building_mat.diffuse = whiteTexture.get();
+		building_mat.diffuseAlbedo = glm::vec4(0.6f, 0.6f, 0.65f, 1.0f);
+		building_mat.roughness = 0.8f;
+		scene.AddMaterial(building_mat);
+
+		const int blockCount = 16;
+		const float blockSize = 12.0f;
+		const float origin = -blockSize * blockCount * 0.5f;
+		GeometryGenerator::MeshData buildingMesh = geoGen.CreateBox(8.0f, 1.0f, 8.0f);
+		GeometryGenerator::MeshData propMesh = geoGen.CreateBox(0.6f, 0.6f, 0.6f);
+		for (int x = 0; x < blockCount; x++) {
+			for (int z = 0; z < blockCount; z++) {
+				float centerX = origin + (x + 0.5f) * blockSize;
+				float centerZ = origin + (z + 0.5f) * blockSize;
+
+				//高度在10到30之间变化，盒子以中心为原点
+				GameObject building;
+				building.name = "building_" + std::to_string(x) + "_" + std::to_string(z);
+				building.material = scene.GetMaterial("building");
+				float height = 10.0f + static_cast<float>((x * 7 + z * 13) % 5) * 5.0f;
+				building.transform.position = glm::vec3(centerX, height * 0.5f - 1.0f, centerZ);
+				building.transform.scale = glm::vec3(1.0f, height, 1.0f);
+				scene.AddGameObject(building, 0);
+				scene.AddMeshRenderer(scene.GetGameObject(building.name), buildingMesh.vertices, buildingMesh.indices);
+				scene.SetOccluder(scene.GetGameObject(building.name));
+
+				for (int i = 0; i < 4; i++) {
+					GameObject prop;
+					prop.name = "prop_" + std::to_string(x) + "_" + std::to_string(z) + "_" + std::to_string(i);
+					prop.material = scene.GetMaterial("sphere");
+					prop.transform.position = glm::vec3(centerX + ((i & 1) ? 5.0f : -5.0f), -0.7f, centerZ + ((i & 2) ? 5.0f : -5.0f));
+					scene.AddGameObject(prop, 0);
+					scene.AddMeshRenderer(scene.GetGameObject(prop.name), propMesh.vertices, propMesh.indices);
+				}
+			}
+		}
 	}
 
 	/*初始化阴影贴图*/
@@ -439,12 +533,12 @@ void App::Start() {
 	//创建粒子的材质(粒子不参与光照所以不需要指定光照参数)
 	/*Material flame_mat;
 	flame_mat.name = "flame";
-	flame_mat.diffuse = textures[2].get();
+	flame_mat.diffuse = textureHandles[2].Get().get();
 	scene.AddMaterial(flame_mat);
 
 	Material smoke_mat;
 	smoke_mat.name = "smoke";
-	smoke_mat.diffuse = textures[3].get();
+	smoke_mat.diffuse = textureHandles[3].Get().get();
 	scene.AddMaterial(smoke_mat);
 
 	//创建两个GameObject分别代表粒子和子粒子
@@ -491,6 +585,10 @@ void App::Start() {
 	subParticle.used = true;*/
 	//scene.AddParticleSystem(scene.GetGameObject("flame"), scene.GetGameObject("smoke"), property, emitter, particleTexture, subParticle);
 
+	//间接命令的firstInstance用来索引物体常量，每个桶要提交多条命令
+	scene.gpuDrivenRendering = gpuDrivenRendering && vkInfo.multiDrawIndirect && vkInfo.drawIndirectFirstInstance;
+	//渲染通道与深度附件的创建取决于是否遮挡剔除
+	scene.occlusionCulling = occlusionCulling;
 	scene.SetupRenderEngine();
 
 	//设定后处理
@@ -500,12 +598,166 @@ void App::Start() {
 
 	//设定GUI
 	engineEditor = new Editor(&scene);
+	engineEditor->SetAssetImporter(&assetImporter);
 	scene.PrepareImGUI();
 
-	scene.SetupVertexBuffer();
-	scene.SetupDescriptors();
-	scene.PreparePipeline();
+	scene.compactVertices = compactVertices;
+	scene.softwareOcclusionCulling = softwareOcclusionCulling;
+	scene.automaticInstancing = automaticInstancing;
+	scene.SetupVertexBuffer(uploadBatcher);
+	scene.SetupDescriptors(uploadBatcher);
+
+	//先提交已记录的上传，GPU拷贝与管线编译重叠进行
+	uploadBatcher.Flush();
+
+	auto pipelineStartTime = std::chrono::high_resolution_clock::now();
+	//渐进加载时首帧也不等待管线编译
+	scene.PreparePipeline(asyncPipelineCompile || progressiveLoading);
+	auto pipelineEndTime = std::chrono::high_resolution_clock::now();
+
+	//不等待上传完成，同一队列上的首帧在拷贝之后执行；导入线程还没写完的预留转入之后的批次，不阻塞首帧
+	uploadBatcher.Flush();
+	auto endTime = std::chrono::high_resolution_clock::now();
+
 	scene.PrepareShaderModel();
+
+	startupTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	pipelineBuildTime = std::chrono::duration<float, std::milli>(pipelineEndTime - pipelineStartTime).count();
+
+	char startupInfo[128];
+	sprintf_s(startupInfo, "Startup: %.2f ms, pipelines: %.2f ms (%s pipeline cache)\n", startupTime, pipelineBuildTime, pipelineCacheWarm ? "warm" : "cold");
+	OutputDebugStringA(startupInfo);
+}
+
+void App::SetupModel(Model& model) {
+	modelOptimizeStats = model.optimizeStats;
+	std::copy(std::begin(model.lodTriangles), std::end(model.lodTriangles), modelLodTriangles);
+
+	//导入完成的模型替换掉父物件上的占位包围盒
+	scene.RemoveMeshRenderer(scene.GetGameObject("marisaModel"));
+	std::shared_ptr<Texture> whiteTexture = textureCache.GetPlaceholder(0xFFFFFFFF);
+
+	//使用图片的文件名称作为GameObject的名称
+	std::vector<std::string> meshNames;
+
+	//UV超出[0, 1]的贴图依赖边界采样，不能放进图集
+	std::vector<bool> packable(model.texturePath.size(), useTextureAtlas);
+	for (size_t i = 0; i < model.renderInfo.size(); i++) {
+		for (auto& vertex : model.renderInfo[i].vertices) {
+			if (vertex.texCoord.x < -0.001f || vertex.texCoord.x > 1.001f || vertex.texCoord.y < -0.001f || vertex.texCoord.y > 1.001f) {
+				packable[model.materials[i].diffuseMaps] = false;
+				break;
+			}
+		}
+	}
+
+	//小贴图打包进共享的图集
+	std::vector<std::string> atlasPaths;
+	std::vector<int32_t> atlasIndices(model.texturePath.size(), -1);
+	for (size_t i = 0; i < model.texturePath.size(); i++) {
+		if (packable[i]) {
+			atlasIndices[i] = static_cast<int32_t>(atlasPaths.size());
+			atlasPaths.push_back(model.texturePath[i]);
+		}
+	}
+	//未打包的贴图在导入线程中加载，同时在这里打包图集(只含小贴图)
+	std::vector<AssetHandle<Texture>> modelTextures(model.texturePath.size());
+	for (size_t i = 0; i < model.texturePath.size(); i++) {
+		if (!packable[i])
+			modelTextures[i] = AssetHandle<Texture>(assetImporter.LoadTexture(model.texturePath[i], TextureUsage::color), whiteTexture);
+	}
+	std::vector<TextureAtlasRegion> atlasRegions;
+	std::vector<std::shared_ptr<Texture>> atlasPages;
+	if (!atlasPaths.empty())
+		atlasPages = textureCache.LoadAtlas(atlasPaths, TextureAtlasOptions(), atlasRegions);
+	textures.insert(textures.end(), atlasPages.begin(), atlasPages.end());
+
+	auto GetAtlasRegion = [&](size_t textureIndex) {
+		return atlasIndices[textureIndex] < 0 ? TextureAtlasRegion() : atlasRegions[atlasIndices[textureIndex]];
+	};
+
+	auto AddModelMaterial = [&](const std::string& name, Texture* texture) {
+		Material material;
+		material.name = name;
+		material.samplerType = SamplerType::border;
+		material.diffuse = texture;
+		material.diffuseAlbedo = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+		material.fresnelR0 = glm::vec3(0.0f, 0.0f, 0.0f);
+		material.matTransform = glm::mat4(1.0f);
+		material.roughness = 0.8f;
+		scene.AddMaterial(material);
+		return scene.GetMaterial(name);
+	};
+
+	for (size_t i = 0; i < model.texturePath.size(); i++) {
+		meshNames.push_back(model.texturePath[i].substr(model.texturePath[i].find_last_of('\\') + 1, model.texturePath[i].length() - 1));
+
+		//未打包的贴图单独加载并创建材质
+		if (GetAtlasRegion(i).page < 0) {
+			//图集打包失败的贴图也退回单独加载
+			if (!modelTextures[i].IsValid())
+				modelTextures[i] = AssetHandle<Texture>(assetImporter.LoadTexture(model.texturePath[i], TextureUsage::color), whiteTexture);
+			scene.SetMaterialTexture(AddModelMaterial(meshNames[i], whiteTexture.get()), modelTextures[i]);
+		}
+	}
+	for (size_t i = 0; i < atlasPages.size(); i++)
+		AddModelMaterial("marisaModel_atlas" + std::to_string(i), atlasPages[i].get());
+
+	//加载模型的所有的Mesh并添加到modelObject下，共用同一张图集的Mesh改写UV后合并为一次绘制
+	//各部分的LOD按级别合并，合并后的第i级绘制每个部分的第i级
+	std::vector<Mesh::RenderInfo> atlasMeshes(atlasPages.size());
+	std::vector<std::vector<MeshLodPart>> atlasParts(atlasPages.size());
+	for (size_t i = 0; i < model.renderInfo.size(); i++) {
+		UINT textureIndex = model.materials[i].diffuseMaps;
+		TextureAtlasRegion region = GetAtlasRegion(textureIndex);
+		if (region.page >= 0) {
+			Mesh::RenderInfo& atlasMesh = atlasMeshes[region.page];
+			UINT indexOffset = static_cast<UINT>(atlasMesh.vertices.size());
+			for (auto vertex : model.renderInfo[i].vertices) {
+				vertex.texCoord = region.Remap(vertex.texCoord);
+				atlasMesh.vertices.push_back(vertex);
+			}
+			atlasParts[region.page].push_back({ &model.renderInfo[i].indices, &model.renderInfo[i].lods, indexOffset });
+			continue;
+		}
+
+		GameObject childObject;
+		childObject.name = meshNames[textureIndex];
+		childObject.material = scene.GetMaterial(meshNames[textureIndex]);
+		scene.AddGameObject(childObject, scene.GetGameObject("marisaModel"));
+		scene.AddMeshRenderer(scene.GetGameObject(meshNames[textureIndex]), model.renderInfo[i]);
+	}
+	for (size_t i = 0; i < atlasMeshes.size(); i++) {
+		if (atlasParts[i].empty())
+			continue;
+		MergeMeshLods(atlasParts[i], atlasMeshes[i].indices, atlasMeshes[i].lods);
+		BuildMeshlets(atlasMeshes[i].vertices, atlasMeshes[i].indices, atlasMeshes[i].lods, atlasMeshes[i].meshlets);
+		ComputeMeshBounds(atlasMeshes[i].vertices, atlasMeshes[i].boundsCenter, atlasMeshes[i].boundsRadius);
+
+		GameObject childObject;
+		childObject.name = "marisaModel_atlas" + std::to_string(i);
+		childObject.material = scene.GetMaterial(childObject.name);
+		scene.AddGameObject(childObject, scene.GetGameObject("marisaModel"));
+		scene.AddMeshRenderer(scene.GetGameObject(childObject.name), atlasMeshes[i]);
+	}
+}
+
+void App::Shutdown() {
+	//导入线程可能还在提交上传批次
+	assetImporter.Destroy();
+	vkInfo.device.waitIdle();
+
+	if (!SavePipelineCache(vkInfo.device, vkInfo.gpu, vkInfo.pipelineCache, pipelineCachePath)) {
+		OutputDebugStringA("Save pipeline cache failed\n");
+	}
+	vkInfo.device.destroyPipelineCache(vkInfo.pipelineCache);
+
+	textures.clear();
+	textureCache.Destroy();
+	textureStreamer.Destroy();
+	uploadBatcher.Destroy();
+
+	shaderLibrary.Destroy();
 }
 
 void App::OnGUI() {
@@ -513,12 +765,26 @@ void App::OnGUI() {
 
 	engineEditor->Update();
 
-	ImGui::SetNextWindowSize(ImVec2(400, 100), 0);
+	ImGui::SetNextWindowSize(ImVec2(400, 220), 0);
 	ImGui::Begin("Modify attribute");
 
 	//ImGui::SliderFloat("delta time", &deltaTime, 0.001f, 0.05f);
 	ImGui::SliderFloat("HDR", &hdrExposure, 0.0f, 5.0f);
 	ImGui::SliderFloat("Gamma", &gamma, 0.0f, 5.0f);
+	ImGui::Text("Startup %.1f ms, pipelines %.1f ms (%s cache)", startupTime, pipelineBuildTime, pipelineCacheWarm ? "warm" : "cold");
+	MemoryAllocator::Statistics memoryStats = memoryAllocator.GetStatistics();
+	ImGui::Text("GPU memory %.1f/%.1f MB, %u blocks, %u allocations", memoryStats.usedBytes / 1048576.0f, memoryStats.reservedBytes / 1048576.0f, memoryStats.blockCount + memoryStats.dedicatedCount, memoryStats.allocationCount);
+	ImGui::Text("Streamed textures %.1f/%.1f MB", textureStreamer.GetResidentBytes() / 1048576.0f, textureStreamer.GetBudget() / 1048576.0f);
+	ImGui::Text("Unique meshes %u, shared geometry saved %.2f MB", scene.GetUniqueMeshCount(), scene.GetSharedMeshBytes() / 1048576.0f);
+	if (scene.softwareOcclusionCulling)
+		ImGui::Text("Software occlusion %.2f ms, culled %u/%u meshes", scene.GetOcclusionRasterTime(), scene.GetOccludedMeshCount(), scene.GetOcclusionTestedCount());
+	if (scene.automaticInstancing)
+		ImGui::Text("Instance batches %u", scene.GetInstanceBatchCount());
+	//从烘焙文件读取的模型没有导入时的统计
+	if (modelOptimizeStats.triangleCount > 0) {
+		ImGui::Text("Model vertices %u -> %u, ACMR %.3f -> %.3f", modelOptimizeStats.vertexCountBefore, modelOptimizeStats.vertexCountAfter, modelOptimizeStats.acmrBefore, modelOptimizeStats.acmrAfter);
+		ImGui::Text("Model LOD triangles %u / %u / %u / %u", modelLodTriangles[0], modelLodTriangles[1], modelLodTriangles[2], modelLodTriangles[3]);
+	}
 
 	ImGui::End();
 
@@ -533,6 +799,10 @@ void App::Loop() {
 	Update();
 	OnGUI();
 
+	//异步编译完成的管线需要重新录制命令
+	if (scene.UpdatePipelines())
+		recordCommand = true;
+
 	scene.UpdateObjectConstants();
 	scene.UpdatePassConstants();
 	scene.UpdateMaterialConstants();
@@ -540,6 +810,35 @@ void App::Loop() {
 	scene.UpdateImGUI(deltaTime);
 	scene.UpdateCPUParticleSystem(deltaTime);
 
+	//渐进加载: 上一帧已经结束，把导入完成的资源换进场景，不等待仍在导入的资源
+	if (pendingModel.valid() && pendingModel.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		if (std::shared_ptr<Model> model = pendingModel.get())
+			SetupModel(*model);
+		pendingModel = std::shared_future<std::shared_ptr<Model>>();
+	}
+	if (scene.SetupLoadedObjects(uploadBatcher)) {
+		//新的顶点缓冲在本帧绘制前必须提交，Flush不等待还在解码纹理的导入线程
+		uploadBatcher.Flush();
+		recordCommand = true;
+	}
+	if (scene.ResolveLoadedTextures(uploadBatcher))
+		recordCommand = true;
+
+	//LOD只改变绘制的索引范围，换了级别时重新录制命令即可
+	if (scene.SelectLods())
+		recordCommand = true;
+	//剔除结果写入间接绘制缓冲，不需要重新录制命令
+	scene.CullOcclusion();
+	scene.CullMeshlets();
+
+	//上一帧已经结束，换图像的拷贝随上传批次提交，描述符改写后重新录制命令，不需要等待GPU空闲
+	scene.RequestTextureMips(textureStreamer);
+	if (textureStreamer.Update()) {
+		uploadBatcher.Flush();
+		scene.RefreshMaterialTextures();
+		recordCommand = true;
+	}
+
 	//Wait for swap chain
 	uint32_t currentBuffer;
 	if (vkInfo.device.acquireNextImageKHR(vkInfo.swapchain, UINT64_MAX, vkInfo.imageAcquiredSemaphore, vk::Fence(), &currentBuffer) != vk::Result::eSuccess) {
@@ -550,6 +849,7 @@ void App::Loop() {
 		auto cmdBeginInfo = vk::CommandBufferBeginInfo()
 			.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
 
+		scene.BuildDrawQueue();
 		for (uint32_t i = 0; i < vkInfo.frameCount; i++) {
 			vkInfo.cmd[i].begin(&cmdBeginInfo);
 			scene.DrawObject(vkInfo.cmd[i], i);
@@ -572,7 +872,11 @@ void App::Loop() {
 		.setWaitSemaphoreCount(1)
 		.setPWaitSemaphores(&vkInfo.imageAcquiredSemaphore)
 		.setPWaitDstStageMask(dstStageMask);
-	vkInfo.queue.submit(1, &submitInfo, vkInfo.fence);
+	{
+		//导入线程也会向同一队列提交上传批次
+		auto queueLock = uploadBatcher.LockQueue();
+		vkInfo.queue.submit(1, &submitInfo, vkInfo.fence);
+	}
 
 	//Wait for GPU to be finished
 	vk::Result waitingRes;
@@ -580,12 +884,17 @@ void App::Loop() {
 		waitingRes = vkInfo.device.waitForFences(1, &vkInfo.fence, VK_TRUE, UINT64_MAX);
 	while (waitingRes == vk::Result::eTimeout);
 
+	//帧结束后GPU空闲，释放引用计数归零的纹理
+	textureCache.Collect();
+	textureStreamer.Collect();
+
 	//Present
 	auto presentInfo = vk::PresentInfoKHR()
 		.setPImageIndices(&currentBuffer)
 		.setSwapchainCount(1)
 		.setPSwapchains(&vkInfo.swapchain);
 
+	auto queueLock = uploadBatcher.LockQueue();
 	if (vkInfo.queue.presentKHR(&presentInfo) != vk::Result::eSuccess) {
 		MessageBox(0, L"Present the render target failed!!!", 0, 0);
 	}
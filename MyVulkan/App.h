@@ -1,6 +1,10 @@
 #pragma once
 #include "core/camera.h"
 #include "core/Editor.h"
+#include "Util/ShaderLibrary.h"
+#include "Util/UploadBatcher.h"
+#include "core/Resource/TextureCache.h"
+#include "core/Resource/AssetImporter.h"
 
 class App
 {
@@ -8,22 +12,77 @@ public:
 	void Initialize(uint32_t windowWidth, uint32_t windowHeight, HWND hWnd, HINSTANCE hInstance);
 	void Start();
 	void Loop();
+	void Shutdown();
 
 private:
 	void Update();
 	void OnGUI();
+	void SetupModel(Model& model);
 
 	Vulkan vkInfo;
+	//需要比场景中的资源后析构
+	MemoryAllocator memoryAllocator;
+	ShaderLibrary shaderLibrary;
+	UploadBatcher uploadBatcher;
+	TextureCache textureCache;
+	TextureStreamer textureStreamer;
+	AssetImporter assetImporter;
 	Scene scene;
 	Editor* engineEditor;
 
 	bool recordCommand = true;
 
+	//为true时管线在后台线程编译，首帧不等待
+	bool asyncPipelineCompile = false;
+
+	//法线贴图使用BC5时需要着色器由XY重建Z，重新编译fragment与deferredShadingOutput着色器之后再开启
+	bool compressNormalMaps = false;
+
+	//顶点量化为约一半大小的压缩格式，需要先编译*Compact.hlsl对应的着色器
+	bool compactVertices = false;
+
+	//静态网格由计算着色器剔除后间接绘制，需要先编译cullDraws与*Indirect着色器
+	bool gpuDrivenRendering = false;
+
+	//GPU剔除之外再用层级深度做两段式遮挡剔除，需要先编译cullDrawsOcclusion与buildHiZ着色器
+	bool occlusionCulling = false;
+
+	//不使用GPU剔除时在CPU上光栅化遮挡物做遮挡剔除
+	bool softwareOcclusionCulling = false;
+	//加入街区状的测试场景: 建筑作为遮挡物，街道与建筑之间放置小物件，配合softwareOcclusionCulling比较光栅化耗时与剔除率
+	bool cityBlockScene = false;
+
+	//不使用GPU剔除时把几何与材质相同的网格合并为实例化绘制，需要先编译*Indirect着色器
+	bool automaticInstancing = false;
+
+	//把模型的小贴图打包进图集，共用图集的子网格合并绘制
+	bool useTextureAtlas = true;
+
+	//块压缩纹理先只加载低级mip，按屏幕上的大小在显存预算内提升
+	bool streamTextures = true;
+	uint64_t textureBudget = 256ull * 1024 * 1024;
+
+	//启动时只创建场景结构与占位资源，首帧不等待任何导入，资源完成后在之后的帧中换入
+	bool progressiveLoading = true;
+	//导入完成后再创建模型的子物件
+	std::shared_future<std::shared_ptr<Model>> pendingModel;
+	//最近一次导入的模型的优化统计，显示在GUI中
+	MeshOptimizeStats modelOptimizeStats;
+	uint32_t modelLodTriangles[4] = {};
+
+	//场景使用的纹理句柄，持有期间缓存不会释放它们
+	std::vector<std::shared_ptr<Texture>> textures;
+
 	//Global variable
 	Camera mainCamera;
 	float deltaTime = 0.05f;
 
 	float hdrExposure = 1.0f;
 	float gamma = 2.2f;
+
+	//启动耗时统计(毫秒)，用于比较管线缓存冷/热启动
+	bool pipelineCacheWarm = false;
+	float startupTime = 0.0f;
+	float pipelineBuildTime = 0.0f;
 };
 
@@ -0,0 +1,35 @@
+//One level of the farthest depth pyramid used by occlusion culling, compiled to buildHiZ.spv
+//The source is the depth target for level 0 and the previous level otherwise
+
+[vk::binding(0, 0)]
+Texture2D<float> source;
+
+[vk::binding(1, 0)]
+RWTexture2D<float> destination;
+
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	uint2 destinationSize;
+	destination.GetDimensions(destinationSize.x, destinationSize.y);
+	if (any(id.xy >= destinationSize))
+		return;
+
+	uint2 sourceSize;
+	source.GetDimensions(sourceSize.x, sourceSize.y);
+
+	//Levels are halved rounding down, the last texel of a row or column also covers the odd texel left over
+	uint2 first = id.xy * 2;
+	uint2 last = first + 1;
+	if (id.x == destinationSize.x - 1 && (sourceSize.x & 1) != 0)
+		last.x++;
+	if (id.y == destinationSize.y - 1 && (sourceSize.y & 1) != 0)
+		last.y++;
+	last = min(last, sourceSize - 1);
+
+	float depth = 0.0f;
+	for (uint y = first.y; y <= last.y; y++) {
+		for (uint x = first.x; x <= last.x; x++)
+			depth = max(depth, source.Load(int3(x, y, 0)));
+	}
+	destination[id.xy] = depth;
+}
@@ -0,0 +1,177 @@
+//Frustum culling of static mesh draws, compiled to cullDraws.spv
+//Every visible draw appends a command to its bucket for the main camera and another one for the shadow map
+//OCCLUSION_CULLING adds the two phase Hi-Z test of the main camera view (CullDrawsOcclusion.hlsl)
+
+struct ObjectData {
+	float4x4 worldMatrix;
+	float4x4 worldMatrix_trans_inv;
+	float4 positionScale;
+	float4 positionBias;
+};
+
+struct DrawInfo {
+	uint objectIndex;
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	//Bounding sphere in model space
+	float4 bounds;
+	//0xffffffff when the draw is not part of the view
+	uint bucket;
+	uint shadowBucket;
+	uint2 padding;
+};
+
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+[vk::binding(0, 0)]
+StructuredBuffer<ObjectData> objects;
+
+[vk::binding(1, 0)]
+StructuredBuffer<DrawInfo> draws;
+
+//First command of every bucket, shadow buckets follow the main ones
+[vk::binding(2, 0)]
+StructuredBuffer<uint> bucketOffsets;
+
+[vk::binding(3, 0)]
+RWStructuredBuffer<DrawCommand> commands;
+
+[vk::binding(4, 0)]
+RWStructuredBuffer<uint> counts;
+
+[vk::binding(5, 0)]
+cbuffer CullConstants {
+	//Main camera planes followed by the shadow map planes, positive inside
+	float4 planes[12];
+	uint drawCount;
+	uint mainBucketCount;
+	uint shadowBucketCount;
+	uint padding;
+	float4x4 viewProj;
+	//View the pyramid was built with, the previous frame's
+	float4x4 hiZViewProj;
+	float2 depthSize;
+	uint hiZLevels;
+	uint hiZValid;
+};
+
+#ifdef OCCLUSION_CULLING
+//Farthest depth pyramid, level 0 is half the depth target resolution
+[vk::binding(6, 0)]
+Texture2D<float> hiZ;
+
+//Draws the first phase found occluded, the second phase tests them again
+[vk::binding(7, 0)]
+RWStructuredBuffer<uint> occluded;
+
+//0: test against last frame's pyramid, 1: test the occluded draws against the pyramid of this frame's first phase
+[vk::constant_id(0)] const uint cullPhase = 0;
+
+bool IsOccluded(float3 center, float radius, float4x4 occluderViewProj) {
+	//Screen rectangle and nearest depth of the sphere's bounding box
+	float2 minUV = float2(1.0f, 1.0f);
+	float2 maxUV = float2(0.0f, 0.0f);
+	float nearestDepth = 1.0f;
+	for (uint i = 0; i < 8; i++) {
+		float3 corner = center + radius * float3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		float4 clip = mul(occluderViewProj, float4(corner, 1.0f));
+		//Crossing the near plane, the projection is not bounded
+		if (clip.w <= 0.0f || clip.z < 0.0f)
+			return false;
+
+		float3 ndc = clip.xyz / clip.w;
+		float2 uv = ndc.xy * 0.5f + 0.5f;
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+
+	//Pick the level where the rectangle covers at most 2x2 texels
+	float2 pixelMin = saturate(minUV) * depthSize;
+	float2 pixelMax = min(saturate(maxUV) * depthSize, depthSize - 1.0f);
+	float2 extent = (pixelMax - pixelMin) * 0.5f;
+	uint level = min((uint)ceil(log2(max(max(extent.x, extent.y), 1.0f))), hiZLevels - 1);
+
+	uint width, height, levelCount;
+	hiZ.GetDimensions(level, width, height, levelCount);
+	uint2 size = uint2(width, height);
+	//The last texel of a level also covers the pixels left over by odd sizes
+	uint2 first = min(uint2(pixelMin) >> (level + 1), size - 1);
+	uint2 last = min(uint2(pixelMax) >> (level + 1), size - 1);
+
+	float farthestDepth = 0.0f;
+	for (uint y = first.y; y <= last.y; y++) {
+		for (uint x = first.x; x <= last.x; x++)
+			farthestDepth = max(farthestDepth, hiZ.Load(int3(x, y, level)));
+	}
+
+	//One step of the 16-bit depth buffer, an object touching its occluder stays visible
+	return nearestDepth > farthestDepth + 1.0f / 65535.0f;
+}
+#endif
+
+bool IsVisible(uint view, float3 center, float radius) {
+	for (uint i = 0; i < 6; i++) {
+		float4 plane = planes[view * 6 + i];
+		if (dot(plane.xyz, center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+void AppendCommand(uint bucket, DrawInfo draw) {
+	uint slot;
+	InterlockedAdd(counts[bucket], 1, slot);
+
+	DrawCommand command;
+	command.indexCount = draw.indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = draw.firstIndex;
+	command.vertexOffset = draw.vertexOffset;
+	//The vertex shader finds the object constants through SV_InstanceID
+	command.firstInstance = draw.objectIndex;
+	commands[bucketOffsets[bucket] + slot] = command;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	if (id.x >= drawCount)
+		return;
+
+	DrawInfo draw = draws[id.x];
+	float4x4 world = objects[draw.objectIndex].worldMatrix;
+	float3 center = mul(world, float4(draw.bounds.xyz, 1.0f)).xyz;
+	float scale = max(length(mul(world, float4(1.0f, 0.0f, 0.0f, 0.0f)).xyz),
+		max(length(mul(world, float4(0.0f, 1.0f, 0.0f, 0.0f)).xyz), length(mul(world, float4(0.0f, 0.0f, 1.0f, 0.0f)).xyz)));
+	float radius = draw.bounds.w * scale;
+
+	bool mainVisible = draw.bucket != 0xffffffff && IsVisible(0, center, radius);
+
+#ifdef OCCLUSION_CULLING
+	//Late buckets follow the shadow buckets
+	if (cullPhase == 1) {
+		if (mainVisible && occluded[id.x] != 0 && !IsOccluded(center, radius, viewProj))
+			AppendCommand(mainBucketCount + shadowBucketCount + draw.bucket, draw);
+		return;
+	}
+
+	uint wasOccluded = 0;
+	if (mainVisible && hiZValid != 0 && IsOccluded(center, radius, hiZViewProj)) {
+		wasOccluded = 1;
+		mainVisible = false;
+	}
+	occluded[id.x] = wasOccluded;
+#endif
+
+	if (mainVisible)
+		AppendCommand(draw.bucket, draw);
+	if (draw.shadowBucket != 0xffffffff && IsVisible(1, center, radius))
+		AppendCommand(mainBucketCount + draw.shadowBucket, draw);
+}
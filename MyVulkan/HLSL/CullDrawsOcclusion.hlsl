@@ -0,0 +1,3 @@
+//Compiled to cullDrawsOcclusion.spv
+#define OCCLUSION_CULLING
+#include "CullDraws.hlsl"
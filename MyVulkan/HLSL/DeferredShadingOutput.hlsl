@@ -29,6 +29,8 @@ Texture2D normalMap;
 float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float3 tangentW) {
 	//ӳ䷨[0,1][-1,1]
 	float3 normalT = 2.0f * normalMapSample - 1.0f;
+	//XYؽZBC5ѹķͼֻ洢ͨ
+	normalT.z = sqrt(saturate(1.0f - dot(normalT.xy, normalT.xy)));
 
 	//TBN
 	float3 N = unitNormalW;
@@ -0,0 +1,36 @@
+//Per-object constants shared by the static mesh vertex shaders
+//INDIRECT_DRAW: GPU-driven draws read them from a storage buffer with the firstInstance the culling pass writes,
+//SV_InstanceID includes firstInstance as long as -fvk-support-nonzero-base-instance is not used
+
+struct ObjectData {
+	float4x4 worldMatrix;
+	float4x4 worldMatrix_trans_inv;
+	float4 positionScale;
+	float4 positionBias;
+};
+
+#ifdef INDIRECT_DRAW
+[vk::binding(0, 5)]
+StructuredBuffer<ObjectData> objects;
+
+ObjectData GetObjectData(uint instanceID) {
+	return objects[instanceID];
+}
+#else
+[vk::binding(0, 0)]
+cbuffer ObjectConstants {
+	float4x4 worldMatrix;
+	float4x4 worldMatrix_trans_inv;
+	float4 positionScale;
+	float4 positionBias;
+};
+
+ObjectData GetObjectData(uint instanceID) {
+	ObjectData data;
+	data.worldMatrix = worldMatrix;
+	data.worldMatrix_trans_inv = worldMatrix_trans_inv;
+	data.positionScale = positionScale;
+	data.positionBias = positionBias;
+	return data;
+}
+#endif
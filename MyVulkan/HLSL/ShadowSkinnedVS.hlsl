@@ -1,22 +1,17 @@
 #include "Common.hlsl"
+#define SKINNED_VERTEX
+#include "VertexInput.hlsl"
 
 struct VertexOut {
 	float4 position : SV_POSITION;
 };
 
-struct VertexIn {
-	float3 position;
-	float2 texCoord;
-	float3 normal;
-	float3 tangent;
-
-	float3 boneWeights;
-	uint4 boneIndices;
-};
-
 [vk::binding(0, 0)]
 cbuffer ObjectConstants {
 	float4x4 worldMatrix;
+	float4x4 worldMatrix_trans_inv;
+	float4 positionScale;
+	float4 positionBias;
 };
 
 [vk::binding(0, 4)]
@@ -27,6 +22,7 @@ cbuffer SkinnedConstants {
 VertexOut main(VertexIn input)
 {
 	VertexOut output;
+	VertexAttributes vertex = DecodeVertex(input, positionScale, positionBias);
 
 	float3 posL = float3(0.0f, 0.0f, 0.0f);    //Local Space
 
@@ -34,7 +30,7 @@ VertexOut main(VertexIn input)
 	float weights[4] = { input.boneWeights.x, input.boneWeights.y, input.boneWeights.z, 1.0f - input.boneWeights.x - input.boneWeights.y - input.boneWeights.z };
 
 	for (int i = 0; i < 4; i++) {
-		posL += weights[i] * mul(boneTransforms[input.boneIndices[i]], float4(input.position, 1.0f)).xyz;
+		posL += weights[i] * mul(boneTransforms[input.boneIndices[i]], float4(vertex.position, 1.0f)).xyz;
 	}
 
 	float4 transformPosition = mul(worldMatrix, float4(posL, 1.0f));
@@ -0,0 +1,3 @@
+//Compiled to shadowSkinnedVSCompact.spv
+#define COMPACT_VERTEX
+#include "ShadowSkinnedVS.hlsl"
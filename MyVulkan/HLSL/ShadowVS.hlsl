@@ -1,27 +1,18 @@
 #include "Common.hlsl"
-
-struct VertexIn {
-	float3 posH;
-	float2 texCoord;
-	float3 normal;
-	float3 tangent;
-};
+#include "VertexInput.hlsl"
+#include "ObjectInput.hlsl"
 
 struct VertexOut {
 	float4 position : SV_POSITION;
 };
 
-[vk::binding(0, 0)]
-cbuffer ObjectConstants {
-	float4x4 worldMatrix;
-	float4x4 worldMatrix_trans_inv;
-};
-
-VertexOut main(VertexIn input) {
+VertexOut main(VertexIn input, uint instanceID : SV_InstanceID) {
 	VertexOut output;
+	ObjectData object = GetObjectData(instanceID);
+	VertexAttributes vertex = DecodeVertex(input, object.positionScale, object.positionBias);
 
 	float4x4 viewProjMatrix = mul(projMatrix, viewMatrix);
-	output.position = mul(viewProjMatrix, mul(worldMatrix, float4(input.posH, 1.0f)));
+	output.position = mul(viewProjMatrix, mul(object.worldMatrix, float4(vertex.position, 1.0f)));
 
 	return output;
 }
\ No newline at end of file
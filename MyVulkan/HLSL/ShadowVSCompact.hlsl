@@ -0,0 +1,3 @@
+//Compiled to shadowVSCompact.spv
+#define COMPACT_VERTEX
+#include "ShadowVS.hlsl"
@@ -0,0 +1,4 @@
+//Compiled to shadowVSCompactIndirect.spv
+#define COMPACT_VERTEX
+#define INDIRECT_DRAW
+#include "ShadowVS.hlsl"
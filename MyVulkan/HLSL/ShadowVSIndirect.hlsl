@@ -0,0 +1,3 @@
+//Compiled to shadowVSIndirect.spv
+#define INDIRECT_DRAW
+#include "ShadowVS.hlsl"
@@ -1,4 +1,6 @@
 #include "Common.hlsl"
+#define SKINNED_VERTEX
+#include "VertexInput.hlsl"
 
 struct VertexOut {
 	float4 position : SV_POSITION;
@@ -9,20 +11,12 @@ struct VertexOut {
 	float4 shadowPos;
 };
 
-struct VertexIn {
-	float3 position;
-	float2 texCoord;
-	float3 normal;
-	float3 tangent;
-
-	float3 boneWeights;
-	uint4 boneIndices;
-};
-
 [vk::binding(0, 0)]
 cbuffer ObjectConstants {
 	float4x4 worldMatrix;
 	float4x4 worldMatrix_trans_inv;
+	float4 positionScale;
+	float4 positionBias;
 };
 
 [vk::binding(0, 4)]
@@ -34,6 +28,7 @@ cbuffer SkinnedConstants {
 VertexOut main(VertexIn input)
 {
 	VertexOut output;
+	VertexAttributes vertex = DecodeVertex(input, positionScale, positionBias);
 
 	float3 posL = float3(0.0f, 0.0f, 0.0f);    //Local Space
 	float3 normalL = float3(0.0f, 0.0f, 0.0f);
@@ -43,9 +38,9 @@ VertexOut main(VertexIn input)
 	float weights[4] = { input.boneWeights.x, input.boneWeights.y, input.boneWeights.z, 1.0f - input.boneWeights.x - input.boneWeights.y - input.boneWeights.z };
 
 	for (int i = 0; i < 4; i++) {
-		posL += weights[i] * mul(boneTransforms[input.boneIndices[i]], float4(input.position, 1.0f)).xyz;
-		normalL += weights[i] * mul((float3x3)boneTransforms_inv_trans[input.boneIndices[i]], input.normal);
-		normalL += weights[i] * mul((float3x3)boneTransforms[input.boneIndices[i]], input.normal);
+		posL += weights[i] * mul(boneTransforms[input.boneIndices[i]], float4(vertex.position, 1.0f)).xyz;
+		normalL += weights[i] * mul((float3x3)boneTransforms_inv_trans[input.boneIndices[i]], vertex.normal);
+		normalL += weights[i] * mul((float3x3)boneTransforms[input.boneIndices[i]], vertex.normal);
 	}
 
 	float4 transformPosition = mul(worldMatrix, float4(posL, 1.0f));
@@ -55,7 +50,7 @@ VertexOut main(VertexIn input)
 	output.position = mul(viewProjMatrix, transformPosition);
 	output.normal = mul((float3x3)worldMatrix_trans_inv, normalL);
 	output.tangent = mul((float3x3)worldMatrix, tangentL);
-	output.texCoord = input.texCoord;
+	output.texCoord = vertex.texCoord;
 	output.shadowPos = mul(shadowTransform, transformPosition);
 
 	return output;
@@ -0,0 +1,3 @@
+//Compiled to skinnedVSCompact.spv
+#define COMPACT_VERTEX
+#include "SkinnedVS.hlsl"
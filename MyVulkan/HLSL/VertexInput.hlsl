@@ -0,0 +1,52 @@
+//Vertex input shared by the mesh vertex shaders
+//COMPACT_VERTEX: position is UNORM16 inside the mesh's bounding box, normal and tangent are octahedral SNORM16, texCoord is half
+//SKINNED_VERTEX: bone weights and indices follow the static attributes
+
+struct VertexIn {
+#ifdef COMPACT_VERTEX
+	float4 position;
+	float2 texCoord;
+	float2 normal;
+	float2 tangent;
+#else
+	float3 position;
+	float2 texCoord;
+	float3 normal;
+	float3 tangent;
+#endif
+
+#ifdef SKINNED_VERTEX
+	float3 boneWeights;
+	uint4 boneIndices;
+#endif
+};
+
+struct VertexAttributes {
+	float3 position;
+	float2 texCoord;
+	float3 normal;
+	float3 tangent;
+};
+
+float3 DecodeOctahedral(float2 e) {
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+VertexAttributes DecodeVertex(VertexIn input, float4 positionScale, float4 positionBias) {
+	VertexAttributes attributes;
+#ifdef COMPACT_VERTEX
+	attributes.position = input.position.xyz * positionScale.xyz + positionBias.xyz;
+	attributes.normal = DecodeOctahedral(input.normal);
+	attributes.tangent = DecodeOctahedral(input.tangent);
+#else
+	attributes.position = input.position;
+	attributes.normal = input.normal;
+	attributes.tangent = input.tangent;
+#endif
+	attributes.texCoord = input.texCoord;
+	return attributes;
+}
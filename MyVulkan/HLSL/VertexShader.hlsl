@@ -1,11 +1,6 @@
 #include "Common.hlsl"
-
-struct VertexIn {
-	float3 posL;
-	float2 texCoord;
-	float3 normal;
-	float3 tangent;
-};
+#include "VertexInput.hlsl"
+#include "ObjectInput.hlsl"
 
 struct VertexOut {
 	float4 position : SV_POSITION;
@@ -16,24 +11,20 @@ struct VertexOut {
 	float4 shadowPos;
 };
 
-[vk::binding(0, 0)]
-cbuffer ObjectConstants {
-	float4x4 worldMatrix;
-	float4x4 worldMatrix_trans_inv;
-};
-
-VertexOut main(VertexIn input) {
+VertexOut main(VertexIn input, uint instanceID : SV_InstanceID) {
 	VertexOut output;
+	ObjectData object = GetObjectData(instanceID);
+	VertexAttributes vertex = DecodeVertex(input, object.positionScale, object.positionBias);
 
 	float4x4 viewProjMatrix = mul(projMatrix, viewMatrix);
 
-	output.posW = float3(mul(worldMatrix, float4(input.posL, 1.0f)));
+	output.posW = float3(mul(object.worldMatrix, float4(vertex.position, 1.0f)));
 	output.position = mul(viewProjMatrix, float4(output.posW, 1.0f));
-	output.normal = float3(mul(worldMatrix_trans_inv, float4(input.normal, 0.0f)));
-	output.tangent = float3(mul(worldMatrix, float4(input.tangent, 0.0f)));
+	output.normal = float3(mul(object.worldMatrix_trans_inv, float4(vertex.normal, 0.0f)));
+	output.tangent = float3(mul(object.worldMatrix, float4(vertex.tangent, 0.0f)));
 
 	output.shadowPos = mul(shadowTransform, float4(output.posW, 1.0f));
-	output.texCoord = input.texCoord;
+	output.texCoord = vertex.texCoord;
 
 	return output;
 }
\ No newline at end of file
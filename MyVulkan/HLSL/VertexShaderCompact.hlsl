@@ -0,0 +1,3 @@
+//Compiled to vertexCompact.spv
+#define COMPACT_VERTEX
+#include "VertexShader.hlsl"
@@ -0,0 +1,4 @@
+//Compiled to vertexCompactIndirect.spv
+#define COMPACT_VERTEX
+#define INDIRECT_DRAW
+#include "VertexShader.hlsl"
@@ -0,0 +1,3 @@
+//Compiled to vertexIndirect.spv
+#define INDIRECT_DRAW
+#include "VertexShader.hlsl"
@@ -0,0 +1,47 @@
+#include "DrawSort.h"
+
+#include <cmath>
+
+uint64_t MakeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+	auto field = [](uint64_t value, uint32_t bits) { return value & ((1ull << bits) - 1); };
+
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	uint64_t quantizedDepth = static_cast<uint64_t>(std::lround(depth * ((1 << drawKeyDepthBits) - 1)));
+
+	uint64_t key = field(pass, drawKeyPassBits);
+	key = (key << drawKeyPipelineBits) | field(pipeline, drawKeyPipelineBits);
+	key = (key << drawKeyMaterialBits) | field(material, drawKeyMaterialBits);
+	key = (key << drawKeyMeshBits) | field(mesh, drawKeyMeshBits);
+	key = (key << drawKeyDepthBits) | quantizedDepth;
+	return key;
+}
+
+void RadixSortDraws(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch) {
+	if (entries.size() < 2)
+		return;
+	scratch.resize(entries.size());
+
+	//一次统计全部8个字节的直方图
+	uint32_t histograms[8][256] = {};
+	for (auto& entry : entries) {
+		for (uint32_t byte = 0; byte < 8; byte++)
+			histograms[byte][(entry.key >> (byte * 8)) & 0xff]++;
+	}
+
+	for (uint32_t byte = 0; byte < 8; byte++) {
+		uint32_t* histogram = histograms[byte];
+		//所有键在这个字节上相同时顺序不变
+		if (histogram[(entries[0].key >> (byte * 8)) & 0xff] == entries.size())
+			continue;
+
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t count = histogram[i];
+			histogram[i] = offset;
+			offset += count;
+		}
+		for (auto& entry : entries)
+			scratch[histogram[(entry.key >> (byte * 8)) & 0xff]++] = entry;
+		entries.swap(scratch);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*Draws sorted by a packed 64-bit state key, so recording only rebinds the state that changes between neighbours.
+  Fields from the most significant bit: pass, pipeline, material, mesh, depth. Values wider than a field are masked*/
+const uint32_t drawKeyPassBits = 2;
+const uint32_t drawKeyPipelineBits = 6;
+const uint32_t drawKeyMaterialBits = 16;
+const uint32_t drawKeyMeshBits = 16;
+const uint32_t drawKeyDepthBits = 24;
+
+//depth in [0, 1] sorts front to back inside a state, pass 1 - depth for draws that must go back to front
+uint64_t MakeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+inline uint32_t GetDrawKeyPass(uint64_t key) { return static_cast<uint32_t>(key >> (64 - drawKeyPassBits)); }
+
+struct DrawSortEntry {
+	uint64_t key;
+	//Index of the draw in the caller's list
+	uint32_t draw;
+};
+
+//Stable ascending LSD radix sort on key bytes, a byte that is equal in every key costs no pass. scratch is reused between frames
+void RadixSortDraws(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch);
@@ -1,6 +1,6 @@
 #include "FrameResoure.h"
 
-FrameResource::FrameResource(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t passCount,
+FrameResource::FrameResource(vk::Device* device, MemoryAllocator* allocator, uint32_t passCount,
     uint32_t objectCount, uint32_t materialCount, uint32_t skinnedObjectCount)
 {
     vk::MemoryPropertyFlags memProp = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
@@ -8,18 +8,30 @@ FrameResource::FrameResource(vk::Device* device, vk::PhysicalDeviceMemoryPropert
 
     passCB.resize(passCount);
     for (uint32_t i = 0; i < passCount; i++)
-        passCB[i] = std::make_unique<Buffer<PassConstants>>(device, 1, usage, gpuProp, memProp, true);
+        passCB[i] = std::make_unique<Buffer<PassConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
     objCB.resize(objectCount);
     for (uint32_t i = 0; i < objectCount; i++)
-        objCB[i] = std::make_unique<Buffer<ObjectConstants>>(device, 1, usage, gpuProp, memProp, true);
+        objCB[i] = std::make_unique<Buffer<ObjectConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
     matCB.resize(materialCount);
     for (uint32_t i = 0; i < materialCount; i++)
-        matCB[i] = std::make_unique<Buffer<MaterialConstants>>(device, 1, usage, gpuProp, memProp, true);
+        matCB[i] = std::make_unique<Buffer<MaterialConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
     skinnedCB.resize(skinnedObjectCount);
     for (uint32_t i = 0; i < skinnedObjectCount; i++)
-        skinnedCB[i] = std::make_unique<Buffer<SkinnedConstants>>(device, 1, usage, gpuProp, memProp, true);
+        skinnedCB[i] = std::make_unique<Buffer<SkinnedConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal);
     
 }
+
+void FrameResource::Resize(vk::Device* device, MemoryAllocator* allocator, uint32_t objectCount, uint32_t materialCount)
+{
+    vk::MemoryPropertyFlags memProp = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
+    vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer;
+
+    for (uint32_t i = static_cast<uint32_t>(objCB.size()); i < objectCount; i++)
+        objCB.push_back(std::make_unique<Buffer<ObjectConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal));
+
+    for (uint32_t i = static_cast<uint32_t>(matCB.size()); i < materialCount; i++)
+        matCB.push_back(std::make_unique<Buffer<MaterialConstants>>(device, 1, usage, allocator, memProp, vk::MemoryPropertyFlagBits::eDeviceLocal));
+}
@@ -3,9 +3,12 @@
 
 class FrameResource {
 public:
-    FrameResource(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t passCount, uint32_t objectCount, uint32_t materialCount, uint32_t skinnedObjectCount);
+    FrameResource(vk::Device* device, MemoryAllocator* allocator, uint32_t passCount, uint32_t objectCount, uint32_t materialCount, uint32_t skinnedObjectCount);
     ~FrameResource(){}
 
+    //场景在初始化之后加入新的物体或材质时追加对应的常量缓冲
+    void Resize(vk::Device* device, MemoryAllocator* allocator, uint32_t objectCount, uint32_t materialCount);
+
     std::vector<std::unique_ptr<Buffer<PassConstants>>> passCB;				   //每帧的一遍Pass所共有的常量
     std::vector<std::unique_ptr<Buffer<ObjectConstants>>> objCB;			   //单个渲染项使用的常量
     std::vector<std::unique_ptr<Buffer<MaterialConstants>>> matCB;			   //每个材质所使用的的常量
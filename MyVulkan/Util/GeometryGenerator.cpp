@@ -91,6 +91,48 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 	return meshData;
 }
 
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth) {
+	glm::vec3 halfExtent = glm::vec3(width, height, depth) * 0.5f;
+
+	//每个面4个顶点，与CreatePlane相同的绕序，u为切线方向
+	const glm::vec3 normals[6] = {
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	const glm::vec3 tangents[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)
+	};
+
+	MeshData meshData;
+	for (UINT face = 0; face < 6; face++) {
+		glm::vec3 n = normals[face];
+		glm::vec3 u = tangents[face];
+		glm::vec3 v = glm::cross(u, n);
+
+		UINT base = static_cast<UINT>(meshData.vertices.size());
+		for (UINT i = 0; i < 4; i++) {
+			float s = (i & 1) ? 1.0f : -1.0f;
+			float t = (i & 2) ? 1.0f : -1.0f;
+
+			Vertex vertex;
+			vertex.position = (n + u * s + v * t) * halfExtent;
+			vertex.texCoord = glm::vec2((i & 1) ? 1.0f : 0.0f, (i & 2) ? 1.0f : 0.0f);
+			vertex.normal = n;
+			vertex.tangent = u;
+			meshData.vertices.push_back(vertex);
+		}
+
+		UINT indices[6] = { 0, 1, 3, 0, 3, 2 };
+		for (UINT index : indices)
+			meshData.indices.push_back(base + index);
+	}
+
+	return meshData;
+}
+
 void GeometryGenerator::Subdivide(MeshData& meshData) {
 	MeshData inputCopy = meshData;
 
@@ -16,6 +16,7 @@ public:
 
     MeshData CreatePlane(float width, float depth, uint32_t texRepeatX, uint32_t texRepeatY);
     MeshData CreateGeosphere(float radius, uint32_t numSubdivisions);
+    MeshData CreateBox(float width, float height, float depth);
 
     void Subdivide(MeshData& meshData);
     Vertex GetMidPoint(const Vertex& v0, const Vertex& v1);
@@ -0,0 +1,414 @@
+#include "vkUtil.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*TLSF: 一级按2的幂划分，二级再把每个区间等分为16份，两级位图可在O(1)内找到足够大的空闲节点*/
+static const uint32_t secondLevelBits = 4;
+static const uint32_t secondLevelCount = 1 << secondLevelBits;
+static const uint32_t firstLevelCount = 64;
+static const uint64_t minAllocationSize = 256;
+
+struct MemoryBlock {
+	vk::DeviceMemory memory;
+	uint64_t size = 0;
+	uint8_t* mappedData = nullptr;
+	uint32_t allocationCount = 0;
+
+	MemoryPool* pool = nullptr;
+	MemoryNode* firstNode = nullptr;
+};
+
+struct MemoryNode {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	bool free = true;
+
+	MemoryBlock* block = nullptr;
+	MemoryNode* prevPhysical = nullptr;
+	MemoryNode* nextPhysical = nullptr;
+	MemoryNode* prevFree = nullptr;
+	MemoryNode* nextFree = nullptr;
+};
+
+struct MemoryPool {
+	uint32_t memoryTypeIndex = 0;
+	std::vector<std::unique_ptr<MemoryBlock>> blocks;
+
+	uint64_t firstLevelBitmap = 0;
+	uint32_t secondLevelBitmap[firstLevelCount] = {};
+	MemoryNode* freeLists[firstLevelCount][secondLevelCount] = {};
+};
+
+static uint32_t HighestBit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static uint32_t LowestBit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+static uint32_t CountBits(uint32_t value) {
+	uint32_t count = 0;
+	for (; value; value &= value - 1)
+		count++;
+	return count;
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//大小不小于minAllocationSize，所以一级索引总是大于secondLevelBits
+static void Mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel) {
+	firstLevel = HighestBit(size);
+	secondLevel = static_cast<uint32_t>(size >> (firstLevel - secondLevelBits)) ^ secondLevelCount;
+}
+
+static void InsertFree(MemoryPool& pool, MemoryNode* node) {
+	uint32_t fl, sl;
+	Mapping(node->size, fl, sl);
+
+	node->prevFree = nullptr;
+	node->nextFree = pool.freeLists[fl][sl];
+	if (node->nextFree)
+		node->nextFree->prevFree = node;
+	pool.freeLists[fl][sl] = node;
+
+	pool.firstLevelBitmap |= 1ull << fl;
+	pool.secondLevelBitmap[fl] |= 1u << sl;
+}
+
+static void RemoveFree(MemoryPool& pool, MemoryNode* node) {
+	uint32_t fl, sl;
+	Mapping(node->size, fl, sl);
+
+	if (node->prevFree)
+		node->prevFree->nextFree = node->nextFree;
+	else
+		pool.freeLists[fl][sl] = node->nextFree;
+	if (node->nextFree)
+		node->nextFree->prevFree = node->prevFree;
+	node->prevFree = node->nextFree = nullptr;
+
+	if (pool.freeLists[fl][sl] == nullptr) {
+		pool.secondLevelBitmap[fl] &= ~(1u << sl);
+		if (pool.secondLevelBitmap[fl] == 0)
+			pool.firstLevelBitmap &= ~(1ull << fl);
+	}
+}
+
+static MemoryNode* FindFree(MemoryPool& pool, uint64_t size) {
+	//向上取整到下一个二级区间，保证找到的链表中任意节点都足够大
+	uint64_t searchSize = size + (1ull << (HighestBit(size) - secondLevelBits)) - 1;
+	uint32_t fl, sl;
+	Mapping(searchSize, fl, sl);
+
+	uint32_t secondLevelMap = pool.secondLevelBitmap[fl] & (~0u << sl);
+	if (secondLevelMap == 0) {
+		uint64_t firstLevelMap = fl + 1 < firstLevelCount ? pool.firstLevelBitmap & (~0ull << (fl + 1)) : 0;
+		if (firstLevelMap == 0)
+			return nullptr;
+		fl = LowestBit(firstLevelMap);
+		secondLevelMap = pool.secondLevelBitmap[fl];
+	}
+	sl = LowestBit(secondLevelMap);
+	return pool.freeLists[fl][sl];
+}
+
+MemoryAllocator::~MemoryAllocator() {
+	Destroy();
+}
+
+void MemoryAllocator::Init(vk::Device device, vk::PhysicalDevice gpu, uint64_t blockSize) {
+	this->device = device;
+	this->blockSize = blockSize;
+	memProp = gpu.getMemoryProperties();
+
+	pools.resize(memProp.memoryTypeCount * 2);
+	for (size_t i = 0; i < pools.size(); i++) {
+		pools[i] = std::make_unique<MemoryPool>();
+		pools[i]->memoryTypeIndex = static_cast<uint32_t>(i / 2);
+	}
+}
+
+void MemoryAllocator::Destroy() {
+	if (!device)
+		return;
+
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+	for (auto& pool : pools) {
+		for (auto& block : pool->blocks) {
+			for (MemoryNode* node = block->firstNode; node;) {
+				MemoryNode* next = node->nextPhysical;
+				delete node;
+				node = next;
+			}
+			device.freeMemory(block->memory);
+		}
+	}
+	pools.clear();
+	statistics = Statistics();
+
+	device = vk::Device();
+}
+
+int MemoryAllocator::FindMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred)const {
+	//没有要求的主机可见或延迟分配属性往往意味着容量很小的BAR堆或不适合常驻的内存
+	vk::MemoryPropertyFlags unwanted = (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent |
+		vk::MemoryPropertyFlagBits::eHostCached | vk::MemoryPropertyFlagBits::eLazilyAllocated) & ~(required | preferred);
+
+	int bestIndex = -1;
+	int bestScore = 0;
+	uint64_t bestHeapSize = 0;
+	for (uint32_t i = 0; i < memProp.memoryTypeCount; i++) {
+		vk::MemoryPropertyFlags flags = memProp.memoryTypes[i].propertyFlags;
+		if (!(typeBits & (1u << i)) || (flags & required) != required)
+			continue;
+
+		int score = 4 * CountBits(VkMemoryPropertyFlags(flags & preferred)) - CountBits(VkMemoryPropertyFlags(flags & unwanted));
+		uint64_t heapSize = memProp.memoryHeaps[memProp.memoryTypes[i].heapIndex].size;
+		if (bestIndex < 0 || score > bestScore || (score == bestScore && heapSize > bestHeapSize)) {
+			bestIndex = i;
+			bestScore = score;
+			bestHeapSize = heapSize;
+		}
+	}
+	return bestIndex;
+}
+
+MemoryBlock* MemoryAllocator::CreateBlock(MemoryPool& pool, uint64_t size) {
+	auto memoryInfo = vk::MemoryAllocateInfo()
+		.setAllocationSize(size)
+		.setMemoryTypeIndex(pool.memoryTypeIndex);
+
+	auto block = std::make_unique<MemoryBlock>();
+	if (device.allocateMemory(&memoryInfo, 0, &block->memory) != vk::Result::eSuccess)
+		return nullptr;
+
+	//主机可见的块整体常驻映射，同一块内的多个资源共享这一次映射
+	if (GetMemoryPropertyFlags(pool.memoryTypeIndex) & vk::MemoryPropertyFlagBits::eHostVisible)
+		device.mapMemory(block->memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), reinterpret_cast<void**>(&block->mappedData));
+
+	block->size = size;
+	block->pool = &pool;
+
+	MemoryNode* node = new MemoryNode();
+	node->size = size;
+	node->block = block.get();
+	block->firstNode = node;
+	InsertFree(pool, node);
+
+	statistics.blockCount++;
+	statistics.reservedBytes += size;
+
+	pool.blocks.push_back(std::move(block));
+	return pool.blocks.back().get();
+}
+
+bool MemoryAllocator::AllocateDedicated(uint64_t size, uint32_t memoryTypeIndex, MemoryAllocation& allocation) {
+	auto memoryInfo = vk::MemoryAllocateInfo()
+		.setAllocationSize(size)
+		.setMemoryTypeIndex(memoryTypeIndex);
+	if (device.allocateMemory(&memoryInfo, 0, &allocation.memory) != vk::Result::eSuccess)
+		return false;
+
+	allocation.offset = 0;
+	allocation.size = size;
+	allocation.node = nullptr;
+	allocation.mappedData = nullptr;
+	if (GetMemoryPropertyFlags(memoryTypeIndex) & vk::MemoryPropertyFlagBits::eHostVisible)
+		device.mapMemory(allocation.memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), reinterpret_cast<void**>(&allocation.mappedData));
+
+	statistics.dedicatedCount++;
+	statistics.reservedBytes += size;
+	return true;
+}
+
+bool MemoryAllocator::AllocateFromPool(MemoryPool& pool, uint64_t size, uint64_t alignment, MemoryAllocation& allocation) {
+	//节点的偏移与大小都是minAllocationSize的倍数，更大的对齐需要预留前部空隙
+	size = AlignUp(size, minAllocationSize);
+	uint64_t requestSize = alignment > minAllocationSize ? size + alignment - minAllocationSize : size;
+
+	MemoryNode* node = FindFree(pool, requestSize);
+	if (node == nullptr) {
+		if (CreateBlock(pool, blockSize >= requestSize ? blockSize : AlignUp(requestSize, minAllocationSize)) == nullptr)
+			return false;
+		node = FindFree(pool, requestSize);
+		if (node == nullptr)
+			return false;
+	}
+	RemoveFree(pool, node);
+
+	uint64_t alignedOffset = AlignUp(node->offset, alignment);
+	if (alignedOffset > node->offset) {
+		MemoryNode* padding = new MemoryNode();
+		padding->offset = node->offset;
+		padding->size = alignedOffset - node->offset;
+		padding->block = node->block;
+		padding->prevPhysical = node->prevPhysical;
+		padding->nextPhysical = node;
+		if (node->prevPhysical)
+			node->prevPhysical->nextPhysical = padding;
+		else
+			node->block->firstNode = padding;
+		node->prevPhysical = padding;
+		node->offset = alignedOffset;
+		node->size -= padding->size;
+		InsertFree(pool, padding);
+	}
+
+	if (node->size > size) {
+		MemoryNode* remainder = new MemoryNode();
+		remainder->offset = node->offset + size;
+		remainder->size = node->size - size;
+		remainder->block = node->block;
+		remainder->prevPhysical = node;
+		remainder->nextPhysical = node->nextPhysical;
+		if (node->nextPhysical)
+			node->nextPhysical->prevPhysical = remainder;
+		node->nextPhysical = remainder;
+		node->size = size;
+		InsertFree(pool, remainder);
+	}
+
+	node->free = false;
+	node->block->allocationCount++;
+
+	allocation.memory = node->block->memory;
+	allocation.offset = node->offset;
+	allocation.size = node->size;
+	allocation.mappedData = node->block->mappedData ? node->block->mappedData + node->offset : nullptr;
+	allocation.node = node;
+	return true;
+}
+
+bool MemoryAllocator::Allocate(const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, bool linear, MemoryAllocation& allocation) {
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	uint32_t typeBits = memReqs.memoryTypeBits;
+	while (true) {
+		int memoryTypeIndex = FindMemoryType(typeBits, required, preferred);
+		if (memoryTypeIndex < 0)
+			break;
+
+		//大资源单独分配，避免占用整块
+		bool allocated = memReqs.size >= blockSize / 2 ?
+			AllocateDedicated(memReqs.size, memoryTypeIndex, allocation) :
+			AllocateFromPool(*pools[memoryTypeIndex * 2 + (linear ? 1 : 0)], memReqs.size, memReqs.alignment, allocation);
+		if (allocated) {
+			allocation.allocator = this;
+			allocation.memoryTypeIndex = memoryTypeIndex;
+			statistics.allocationCount++;
+			statistics.usedBytes += allocation.size;
+			return true;
+		}
+
+		//该类型所在的堆已满，换下一个满足要求的类型
+		typeBits &= ~(1u << memoryTypeIndex);
+	}
+
+	MessageBox(0, L"Allocate device memory failed!!!", 0, 0);
+	return false;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation) {
+	if (!allocation.memory)
+		return;
+
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+	if (!device)
+		return;
+
+	statistics.allocationCount--;
+	statistics.usedBytes -= allocation.size;
+
+	if (allocation.node == nullptr) {
+		device.freeMemory(allocation.memory);
+		statistics.dedicatedCount--;
+		statistics.reservedBytes -= allocation.size;
+		allocation = MemoryAllocation();
+		return;
+	}
+
+	MemoryNode* node = allocation.node;
+	MemoryBlock* block = node->block;
+	MemoryPool& pool = *block->pool;
+	node->free = true;
+	block->allocationCount--;
+
+	//与相邻的空闲节点合并
+	MemoryNode* prev = node->prevPhysical;
+	if (prev && prev->free) {
+		RemoveFree(pool, prev);
+		prev->size += node->size;
+		prev->nextPhysical = node->nextPhysical;
+		if (node->nextPhysical)
+			node->nextPhysical->prevPhysical = prev;
+		delete node;
+		node = prev;
+	}
+	MemoryNode* next = node->nextPhysical;
+	if (next && next->free) {
+		RemoveFree(pool, next);
+		node->size += next->size;
+		node->nextPhysical = next->nextPhysical;
+		if (next->nextPhysical)
+			next->nextPhysical->prevPhysical = node;
+		delete next;
+	}
+
+	//整块都空闲且池中还有其他块时把它还给驱动
+	if (block->allocationCount == 0 && pool.blocks.size() > 1) {
+		delete node;
+		device.freeMemory(block->memory);
+		statistics.blockCount--;
+		statistics.reservedBytes -= block->size;
+		for (auto it = pool.blocks.begin(); it != pool.blocks.end(); ++it) {
+			if (it->get() == block) {
+				pool.blocks.erase(it);
+				break;
+			}
+		}
+	}
+	else
+		InsertFree(pool, node);
+
+	allocation = MemoryAllocation();
+}
+
+bool MemoryAllocator::AllocateBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, MemoryAllocation& allocation) {
+	vk::MemoryRequirements memReqs;
+	device.getBufferMemoryRequirements(buffer, &memReqs);
+	if (!Allocate(memReqs, required, preferred, true, allocation))
+		return false;
+	device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+	return true;
+}
+
+bool MemoryAllocator::AllocateImage(vk::Image image, vk::MemoryPropertyFlags required, MemoryAllocation& allocation) {
+	vk::MemoryRequirements memReqs;
+	device.getImageMemoryRequirements(image, &memReqs);
+	if (!Allocate(memReqs, required, vk::MemoryPropertyFlags(), false, allocation))
+		return false;
+	device.bindImageMemory(image, allocation.memory, allocation.offset);
+	return true;
+}
+
+MemoryAllocator::Statistics MemoryAllocator::GetStatistics() {
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+	return statistics;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "vulkan/vulkan.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class MemoryAllocator;
+struct MemoryNode;
+struct MemoryBlock;
+struct MemoryPool;
+
+/*A range of device memory, sub-allocated from a shared block or owning a dedicated allocation*/
+struct MemoryAllocation {
+	vk::DeviceMemory memory;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+
+	//Host visible memory stays mapped for its whole lifetime
+	uint8_t* mappedData = nullptr;
+
+	MemoryAllocator* allocator = nullptr;
+	MemoryNode* node = nullptr;	//null for dedicated allocations
+	uint32_t memoryTypeIndex = 0;
+};
+
+/*Pooled device memory: large blocks per memory type, sub-allocated with a two-level segregated fit (TLSF)*/
+class MemoryAllocator {
+public:
+	struct Statistics {
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		uint64_t reservedBytes = 0;	//bytes of every vkAllocateMemory still alive
+		uint64_t usedBytes = 0;		//bytes handed out to resources
+	};
+
+	~MemoryAllocator();
+
+	void Init(vk::Device device, vk::PhysicalDevice gpu, uint64_t blockSize = 64ull * 1024 * 1024);
+	void Destroy();
+
+	//Buffers and optimal images never share a block, so bufferImageGranularity needs no padding.
+	//Preferred flags are used when a memory type has them, the required ones must match.
+	bool Allocate(const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, bool linear, MemoryAllocation& allocation);
+	void Free(MemoryAllocation& allocation);
+
+	//Allocate and bind
+	bool AllocateBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, MemoryAllocation& allocation);
+	bool AllocateImage(vk::Image image, vk::MemoryPropertyFlags required, MemoryAllocation& allocation);
+
+	vk::MemoryPropertyFlags GetMemoryPropertyFlags(uint32_t memoryTypeIndex)const { return memProp.memoryTypes[memoryTypeIndex].propertyFlags; }
+	Statistics GetStatistics();
+
+private:
+	int FindMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred)const;
+	bool AllocateDedicated(uint64_t size, uint32_t memoryTypeIndex, MemoryAllocation& allocation);
+	bool AllocateFromPool(MemoryPool& pool, uint64_t size, uint64_t alignment, MemoryAllocation& allocation);
+	MemoryBlock* CreateBlock(MemoryPool& pool, uint64_t size);
+
+	vk::Device device;
+	vk::PhysicalDeviceMemoryProperties memProp;
+	uint64_t blockSize = 0;
+
+	//Index is memoryTypeIndex * 2 + (linear ? 1 : 0)
+	std::vector<std::unique_ptr<MemoryPool>> pools;
+
+	Statistics statistics;
+	std::mutex allocatorMutex;
+};
@@ -0,0 +1,670 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+
+void MeshOptimizeStats::Add(const MeshOptimizeStats& other) {
+	uint32_t total = triangleCount + other.triangleCount;
+	if (total > 0) {
+		acmrBefore = (acmrBefore * triangleCount + other.acmrBefore * other.triangleCount) / total;
+		acmrAfter = (acmrAfter * triangleCount + other.acmrAfter * other.triangleCount) / total;
+	}
+	triangleCount = total;
+	vertexCountBefore += other.vertexCountBefore;
+	vertexCountAfter += other.vertexCountAfter;
+}
+
+float ComputeACMR(const std::vector<UINT>& indices, uint32_t vertexCount, uint32_t cacheSize) {
+	if (indices.size() < 3)
+		return 0.0f;
+
+	//FIFO缓存: 顶点进入缓存时记录时间戳，之后又进入了cacheSize个顶点即被挤出
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t misses = 0;
+	for (UINT index : indices) {
+		if (timestamp - cacheTime[index] > cacheSize) {
+			cacheTime[index] = timestamp++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+uint32_t WeldVertices(void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<UINT>& indices) {
+	if (vertexCount == 0)
+		return 0;
+
+	uint8_t* data = static_cast<uint8_t*>(vertices);
+	uint32_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+		tableSize <<= 1;
+
+	//开放寻址的哈希表，保存压缩后的顶点位置
+	std::vector<UINT> table(tableSize, UINT_MAX);
+	std::vector<UINT> remap(vertexCount);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const uint8_t* vertex = data + (size_t)i * stride;
+		uint32_t slot = static_cast<uint32_t>(HashBytes(vertex, stride)) & (tableSize - 1);
+		while (table[slot] != UINT_MAX && memcmp(data + (size_t)table[slot] * stride, vertex, stride) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+
+		if (table[slot] == UINT_MAX) {
+			//写入位置不在任何已保留顶点之上
+			if (count != i)
+				memcpy(data + (size_t)count * stride, vertex, stride);
+			table[slot] = count;
+			remap[i] = count++;
+		}
+		else {
+			remap[i] = table[slot];
+		}
+	}
+
+	for (UINT& index : indices)
+		index = remap[index];
+	return count;
+}
+
+void OptimizeVertexCache(std::vector<UINT>& indices, uint32_t vertexCount, std::vector<uint32_t>& clusters, uint32_t cacheSize) {
+	clusters.clear();
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	//每个顶点相邻的三角形，live为尚未输出的相邻三角形数量
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (size_t i = 0; i < (size_t)triangleCount * 3; i++)
+		live[indices[i]]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < vertexCount; i++)
+		offsets[i + 1] = offsets[i] + live[i];
+	std::vector<uint32_t> adjacency(offsets[vertexCount]);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (uint32_t i = 0; i < triangleCount; i++) {
+		for (uint32_t j = 0; j < 3; j++)
+			adjacency[fill[indices[i * 3 + j]]++] = i;
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<UINT> deadEnd;
+	std::vector<UINT> candidates;
+	std::vector<UINT> result;
+	deadEnd.reserve((size_t)triangleCount * 3);
+	result.reserve((size_t)triangleCount * 3);
+
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t cursor = 0;
+	while (cursor < vertexCount && live[cursor] == 0)
+		cursor++;
+	int64_t current = cursor;
+	clusters.push_back(0);
+
+	while (current >= 0) {
+		//输出扇形顶点周围所有剩余的三角形
+		candidates.clear();
+		for (uint32_t i = offsets[current]; i < offsets[current + 1]; i++) {
+			uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+
+			for (uint32_t j = 0; j < 3; j++) {
+				UINT vertex = indices[triangle * 3 + j];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				if (timestamp - cacheTime[vertex] > cacheSize)
+					cacheTime[vertex] = timestamp++;
+			}
+		}
+
+		//下一个扇形顶点: 输出剩余三角形后仍在缓存中的候选里，最早进入缓存的优先
+		int64_t next = -1;
+		uint32_t bestPriority = 0;
+		for (UINT vertex : candidates) {
+			if (live[vertex] == 0)
+				continue;
+			uint32_t age = timestamp - cacheTime[vertex];
+			if (age + 2 * live[vertex] <= cacheSize && age > bestPriority) {
+				bestPriority = age;
+				next = vertex;
+			}
+		}
+
+		if (next < 0) {
+			//走进死路时先回溯最近输出的顶点，再顺序查找，新的一段作为一个簇
+			while (!deadEnd.empty()) {
+				UINT vertex = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[vertex] > 0) {
+					next = vertex;
+					break;
+				}
+			}
+			while (next < 0 && cursor < vertexCount) {
+				if (live[cursor] > 0)
+					next = cursor;
+				else
+					cursor++;
+			}
+			if (next >= 0)
+				clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+		}
+		current = next;
+	}
+
+	//不足一个三角形的尾部索引原样保留
+	result.insert(result.end(), indices.begin() + (size_t)triangleCount * 3, indices.end());
+	indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<UINT>& indices, const std::vector<uint32_t>& clusters, const void* positions, uint32_t vertexCount, uint32_t stride) {
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (clusters.size() < 2 || triangleCount == 0)
+		return;
+	//有越界的索引时读不到位置，保持原有顺序
+	for (size_t i = 0; i < (size_t)triangleCount * 3; i++) {
+		if (indices[i] >= vertexCount)
+			return;
+	}
+
+	const uint8_t* data = static_cast<const uint8_t*>(positions);
+	auto position = [&](UINT index) {
+		glm::vec3 value;
+		memcpy(&value, data + (size_t)index * stride, sizeof(glm::vec3));
+		return value;
+	};
+
+	//簇的中心与平均法线都按面积加权
+	size_t clusterCount = clusters.size();
+	std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+	std::vector<float> clusterArea(clusterCount, 0.0f);
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	for (size_t i = 0; i < clusterCount; i++) {
+		uint32_t end = i + 1 < clusterCount ? clusters[i + 1] : triangleCount;
+		for (uint32_t j = clusters[i]; j < end; j++) {
+			glm::vec3 p0 = position(indices[j * 3]);
+			glm::vec3 p1 = position(indices[j * 3 + 1]);
+			glm::vec3 p2 = position(indices[j * 3 + 2]);
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal) * 0.5f;
+
+			clusterCenter[i] += (p0 + p1 + p2) * (area / 3.0f);
+			clusterNormal[i] += normal;
+			clusterArea[i] += area;
+		}
+		meshCenter += clusterCenter[i];
+		meshArea += clusterArea[i];
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	//朝外越明显的簇越先绘制，能挡住同一网格中靠内、背向视线的部分
+	std::vector<float> keys(clusterCount, 0.0f);
+	for (size_t i = 0; i < clusterCount; i++) {
+		float normalLength = glm::length(clusterNormal[i]);
+		if (clusterArea[i] > 0.0f && normalLength > 0.0f)
+			keys[i] = glm::dot(clusterCenter[i] / clusterArea[i] - meshCenter, clusterNormal[i] / normalLength);
+	}
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t i = 0; i < clusterCount; i++)
+		order[i] = static_cast<uint32_t>(i);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<UINT> result;
+	result.reserve(indices.size());
+	for (uint32_t cluster : order) {
+		uint32_t end = cluster + 1 < clusterCount ? clusters[cluster + 1] : triangleCount;
+		result.insert(result.end(), indices.begin() + (size_t)clusters[cluster] * 3, indices.begin() + (size_t)end * 3);
+	}
+	result.insert(result.end(), indices.begin() + (size_t)triangleCount * 3, indices.end());
+	indices.swap(result);
+}
+
+uint32_t OptimizeVertexFetch(void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<UINT>& indices) {
+	//按索引中第一次出现的顺序重新编号
+	std::vector<UINT> remap(vertexCount, UINT_MAX);
+	uint32_t count = 0;
+	for (UINT& index : indices) {
+		if (remap[index] == UINT_MAX)
+			remap[index] = count++;
+		index = remap[index];
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(vertices);
+	std::vector<uint8_t> reordered((size_t)count * stride);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		if (remap[i] != UINT_MAX)
+			memcpy(reordered.data() + (size_t)remap[i] * stride, data + (size_t)i * stride, stride);
+	}
+	memcpy(data, reordered.data(), reordered.size());
+	return count;
+}
+
+//对称矩阵A、向量b与常数c: E(p) = pAp + 2bp + c，weight为累加的面积
+struct Quadric {
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+};
+
+//累加w(n·p + d)^2，n不要求是单位向量
+static void AddPlane(Quadric& q, const glm::dvec3& n, double d, double w) {
+	q.a00 += w * n.x * n.x;
+	q.a01 += w * n.x * n.y;
+	q.a02 += w * n.x * n.z;
+	q.a11 += w * n.y * n.y;
+	q.a12 += w * n.y * n.z;
+	q.a22 += w * n.z * n.z;
+	q.b0 += w * d * n.x;
+	q.b1 += w * d * n.y;
+	q.b2 += w * d * n.z;
+	q.c += w * d * d;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other) {
+	q.a00 += other.a00;
+	q.a01 += other.a01;
+	q.a02 += other.a02;
+	q.a11 += other.a11;
+	q.a12 += other.a12;
+	q.a22 += other.a22;
+	q.b0 += other.b0;
+	q.b1 += other.b1;
+	q.b2 += other.b2;
+	q.c += other.c;
+	q.weight += other.weight;
+}
+
+static double EvaluateQuadric(const Quadric& q, const glm::dvec3& p) {
+	return q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+		+ 2.0 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z)
+		+ 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+}
+
+static float GetMeshExtent(const std::vector<glm::vec3>& positions, glm::vec3& minPos) {
+	minPos = glm::vec3(0.0f);
+	if (positions.empty())
+		return 0.0f;
+
+	minPos = positions[0];
+	glm::vec3 maxPos = positions[0];
+	for (auto& position : positions) {
+		minPos = glm::min(minPos, position);
+		maxPos = glm::max(maxPos, position);
+	}
+	glm::vec3 size = maxPos - minPos;
+	return std::max(size.x, std::max(size.y, size.z));
+}
+
+std::vector<UINT> SimplifyMesh(const std::vector<UINT>& indices, const std::vector<glm::vec3>& positions, const std::vector<float>& attributes, uint32_t attributeCount,
+	uint32_t targetIndexCount, float targetError, float& resultError) {
+	resultError = 0.0f;
+	uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+	std::vector<UINT> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	if (result.size() <= targetIndexCount || vertexCount == 0)
+		return result;
+
+	//缩放到包围盒最长边为1，误差与网格大小无关
+	glm::vec3 minPos;
+	float extent = GetMeshExtent(positions, minPos);
+	double invExtent = extent > 0.0f ? 1.0 / extent : 1.0;
+	std::vector<glm::dvec3> points(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+		points[i] = glm::dvec3(positions[i] - minPos) * invExtent;
+
+	//位置相同的顶点(UV接缝或硬边两侧的副本)归为一组，以组内第一个顶点为代表，只统计索引用到的顶点
+	std::vector<UINT> positionId(vertexCount);
+	std::vector<uint32_t> groupSize(vertexCount, 0);
+	//组内恰好两个顶点时互为接缝另一侧的副本
+	std::vector<UINT> seamPartner(vertexCount, UINT_MAX);
+	{
+		std::vector<bool> referenced(vertexCount, false);
+		for (UINT index : result)
+			referenced[index] = true;
+
+		std::unordered_map<uint64_t, std::vector<UINT>> buckets;
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			positionId[i] = i;
+			if (!referenced[i])
+				continue;
+			uint32_t bits[3];
+			memcpy(bits, &positions[i], sizeof(bits));
+			uint64_t hash = (uint64_t)bits[0] * 73856093ull ^ (uint64_t)bits[1] * 19349663ull ^ (uint64_t)bits[2] * 83492791ull;
+			auto& bucket = buckets[hash];
+			for (UINT other : bucket) {
+				if (positions[other] == positions[i]) {
+					positionId[i] = other;
+					break;
+				}
+			}
+			if (positionId[i] == i)
+				bucket.push_back(i);
+			else if (groupSize[positionId[i]] == 1) {
+				seamPartner[i] = positionId[i];
+				seamPartner[positionId[i]] = i;
+			}
+			groupSize[positionId[i]]++;
+		}
+	}
+
+	//按位置只属于一个三角形(边界)或多于两个三角形(非流形)的边，以及多条接缝交汇处(组内多于两个副本)的顶点固定不动
+	//接缝上的顶点只能沿接缝合并，两侧的副本一起移动，见下面的findPartner
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeCount;
+		auto edgeKey = [&](UINT a, UINT b) {
+			UINT pa = positionId[a], pb = positionId[b];
+			return pa < pb ? ((uint64_t)pa << 32) | pb : ((uint64_t)pb << 32) | pa;
+		};
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (uint32_t j = 0; j < 3; j++)
+				edgeCount[edgeKey(result[i + j], result[i + (j + 1) % 3])]++;
+		}
+		std::vector<bool> lockedGroup(vertexCount, false);
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (uint32_t j = 0; j < 3; j++) {
+				UINT a = result[i + j], b = result[i + (j + 1) % 3];
+				if (edgeCount[edgeKey(a, b)] != 2) {
+					lockedGroup[positionId[a]] = true;
+					lockedGroup[positionId[b]] = true;
+				}
+			}
+		}
+		for (uint32_t i = 0; i < vertexCount; i++)
+			locked[i] = lockedGroup[positionId[i]] || groupSize[positionId[i]] > 2;
+	}
+
+	//每个三角形的平面与属性在三角形上的线性插值累加到它的三个顶点
+	//属性项: E += e*a^2 + 2a(f·p) + 2h*a，与位置项一起构成(p, a)的二次型
+	//positionQuadrics只含平面项，用来给出几何误差，quadrics再加上属性项用来排序与限制合并
+	const uint32_t termSize = 5;
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<Quadric> positionQuadrics(vertexCount);
+	std::vector<double> terms((size_t)vertexCount * attributeCount * termSize, 0.0);
+	for (size_t i = 0; i < result.size(); i += 3) {
+		UINT i0 = result[i], i1 = result[i + 1], i2 = result[i + 2];
+		glm::dvec3 e1 = points[i1] - points[i0];
+		glm::dvec3 e2 = points[i2] - points[i0];
+		glm::dvec3 normal = glm::cross(e1, e2);
+		double length = glm::length(normal);
+		if (length <= 0.0)
+			continue;
+
+		double area = length * 0.5;
+		glm::dvec3 unitNormal = normal / length;
+		Quadric quadric;
+		AddPlane(quadric, unitNormal, -glm::dot(unitNormal, points[i0]), area);
+		quadric.weight = area;
+		Quadric positionQuadric = quadric;
+
+		for (uint32_t k = 0; k < attributeCount; k++) {
+			double a0 = attributes[(size_t)i0 * attributeCount + k];
+			double a1 = attributes[(size_t)i1 * attributeCount + k];
+			double a2 = attributes[(size_t)i2 * attributeCount + k];
+			//属性在三角形平面内的梯度
+			glm::dvec3 gradient = ((a1 - a0) * glm::cross(e2, normal) + (a2 - a0) * glm::cross(normal, e1)) / (length * length);
+			double offset = a0 - glm::dot(gradient, points[i0]);
+			AddPlane(quadric, gradient, offset, area);
+
+			for (UINT vertex : { i0, i1, i2 }) {
+				double* term = &terms[((size_t)vertex * attributeCount + k) * termSize];
+				term[0] += area;
+				term[1] -= area * gradient.x;
+				term[2] -= area * gradient.y;
+				term[3] -= area * gradient.z;
+				term[4] -= area * offset;
+			}
+		}
+
+		for (UINT vertex : { i0, i1, i2 }) {
+			AddQuadric(quadrics[vertex], quadric);
+			AddQuadric(positionQuadrics[vertex], positionQuadric);
+		}
+	}
+
+	//u合并到v后在v处的误差，除以面积得到平均的距离平方
+	auto collapseError = [&](UINT u, UINT v) {
+		const glm::dvec3& p = points[v];
+		double error = EvaluateQuadric(quadrics[u], p) + EvaluateQuadric(quadrics[v], p);
+		for (uint32_t k = 0; k < attributeCount; k++) {
+			double a = attributes[(size_t)v * attributeCount + k];
+			for (UINT vertex : { u, v }) {
+				const double* term = &terms[((size_t)vertex * attributeCount + k) * termSize];
+				error += term[0] * a * a + 2.0 * a * (term[1] * p.x + term[2] * p.y + term[3] * p.z) + 2.0 * term[4] * a;
+			}
+		}
+		double weight = quadrics[u].weight + quadrics[v].weight;
+		return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+	};
+	//只按位置平面计算的误差，即到原表面的平均距离平方
+	auto geometricError = [&](UINT u, UINT v) {
+		const glm::dvec3& p = points[v];
+		double error = EvaluateQuadric(positionQuadrics[u], p) + EvaluateQuadric(positionQuadrics[v], p);
+		double weight = positionQuadrics[u].weight + positionQuadrics[v].weight;
+		return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+	};
+
+	struct Collapse {
+		UINT u;
+		UINT v;
+		//接缝另一侧随之合并的副本，不在接缝上时为UINT_MAX
+		UINT partnerU;
+		UINT partnerV;
+		double error;
+		double geometricError;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<UINT> remap(vertexCount);
+	std::vector<bool> passLocked(vertexCount);
+	std::vector<uint32_t> offsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	double maxErrorSquared = (double)targetError * targetError;
+	double resultErrorSquared = 0.0;
+
+	//每一轮按误差从小到大合并，被改动的顶点本轮不再参与，直到达到目标或没有可合并的边
+	while (result.size() > targetIndexCount) {
+		uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (UINT index : result)
+			offsets[index + 1]++;
+		for (uint32_t i = 0; i < vertexCount; i++)
+			offsets[i + 1] += offsets[i];
+		adjacency.resize(result.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			for (uint32_t j = 0; j < 3; j++)
+				adjacency[fill[result[i * 3 + j]]++] = i;
+		}
+
+		//接缝上的u合并到v时，u的副本要合并到与v位置相同、并与它相连的顶点，这样接缝仍然闭合；找不到时说明边不在接缝上
+		auto findPartner = [&](UINT u, UINT v, UINT& partnerV) {
+			UINT partnerU = seamPartner[u];
+			for (uint32_t j = offsets[partnerU]; j < offsets[partnerU + 1]; j++) {
+				const UINT* triangle = &result[adjacency[j] * 3];
+				for (uint32_t k = 0; k < 3; k++) {
+					if (triangle[k] != partnerU && positionId[triangle[k]] == positionId[v]) {
+						partnerV = triangle[k];
+						return partnerU;
+					}
+				}
+			}
+			return UINT_MAX;
+		};
+		auto addCollapse = [&](UINT u, UINT v) {
+			Collapse collapse = { u, v, UINT_MAX, UINT_MAX, collapseError(u, v), geometricError(u, v) };
+			if (seamPartner[u] != UINT_MAX) {
+				collapse.partnerU = findPartner(u, v, collapse.partnerV);
+				if (collapse.partnerU == UINT_MAX)
+					return;
+				collapse.error = std::max(collapse.error, collapseError(collapse.partnerU, collapse.partnerV));
+				collapse.geometricError = std::max(collapse.geometricError, geometricError(collapse.partnerU, collapse.partnerV));
+			}
+			collapses.push_back(collapse);
+		};
+
+		collapses.clear();
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			for (uint32_t j = 0; j < 3; j++) {
+				UINT a = result[i * 3 + j], b = result[i * 3 + (j + 1) % 3];
+				if (!locked[a])
+					addCollapse(a, b);
+				if (!locked[b])
+					addCollapse(b, a);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		uint32_t trianglesToRemove = triangleCount - targetIndexCount / 3;
+		uint32_t removed = 0;
+		std::fill(passLocked.begin(), passLocked.end(), false);
+		for (uint32_t i = 0; i < vertexCount; i++)
+			remap[i] = i;
+
+		//u周围不含v的三角形移动到v之后不能翻面，removing累加会被去掉的三角形数
+		auto flips = [&](UINT u, UINT v, uint32_t& removing) {
+			for (uint32_t j = offsets[u]; j < offsets[u + 1]; j++) {
+				const UINT* triangle = &result[adjacency[j] * 3];
+				if (positionId[triangle[0]] == positionId[v] || positionId[triangle[1]] == positionId[v] || positionId[triangle[2]] == positionId[v]) {
+					removing++;
+					continue;
+				}
+				glm::dvec3 p[3], moved[3];
+				for (uint32_t k = 0; k < 3; k++) {
+					p[k] = points[triangle[k]];
+					moved[k] = triangle[k] == u ? points[v] : p[k];
+				}
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				if (glm::dot(before, after) <= 0.0)
+					return true;
+			}
+			return false;
+		};
+		auto lockNeighborhood = [&](UINT u, UINT v) {
+			passLocked[u] = true;
+			passLocked[v] = true;
+			for (uint32_t j = offsets[u]; j < offsets[u + 1]; j++) {
+				for (uint32_t k = 0; k < 3; k++)
+					passLocked[result[adjacency[j] * 3 + k]] = true;
+			}
+		};
+		auto merge = [&](UINT u, UINT v) {
+			remap[u] = v;
+			AddQuadric(quadrics[v], quadrics[u]);
+			AddQuadric(positionQuadrics[v], positionQuadrics[u]);
+			for (uint32_t k = 0; k < attributeCount * termSize; k++)
+				terms[(size_t)v * attributeCount * termSize + k] += terms[(size_t)u * attributeCount * termSize + k];
+		};
+
+		for (auto& collapse : collapses) {
+			if (collapse.error > maxErrorSquared || removed >= trianglesToRemove)
+				break;
+			bool seam = collapse.partnerU != UINT_MAX;
+			if (passLocked[collapse.u] || passLocked[collapse.v])
+				continue;
+			if (seam && (passLocked[collapse.partnerU] || (collapse.partnerV != collapse.v && passLocked[collapse.partnerV])))
+				continue;
+
+			uint32_t removing = 0;
+			if (flips(collapse.u, collapse.v, removing) || (seam && flips(collapse.partnerU, collapse.partnerV, removing)))
+				continue;
+
+			merge(collapse.u, collapse.v);
+			lockNeighborhood(collapse.u, collapse.v);
+			if (seam) {
+				merge(collapse.partnerU, collapse.partnerV);
+				lockNeighborhood(collapse.partnerU, collapse.partnerV);
+			}
+
+			removed += removing;
+			//LOD的误差只计几何偏差，属性误差只影响合并的顺序与上限
+			resultErrorSquared = std::max(resultErrorSquared, collapse.geometricError);
+		}
+		if (removed == 0)
+			break;
+
+		//重写索引，去掉两个顶点重合(包括位置重合)的三角形
+		size_t count = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			UINT a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (positionId[a] == positionId[b] || positionId[b] == positionId[c] || positionId[a] == positionId[c])
+				continue;
+			result[count++] = a;
+			result[count++] = b;
+			result[count++] = c;
+		}
+		result.resize(count);
+	}
+
+	resultError = static_cast<float>(std::sqrt(resultErrorSquared));
+	return result;
+}
+
+void BuildLodChain(const std::vector<glm::vec3>& positions, const std::vector<float>& attributes, uint32_t attributeCount, std::vector<UINT>& indices, std::vector<MeshLod>& lods, const MeshLodOptions& options) {
+	lods.clear();
+	MeshLod base;
+	base.indexCount = static_cast<uint32_t>(indices.size());
+	lods.push_back(base);
+
+	glm::vec3 minPos;
+	float extent = GetMeshExtent(positions, minPos);
+	std::vector<UINT> previous(indices);
+	for (uint32_t level = 1; level < options.maxLodCount; level++) {
+		uint32_t targetIndexCount = static_cast<uint32_t>(previous.size() / 3 * options.reduction) * 3;
+		float error = 0.0f;
+		std::vector<UINT> simplified = SimplifyMesh(previous, positions, attributes, attributeCount, targetIndexCount, options.maxError, error);
+		//误差上限内减少不到一成时结束
+		if (simplified.empty() || simplified.size() * 10 > previous.size() * 9)
+			break;
+
+		std::vector<uint32_t> clusters;
+		OptimizeVertexCache(simplified, static_cast<uint32_t>(positions.size()), clusters);
+
+		//每一级都由上一级简化而来，误差逐级累加
+		MeshLod lod;
+		lod.indexOffset = static_cast<uint32_t>(indices.size());
+		lod.indexCount = static_cast<uint32_t>(simplified.size());
+		lod.error = lods.back().error + error * extent;
+		lods.push_back(lod);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		previous.swap(simplified);
+	}
+}
+
+void MergeMeshLods(const std::vector<MeshLodPart>& parts, std::vector<UINT>& indices, std::vector<MeshLod>& lods) {
+	indices.clear();
+	lods.clear();
+
+	size_t levelCount = 1;
+	for (auto& part : parts)
+		levelCount = std::max(levelCount, part.lods->size());
+
+	for (size_t level = 0; level < levelCount; level++) {
+		MeshLod lod;
+		lod.indexOffset = static_cast<uint32_t>(indices.size());
+		for (auto& part : parts) {
+			//没有LOD的部分每一级都绘制全部索引，级数较少的部分使用它最粗的一级
+			MeshLod range;
+			range.indexCount = static_cast<uint32_t>(part.indices->size());
+			if (!part.lods->empty())
+				range = (*part.lods)[std::min(level, part.lods->size() - 1)];
+
+			for (uint32_t i = 0; i < range.indexCount; i++)
+				indices.push_back((*part.indices)[range.indexOffset + i] + part.vertexOffset);
+			lod.error = std::max(lod.error, range.error);
+		}
+		lod.indexCount = static_cast<uint32_t>(indices.size()) - lod.indexOffset;
+		lods.push_back(lod);
+	}
+}
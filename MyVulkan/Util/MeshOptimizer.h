@@ -0,0 +1,115 @@
+#pragma once
+#include "vkUtil.h"
+
+#include <cstddef>
+#include <vector>
+
+/*Offline mesh optimization applied when a model is imported, before it is baked*/
+struct MeshOptimizeStats {
+	uint32_t triangleCount = 0;
+	uint32_t vertexCountBefore = 0;
+	uint32_t vertexCountAfter = 0;
+	//Transformed vertices per triangle
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+
+	//Sum of several meshes, ACMR is weighted by triangle count
+	void Add(const MeshOptimizeStats& other);
+};
+
+//Average cache miss ratio of the index order with a FIFO post-transform cache
+float ComputeACMR(const std::vector<UINT>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+//Merge bitwise identical vertices, the unique ones are compacted to the front and the new count is returned
+uint32_t WeldVertices(void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<UINT>& indices);
+
+//Tipsify triangle order for vertex cache locality, clusters receives the first triangle of every cluster
+void OptimizeVertexCache(std::vector<UINT>& indices, uint32_t vertexCount, std::vector<uint32_t>& clusters, uint32_t cacheSize = 16);
+
+//Reorder whole clusters so the ones facing away from the mesh center are drawn first, triangle order inside a cluster is kept
+//Indices must be below vertexCount, otherwise the order is left unchanged
+void OptimizeOverdraw(std::vector<UINT>& indices, const std::vector<uint32_t>& clusters, const void* positions, uint32_t vertexCount, uint32_t stride);
+
+//Reorder vertices by first use in the index buffer, unused vertices are dropped and the new count is returned
+uint32_t OptimizeVertexFetch(void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<UINT>& indices);
+
+//One level of detail inside a mesh's index list, every level shares the mesh's vertices
+struct MeshLod {
+	uint32_t indexOffset = 0;
+	uint32_t indexCount = 0;
+	//Surface deviation from LOD0 in model units
+	float error = 0.0f;
+	//Meshlets of this level, filled by BuildMeshlets
+	uint32_t meshletOffset = 0;
+	uint32_t meshletCount = 0;
+};
+
+struct MeshLodOptions {
+	//Including LOD0
+	uint32_t maxLodCount = 4;
+	//Triangle ratio of each level to the previous one
+	float reduction = 0.5f;
+	//Error allowed per simplification step, relative to the mesh extent
+	float maxError = 0.02f;
+	float normalWeight = 0.5f;
+	float texCoordWeight = 1.0f;
+};
+
+//Quadric error edge collapse onto existing vertices, with attribute quadrics for attributeCount floats per vertex (already scaled by their weights).
+//Border vertices and corners where seams meet stay in place, vertices on a UV or hard normal seam only collapse along it together with their copy.
+//Collapses are ordered and capped by position plus attribute error, resultError receives only the surface deviation relative to the mesh extent
+std::vector<UINT> SimplifyMesh(const std::vector<UINT>& indices, const std::vector<glm::vec3>& positions, const std::vector<float>& attributes, uint32_t attributeCount,
+	uint32_t targetIndexCount, float targetError, float& resultError);
+
+//Append simplified levels after LOD0 in indices, each one made from the previous level. The chain ends early when a step cannot remove enough triangles within maxError
+void BuildLodChain(const std::vector<glm::vec3>& positions, const std::vector<float>& attributes, uint32_t attributeCount, std::vector<UINT>& indices, std::vector<MeshLod>& lods, const MeshLodOptions& options);
+
+//Meshes merged into one vertex buffer, level i of the result draws level i of every part (or its coarsest one)
+struct MeshLodPart {
+	const std::vector<UINT>* indices;
+	const std::vector<MeshLod>* lods;
+	UINT vertexOffset;
+};
+void MergeMeshLods(const std::vector<MeshLodPart>& parts, std::vector<UINT>& indices, std::vector<MeshLod>& lods);
+
+//T must have position, normal and texCoord members
+template<typename T>
+void GenerateMeshLods(const std::vector<T>& vertices, std::vector<UINT>& indices, std::vector<MeshLod>& lods, const MeshLodOptions& options = MeshLodOptions()) {
+	const uint32_t attributeCount = 5;
+	std::vector<glm::vec3> positions(vertices.size());
+	std::vector<float> attributes(vertices.size() * attributeCount);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		positions[i] = vertices[i].position;
+		float* attribute = &attributes[i * attributeCount];
+		attribute[0] = vertices[i].normal.x * options.normalWeight;
+		attribute[1] = vertices[i].normal.y * options.normalWeight;
+		attribute[2] = vertices[i].normal.z * options.normalWeight;
+		attribute[3] = vertices[i].texCoord.x * options.texCoordWeight;
+		attribute[4] = vertices[i].texCoord.y * options.texCoordWeight;
+	}
+	BuildLodChain(positions, attributes, attributeCount, indices, lods, options);
+}
+
+//Weld, cache, overdraw and fetch passes in order, T must have a glm::vec3 position member
+template<typename T>
+MeshOptimizeStats OptimizeMesh(std::vector<T>& vertices, std::vector<UINT>& indices, uint32_t cacheSize = 16) {
+	MeshOptimizeStats stats;
+	stats.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	stats.vertexCountBefore = static_cast<uint32_t>(vertices.size());
+	stats.acmrBefore = ComputeACMR(indices, stats.vertexCountBefore, cacheSize);
+
+	uint32_t stride = static_cast<uint32_t>(sizeof(T));
+	vertices.resize(WeldVertices(vertices.data(), static_cast<uint32_t>(vertices.size()), stride, indices));
+
+	std::vector<uint32_t> clusters;
+	OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()), clusters, cacheSize);
+	if (!vertices.empty()) {
+		const uint8_t* positions = reinterpret_cast<const uint8_t*>(vertices.data()) + offsetof(T, position);
+		OptimizeOverdraw(indices, clusters, positions, static_cast<uint32_t>(vertices.size()), stride);
+	}
+	vertices.resize(OptimizeVertexFetch(vertices.data(), static_cast<uint32_t>(vertices.size()), stride, indices));
+
+	stats.vertexCountAfter = static_cast<uint32_t>(vertices.size());
+	stats.acmrAfter = ComputeACMR(indices, stats.vertexCountAfter, cacheSize);
+	return stats;
+}
@@ -0,0 +1,230 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+//一个簇的包围球与法线锥
+static void ComputeMeshletBounds(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<UINT>& indices, Meshlet& meshlet) {
+	glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+	for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+		const glm::vec3& position = positions[indices[meshlet.indexOffset + i]];
+		minPos = glm::min(minPos, position);
+		maxPos = glm::max(maxPos, position);
+	}
+	meshlet.center = (minPos + maxPos) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet.indexCount; i++)
+		meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[meshlet.indexOffset + i]] - meshlet.center));
+
+	//三角形法线按顶点法线定向，不依赖绕序
+	std::vector<glm::vec3> triangleNormals;
+	triangleNormals.reserve(meshlet.indexCount / 3);
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+		UINT i0 = indices[meshlet.indexOffset + i], i1 = indices[meshlet.indexOffset + i + 1], i2 = indices[meshlet.indexOffset + i + 2];
+		glm::vec3 normal = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+			continue;
+		normal /= length;
+		if (glm::dot(normal, normals[i0] + normals[i1] + normals[i2]) < 0.0f)
+			normal = -normal;
+
+		triangleNormals.push_back(normal);
+		axis += normal;
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f);
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length(axis);
+	if (triangleNormals.empty() || axisLength <= 0.0f)
+		return;
+	axis /= axisLength;
+
+	//法线散开接近半球时锥测试几乎不可能成立，直接关闭
+	float minDot = 1.0f;
+	for (auto& normal : triangleNormals)
+		minDot = std::min(minDot, glm::dot(normal, axis));
+	if (minDot <= 0.1f)
+		return;
+
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<UINT>& indices,
+	std::vector<MeshLod>& lods, std::vector<Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles) {
+	meshlets.clear();
+
+	//顶点最近一次加入的簇的编号，用来统计簇内的顶点数
+	std::vector<uint32_t> meshletStamp(positions.size(), 0);
+	uint32_t stamp = 0;
+	auto countNewVertices = [&](const UINT* triangle) {
+		uint32_t count = 0;
+		for (uint32_t j = 0; j < 3; j++) {
+			bool repeated = (j > 0 && triangle[j] == triangle[0]) || (j > 1 && triangle[j] == triangle[1]);
+			if (!repeated && meshletStamp[triangle[j]] != stamp)
+				count++;
+		}
+		return count;
+	};
+
+	auto buildRange = [&](uint32_t indexOffset, uint32_t indexCount, uint32_t& meshletOffset, uint32_t& meshletCount) {
+		meshletOffset = static_cast<uint32_t>(meshlets.size());
+
+		//按索引顺序贪心装入，索引已按顶点缓存优化，相邻三角形在空间上也相邻
+		Meshlet meshlet;
+		uint32_t vertexCount = 0;
+		auto finish = [&]() {
+			if (meshlet.indexCount == 0)
+				return;
+			ComputeMeshletBounds(positions, normals, indices, meshlet);
+			meshlets.push_back(meshlet);
+		};
+		meshlet.indexOffset = indexOffset;
+		stamp++;
+		for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+			const UINT* triangle = &indices[indexOffset + i];
+			uint32_t newVertices = countNewVertices(triangle);
+
+			if (vertexCount + newVertices > maxVertices || meshlet.indexCount / 3 + 1 > maxTriangles) {
+				finish();
+				meshlet = Meshlet();
+				meshlet.indexOffset = indexOffset + i;
+				vertexCount = 0;
+				stamp++;
+				newVertices = countNewVertices(triangle);
+			}
+
+			for (uint32_t j = 0; j < 3; j++)
+				meshletStamp[triangle[j]] = stamp;
+			vertexCount += newVertices;
+			meshlet.indexCount += 3;
+		}
+		finish();
+
+		meshletCount = static_cast<uint32_t>(meshlets.size()) - meshletOffset;
+	};
+
+	if (lods.empty()) {
+		uint32_t meshletOffset, meshletCount;
+		buildRange(0, static_cast<uint32_t>(indices.size()), meshletOffset, meshletCount);
+		return;
+	}
+	for (auto& lod : lods)
+		buildRange(lod.indexOffset, lod.indexCount, lod.meshletOffset, lod.meshletCount);
+}
+
+void MeshletCullData::Build(const std::vector<Meshlet>& meshlets) {
+	//末尾补3个，从任意位置开始读4个都不越界，补齐的部分半径为负，任何平面测试都不通过
+	size_t count = meshlets.size() + 3;
+	centerX.assign(count, 0.0f);
+	centerY.assign(count, 0.0f);
+	centerZ.assign(count, 0.0f);
+	radius.assign(count, -FLT_MAX);
+	axisX.assign(count, 0.0f);
+	axisY.assign(count, 0.0f);
+	axisZ.assign(count, 0.0f);
+	cutoff.assign(count, 1.0f);
+
+	for (size_t i = 0; i < meshlets.size(); i++) {
+		centerX[i] = meshlets[i].center.x;
+		centerY[i] = meshlets[i].center.y;
+		centerZ[i] = meshlets[i].center.z;
+		radius[i] = meshlets[i].radius;
+		axisX[i] = meshlets[i].coneAxis.x;
+		axisY[i] = meshlets[i].coneAxis.y;
+		axisZ[i] = meshlets[i].coneAxis.z;
+		cutoff[i] = meshlets[i].coneCutoff;
+	}
+}
+
+void ExtractFrustumPlanes(const glm::mat4x4& viewProj, glm::vec4 planes[6]) {
+	//列主序，第i行为(m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	//近平面按-w <= z取，深度范围为[0, 1]时也是保守的
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+MeshletCullView MakeMeshletCullView(const glm::vec4 worldPlanes[6], const glm::vec3& eye, const glm::mat4x4& world, bool coneCulling) {
+	MeshletCullView view;
+
+	//dot(plane, world * p) = dot(transpose(world) * plane, p)，变换后的平面仍给出世界空间的距离
+	glm::mat4x4 transposed = glm::transpose(world);
+	for (int i = 0; i < 6; i++)
+		view.planes[i] = transposed * worldPlanes[i];
+
+	glm::vec3 scale(glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])));
+	float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+	float minScale = std::min(scale.x, std::min(scale.y, scale.z));
+	view.radiusScale = maxScale;
+	view.eye = glm::vec3(glm::inverse(world) * glm::vec4(eye, 1.0f));
+
+	//非均匀缩放会改变法线方向，镜像会翻转朝向，两种情况都不做锥测试
+	float determinant = glm::determinant(glm::mat3(world));
+	view.coneCulling = coneCulling && determinant > 0.0f && maxScale - minScale <= maxScale * 1e-3f;
+	return view;
+}
+
+uint32_t CullMeshlets(const MeshletCullData& data, uint32_t first, uint32_t count, const MeshletCullView& view, uint8_t* visible) {
+	uint32_t visibleCount = 0;
+	const __m128 radiusScale = _mm_set1_ps(view.radiusScale);
+	const __m128 eyeX = _mm_set1_ps(view.eye.x);
+	const __m128 eyeY = _mm_set1_ps(view.eye.y);
+	const __m128 eyeZ = _mm_set1_ps(view.eye.z);
+	const __m128 zero = _mm_setzero_ps();
+
+	//每次测试4个簇，起点不必对齐，末尾越界的部分读到的是补齐数据或其他LOD的簇，结果丢弃
+	for (uint32_t i = 0; i < count; i += 4) {
+		uint32_t index = first + i;
+		__m128 cx = _mm_loadu_ps(&data.centerX[index]);
+		__m128 cy = _mm_loadu_ps(&data.centerY[index]);
+		__m128 cz = _mm_loadu_ps(&data.centerZ[index]);
+		__m128 r = _mm_loadu_ps(&data.radius[index]);
+
+		//包围球完全在任一平面外侧时剔除
+		__m128 negRadius = _mm_sub_ps(zero, _mm_mul_ps(r, radiusScale));
+		__m128 inside = _mm_cmpge_ps(r, zero);
+		for (int j = 0; j < 6; j++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(view.planes[j].x)), _mm_mul_ps(cy, _mm_set1_ps(view.planes[j].y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(view.planes[j].z)), _mm_set1_ps(view.planes[j].w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+
+		//dot(c - eye, axis) >= cutoff * |c - eye| + r 时簇内所有三角形背向相机
+		if (view.coneCulling) {
+			__m128 dx = _mm_sub_ps(cx, eyeX);
+			__m128 dy = _mm_sub_ps(cy, eyeY);
+			__m128 dz = _mm_sub_ps(cz, eyeZ);
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&data.axisX[index])), _mm_mul_ps(dy, _mm_loadu_ps(&data.axisY[index]))),
+				_mm_mul_ps(dz, _mm_loadu_ps(&data.axisZ[index])));
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 threshold = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&data.cutoff[index]), length), r);
+			inside = _mm_andnot_ps(_mm_cmpge_ps(along, threshold), inside);
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		uint32_t lanes = std::min(4u, count - i);
+		for (uint32_t j = 0; j < lanes; j++) {
+			visible[i + j] = (mask >> j) & 1;
+			visibleCount += visible[i + j];
+		}
+	}
+	return visibleCount;
+}
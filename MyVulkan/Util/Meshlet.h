@@ -0,0 +1,63 @@
+#pragma once
+#include "MeshOptimizer.h"
+
+/*Small clusters of a mesh's triangles with bounds for per-cluster culling on the CPU, drawn as index ranges without mesh shaders*/
+struct Meshlet {
+	//Range in the mesh's index list, the triangles of a meshlet are contiguous
+	uint32_t indexOffset = 0;
+	uint32_t indexCount = 0;
+
+	//Bounding sphere in model space
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	//Every triangle faces away from a viewer for which dot(normalize(center - eye), coneAxis) >= coneCutoff (padded by radius), 1 disables the test
+	glm::vec3 coneAxis = glm::vec3(0.0f);
+	float coneCutoff = 1.0f;
+};
+
+//Split every LOD range into meshlets in index order, filling meshletOffset and meshletCount of each level. Without lods the whole index list is split.
+//Cone normals follow the vertex normals, so a mesh with inconsistent winding still gets correct cones
+void BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<UINT>& indices,
+	std::vector<MeshLod>& lods, std::vector<Meshlet>& meshlets, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+//T must have position and normal members
+template<typename T>
+void BuildMeshlets(const std::vector<T>& vertices, const std::vector<UINT>& indices, std::vector<MeshLod>& lods, std::vector<Meshlet>& meshlets,
+	uint32_t maxVertices = 64, uint32_t maxTriangles = 124) {
+	std::vector<glm::vec3> positions(vertices.size());
+	std::vector<glm::vec3> normals(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		positions[i] = vertices[i].position;
+		normals[i] = vertices[i].normal;
+	}
+	BuildMeshlets(positions, normals, indices, lods, meshlets, maxVertices, maxTriangles);
+}
+
+//Meshlet bounds in structure of arrays, padded so 4 of them can be loaded from any start
+struct MeshletCullData {
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> axisX, axisY, axisZ, cutoff;
+
+	void Build(const std::vector<Meshlet>& meshlets);
+};
+
+//View of one mesh in its model space
+struct MeshletCullView {
+	//Frustum planes, dot(plane.xyz, p) + plane.w is the distance in world units, positive inside
+	glm::vec4 planes[6];
+	glm::vec3 eye;
+	//World radius of a model space radius
+	float radiusScale = 1.0f;
+	//Cones are only valid without non-uniform scale or mirroring
+	bool coneCulling = true;
+};
+
+//Build the view from world space frustum planes (normalized) and eye, and the object's world matrix
+MeshletCullView MakeMeshletCullView(const glm::vec4 worldPlanes[6], const glm::vec3& eye, const glm::mat4x4& world, bool coneCulling);
+
+//Normalized frustum planes of a view projection matrix
+void ExtractFrustumPlanes(const glm::mat4x4& viewProj, glm::vec4 planes[6]);
+
+//Test meshlets [first, first + count), visible receives one flag per meshlet. Returns the number of visible meshlets
+uint32_t CullMeshlets(const MeshletCullData& data, uint32_t first, uint32_t count, const MeshletCullView& view, uint8_t* visible);
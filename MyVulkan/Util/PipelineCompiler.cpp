@@ -0,0 +1,170 @@
+#include "PipelineCompiler.h"
+
+PipelineCompiler::~PipelineCompiler() {
+	//等待后台编译结束后再销毁线程
+	threadPool.Wait();
+	threadPool.threads.clear();
+
+	//尚未发布的管线不属于任何人，直接销毁
+	for (auto& job : runningJobs) {
+		if (job->result)
+			device.destroyPipeline(job->result);
+	}
+	runningJobs.clear();
+}
+
+void PipelineCompiler::Init(vk::Device device, vk::PipelineCache pipelineCache, uint32_t threadCount) {
+	this->device = device;
+	this->pipelineCache = pipelineCache;
+
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	threadPool.SetThreadCount(threadCount);
+}
+
+void PipelineCompiler::Add(const vk::GraphicsPipelineCreateInfo& pipelineInfo, vk::Pipeline* target) {
+	auto job = std::make_unique<PipelineJob>();
+	job->pipelineInfo = pipelineInfo;
+	job->target = target;
+
+	//着色器阶段以及特化常量
+	job->stages.assign(pipelineInfo.pStages, pipelineInfo.pStages + pipelineInfo.stageCount);
+	job->entryNames.resize(job->stages.size());
+	job->specInfos.resize(job->stages.size());
+	job->specEntries.resize(job->stages.size());
+	job->specData.resize(job->stages.size());
+	for (size_t i = 0; i < job->stages.size(); i++) {
+		auto& stage = job->stages[i];
+		job->entryNames[i] = stage.pName;
+		stage.pName = job->entryNames[i].c_str();
+
+		if (stage.pSpecializationInfo) {
+			const vk::SpecializationInfo& specInfo = *stage.pSpecializationInfo;
+			job->specEntries[i].assign(specInfo.pMapEntries, specInfo.pMapEntries + specInfo.mapEntryCount);
+			job->specData[i].assign(static_cast<const uint8_t*>(specInfo.pData), static_cast<const uint8_t*>(specInfo.pData) + specInfo.dataSize);
+			job->specInfos[i] = vk::SpecializationInfo()
+				.setMapEntryCount(job->specEntries[i].size())
+				.setPMapEntries(job->specEntries[i].data())
+				.setDataSize(job->specData[i].size())
+				.setPData(job->specData[i].data());
+			stage.pSpecializationInfo = &job->specInfos[i];
+		}
+	}
+	job->pipelineInfo.setStageCount(job->stages.size());
+	job->pipelineInfo.setPStages(job->stages.data());
+
+	//顶点输入
+	const vk::PipelineVertexInputStateCreateInfo& vi = *pipelineInfo.pVertexInputState;
+	job->bindings.assign(vi.pVertexBindingDescriptions, vi.pVertexBindingDescriptions + vi.vertexBindingDescriptionCount);
+	job->attributes.assign(vi.pVertexAttributeDescriptions, vi.pVertexAttributeDescriptions + vi.vertexAttributeDescriptionCount);
+	job->vi = vi;
+	job->vi.setPVertexBindingDescriptions(job->bindings.data());
+	job->vi.setPVertexAttributeDescriptions(job->attributes.data());
+	job->pipelineInfo.setPVertexInputState(&job->vi);
+
+	job->ia = *pipelineInfo.pInputAssemblyState;
+	job->pipelineInfo.setPInputAssemblyState(&job->ia);
+
+	job->rs = *pipelineInfo.pRasterizationState;
+	job->pipelineInfo.setPRasterizationState(&job->rs);
+
+	//颜色混合
+	if (pipelineInfo.pColorBlendState) {
+		const vk::PipelineColorBlendStateCreateInfo& cb = *pipelineInfo.pColorBlendState;
+		job->blendAttachments.assign(cb.pAttachments, cb.pAttachments + cb.attachmentCount);
+		job->cb = cb;
+		job->cb.setPAttachments(job->blendAttachments.data());
+		job->pipelineInfo.setPColorBlendState(&job->cb);
+	}
+
+	//视口
+	if (pipelineInfo.pViewportState) {
+		const vk::PipelineViewportStateCreateInfo& vp = *pipelineInfo.pViewportState;
+		if (vp.pViewports)
+			job->viewports.assign(vp.pViewports, vp.pViewports + vp.viewportCount);
+		if (vp.pScissors)
+			job->scissors.assign(vp.pScissors, vp.pScissors + vp.scissorCount);
+		job->vp = vp;
+		job->vp.setPViewports(vp.pViewports ? job->viewports.data() : nullptr);
+		job->vp.setPScissors(vp.pScissors ? job->scissors.data() : nullptr);
+		job->pipelineInfo.setPViewportState(&job->vp);
+	}
+
+	if (pipelineInfo.pDepthStencilState) {
+		job->ds = *pipelineInfo.pDepthStencilState;
+		job->pipelineInfo.setPDepthStencilState(&job->ds);
+	}
+
+	if (pipelineInfo.pMultisampleState) {
+		const vk::PipelineMultisampleStateCreateInfo& ms = *pipelineInfo.pMultisampleState;
+		job->ms = ms;
+		if (ms.pSampleMask) {
+			job->sampleMask.assign(ms.pSampleMask, ms.pSampleMask + ((uint32_t)ms.rasterizationSamples + 31) / 32);
+			job->ms.setPSampleMask(job->sampleMask.data());
+		}
+		job->pipelineInfo.setPMultisampleState(&job->ms);
+	}
+
+	if (pipelineInfo.pDynamicState) {
+		const vk::PipelineDynamicStateCreateInfo& dynamic = *pipelineInfo.pDynamicState;
+		job->dynamicStates.assign(dynamic.pDynamicStates, dynamic.pDynamicStates + dynamic.dynamicStateCount);
+		job->dynamic = dynamic;
+		job->dynamic.setPDynamicStates(job->dynamicStates.data());
+		job->pipelineInfo.setPDynamicState(&job->dynamic);
+	}
+
+	*target = vk::Pipeline();
+	queuedJobs.push_back(std::move(job));
+	pendingCount++;
+}
+
+void PipelineCompiler::Submit() {
+	//按轮询的方式把管线分配到各个工作线程
+	size_t threadIndex = 0;
+	for (auto& job : queuedJobs) {
+		PipelineJob* pJob = job.get();
+		vk::Device device = this->device;
+		vk::PipelineCache pipelineCache = this->pipelineCache;
+
+		threadPool.threads[threadIndex]->AddJob([pJob, device, pipelineCache]() {
+			if (device.createGraphicsPipelines(pipelineCache, 1, &pJob->pipelineInfo, 0, &pJob->result) != vk::Result::eSuccess) {
+				MessageBox(0, L"Create graphics pipeline failed!!!", 0, 0);
+			}
+			pJob->finished = true;
+		});
+
+		threadIndex = (threadIndex + 1) % threadPool.threads.size();
+		runningJobs.push_back(std::move(job));
+	}
+	queuedJobs.clear();
+}
+
+void PipelineCompiler::Compile() {
+	Submit();
+	threadPool.Wait();
+	Update();
+}
+
+void PipelineCompiler::CompileAsync() {
+	Submit();
+}
+
+bool PipelineCompiler::Update() {
+	bool published = false;
+
+	for (size_t i = 0; i < runningJobs.size();) {
+		if (runningJobs[i]->finished) {
+			*runningJobs[i]->target = runningJobs[i]->result;
+			runningJobs[i] = std::move(runningJobs.back());
+			runningJobs.pop_back();
+			pendingCount--;
+			published = true;
+		}
+		else
+			i++;
+	}
+
+	return published;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "vkUtil.h"
+#include "../core/Thread.h"
+
+#include <atomic>
+
+/*Collects graphics pipeline descriptions and compiles them on worker threads*/
+class PipelineCompiler {
+public:
+	~PipelineCompiler();
+
+	void Init(vk::Device device, vk::PipelineCache pipelineCache, uint32_t threadCount = 0);
+
+	//Copies every state the create info points to, so the caller's locals may go out of scope
+	void Add(const vk::GraphicsPipelineCreateInfo& pipelineInfo, vk::Pipeline* target);
+
+	//Compile all queued pipelines in parallel and wait for them
+	void Compile();
+
+	//Start compiling the queued pipelines without waiting, targets stay null until Update() publishes them
+	void CompileAsync();
+
+	//Publish finished asynchronous pipelines, returns true if any target changed
+	bool Update();
+
+	uint32_t GetPendingCount()const { return pendingCount; }
+
+private:
+	struct PipelineJob {
+		vk::GraphicsPipelineCreateInfo pipelineInfo;
+
+		std::vector<vk::PipelineShaderStageCreateInfo> stages;
+		std::vector<std::string> entryNames;
+		std::vector<vk::SpecializationInfo> specInfos;
+		std::vector<std::vector<vk::SpecializationMapEntry>> specEntries;
+		std::vector<std::vector<uint8_t>> specData;
+
+		std::vector<vk::VertexInputBindingDescription> bindings;
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+		vk::PipelineVertexInputStateCreateInfo vi;
+		vk::PipelineInputAssemblyStateCreateInfo ia;
+		vk::PipelineRasterizationStateCreateInfo rs;
+		std::vector<vk::PipelineColorBlendAttachmentState> blendAttachments;
+		vk::PipelineColorBlendStateCreateInfo cb;
+		std::vector<vk::Viewport> viewports;
+		std::vector<vk::Rect2D> scissors;
+		vk::PipelineViewportStateCreateInfo vp;
+		vk::PipelineDepthStencilStateCreateInfo ds;
+		std::vector<vk::SampleMask> sampleMask;
+		vk::PipelineMultisampleStateCreateInfo ms;
+		std::vector<vk::DynamicState> dynamicStates;
+		vk::PipelineDynamicStateCreateInfo dynamic;
+
+		vk::Pipeline* target = nullptr;
+		vk::Pipeline result;
+		std::atomic<bool> finished{ false };
+	};
+
+	void Submit();
+
+	vk::Device device;
+	vk::PipelineCache pipelineCache;
+
+	ThreadPool threadPool;
+
+	std::vector<std::unique_ptr<PipelineJob>> queuedJobs;
+	std::vector<std::unique_ptr<PipelineJob>> runningJobs;
+
+	uint32_t pendingCount = 0;
+};
@@ -0,0 +1,235 @@
+#include "ShaderLibrary.h"
+
+#include <filesystem>
+#include <algorithm>
+
+/*文件布局: Header | Entry[entryCount] | 按16字节对齐的SPIR-V数据*/
+struct ShaderLibraryHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct ShaderLibraryEntry {
+	char name[48];
+	uint64_t offset;
+	uint64_t size;
+	uint64_t hash;
+};
+
+static const uint32_t shaderLibraryMagic = 0x4B415053; //"SPAK"
+static const uint32_t shaderLibraryVersion = 1;
+static const uint64_t shaderCodeAlignment = 16;
+static const uint32_t spirvMagic = 0x07230203;
+
+//库中的条目与目录中的.spv一一对应(按名字排序)，删除或新增的着色器不会改变修改时间
+static bool MatchesShaderFiles(const std::string& path, const std::vector<std::filesystem::path>& shaderFiles) {
+	std::ifstream loadFile(path, std::ios::binary);
+	ShaderLibraryHeader header = {};
+	if (!loadFile.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (header.magic != shaderLibraryMagic || header.version != shaderLibraryVersion || header.entryCount != shaderFiles.size())
+		return false;
+
+	std::vector<ShaderLibraryEntry> toc(header.entryCount);
+	if (!loadFile.read(reinterpret_cast<char*>(toc.data()), sizeof(ShaderLibraryEntry) * toc.size()))
+		return false;
+	for (size_t i = 0; i < toc.size(); i++) {
+		if (std::string(toc[i].name, strnlen(toc[i].name, sizeof(toc[i].name))) != shaderFiles[i].stem().string())
+			return false;
+	}
+	return true;
+}
+
+ShaderLibrary::~ShaderLibrary() {
+	Destroy();
+}
+
+bool ShaderLibrary::Pack(const std::string& directory, const std::string& path) {
+	namespace fs = std::filesystem;
+
+	std::error_code error;
+	std::vector<fs::path> shaderFiles;
+	for (auto& file : fs::directory_iterator(directory, error)) {
+		if (file.path().extension() == ".spv")
+			shaderFiles.push_back(file.path());
+	}
+	if (error || shaderFiles.empty())
+		return fs::exists(path);
+	std::sort(shaderFiles.begin(), shaderFiles.end());
+
+	//库文件比所有.spv都新，并且条目与.spv的列表相同时不需要重新打包
+	if (fs::exists(path) && MatchesShaderFiles(path, shaderFiles)) {
+		auto libraryTime = fs::last_write_time(path, error);
+		bool upToDate = !error;
+		for (auto& shaderFile : shaderFiles) {
+			if (fs::last_write_time(shaderFile, error) > libraryTime)
+				upToDate = false;
+		}
+		if (upToDate)
+			return true;
+	}
+
+	std::vector<ShaderLibraryEntry> toc(shaderFiles.size());
+	std::vector<std::vector<char>> codes(shaderFiles.size());
+
+	uint64_t offset = sizeof(ShaderLibraryHeader) + sizeof(ShaderLibraryEntry) * toc.size();
+	for (size_t i = 0; i < shaderFiles.size(); i++) {
+		std::string name = shaderFiles[i].stem().string();
+		if (name.size() >= sizeof(toc[i].name)) {
+			MessageBox(0, L"Shader name is too long!!!", 0, 0);
+			return false;
+		}
+
+		std::ifstream loadFile(shaderFiles[i], std::ios::ate | std::ios::binary);
+		if (!loadFile.is_open()) {
+			MessageBox(0, L"Cannot open the shader file!!!", 0, 0);
+			return false;
+		}
+		codes[i].resize((size_t)loadFile.tellg());
+		loadFile.seekg(0);
+		loadFile.read(codes[i].data(), codes[i].size());
+
+		offset = (offset + shaderCodeAlignment - 1) & ~(shaderCodeAlignment - 1);
+
+		memset(toc[i].name, 0, sizeof(toc[i].name));
+		memcpy(toc[i].name, name.c_str(), name.size());
+		toc[i].offset = offset;
+		toc[i].size = codes[i].size();
+		toc[i].hash = HashBytes(codes[i].data(), codes[i].size());
+
+		offset += codes[i].size();
+	}
+
+	ShaderLibraryHeader header = {};
+	header.magic = shaderLibraryMagic;
+	header.version = shaderLibraryVersion;
+	header.entryCount = (uint32_t)toc.size();
+
+	//与管线缓存相同，写临时文件后替换
+	std::string tempPath = path + ".tmp";
+	std::ofstream saveFile(tempPath, std::ios::binary | std::ios::trunc);
+	if (!saveFile.is_open())
+		return false;
+	saveFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	saveFile.write(reinterpret_cast<const char*>(toc.data()), sizeof(ShaderLibraryEntry) * toc.size());
+	for (size_t i = 0; i < toc.size(); i++) {
+		static const char padding[shaderCodeAlignment] = {};
+		saveFile.write(padding, toc[i].offset - (uint64_t)saveFile.tellp());
+		saveFile.write(codes[i].data(), codes[i].size());
+	}
+	saveFile.close();
+	if (saveFile.fail()) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool ShaderLibrary::Open(vk::Device device, const std::string& path) {
+	Destroy();
+	this->device = device;
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		MessageBox(0, L"Cannot open the shader library!!!", 0, 0);
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		mappedData = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mappedData || (uint64_t)fileSize.QuadPart < sizeof(ShaderLibraryHeader)) {
+		MessageBox(0, L"Map the shader library failed!!!", 0, 0);
+		Destroy();
+		return false;
+	}
+
+	const ShaderLibraryHeader* header = reinterpret_cast<const ShaderLibraryHeader*>(mappedData);
+	uint64_t tocEnd = sizeof(ShaderLibraryHeader) + sizeof(ShaderLibraryEntry) * (uint64_t)header->entryCount;
+	if (header->magic != shaderLibraryMagic || header->version != shaderLibraryVersion || tocEnd > (uint64_t)fileSize.QuadPart) {
+		MessageBox(0, L"Invalid shader library!!!", 0, 0);
+		Destroy();
+		return false;
+	}
+
+	//映射的起始地址按页对齐，所以偏移对齐后即可直接作为uint32_t*交给Vulkan
+	const ShaderLibraryEntry* toc = reinterpret_cast<const ShaderLibraryEntry*>(mappedData + sizeof(ShaderLibraryHeader));
+	for (uint32_t i = 0; i < header->entryCount; i++) {
+		const ShaderLibraryEntry& entry = toc[i];
+		if (entry.offset % sizeof(uint32_t) != 0 || entry.size % sizeof(uint32_t) != 0 || entry.size < sizeof(uint32_t) ||
+			entry.offset + entry.size > (uint64_t)fileSize.QuadPart)
+			continue;
+
+		const uint32_t* code = reinterpret_cast<const uint32_t*>(mappedData + entry.offset);
+		if (code[0] != spirvMagic)
+			continue;
+
+		std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+		entries[name] = { code, (size_t)entry.size, entry.hash };
+	}
+
+	return true;
+}
+
+void ShaderLibrary::Destroy() {
+	for (auto& shaderModule : modules)
+		device.destroyShaderModule(shaderModule.second);
+	modules.clear();
+	entries.clear();
+
+	if (mappedData)
+		UnmapViewOfFile(mappedData);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	mappedData = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+
+bool ShaderLibrary::HasShaders(std::initializer_list<const char*> names)const {
+	for (const char* name : names) {
+		if (entries.find(name) == entries.end())
+			return false;
+	}
+	return true;
+}
+
+vk::ShaderModule ShaderLibrary::GetShaderModule(const std::string& name) {
+	auto entry = entries.find(name);
+	if (entry == entries.end()) {
+		MessageBox(0, L"Cannot find the shader in library!!!", 0, 0);
+		return vk::ShaderModule();
+	}
+
+	std::lock_guard<std::mutex> lock(moduleMutex);
+
+	auto cached = modules.find(entry->second.hash);
+	if (cached != modules.end())
+		return cached->second;
+
+	auto createInfo = vk::ShaderModuleCreateInfo()
+		.setCodeSize(entry->second.codeSize)
+		.setPCode(entry->second.code);
+
+	vk::ShaderModule shaderModule;
+	if (device.createShaderModule(&createInfo, 0, &shaderModule) != vk::Result::eSuccess) {
+		MessageBox(0, L"Create shader module failed!!!", 0, 0);
+		return vk::ShaderModule();
+	}
+
+	modules[entry->second.hash] = shaderModule;
+	return shaderModule;
+}
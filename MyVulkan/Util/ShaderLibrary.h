@@ -0,0 +1,42 @@
+#pragma once
+#include "vkUtil.h"
+
+#include <mutex>
+#include <initializer_list>
+
+/*All SPIR-V packed into one file with a table of contents, mapped once and shared by every pipeline*/
+class ShaderLibrary {
+public:
+	~ShaderLibrary();
+
+	//Pack every .spv under the directory into the library file, skipped when the library is newer than all of them
+	//and its entries name exactly the .spv files in the directory
+	static bool Pack(const std::string& directory, const std::string& path);
+
+	bool Open(vk::Device device, const std::string& path);
+	void Destroy();
+
+	//Modules are cached by content hash, stages shared between pipelines are only created once
+	vk::ShaderModule GetShaderModule(const std::string& name);
+	//Whether every named shader was packed, optional features check this before asking for their modules
+	bool HasShaders(std::initializer_list<const char*> names)const;
+
+	uint32_t GetModuleCount()const { return (uint32_t)modules.size(); }
+
+private:
+	struct Entry {
+		const uint32_t* code;
+		size_t codeSize;
+		uint64_t hash;
+	};
+
+	vk::Device device;
+
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	const BYTE* mappedData = nullptr;
+
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<uint64_t, vk::ShaderModule> modules;
+	std::mutex moduleMutex;
+};
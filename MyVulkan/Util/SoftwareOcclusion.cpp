@@ -0,0 +1,190 @@
+#include "SoftwareOcclusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+void SoftwareOcclusion::Resize(uint32_t width, uint32_t height) {
+	//按整块划分，每行的像素数也是4的倍数
+	tilesX = std::max((width + tileWidth - 1) / tileWidth, 1u);
+	tilesY = std::max((height + tileHeight - 1) / tileHeight, 1u);
+	this->width = tilesX * tileWidth;
+	this->height = tilesY * tileHeight;
+
+	depth.assign(this->width * this->height, FLT_MAX);
+	bins.resize(tilesX * tilesY);
+}
+
+void SoftwareOcclusion::Begin(const glm::mat4x4& viewProj) {
+	this->viewProj = viewProj;
+	std::fill(depth.begin(), depth.end(), FLT_MAX);
+	triangles.clear();
+	for (auto& bin : bins)
+		bin.clear();
+}
+
+void SoftwareOcclusion::AddOccluder(const void* positions, uint32_t vertexCount, uint32_t stride, const uint32_t* indices, uint32_t indexCount, const glm::mat4x4& world) {
+	if (bins.empty())
+		return;
+
+	//近平面之前的顶点w记为负，用到它的三角形整个丢弃
+	glm::mat4x4 transform = viewProj * world;
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(positions);
+	screenPositions.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(data + (size_t)i * stride);
+		glm::vec4 clip = transform * glm::vec4(position, 1.0f);
+		if (clip.w <= 0.0f || clip.z < 0.0f) {
+			screenPositions[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+			continue;
+		}
+		float invW = 1.0f / clip.w;
+		screenPositions[i] = glm::vec4((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height, clip.z * invW, clip.w);
+	}
+
+	for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+		glm::vec4 v[3] = { screenPositions[indices[i]], screenPositions[indices[i + 1]], screenPositions[indices[i + 2]] };
+		if (v[0].w < 0.0f || v[1].w < 0.0f || v[2].w < 0.0f)
+			continue;
+
+		//不剔除背面，统一转为逆时针使三条边函数在内部为正
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (std::fabs(area) < 1e-6f)
+			continue;
+		if (area < 0.0f) {
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+
+		Triangle triangle;
+		triangle.minX = std::max(static_cast<int32_t>(std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x)))), 0);
+		triangle.minY = std::max(static_cast<int32_t>(std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y)))), 0);
+		triangle.maxX = std::min(static_cast<int32_t>(std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x)))), static_cast<int32_t>(width) - 1);
+		triangle.maxY = std::min(static_cast<int32_t>(std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y)))), static_cast<int32_t>(height) - 1);
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		//第k条边为对面顶点k的边，除以面积后即为重心坐标，深度按重心坐标插值
+		float invArea = 1.0f / area;
+		triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			const glm::vec4& a = v[(k + 1) % 3];
+			const glm::vec4& b = v[(k + 2) % 3];
+			triangle.edgeA[k] = a.y - b.y;
+			triangle.edgeB[k] = b.x - a.x;
+			triangle.edgeC[k] = a.x * b.y - a.y * b.x;
+			//填充规则: 共用的边在两个三角形中方向相反，系数互为相反数，恰好归其中一个
+			triangle.inclusive[k] = triangle.edgeA[k] > 0.0f || (triangle.edgeA[k] == 0.0f && triangle.edgeB[k] > 0.0f);
+			triangle.depthA += triangle.edgeA[k] * invArea * v[k].z;
+			triangle.depthB += triangle.edgeB[k] * invArea * v[k].z;
+			triangle.depthC += triangle.edgeC[k] * invArea * v[k].z;
+		}
+
+		uint32_t index = static_cast<uint32_t>(triangles.size());
+		triangles.push_back(triangle);
+		for (uint32_t ty = triangle.minY / tileHeight; ty <= triangle.maxY / tileHeight; ty++) {
+			for (uint32_t tx = triangle.minX / tileWidth; tx <= triangle.maxX / tileWidth; tx++)
+				bins[ty * tilesX + tx].push_back(index);
+		}
+	}
+}
+
+void SoftwareOcclusion::RasterizeTiles(uint32_t first, uint32_t count) {
+	const __m128 laneOffset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 allLanes = _mm_cmpeq_ps(zero, zero);
+
+	uint32_t end = std::min(first + count, GetTileCount());
+	for (uint32_t tile = first; tile < end; tile++) {
+		int32_t tileX = static_cast<int32_t>((tile % tilesX) * tileWidth);
+		int32_t tileY = static_cast<int32_t>((tile / tilesX) * tileHeight);
+
+		for (uint32_t index : bins[tile]) {
+			const Triangle& triangle = triangles[index];
+			//每次处理一行中的4个像素，起点按4对齐，不会越出这一块
+			int32_t minX = std::max(triangle.minX, tileX) & ~3;
+			int32_t maxX = std::min(triangle.maxX, tileX + static_cast<int32_t>(tileWidth) - 1);
+			int32_t minY = std::max(triangle.minY, tileY);
+			int32_t maxY = std::min(triangle.maxY, tileY + static_cast<int32_t>(tileHeight) - 1);
+
+			__m128 edgeA[3], edgeB[3], edgeC[3], inclusive[3];
+			for (int k = 0; k < 3; k++) {
+				edgeA[k] = _mm_set1_ps(triangle.edgeA[k]);
+				edgeB[k] = _mm_set1_ps(triangle.edgeB[k]);
+				edgeC[k] = _mm_set1_ps(triangle.edgeC[k]);
+				inclusive[k] = triangle.inclusive[k] ? allLanes : zero;
+			}
+			auto insideEdge = [&](int k, __m128 px, __m128 py) {
+				__m128 edge = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[k], px), _mm_mul_ps(edgeB[k], py)), edgeC[k]);
+				return _mm_or_ps(_mm_cmpgt_ps(edge, zero), _mm_and_ps(_mm_cmpeq_ps(edge, zero), inclusive[k]));
+			};
+			__m128 depthA = _mm_set1_ps(triangle.depthA);
+			__m128 depthB = _mm_set1_ps(triangle.depthB);
+			__m128 depthC = _mm_set1_ps(triangle.depthC);
+
+			for (int32_t y = minY; y <= maxY; y++) {
+				__m128 py = _mm_set1_ps(y + 0.5f);
+				float* row = &depth[(size_t)y * width];
+				for (int32_t x = minX; x <= maxX; x += 4) {
+					__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffset);
+
+					//像素中心在三角形内才写入，恰好落在边上的按填充规则归属
+					__m128 inside = _mm_and_ps(_mm_and_ps(insideEdge(0, px, py), insideEdge(1, px, py)), insideEdge(2, px, py));
+					if (_mm_movemask_ps(inside) == 0)
+						continue;
+
+					__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(depthA, px), _mm_mul_ps(depthB, py)), depthC);
+					__m128 current = _mm_loadu_ps(row + x);
+					__m128 nearest = _mm_min_ps(current, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+				}
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax)const {
+	if (depth.empty())
+		return true;
+
+	//包围盒在屏幕上的矩形与最近的深度，跨过近平面时无法投影，按可见处理
+	glm::vec2 minPos(FLT_MAX), maxPos(-FLT_MAX);
+	float nearestDepth = FLT_MAX;
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+		if (clip.w <= 0.0f || clip.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		glm::vec2 pixel((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height);
+		minPos = glm::min(minPos, pixel);
+		maxPos = glm::max(maxPos, pixel);
+		nearestDepth = std::min(nearestDepth, clip.z * invW);
+	}
+
+	//完全在屏幕外的由视锥剔除处理
+	int32_t minX = std::max(static_cast<int32_t>(std::floor(minPos.x)), 0);
+	int32_t minY = std::max(static_cast<int32_t>(std::floor(minPos.y)), 0);
+	int32_t maxX = std::min(static_cast<int32_t>(std::floor(maxPos.x)), static_cast<int32_t>(width) - 1);
+	int32_t maxY = std::min(static_cast<int32_t>(std::floor(maxPos.y)), static_cast<int32_t>(height) - 1);
+	if (minX > maxX || minY > maxY)
+		return true;
+
+	//任一像素上的遮挡物不比包围盒近就可见
+	const __m128 nearest = _mm_set1_ps(nearestDepth);
+	for (int32_t y = minY; y <= maxY; y++) {
+		const float* row = &depth[(size_t)y * width];
+		for (int32_t x = minX & ~3; x <= maxX; x += 4) {
+			int lanes = 0xf;
+			if (x < minX)
+				lanes &= 0xf << (minX - x);
+			if (x + 3 > maxX)
+				lanes &= 0xf >> (x + 3 - maxX);
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)) & lanes)
+				return true;
+		}
+	}
+	return false;
+}
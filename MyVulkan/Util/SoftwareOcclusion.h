@@ -0,0 +1,60 @@
+#pragma once
+//Only depends on glm, so it builds and runs without a GPU
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/*Occlusion culling on the CPU: flagged occluders are rasterized into a small depth buffer, bounds are tested against it before drawing.
+  Triangles are binned to screen tiles first, tiles are independent and can be rasterized on different threads*/
+class SoftwareOcclusion {
+public:
+	static const uint32_t tileWidth = 32;
+	static const uint32_t tileHeight = 32;
+
+	//The size is rounded up to whole tiles
+	void Resize(uint32_t width, uint32_t height);
+	uint32_t GetWidth()const { return width; }
+	uint32_t GetHeight()const { return height; }
+	uint32_t GetTileCount()const { return tilesX * tilesY; }
+
+	//Clear the depth and the bins for a new view. Depth is clip.z / clip.w, smaller is nearer, clip.z < 0 is in front of the near plane
+	void Begin(const glm::mat4x4& viewProj);
+
+	//Transform and bin the triangles of an occluder, positions are model space with the given stride. Not thread safe.
+	//Triangles crossing the near plane are dropped, an occluder only ever hides less than it should
+	void AddOccluder(const void* positions, uint32_t vertexCount, uint32_t stride, const uint32_t* indices, uint32_t indexCount, const glm::mat4x4& world);
+
+	//Rasterize tiles [first, first + count), different ranges can run on different threads once every occluder is added
+	void RasterizeTiles(uint32_t first, uint32_t count);
+
+	//Test a world space box after rasterization, thread safe. False only when every covered pixel has an occluder in front of the box
+	bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax)const;
+
+	uint32_t GetBinnedTriangleCount()const { return static_cast<uint32_t>(triangles.size()); }
+	//Row major, width * height floats
+	const float* GetDepth()const { return depth.data(); }
+
+private:
+	//Edge functions are positive inside, depth is a plane in screen space.
+	//A pixel center exactly on an edge is inside only for inclusive edges, so an edge shared by two triangles is filled exactly once
+	struct Triangle {
+		float edgeA[3], edgeB[3], edgeC[3];
+		bool inclusive[3];
+		float depthA, depthB, depthC;
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t tilesX = 0;
+	uint32_t tilesY = 0;
+
+	glm::mat4x4 viewProj = glm::mat4x4(1.0f);
+	std::vector<float> depth;
+	std::vector<Triangle> triangles;
+	//Indices into triangles for every tile
+	std::vector<std::vector<uint32_t>> bins;
+	//Screen positions of the occluder being added, xy in pixels, z depth, w clip w
+	std::vector<glm::vec4> screenPositions;
+};
@@ -0,0 +1,274 @@
+#include "TextureCompressor.h"
+
+#include <cmath>
+
+/*BC7只使用mode 6: 单子集，RGBA端点7位加共享p位，16个4位索引*/
+static const uint32_t bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+	uint8_t* data;
+	uint32_t position = 0;
+
+	void Write(uint32_t value, uint32_t bitCount) {
+		for (uint32_t i = 0; i < bitCount; i++) {
+			if ((value >> i) & 1)
+				data[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+			position++;
+		}
+	}
+};
+
+static int Clamp(int value, int low, int high) {
+	return value < low ? low : (value > high ? high : value);
+}
+
+//读取一个4x4块，超出图片边缘的部分重复边缘像素
+static void FetchBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t pixels[16][4]) {
+	for (uint32_t y = 0; y < 4; y++) {
+		uint32_t sy = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+		for (uint32_t x = 0; x < 4; x++) {
+			uint32_t sx = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+			memcpy(pixels[y * 4 + x], rgba + ((uint64_t)sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+static void CompressBC4Block(const uint8_t values[16], uint8_t* block) {
+	uint8_t minValue = 255, maxValue = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (values[i] < minValue) minValue = values[i];
+		if (values[i] > maxValue) maxValue = values[i];
+	}
+
+	//e0 > e1时为8值插值模式
+	block[0] = maxValue;
+	block[1] = minValue;
+
+	uint64_t indices = 0;
+	if (maxValue != minValue) {
+		int palette[8];
+		palette[0] = maxValue;
+		palette[1] = minValue;
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * maxValue + i * minValue + 3) / 7;
+
+		for (uint32_t i = 0; i < 16; i++) {
+			uint32_t bestIndex = 0;
+			int bestError = 256;
+			for (uint32_t j = 0; j < 8; j++) {
+				int error = abs(palette[j] - values[i]);
+				if (error < bestError) {
+					bestError = error;
+					bestIndex = j;
+				}
+			}
+			indices |= (uint64_t)bestIndex << (3 * i);
+		}
+	}
+
+	for (uint32_t i = 0; i < 6; i++)
+		block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+static void CompressBC7Block(const uint8_t pixels[16][4], uint8_t* block) {
+	//用主成分方向作为端点连线
+	float mean[4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t c = 0; c < 4; c++)
+			mean[c] += pixels[i][c] / 16.0f;
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < 16; i++) {
+		float d[4];
+		for (uint32_t c = 0; c < 4; c++)
+			d[c] = pixels[i][c] - mean[c];
+		for (uint32_t a = 0; a < 4; a++)
+			for (uint32_t b = 0; b < 4; b++)
+				covariance[a][b] += d[a] * d[b];
+	}
+
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (uint32_t iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		for (uint32_t a = 0; a < 4; a++)
+			for (uint32_t b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+
+		float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+		for (uint32_t c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float minT = 0.0f, maxT = 0.0f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (uint32_t c = 0; c < 4; c++)
+			t += (pixels[i][c] - mean[c]) * axis[c];
+		if (t < minT) minT = t;
+		if (t > maxT) maxT = t;
+	}
+
+	float endpoints[2][4];
+	for (uint32_t c = 0; c < 4; c++) {
+		endpoints[0][c] = mean[c] + minT * axis[c];
+		endpoints[1][c] = mean[c] + maxT * axis[c];
+	}
+
+	//尝试四种p位组合，保留误差最小的量化结果
+	int bestQuantized[2][4] = {};
+	int bestP[2] = {};
+	uint32_t bestIndices[16] = {};
+	uint64_t bestError = UINT64_MAX;
+	for (int p0 = 0; p0 < 2; p0++) {
+		for (int p1 = 0; p1 < 2; p1++) {
+			int p[2] = { p0, p1 };
+			int quantized[2][4];
+			int unquantized[2][4];
+			for (uint32_t e = 0; e < 2; e++) {
+				for (uint32_t c = 0; c < 4; c++) {
+					float value = endpoints[e][c] < 0.0f ? 0.0f : (endpoints[e][c] > 255.0f ? 255.0f : endpoints[e][c]);
+					quantized[e][c] = Clamp(static_cast<int>((value - p[e]) / 2.0f + 0.5f), 0, 127);
+					unquantized[e][c] = (quantized[e][c] << 1) | p[e];
+				}
+			}
+
+			int palette[16][4];
+			for (uint32_t i = 0; i < 16; i++)
+				for (uint32_t c = 0; c < 4; c++)
+					palette[i][c] = ((64 - bc7Weights[i]) * unquantized[0][c] + bc7Weights[i] * unquantized[1][c] + 32) >> 6;
+
+			uint64_t error = 0;
+			uint32_t indices[16];
+			for (uint32_t i = 0; i < 16; i++) {
+				uint32_t bestPixelError = UINT32_MAX;
+				for (uint32_t j = 0; j < 16; j++) {
+					uint32_t pixelError = 0;
+					for (uint32_t c = 0; c < 4; c++) {
+						int d = palette[j][c] - pixels[i][c];
+						pixelError += d * d;
+					}
+					if (pixelError < bestPixelError) {
+						bestPixelError = pixelError;
+						indices[i] = j;
+					}
+				}
+				error += bestPixelError;
+			}
+
+			if (error < bestError) {
+				bestError = error;
+				memcpy(bestQuantized, quantized, sizeof(quantized));
+				memcpy(bestIndices, indices, sizeof(indices));
+				bestP[0] = p0;
+				bestP[1] = p1;
+			}
+		}
+	}
+
+	//第一个索引的最高位隐含为0，否则交换端点并翻转索引
+	if (bestIndices[0] >= 8) {
+		for (uint32_t c = 0; c < 4; c++) {
+			int temp = bestQuantized[0][c];
+			bestQuantized[0][c] = bestQuantized[1][c];
+			bestQuantized[1][c] = temp;
+		}
+		int temp = bestP[0];
+		bestP[0] = bestP[1];
+		bestP[1] = temp;
+		for (uint32_t i = 0; i < 16; i++)
+			bestIndices[i] = 15 - bestIndices[i];
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer = { block };
+	writer.Write(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++) {
+		writer.Write(bestQuantized[0][c], 7);
+		writer.Write(bestQuantized[1][c], 7);
+	}
+	writer.Write(bestP[0], 1);
+	writer.Write(bestP[1], 1);
+	writer.Write(bestIndices[0], 3);
+	for (uint32_t i = 1; i < 16; i++)
+		writer.Write(bestIndices[i], 4);
+}
+
+vk::Format GetCompressedFormat(TextureUsage usage) {
+	switch (usage) {
+	case TextureUsage::normal:
+		return vk::Format::eBc5UnormBlock;
+	case TextureUsage::mask:
+		return vk::Format::eBc4UnormBlock;
+	default:
+		return vk::Format::eBc7UnormBlock;
+	}
+}
+
+uint32_t GetCompressedBlockSize(vk::Format format) {
+	return format == vk::Format::eBc4UnormBlock ? 8 : 16;
+}
+
+uint64_t GetCompressedLevelSize(vk::Format format, uint32_t width, uint32_t height) {
+	return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * GetCompressedBlockSize(format);
+}
+
+void CompressImage(const uint8_t* rgba, uint32_t width, uint32_t height, TextureUsage usage, std::vector<uint8_t>& output) {
+	vk::Format format = GetCompressedFormat(usage);
+	uint32_t blockSize = GetCompressedBlockSize(format);
+	uint32_t blockCountX = (width + 3) / 4;
+	uint32_t blockCountY = (height + 3) / 4;
+
+	size_t offset = output.size();
+	output.resize(offset + (size_t)blockCountX * blockCountY * blockSize);
+
+	uint8_t pixels[16][4];
+	uint8_t channel[16];
+	for (uint32_t by = 0; by < blockCountY; by++) {
+		for (uint32_t bx = 0; bx < blockCountX; bx++) {
+			FetchBlock(rgba, width, height, bx, by, pixels);
+			uint8_t* block = output.data() + offset + ((size_t)by * blockCountX + bx) * blockSize;
+
+			switch (usage) {
+			case TextureUsage::normal:
+				//BC5为两个BC4块，分别存放X和Y
+				for (uint32_t i = 0; i < 16; i++)
+					channel[i] = pixels[i][0];
+				CompressBC4Block(channel, block);
+				for (uint32_t i = 0; i < 16; i++)
+					channel[i] = pixels[i][1];
+				CompressBC4Block(channel, block + 8);
+				break;
+			case TextureUsage::mask:
+				for (uint32_t i = 0; i < 16; i++)
+					channel[i] = pixels[i][0];
+				CompressBC4Block(channel, block);
+				break;
+			default:
+				CompressBC7Block(pixels, block);
+				break;
+			}
+		}
+	}
+}
+
+void DownsampleImage(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& output) {
+	uint32_t nextWidth = width > 1 ? width / 2 : 1;
+	uint32_t nextHeight = height > 1 ? height / 2 : 1;
+	output.resize((size_t)nextWidth * nextHeight * 4);
+
+	for (uint32_t y = 0; y < nextHeight; y++) {
+		uint32_t y0 = y * 2;
+		uint32_t y1 = y0 + 1 < height ? y0 + 1 : y0;
+		for (uint32_t x = 0; x < nextWidth; x++) {
+			uint32_t x0 = x * 2;
+			uint32_t x1 = x0 + 1 < width ? x0 + 1 : x0;
+			for (uint32_t c = 0; c < 4; c++) {
+				uint32_t sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+					+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+				output[((size_t)y * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "vkUtil.h"
+
+#include <vector>
+
+/*What the texture is sampled as, decides the block compressed format*/
+enum class TextureUsage : int {
+	color,	//BC7, RGBA
+	normal,	//BC5, only XY are stored and Z is rebuilt in the shader
+	mask	//BC4, single channel
+};
+
+vk::Format GetCompressedFormat(TextureUsage usage);
+uint32_t GetCompressedBlockSize(vk::Format format);
+
+//Byte size of one level with the given extent, partial blocks at the border count as whole blocks
+uint64_t GetCompressedLevelSize(vk::Format format, uint32_t width, uint32_t height);
+
+//Encode an RGBA8 image into 4x4 blocks, appended to output
+void CompressImage(const uint8_t* rgba, uint32_t width, uint32_t height, TextureUsage usage, std::vector<uint8_t>& output);
+
+//2x2 box filter to the next mip level, odd edges are clamped
+void DownsampleImage(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& output);
@@ -0,0 +1,358 @@
+#include "UploadBatcher.h"
+
+//当前线程在哪个UploadBatcher中有尚未记录拷贝的预留
+static thread_local UploadBatcher* pendingBatcher = nullptr;
+
+UploadBatcher::~UploadBatcher() {
+	Destroy();
+}
+
+void UploadBatcher::Init(vk::Device device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::Queue queue, uint32_t queueFamilyIndex, uint64_t capacity) {
+	this->device = device;
+	this->gpuProp = gpuProp;
+	this->queue = queue;
+	this->capacity = capacity;
+
+	auto commandPoolInfo = vk::CommandPoolCreateInfo()
+		.setQueueFamilyIndex(queueFamilyIndex)
+		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+	if (device.createCommandPool(&commandPoolInfo, 0, &cmdPool) != vk::Result::eSuccess) {
+		MessageBox(0, L"Create upload command pool failed!!!", 0, 0);
+	}
+
+	//常驻映射的上传环形缓冲
+	auto bufferInfo = vk::BufferCreateInfo()
+		.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+		.setSize(capacity);
+	device.createBuffer(&bufferInfo, 0, &ringBuffer);
+
+	vk::MemoryRequirements memReqs;
+	device.getBufferMemoryRequirements(ringBuffer, &memReqs);
+
+	auto memoryInfo = vk::MemoryAllocateInfo()
+		.setAllocationSize(memReqs.size);
+	FindStagingMemoryType(memReqs.memoryTypeBits, memoryInfo.memoryTypeIndex);
+	if (device.allocateMemory(&memoryInfo, 0, &ringMemory) != vk::Result::eSuccess) {
+		MessageBox(0, L"Allocate upload ring memory failed!!!", 0, 0);
+	}
+	device.bindBufferMemory(ringBuffer, ringMemory, 0);
+	device.mapMemory(ringMemory, 0, capacity, vk::MemoryMapFlags(), reinterpret_cast<void**>(&mappedData));
+}
+
+void UploadBatcher::FindStagingMemoryType(uint32_t typeBits, uint32_t& typeIndex)const {
+	//解码器会回读已写入的像素(如PNG的行滤波)，优先使用带缓存的内存，没有时退回写合并内存
+	vk::MemoryPropertyFlags hostFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	if (!MemoryTypeFromProperties(gpuProp, typeBits, hostFlags | vk::MemoryPropertyFlagBits::eHostCached, typeIndex))
+		MemoryTypeFromProperties(gpuProp, typeBits, hostFlags, typeIndex);
+}
+
+void UploadBatcher::Destroy() {
+	if (!device)
+		return;
+
+	Finish();
+
+	for (auto& batch : freeBatches)
+		device.destroyFence(batch.fence);
+	freeBatches.clear();
+	device.destroyCommandPool(cmdPool);
+
+	device.unmapMemory(ringMemory);
+	device.destroyBuffer(ringBuffer);
+	device.freeMemory(ringMemory);
+	mappedData = nullptr;
+
+	device = vk::Device();
+}
+
+void UploadBatcher::ReleasePending() {
+	//调用时持有batchMutex
+	if (pendingBatcher != this)
+		return;
+	pendingBatcher = nullptr;
+	pendingReservations.erase(std::this_thread::get_id());
+	pendingCondition.notify_all();
+}
+
+UploadBatcher::Recording::Recording(UploadBatcher& uploadBatcher) : uploadBatcher(uploadBatcher), lock(uploadBatcher.batchMutex) {
+	if (!uploadBatcher.recordingActive)
+		uploadBatcher.BeginBatch();
+	cmd = uploadBatcher.recording.cmd;
+}
+
+UploadBatcher::Recording::~Recording() {
+	uploadBatcher.ReleasePending();
+}
+
+UploadBatcher::Scope::~Scope() {
+	std::lock_guard<std::mutex> lock(uploadBatcher.batchMutex);
+	uploadBatcher.ReleasePending();
+}
+
+void UploadBatcher::BeginBatch() {
+	//顺便回收已经完成的批次
+	while (RetireBatch(false));
+
+	if (!freeBatches.empty()) {
+		recording = std::move(freeBatches.back());
+		freeBatches.pop_back();
+	}
+	else {
+		recording = Batch();
+
+		auto cmdAllocInfo = vk::CommandBufferAllocateInfo()
+			.setCommandBufferCount(1)
+			.setCommandPool(cmdPool)
+			.setLevel(vk::CommandBufferLevel::ePrimary);
+		device.allocateCommandBuffers(&cmdAllocInfo, &recording.cmd);
+
+		auto fenceInfo = vk::FenceCreateInfo();
+		device.createFence(&fenceInfo, 0, &recording.fence);
+	}
+	//之前提交时还没记录拷贝的预留归入这个批次
+	recording.ringBytes = carriedBytes;
+	carriedBytes = 0;
+	recording.temporaryBuffers = std::move(carriedTemporaryBuffers);
+	carriedTemporaryBuffers.clear();
+	recording.bufferCopied = false;
+
+	auto beginInfo = vk::CommandBufferBeginInfo()
+		.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	recording.cmd.begin(&beginInfo);
+
+	recordingActive = true;
+}
+
+bool UploadBatcher::RetireBatch(bool wait) {
+	if (inFlight.empty())
+		return false;
+
+	Batch& batch = inFlight.front();
+	if (wait)
+		device.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX);
+	else if (device.getFenceStatus(batch.fence) != vk::Result::eSuccess)
+		return false;
+
+	for (auto& temporaryBuffer : batch.temporaryBuffers) {
+		device.destroyBuffer(temporaryBuffer.first);
+		device.freeMemory(temporaryBuffer.second);
+	}
+	batch.temporaryBuffers.clear();
+
+	//单队列按提交顺序完成，所以环形缓冲可以按批次顺序释放
+	//没有占用环形缓冲的批次(只有布局转换或图像间拷贝)不移动tail，它的ringEnd可能早于环形缓冲清空后的重新分配
+	if (batch.ringBytes > 0) {
+		tail = batch.ringEnd;
+		used -= batch.ringBytes;
+	}
+
+	device.resetFences(1, &batch.fence);
+	batch.cmd.reset(vk::CommandBufferResetFlags());
+
+	freeBatches.push_back(std::move(batch));
+	inFlight.pop_front();
+	return true;
+}
+
+bool UploadBatcher::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset) {
+	if (used == 0)
+		head = tail = 0;
+
+	uint64_t start = (head + alignment - 1) & ~(alignment - 1);
+	uint64_t consumed;
+	if (used == 0 || head > tail) {
+		if (start + size <= capacity)
+			consumed = start - head + size;
+		else if (size <= tail) {
+			//尾部放不下时绕回开头，跳过的部分一并计入占用
+			consumed = capacity - head + size;
+			start = 0;
+		}
+		else
+			return false;
+	}
+	else if (head < tail && start + size <= tail)
+		consumed = start - head + size;
+	else
+		return false;
+
+	//预留从分配前的head开始，绕回时跳过的部分也属于它
+	allocationStart = head;
+	allocationMark = consumedTotal;
+
+	offset = start;
+	head = start + size;
+	used += consumed;
+	consumedTotal += consumed;
+	recording.ringBytes += consumed;
+	return true;
+}
+
+void* UploadBatcher::Reserve(uint64_t size, uint64_t alignment, vk::Buffer& buffer, uint64_t& offset) {
+	std::unique_lock<std::mutex> lock(batchMutex);
+
+	//本线程上一次预留的拷贝已经记录
+	ReleasePending();
+
+	if (!recordingActive)
+		BeginBatch();
+
+	//超出环形缓冲容量的请求使用临时缓冲
+	if (size > capacity) {
+		auto bufferInfo = vk::BufferCreateInfo()
+			.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+			.setSize(size);
+		device.createBuffer(&bufferInfo, 0, &buffer);
+
+		vk::MemoryRequirements memReqs;
+		device.getBufferMemoryRequirements(buffer, &memReqs);
+
+		auto memoryInfo = vk::MemoryAllocateInfo()
+			.setAllocationSize(memReqs.size);
+		FindStagingMemoryType(memReqs.memoryTypeBits, memoryInfo.memoryTypeIndex);
+
+		vk::DeviceMemory memory;
+		device.allocateMemory(&memoryInfo, 0, &memory);
+		device.bindBufferMemory(buffer, memory, 0);
+
+		void* data = nullptr;
+		device.mapMemory(memory, 0, size, vk::MemoryMapFlags(), &data);
+		recording.temporaryBuffers.push_back(std::make_pair(buffer, memory));
+
+		offset = 0;
+		Reservation reservation;
+		reservation.temporaryBuffer = buffer;
+		pendingReservations[std::this_thread::get_id()] = reservation;
+		pendingBatcher = this;
+		return data;
+	}
+
+	//空间不足时提交当前批次并等待最早的批次完成
+	while (!Allocate(size, alignment, offset)) {
+		if (recording.ringBytes > GetPendingRingBytes()) {
+			FlushLocked();
+			BeginBatch();
+		}
+		else if (RetireBatch(true))
+			continue;
+		else if (!pendingReservations.empty()) {
+			//剩下的空间都被其他线程还没记录拷贝的预留占着，等它们记录完
+			pendingCondition.wait(lock);
+			if (!recordingActive)
+				BeginBatch();
+		}
+		else {
+			MessageBox(0, L"Reserve upload memory failed!!!", 0, 0);
+			return nullptr;
+		}
+	}
+
+	buffer = ringBuffer;
+	Reservation reservation;
+	reservation.ringStart = allocationStart;
+	reservation.mark = allocationMark;
+	pendingReservations[std::this_thread::get_id()] = reservation;
+	pendingBatcher = this;
+	return mappedData + offset;
+}
+
+void UploadBatcher::UploadBuffer(const void* data, uint64_t size, vk::Buffer dstBuffer, uint64_t dstOffset) {
+	vk::Buffer srcBuffer;
+	uint64_t srcOffset;
+	void* dst = Reserve(size, 16, srcBuffer, srcOffset);
+	if (dst == nullptr)
+		return;
+	memcpy(dst, data, size);
+
+	auto copyRegion = vk::BufferCopy()
+		.setSrcOffset(srcOffset)
+		.setDstOffset(dstOffset)
+		.setSize(size);
+	Recording record(*this);
+	record.cmd.copyBuffer(srcBuffer, dstBuffer, 1, &copyRegion);
+	recording.bufferCopied = true;
+}
+
+void UploadBatcher::Flush() {
+	std::lock_guard<std::mutex> lock(batchMutex);
+	ReleasePending();
+	FlushLocked();
+}
+
+uint64_t UploadBatcher::RequestFlush() {
+	std::lock_guard<std::mutex> lock(batchMutex);
+	ReleasePending();
+	FlushLocked();
+	return submitCount;
+}
+
+bool UploadBatcher::IsSubmitted(uint64_t ticket) {
+	std::lock_guard<std::mutex> lock(batchMutex);
+	return submitCount >= ticket;
+}
+
+uint64_t UploadBatcher::GetPendingRingBytes()const {
+	//最早的预留之后分配的内存都要留到下一个批次
+	uint64_t earliestMark = consumedTotal;
+	for (auto& pending : pendingReservations)
+		if (!pending.second.temporaryBuffer)
+			earliestMark = std::min(earliestMark, pending.second.mark);
+	return consumedTotal - earliestMark;
+}
+
+void UploadBatcher::FlushLocked() {
+	if (!recordingActive)
+		return;
+
+	//图像在各自的布局转换中同步，缓冲的拷贝在批次末尾统一加一个屏障
+	if (recording.bufferCopied) {
+		auto barrier = vk::MemoryBarrier()
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead);
+		recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), 1, &barrier, 0, 0, 0, 0);
+	}
+
+	recording.cmd.end();
+
+	auto submitInfo = vk::SubmitInfo()
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&recording.cmd);
+	{
+		std::lock_guard<std::mutex> queueLock(queueMutex);
+		queue.submit(1, &submitInfo, recording.fence);
+	}
+	submitCount++;
+
+	//还在写入上传内存的预留不随这个批次释放: 批次在最早的预留处结束，之后的内存和临时缓冲转入下一个批次
+	recording.ringEnd = head;
+	uint64_t pendingRingBytes = GetPendingRingBytes();
+	for (auto& pending : pendingReservations) {
+		if (pending.second.temporaryBuffer) {
+			auto it = std::find_if(recording.temporaryBuffers.begin(), recording.temporaryBuffers.end(),
+				[&pending](const std::pair<vk::Buffer, vk::DeviceMemory>& temporaryBuffer) { return temporaryBuffer.first == pending.second.temporaryBuffer; });
+			if (it != recording.temporaryBuffers.end()) {
+				carriedTemporaryBuffers.push_back(*it);
+				recording.temporaryBuffers.erase(it);
+			}
+		}
+		else if (consumedTotal - pending.second.mark == pendingRingBytes)
+			recording.ringEnd = pending.second.ringStart;
+	}
+	recording.ringBytes -= pendingRingBytes;
+	carriedBytes += pendingRingBytes;
+	inFlight.push_back(std::move(recording));
+	recording = Batch();
+	recordingActive = false;
+}
+
+void UploadBatcher::Finish() {
+	std::unique_lock<std::mutex> lock(batchMutex);
+	ReleasePending();
+	pendingCondition.wait(lock, [this] { return pendingReservations.empty(); });
+	//放弃了的预留转入的内存和临时缓冲需要一个批次来释放
+	if (!recordingActive && (carriedBytes > 0 || !carriedTemporaryBuffers.empty()))
+		BeginBatch();
+	FlushLocked();
+
+	while (RetireBatch(true));
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "vkUtil.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <condition_variable>
+
+/*Persistent staging ring, every upload copy is recorded into one command buffer and submitted as a batch*/
+class UploadBatcher {
+public:
+	~UploadBatcher();
+
+	void Init(vk::Device device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::Queue queue, uint32_t queueFamilyIndex, uint64_t capacity = 64ull * 1024 * 1024);
+	void Destroy();
+
+	//Reserve staging space, the copy reading it must be recorded before the same thread reserves again.
+	//The memory is host cached when the device offers it, so loaders may decode straight into it.
+	//Requests larger than the ring get a temporary buffer that is freed when its batch retires.
+	//Several threads may reserve at once. A submission does not wait for threads that still have to record the copy
+	//for their reservation: that memory moves on to the next batch. A thread must not reserve while it holds a Recording.
+	void* Reserve(uint64_t size, uint64_t alignment, vk::Buffer& buffer, uint64_t& offset);
+
+	//Exclusive access to the command buffer of the batch being recorded.
+	//Ending it marks the staging memory this thread reserved as consumed.
+	class Recording {
+	public:
+		Recording(UploadBatcher& uploadBatcher);
+		~Recording();
+
+		vk::CommandBuffer cmd;
+
+	private:
+		UploadBatcher& uploadBatcher;
+		std::unique_lock<std::mutex> lock;
+	};
+
+	//Wraps a whole upload job on a worker thread, so a job that reserved and then gave up does not hold the batch open
+	class Scope {
+	public:
+		Scope(UploadBatcher& uploadBatcher) : uploadBatcher(uploadBatcher) {}
+		~Scope();
+
+	private:
+		UploadBatcher& uploadBatcher;
+	};
+
+	//Stage data and record a buffer to buffer copy, the batch ends with a barrier making it visible to vertex/index/uniform reads
+	void UploadBuffer(const void* data, uint64_t size, vk::Buffer dstBuffer, uint64_t dstOffset);
+
+	//Submit the recorded copies without waiting
+	void Flush();
+
+	//Same as Flush, returns a ticket for IsSubmitted
+	uint64_t RequestFlush();
+	bool IsSubmitted(uint64_t ticket);
+
+	//Batches may be submitted from worker threads, other submissions to the same queue must hold this lock.
+	//It only guards the queue, so a thread waiting for staging space does not stall the render thread's submits
+	std::unique_lock<std::mutex> LockQueue() { return std::unique_lock<std::mutex>(queueMutex); }
+
+	//Wait for every reservation to be recorded, submit and wait until every batch has completed
+	void Finish();
+
+	uint64_t GetCapacity()const { return capacity; }
+	uint32_t GetSubmitCount()const { return submitCount; }
+
+private:
+	struct Batch {
+		vk::CommandBuffer cmd;
+		vk::Fence fence;
+		uint64_t ringEnd = 0;
+		uint64_t ringBytes = 0;
+		bool bufferCopied = false;
+		std::vector<std::pair<vk::Buffer, vk::DeviceMemory>> temporaryBuffers;
+	};
+
+	void FindStagingMemoryType(uint32_t typeBits, uint32_t& typeIndex)const;
+	void ReleasePending();
+	uint64_t GetPendingRingBytes()const;
+	void FlushLocked();
+	void BeginBatch();
+	bool RetireBatch(bool wait);
+	bool Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+
+	vk::Device device;
+	vk::PhysicalDeviceMemoryProperties gpuProp;
+	vk::Queue queue;
+	vk::CommandPool cmdPool;
+
+	vk::Buffer ringBuffer;
+	vk::DeviceMemory ringMemory;
+	BYTE* mappedData = nullptr;
+	uint64_t capacity = 0;
+
+	//head is the write position, tail the start of the oldest live batch, used the bytes between them.
+	//Batches that reserved nothing leave tail alone, their ringEnd may predate a reset of the empty ring
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	uint64_t used = 0;
+	//Bytes consumed since Init, orders reservations across a wrap of the ring
+	uint64_t consumedTotal = 0;
+	uint64_t allocationStart = 0;
+	uint64_t allocationMark = 0;
+
+	Batch recording;
+	bool recordingActive = false;
+	std::deque<Batch> inFlight;
+	std::vector<Batch> freeBatches;
+
+	uint32_t submitCount = 0;
+
+	//Reserved staging memory whose copy is not recorded yet, one per thread
+	struct Reservation {
+		uint64_t ringStart = 0;
+		uint64_t mark = 0;
+		vk::Buffer temporaryBuffer;
+	};
+	std::unordered_map<std::thread::id, Reservation> pendingReservations;
+	//Pending memory of submitted batches, handed to the next batch
+	uint64_t carriedBytes = 0;
+	std::vector<std::pair<vk::Buffer, vk::DeviceMemory>> carriedTemporaryBuffers;
+	std::mutex batchMutex;
+	//Taken after batchMutex when both are held
+	std::mutex queueMutex;
+	std::condition_variable pendingCondition;
+};
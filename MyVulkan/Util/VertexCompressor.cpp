@@ -0,0 +1,81 @@
+#include "VertexCompressor.h"
+
+#include <cmath>
+
+static uint16_t QuantizeUnorm16(float value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return static_cast<uint16_t>(std::lround(value * 65535.0f));
+}
+
+static uint8_t QuantizeUnorm8(float value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return static_cast<uint8_t>(std::lround(value * 255.0f));
+}
+
+static uint32_t PackSnorm16x2(const glm::vec2& value) {
+	auto quantize = [](float v) {
+		v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+		return static_cast<uint32_t>(static_cast<uint16_t>(static_cast<int16_t>(std::lround(v * 32767.0f))));
+	};
+	return quantize(value.x) | (quantize(value.y) << 16);
+}
+
+VertexQuantization ComputeVertexQuantization(const glm::vec3& minPos, const glm::vec3& maxPos) {
+	//退化的轴(如平面)保留非零的缩放，避免除零
+	VertexQuantization quantization;
+	quantization.bias = minPos;
+	quantization.scale = glm::max(maxPos - minPos, glm::vec3(1e-6f));
+	return quantization;
+}
+
+glm::vec2 EncodeOctahedral(glm::vec3 direction) {
+	float length = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+	if (length <= 0.0f)
+		return glm::vec2(0.0f);
+
+	direction /= length;
+	glm::vec2 encoded(direction.x, direction.y);
+	//下半球沿对角线折叠到外侧的四个三角形
+	if (direction.z < 0.0f) {
+		encoded.x = (1.0f - std::fabs(direction.y)) * (direction.x >= 0.0f ? 1.0f : -1.0f);
+		encoded.y = (1.0f - std::fabs(direction.x)) * (direction.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+
+template<typename T, typename V>
+static void CompressCommon(const V& vertex, const VertexQuantization& quantization, T& compact) {
+	glm::vec3 position = (vertex.position - quantization.bias) / quantization.scale;
+	compact.position[0] = QuantizeUnorm16(position.x);
+	compact.position[1] = QuantizeUnorm16(position.y);
+	compact.position[2] = QuantizeUnorm16(position.z);
+	compact.position[3] = 0;
+
+	compact.texCoord = glm::packHalf2x16(vertex.texCoord);
+	compact.normal = PackSnorm16x2(EncodeOctahedral(vertex.normal));
+	compact.tangent = PackSnorm16x2(EncodeOctahedral(vertex.tangent));
+}
+
+CompactVertex CompressVertex(const Vertex& vertex, const VertexQuantization& quantization) {
+	CompactVertex compact;
+	CompressCommon(vertex, quantization, compact);
+	return compact;
+}
+
+CompactSkinnedVertex CompressVertex(const SkinnedVertex& vertex, const VertexQuantization& quantization) {
+	CompactSkinnedVertex compact;
+	CompressCommon(vertex, quantization, compact);
+
+	//着色器用1-x-y-z求第四个权重，这里先量化前三个，第四个存余量
+	uint8_t weights[4];
+	weights[0] = QuantizeUnorm8(vertex.boneWeights.x);
+	weights[1] = QuantizeUnorm8(vertex.boneWeights.y);
+	weights[2] = QuantizeUnorm8(vertex.boneWeights.z);
+	int rest = 255 - weights[0] - weights[1] - weights[2];
+	weights[3] = static_cast<uint8_t>(rest < 0 ? 0 : rest);
+	compact.boneWeights = weights[0] | (weights[1] << 8) | (weights[2] << 16) | ((uint32_t)weights[3] << 24);
+
+	for (uint32_t i = 0; i < 4; i++)
+		compact.boneIndices[i] = static_cast<uint16_t>(vertex.boneIndices[i]);
+	return compact;
+}
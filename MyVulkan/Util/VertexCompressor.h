@@ -0,0 +1,33 @@
+#pragma once
+#include "vkUtil.h"
+
+/*Quantized vertex layouts, attribute order matches Vertex/SkinnedVertex so the shaders keep the same locations*/
+struct CompactVertex {
+	uint16_t position[4];	//R16G16B16A16_UNORM inside the mesh's bounding box, w unused
+	uint32_t texCoord;		//R16G16_SFLOAT
+	uint32_t normal;		//R16G16_SNORM octahedral
+	uint32_t tangent;		//R16G16_SNORM octahedral
+};
+
+struct CompactSkinnedVertex {
+	uint16_t position[4];
+	uint32_t texCoord;
+	uint32_t normal;
+	uint32_t tangent;
+	uint32_t boneWeights;	//R8G8B8A8_UNORM, the shader still rebuilds w from xyz
+	uint16_t boneIndices[4];	//R16G16B16A16_UINT, bone indices are node indices and may exceed 255
+};
+
+//Decoded position = encoded * scale + bias, passed to the shader through ObjectConstants
+struct VertexQuantization {
+	glm::vec3 scale = glm::vec3(1.0f);
+	glm::vec3 bias = glm::vec3(0.0f);
+};
+
+VertexQuantization ComputeVertexQuantization(const glm::vec3& minPos, const glm::vec3& maxPos);
+
+//Octahedral mapping of a unit vector to [-1,1]^2
+glm::vec2 EncodeOctahedral(glm::vec3 direction);
+
+CompactVertex CompressVertex(const Vertex& vertex, const VertexQuantization& quantization);
+CompactSkinnedVertex CompressVertex(const SkinnedVertex& vertex, const VertexQuantization& quantization);
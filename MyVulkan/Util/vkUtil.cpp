@@ -1,26 +1,14 @@
 #include "vkUtil.h"
 
-vk::ShaderModule CreateShaderModule(const std::string& path, vk::Device device) {
-	std::ifstream loadFile(path, std::ios::ate | std::ios::binary);
-	if (!loadFile.is_open()) {
-		MessageBox(0, L"Cannot open the shader file!!!", 0, 0);
-	}
-	size_t fileSize = (size_t)loadFile.tellg();
-	std::vector<char> buffer(fileSize);
-	loadFile.seekg(0);
-	loadFile.read(buffer.data(), fileSize);
-	loadFile.close();
-
-	vk::ShaderModuleCreateInfo createInfo = {};
-	createInfo.setCodeSize(buffer.size());
-	createInfo.setPCode(reinterpret_cast<const uint32_t*>(buffer.data()));
-
-	vk::ShaderModule shaderModule;
-	if (device.createShaderModule(&createInfo, 0, &shaderModule) != vk::Result::eSuccess) {
-		MessageBox(0, L"Create shader module failed!!!", 0, 0);
+uint64_t HashBytes(const void* data, size_t size) {
+	//FNV-1a
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
 	}
-
-	return shaderModule;
+	return hash;
 }
 
 bool MemoryTypeFromProperties(vk::PhysicalDeviceMemoryProperties memProp, uint32_t typeBits, vk::MemoryPropertyFlags requirementMask, uint32_t& typeIndex) {
@@ -33,8 +21,8 @@ bool MemoryTypeFromProperties(vk::PhysicalDeviceMemoryProperties memProp, uint32
 	return false;
 }
 
-vk::Pipeline CreateGraphicsPipeline(vk::Device& device, vk::PipelineDynamicStateCreateInfo dynamic, vk::PipelineVertexInputStateCreateInfo vi, vk::PipelineInputAssemblyStateCreateInfo ia, vk::PipelineRasterizationStateCreateInfo rs, vk::PipelineColorBlendStateCreateInfo cb, vk::PipelineViewportStateCreateInfo vs, vk::PipelineDepthStencilStateCreateInfo ds, vk::PipelineMultisampleStateCreateInfo ms, vk::PipelineLayout layout, std::vector<vk::PipelineShaderStageCreateInfo>& shaders, vk::RenderPass renderPass) {
-	auto pipelineInfo = vk::GraphicsPipelineCreateInfo()
+vk::GraphicsPipelineCreateInfo MakeGraphicsPipelineInfo(const vk::PipelineDynamicStateCreateInfo& dynamic, const vk::PipelineVertexInputStateCreateInfo& vi, const vk::PipelineInputAssemblyStateCreateInfo& ia, const vk::PipelineRasterizationStateCreateInfo& rs, const vk::PipelineColorBlendStateCreateInfo& cb, const vk::PipelineViewportStateCreateInfo& vs, const vk::PipelineDepthStencilStateCreateInfo& ds, const vk::PipelineMultisampleStateCreateInfo& ms, vk::PipelineLayout layout, const std::vector<vk::PipelineShaderStageCreateInfo>& shaders, vk::RenderPass renderPass) {
+	return vk::GraphicsPipelineCreateInfo()
 		.setLayout(layout)
 		.setPColorBlendState(&cb)
 		.setPDepthStencilState(&ds)
@@ -47,11 +35,127 @@ vk::Pipeline CreateGraphicsPipeline(vk::Device& device, vk::PipelineDynamicState
 		.setRenderPass(renderPass)
 		.setPInputAssemblyState(&ia)
 		.setPVertexInputState(&vi);
+}
+
+vk::Pipeline CreateGraphicsPipeline(vk::Device& device, vk::PipelineCache pipelineCache, vk::PipelineDynamicStateCreateInfo dynamic, vk::PipelineVertexInputStateCreateInfo vi, vk::PipelineInputAssemblyStateCreateInfo ia, vk::PipelineRasterizationStateCreateInfo rs, vk::PipelineColorBlendStateCreateInfo cb, vk::PipelineViewportStateCreateInfo vs, vk::PipelineDepthStencilStateCreateInfo ds, vk::PipelineMultisampleStateCreateInfo ms, vk::PipelineLayout layout, std::vector<vk::PipelineShaderStageCreateInfo>& shaders, vk::RenderPass renderPass) {
+	auto pipelineInfo = MakeGraphicsPipelineInfo(dynamic, vi, ia, rs, cb, vs, ds, ms, layout, shaders, renderPass);
 	vk::Pipeline pipeline;
-	device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, 0, &pipeline);
+	device.createGraphicsPipelines(pipelineCache, 1, &pipelineInfo, 0, &pipeline);
 	return pipeline;
 }
 
+/*磁盘上的管线缓存文件头，data部分为vkGetPipelineCacheData返回的原始数据*/
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static const uint32_t pipelineCacheMagic = 0x43504B56; //"VKPC"
+static const uint32_t pipelineCacheFileVersion = 1;
+
+static bool ValidatePipelineCacheData(const vk::PhysicalDeviceProperties& gpuProp, const PipelineCacheFileHeader& header, const std::vector<char>& data) {
+	if (header.magic != pipelineCacheMagic || header.fileVersion != pipelineCacheFileVersion)
+		return false;
+	if (header.vendorID != gpuProp.vendorID || header.deviceID != gpuProp.deviceID || header.driverVersion != gpuProp.driverVersion)
+		return false;
+	if (memcmp(header.pipelineCacheUUID, gpuProp.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return false;
+	if (header.dataSize != data.size() || header.dataHash != HashBytes(data.data(), data.size()))
+		return false;
+
+	//同时检查驱动写入的缓存头(VkPipelineCacheHeaderVersionOne)
+	uint32_t cacheHeader[4];
+	if (data.size() < sizeof(cacheHeader) + VK_UUID_SIZE)
+		return false;
+	memcpy(cacheHeader, data.data(), sizeof(cacheHeader));
+	if (cacheHeader[0] < sizeof(cacheHeader) + VK_UUID_SIZE || cacheHeader[1] != (uint32_t)vk::PipelineCacheHeaderVersion::eOne)
+		return false;
+	if (cacheHeader[2] != gpuProp.vendorID || cacheHeader[3] != gpuProp.deviceID)
+		return false;
+	return memcmp(data.data() + sizeof(cacheHeader), gpuProp.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+vk::PipelineCache LoadPipelineCache(vk::Device device, vk::PhysicalDevice gpu, const std::string& path, bool& warm) {
+	vk::PhysicalDeviceProperties gpuProp = gpu.getProperties();
+
+	std::vector<char> data;
+	warm = false;
+
+	std::ifstream loadFile(path, std::ios::ate | std::ios::binary);
+	if (loadFile.is_open()) {
+		size_t fileSize = (size_t)loadFile.tellg();
+		PipelineCacheFileHeader header;
+		if (fileSize > sizeof(header)) {
+			loadFile.seekg(0);
+			loadFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+			data.resize(fileSize - sizeof(header));
+			loadFile.read(data.data(), data.size());
+
+			//缓存来自其他设备或驱动时丢弃，从空缓存开始
+			warm = loadFile.good() && ValidatePipelineCacheData(gpuProp, header, data);
+		}
+		loadFile.close();
+	}
+
+	auto pipelineCacheInfo = vk::PipelineCacheCreateInfo()
+		.setInitialDataSize(warm ? data.size() : 0)
+		.setPInitialData(warm ? data.data() : nullptr);
+
+	vk::PipelineCache pipelineCache;
+	if (device.createPipelineCache(&pipelineCacheInfo, 0, &pipelineCache) != vk::Result::eSuccess) {
+		MessageBox(0, L"Create pipeline cache failed!!!", 0, 0);
+	}
+
+	return pipelineCache;
+}
+
+bool SavePipelineCache(vk::Device device, vk::PhysicalDevice gpu, vk::PipelineCache pipelineCache, const std::string& path) {
+	size_t dataSize = 0;
+	if (device.getPipelineCacheData(pipelineCache, &dataSize, static_cast<void*>(nullptr)) != vk::Result::eSuccess || dataSize == 0)
+		return false;
+	std::vector<char> data(dataSize);
+	if (device.getPipelineCacheData(pipelineCache, &dataSize, static_cast<void*>(data.data())) != vk::Result::eSuccess)
+		return false;
+	data.resize(dataSize);
+
+	vk::PhysicalDeviceProperties gpuProp = gpu.getProperties();
+
+	PipelineCacheFileHeader header;
+	header.magic = pipelineCacheMagic;
+	header.fileVersion = pipelineCacheFileVersion;
+	header.vendorID = gpuProp.vendorID;
+	header.deviceID = gpuProp.deviceID;
+	header.driverVersion = gpuProp.driverVersion;
+	memcpy(header.pipelineCacheUUID, gpuProp.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = HashBytes(data.data(), data.size());
+
+	//先写入临时文件再替换，避免中途退出留下损坏的缓存
+	std::string tempPath = path + ".tmp";
+	std::ofstream saveFile(tempPath, std::ios::binary | std::ios::trunc);
+	if (!saveFile.is_open())
+		return false;
+	saveFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	saveFile.write(data.data(), data.size());
+	saveFile.close();
+	if (saveFile.fail()) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
 vk::CommandBuffer BeginSingleTimeCommand(vk::Device* device, const vk::CommandPool& cmdPool) {
 	auto cmdAllocInfo = vk::CommandBufferAllocateInfo()
 		.setCommandBufferCount(1)
@@ -81,7 +185,7 @@ void EndSingleTimeCommand(vk::CommandBuffer* cmd, vk::CommandPool& cmdPool, vk::
 	device->freeCommandBuffers(cmdPool, 1, cmd);
 }
 
-Attachment CreateAttachment(vk::Device device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::Format format, vk::ImageAspectFlags imageAspect, uint32_t width, uint32_t height, vk::ImageUsageFlags imageUsage) {
+Attachment CreateAttachment(vk::Device device, MemoryAllocator* allocator, vk::Format format, vk::ImageAspectFlags imageAspect, uint32_t width, uint32_t height, vk::ImageUsageFlags imageUsage) {
 	Attachment attachment;
 
 	auto imageInfo = vk::ImageCreateInfo()
@@ -96,15 +200,7 @@ Attachment CreateAttachment(vk::Device device, vk::PhysicalDeviceMemoryPropertie
 		.setUsage(imageUsage);
 	device.createImage(&imageInfo, 0, &attachment.image);
 
-	vk::MemoryRequirements sceneImageReqs;
-	device.getImageMemoryRequirements(attachment.image, &sceneImageReqs);
-
-	auto memAlloc = vk::MemoryAllocateInfo()
-		.setAllocationSize(sceneImageReqs.size);
-	MemoryTypeFromProperties(gpuProp, sceneImageReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, memAlloc.memoryTypeIndex);
-	device.allocateMemory(&memAlloc, 0, &attachment.memory);
-
-	device.bindImageMemory(attachment.image, attachment.memory, 0);
+	allocator->AllocateImage(attachment.image, vk::MemoryPropertyFlagBits::eDeviceLocal, attachment.allocation);
 
 	auto sceneImageViewInfo = vk::ImageViewCreateInfo()
 		.setComponents(vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA))
@@ -120,5 +216,5 @@ Attachment CreateAttachment(vk::Device device, vk::PhysicalDeviceMemoryPropertie
 void DestroyAttachment(vk::Device device, Attachment& attachment) {
 	device.destroy(attachment.image);
 	device.destroy(attachment.imageView);
-	device.free(attachment.memory);
+	attachment.allocation.allocator->Free(attachment.allocation);
 }
\ No newline at end of file
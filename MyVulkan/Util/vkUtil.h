@@ -23,14 +23,23 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/quaternion.hpp"
 
+#include "MemoryAllocator.h"
+
 #include "../core/PlayerController.h"
 
 #include <unordered_map>
 #include <map>
 #include <fstream>
 
-vk::ShaderModule CreateShaderModule(const std::string& path, vk::Device device);
-vk::Pipeline CreateGraphicsPipeline(vk::Device&, vk::PipelineDynamicStateCreateInfo, vk::PipelineVertexInputStateCreateInfo, vk::PipelineInputAssemblyStateCreateInfo, vk::PipelineRasterizationStateCreateInfo, vk::PipelineColorBlendStateCreateInfo, vk::PipelineViewportStateCreateInfo, vk::PipelineDepthStencilStateCreateInfo, vk::PipelineMultisampleStateCreateInfo, vk::PipelineLayout, std::vector<vk::PipelineShaderStageCreateInfo>&, vk::RenderPass);
+class ShaderLibrary;
+
+uint64_t HashBytes(const void* data, size_t size);
+vk::GraphicsPipelineCreateInfo MakeGraphicsPipelineInfo(const vk::PipelineDynamicStateCreateInfo&, const vk::PipelineVertexInputStateCreateInfo&, const vk::PipelineInputAssemblyStateCreateInfo&, const vk::PipelineRasterizationStateCreateInfo&, const vk::PipelineColorBlendStateCreateInfo&, const vk::PipelineViewportStateCreateInfo&, const vk::PipelineDepthStencilStateCreateInfo&, const vk::PipelineMultisampleStateCreateInfo&, vk::PipelineLayout, const std::vector<vk::PipelineShaderStageCreateInfo>&, vk::RenderPass);
+vk::Pipeline CreateGraphicsPipeline(vk::Device&, vk::PipelineCache, vk::PipelineDynamicStateCreateInfo, vk::PipelineVertexInputStateCreateInfo, vk::PipelineInputAssemblyStateCreateInfo, vk::PipelineRasterizationStateCreateInfo, vk::PipelineColorBlendStateCreateInfo, vk::PipelineViewportStateCreateInfo, vk::PipelineDepthStencilStateCreateInfo, vk::PipelineMultisampleStateCreateInfo, vk::PipelineLayout, std::vector<vk::PipelineShaderStageCreateInfo>&, vk::RenderPass);
+
+/*Pipeline cache persisted on disk, rejected if it was written by another device or driver*/
+vk::PipelineCache LoadPipelineCache(vk::Device device, vk::PhysicalDevice gpu, const std::string& path, bool& warm);
+bool SavePipelineCache(vk::Device device, vk::PhysicalDevice gpu, vk::PipelineCache pipelineCache, const std::string& path);
 
 bool MemoryTypeFromProperties(vk::PhysicalDeviceMemoryProperties memProp, uint32_t typeBits, vk::MemoryPropertyFlags requirementMask, uint32_t& typeIndex);
 vk::CommandBuffer BeginSingleTimeCommand(vk::Device* device, const vk::CommandPool& cmdPool);
@@ -40,9 +49,9 @@ void EndSingleTimeCommand(vk::CommandBuffer* cmd, vk::CommandPool& cmdPool, vk::
 template<typename T>
 class Buffer {
 public:
-	Buffer(vk::Device* device, uint32_t elementCount, vk::BufferUsageFlags usage, vk::PhysicalDeviceMemoryProperties gpuProp, vk::MemoryPropertyFlags memProp, bool mapped) {
+	//preferred: 额外希望具有的内存属性，例如每帧改写的缓冲优先放在设备本地且主机可见(ReBAR)的堆中
+	Buffer(vk::Device* device, uint32_t elementCount, vk::BufferUsageFlags usage, MemoryAllocator* allocator, vk::MemoryPropertyFlags memProp, vk::MemoryPropertyFlags preferred = vk::MemoryPropertyFlags()) {
 		elementByteSize = sizeof(T);
-		this->mapped = mapped;
 
 		auto bufferInfo = vk::BufferCreateInfo()
 			.setSize(elementByteSize * (uint64_t)elementCount)
@@ -50,49 +59,35 @@ public:
 
 		device->createBuffer(&bufferInfo, 0, &buffer);
 
-		vk::MemoryRequirements memReqs;
-		device->getBufferMemoryRequirements(buffer, &memReqs);
-
-		auto memoryInfo = vk::MemoryAllocateInfo()
-			.setAllocationSize(memReqs.size);
+		allocator->AllocateBuffer(buffer, memProp, preferred, allocation);
 
-		MemoryTypeFromProperties(gpuProp, memReqs.memoryTypeBits, memProp, memoryInfo.memoryTypeIndex);
-
-		device->allocateMemory(&memoryInfo, 0, &memory);
-
-		device->bindBufferMemory(buffer, memory, 0);
-
-		if (mapped)
-			device->mapMemory(memory, 0, elementByteSize * (uint64_t)elementCount, vk::MemoryMapFlags(), reinterpret_cast<void**>(&mappedData));
+		//主机可见的内存由分配器常驻映射，仅设备本地的缓冲没有映射，需通过上传缓冲写入
+		mappedData = allocation.mappedData;
 	}
 
 	void DestroyBuffer(vk::Device* device) {
-		if (mapped)
-			device->unmapMemory(memory);
-
 		device->destroyBuffer(buffer, 0);
-		device->freeMemory(memory, 0);
+
+		if (allocation.allocator)
+			allocation.allocator->Free(allocation);
 	}
 
 	void CopyData(vk::Device* device, uint32_t elementIndex, uint32_t elementCount, const T* data) {
-		if (!mapped)
-			device->mapMemory(memory, 0, elementByteSize * (uint64_t)elementCount, vk::MemoryMapFlags(), reinterpret_cast<void**>(&mappedData));
-
 		memcpy(&mappedData[elementIndex * elementByteSize], data, elementByteSize * elementCount);
-
-		if (!mapped)
-			device->unmapMemory(memory);
 	}
 
 	vk::Buffer GetBuffer()const {
 		return buffer;
 	}
 
+	//主机可见的缓冲可以直接写入，否则为空
+	T* GetMappedData()const {
+		return reinterpret_cast<T*>(mappedData);
+	}
+
 private:
 	vk::Buffer buffer;
-	vk::DeviceMemory memory;
-
-	bool mapped = false;
+	MemoryAllocation allocation;
 
 	BYTE* mappedData = nullptr;
 	uint64_t elementByteSize = 0;
@@ -100,11 +95,11 @@ private:
 
 struct Attachment {
 	vk::Image image;
-	vk::DeviceMemory memory;
+	MemoryAllocation allocation;
 	vk::ImageView imageView;
 };
 
-Attachment CreateAttachment(vk::Device device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::Format format, vk::ImageAspectFlags imageAspect, uint32_t width, uint32_t height, vk::ImageUsageFlags imageUsage);
+Attachment CreateAttachment(vk::Device device, MemoryAllocator* allocator, vk::Format format, vk::ImageAspectFlags imageAspect, uint32_t width, uint32_t height, vk::ImageUsageFlags imageUsage);
 void DestroyAttachment(vk::Device device, Attachment& attachment);
 
 /*===========================================数据存储结构体===========================================*/
@@ -147,6 +142,9 @@ struct PassConstants {
 struct ObjectConstants {
 	glm::mat4x4 worldMatrix;
 	glm::mat4x4 worldMatrix_trans_inv;
+	//压缩顶点的位置还原: posL = encoded * positionScale + positionBias
+	glm::vec4 positionScale = glm::vec4(1.0f);
+	glm::vec4 positionBias = glm::vec4(0.0f);
 };
 
 struct MaterialConstants {
@@ -188,6 +186,9 @@ struct Vulkan {
 		std::vector<vk::VertexInputAttributeDescription> attrib;
 	}vertex;
 
+	vk::PipelineCache pipelineCache;
+	ShaderLibrary* shaderLibrary = nullptr;
+	MemoryAllocator* allocator = nullptr;
 	std::unordered_map<std::string, vk::Pipeline> pipelines;
 	std::unordered_map<std::string, vk::PipelineLayout> pipelineLayout;
 	
@@ -202,6 +203,14 @@ struct Vulkan {
 
 	uint32_t width, height;
 	uint32_t graphicsQueueFamilyIndex;
+
+	bool textureCompressionBC = false;
+	//一次间接绘制调用提交多条命令
+	bool multiDrawIndirect = false;
+	//间接绘制的firstInstance可以不为0，GPU剔除用它索引物体常量
+	bool drawIndirectFirstInstance = false;
+	//VK_KHR_draw_indirect_count，不支持时为空
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
 	uint32_t frameCount;
 
 	PlayerInput input;
@@ -1,5 +1,6 @@
 #pragma once
 #include "../Util/vkUtil.h"
+#include "../Util/Meshlet.h"
 #include "../core/Resource/Texture.h"
 
 enum class SamplerType : int {
@@ -77,14 +78,69 @@ struct GameObject {
 	}
 };
 
+//以AABB中心为球心、到最远顶点的距离为半径的包围球
+template<typename T>
+void ComputeMeshBounds(const std::vector<T>& vertices, glm::vec3& center, float& radius) {
+	center = glm::vec3(0.0f);
+	radius = 0.0f;
+	if (vertices.empty())
+		return;
+
+	glm::vec3 minPos = vertices[0].position, maxPos = vertices[0].position;
+	for (auto& vertex : vertices) {
+		minPos = glm::min(minPos, vertex.position);
+		maxPos = glm::max(maxPos, vertex.position);
+	}
+	center = (minPos + maxPos) * 0.5f;
+	for (auto& vertex : vertices)
+		radius = std::max(radius, glm::length(vertex.position - center));
+}
+
+//静态网格的顶点与索引，Scene按内容去重，相同的网格由多个MeshRenderer共用一份(见Scene::RegisterMesh)
+struct MeshGeometry {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	//登记的顺序，绘制排序时作为网格编号
+	uint32_t id = 0;
+};
+
 struct MeshRenderer {
 	GameObject* gameObject;
 
 	int baseVertexLocation;
 	int startIndexLocation;
-
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	//顶点不超过65536个的网格使用16位索引，startIndexLocation为对应索引缓冲中的位置
+	vk::IndexType indexType = vk::IndexType::eUint32;
+
+	std::shared_ptr<const MeshGeometry> geometry;
+	//各级LOD在geometry->indices中的范围，为空时绘制全部索引，lodIndex由Scene::SelectLods选择
+	std::vector<MeshLod> lods;
+	uint32_t lodIndex = 0;
+
+	uint32_t GetIndexCount()const { return lods.empty() ? static_cast<uint32_t>(geometry->indices.size()) : lods[lodIndex].indexCount; }
+	uint32_t GetFirstIndex()const { return startIndexLocation + (lods.empty() ? 0 : lods[lodIndex].indexOffset); }
+
+	//网格簇(见BuildMeshlets)，主相机的绘制按簇剔除，可见的簇写入间接绘制缓冲
+	std::vector<Meshlet> meshlets;
+	MeshletCullData meshletCullData;
+	//在间接绘制缓冲中占用的命令，数量为各级LOD中最多的簇数
+	uint32_t drawCommandOffset = 0;
+	uint32_t drawCommandCount = 0;
+
+	//当前LOD的簇
+	uint32_t GetFirstMeshlet()const { return lods.empty() ? 0 : lods[lodIndex].meshletOffset; }
+	uint32_t GetMeshletCount()const { return lods.empty() ? static_cast<uint32_t>(meshlets.size()) : lods[lodIndex].meshletCount; }
+
+	//模型空间的包围球
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+
+	//软件遮挡剔除: 作为遮挡物光栅化当前LOD，occluded为这一帧的测试结果(见Scene::CullOcclusion)
+	bool occluder = false;
+	bool occluded = false;
+
+	//由自动实例化的批次绘制(见Scene::BuildInstanceBatches)
+	bool instanced = false;
 };
 
 struct SkinnedMeshRenderer {
@@ -93,8 +149,19 @@ struct SkinnedMeshRenderer {
 
 	int baseVertexLocation;
 	int startIndexLocation;
+	vk::IndexType indexType = vk::IndexType::eUint32;
 
 	std::vector<SkinnedVertex> vertices;
 	std::vector<uint32_t> indices;
+	//各级LOD在indices中的范围，为空时绘制全部索引，lodIndex由Scene::SelectLods选择
+	std::vector<MeshLod> lods;
+	uint32_t lodIndex = 0;
+
+	uint32_t GetIndexCount()const { return lods.empty() ? static_cast<uint32_t>(indices.size()) : lods[lodIndex].indexCount; }
+	uint32_t GetFirstIndex()const { return startIndexLocation + (lods.empty() ? 0 : lods[lodIndex].indexOffset); }
+
+	//模型空间的包围球
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
 };
 
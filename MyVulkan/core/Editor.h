@@ -10,12 +10,29 @@ public:
 	}
 	~Editor() {}
 
+	//显示资源加载进度
+	void SetAssetImporter(AssetImporter* assetImporter) {
+		this->assetImporter = assetImporter;
+	}
+
 	void Update() {
+		//渐进加载时场景中的物体会增加
+		if (objectSelected.size() != scene->GetObjectCount())
+			objectSelected.resize(scene->GetObjectCount());
+
 		ImGui::SetNextWindowSize(ImVec2(300, scene->vkInfo->height - 300), 0);
 		ImGui::SetNextWindowPos(ImVec2(0, 0));
 		ImGui::SetNextWindowBgAlpha(0.3f);
 		ImGui::Begin("GameAsset");
 
+		if (assetImporter && (assetImporter->IsLoading() || scene->GetPendingTextureCount() > 0)) {
+			uint32_t submitted = assetImporter->GetSubmittedCount();
+			uint32_t completed = assetImporter->GetCompletedCount();
+			std::stringstream progress;
+			progress << "Loading " << completed << "/" << submitted;
+			ImGui::ProgressBar(submitted > 0 ? (float)completed / (float)submitted : 1.0f, ImVec2(-1, 0), progress.str().c_str());
+		}
+
 		const char* hierarchyTypeName[] = { "GObject", "Material", "Light" };
 		ImGui::Combo("Type", &hierarchyType, hierarchyTypeName, 3);
 
@@ -271,6 +288,7 @@ private:
 	}
 
 	Scene* scene;
+	AssetImporter* assetImporter = nullptr;
 
 	int index = 0;
 	std::vector<bool> objectSelected;
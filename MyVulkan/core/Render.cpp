@@ -1,6 +1,7 @@
 #include "Render.h"
 
 #include "Component.h"
+#include "../Util/ShaderLibrary.h"
 
 Render::~Render()
 {
@@ -19,19 +20,29 @@ Render::~Render()
 	if (useDeferredShading) {
 		vkInfo->device.destroy(deferredShading.framebuffer);
 		vkInfo->device.destroy(deferredShading.renderPass);
+		if (occlusionCulling) {
+			vkInfo->device.destroy(deferredShading.earlyRenderPass);
+			vkInfo->device.destroy(deferredShading.lateRenderPass);
+		}
 		vkInfo->device.destroy(deferredShading.processingPipeline);
 		vkInfo->device.destroy(deferredShading.pipelineLayout);
 		vkInfo->device.destroy(gbuffer.descSetLayout);
 		for (auto pipeline : deferredShading.outputPipeline) {
 			vkInfo->device.destroy(pipeline);
 		}
+		for (auto pipeline : deferredShading.indirectOutputPipeline) {
+			vkInfo->device.destroy(pipeline);
+		}
 	}
 }
 
 void Render::PrepareResource() {
 	/*Create attachments*/
-	renderTarget = CreateAttachment(vkInfo->device, vkInfo->gpu.getMemoryProperties(), vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
-	depthTarget = CreateAttachment(vkInfo->device, vkInfo->gpu.getMemoryProperties(), vk::Format::eD16Unorm, vk::ImageAspectFlagBits::eDepth, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eDepthStencilAttachment);
+	renderTarget = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
+	vk::ImageUsageFlags depthUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+	if (occlusionCulling)
+		depthUsage |= vk::ImageUsageFlagBits::eSampled;
+	depthTarget = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eD16Unorm, vk::ImageAspectFlagBits::eDepth, vkInfo->width, vkInfo->height, depthUsage);
 
 	//第一个管线布局：世界矩阵
 	auto objCBBinding = vk::DescriptorSetLayoutBinding()
@@ -114,8 +125,15 @@ void Render::PrepareResource() {
 		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
 		.setStageFlags(vk::ShaderStageFlagBits::eVertex);
 
+	//第六个管线布局：间接绘制时所有物体的常量
+	auto layoutBindingObjects = vk::DescriptorSetLayoutBinding()
+		.setBinding(0)
+		.setDescriptorCount(1)
+		.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+		.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+
 	/*Create descriptor set layout*/
-	descSetLayout.resize(5);
+	descSetLayout.resize(6);
 
 	auto descLayoutInfo_obj = vk::DescriptorSetLayoutCreateInfo()
 		.setBindingCount(1)
@@ -141,6 +159,11 @@ void Render::PrepareResource() {
 		.setBindingCount(1)
 		.setPBindings(&layoutBindingSkinned);
 	vkInfo->device.createDescriptorSetLayout(&descLayoutInfo_skinned, 0, &descSetLayout[4]);
+
+	auto descLayoutInfo_objects = vk::DescriptorSetLayoutCreateInfo()
+		.setBindingCount(1)
+		.setPBindings(&layoutBindingObjects);
+	vkInfo->device.createDescriptorSetLayout(&descLayoutInfo_objects, 0, &descSetLayout[5]);
 }
 
 void Render::PrepareForwardShading() {
@@ -209,12 +232,11 @@ void Render::PrepareForwardShading() {
 
 void Render::PrepareGBuffer() {
 	/*Create attachments*/
-	vk::PhysicalDeviceMemoryProperties gpuProp = vkInfo->gpu.getMemoryProperties();
-	gbuffer.diffuseAttach = CreateAttachment(vkInfo->device, gpuProp, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
-	gbuffer.normalAttach = CreateAttachment(vkInfo->device, gpuProp, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
-	gbuffer.materialAttach = CreateAttachment(vkInfo->device, gpuProp, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
-	gbuffer.positionAttach = CreateAttachment(vkInfo->device, gpuProp, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
-	gbuffer.shadowPosAttach = CreateAttachment(vkInfo->device, gpuProp, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+	gbuffer.diffuseAttach = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+	gbuffer.normalAttach = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+	gbuffer.materialAttach = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+	gbuffer.positionAttach = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+	gbuffer.shadowPosAttach = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
 }
 
 void Render::PrepareDeferredShading() {
@@ -371,6 +393,20 @@ void Render::PrepareDeferredShading() {
 		.setPSubpasses(subpassDescriptions.data());
 	vkInfo->device.createRenderPass(&renderPassInfo, 0, &deferredShading.renderPass);
 
+	//两段式的渲染通道只有加载/存储操作与初始布局不同，与上面的兼容，共用管线与帧缓冲
+	if (occlusionCulling) {
+		for (uint32_t i = 2; i < attachments.size(); i++)
+			attachments[i].setStoreOp(vk::AttachmentStoreOp::eStore);
+		vkInfo->device.createRenderPass(&renderPassInfo, 0, &deferredShading.earlyRenderPass);
+
+		for (auto& attachment : attachments) {
+			attachment.setLoadOp(vk::AttachmentLoadOp::eLoad);
+			attachment.setInitialLayout(attachment.finalLayout);
+		}
+		attachments[1].setStencilLoadOp(vk::AttachmentLoadOp::eLoad);
+		vkInfo->device.createRenderPass(&renderPassInfo, 0, &deferredShading.lateRenderPass);
+	}
+
 	/*Create framebuffer*/
 	vk::ImageView imageViewAttachments[7];
 	imageViewAttachments[0] = renderTarget.imageView;
@@ -498,12 +534,12 @@ void Render::PrepareDescriptor() {
 	}
 }
 
-void Render::PreparePipeline() {
+void Render::PreparePipeline(PipelineCompiler& pipelineCompiler) {
 	if (useDeferredShading) {
-		auto vertexShader = CreateShaderModule("Shaders\\vertex.spv", vkInfo->device);
-		auto outputShader = CreateShaderModule("Shaders\\deferredShadingOutput.spv", vkInfo->device);
-		auto quadShader = CreateShaderModule("Shaders\\bloomVS.spv", vkInfo->device);
-		auto processingShader = CreateShaderModule("Shaders\\deferredShadingProcessing.spv", vkInfo->device);
+		auto vertexShader = vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "vertexCompact" : "vertex");
+		auto outputShader = vkInfo->shaderLibrary->GetShaderModule("deferredShadingOutput");
+		auto quadShader = vkInfo->shaderLibrary->GetShaderModule("bloomVS");
+		auto processingShader = vkInfo->shaderLibrary->GetShaderModule("deferredShadingProcessing");
 
 		std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderInfo(2);
 
@@ -620,7 +656,25 @@ void Render::PreparePipeline() {
 
 			pipelineShaderInfo[1].setPSpecializationInfo(&shaderModelSI);
 
-			vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, 0, &deferredShading.outputPipeline[i]);
+			pipelineCompiler.Add(pipelineInfo, &deferredShading.outputPipeline[i]);
+		}
+
+		//间接绘制只换顶点着色器，其余状态相同
+		if (gpuDrivenRendering) {
+			pipelineShaderInfo[0].setModule(vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "vertexCompactIndirect" : "vertexIndirect"));
+
+			deferredShading.indirectOutputPipeline.resize((int)ShaderModel::shaderModelCount);
+			for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
+				auto shaderModelSI = vk::SpecializationInfo()
+					.setDataSize(sizeof(int))
+					.setMapEntryCount(1)
+					.setPMapEntries(&shaderModelSME)
+					.setPData(&i);
+
+				pipelineShaderInfo[1].setPSpecializationInfo(&shaderModelSI);
+
+				pipelineCompiler.Add(pipelineInfo, &deferredShading.indirectOutputPipeline[i]);
+			}
 		}
 
 		pipelineShaderInfo[0] = vk::PipelineShaderStageCreateInfo()
@@ -648,12 +702,8 @@ void Render::PreparePipeline() {
 		pipelineInfo.setSubpass(1);
 		pipelineInfo.setLayout(deferredShading.pipelineLayout);
 		
-		vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, 0, &deferredShading.processingPipeline);
+		pipelineCompiler.Add(pipelineInfo, &deferredShading.processingPipeline);
 
-		vkInfo->device.destroy(vertexShader);
-		vkInfo->device.destroy(outputShader);
-		vkInfo->device.destroy(quadShader);
-		vkInfo->device.destroy(processingShader);
 	}
 }
 
@@ -676,7 +726,7 @@ void Render::BeginForwardShading(vk::CommandBuffer cmd) {
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 }
 
-void Render::BeginDeferredShading(vk::CommandBuffer cmd) {
+void Render::BeginDeferredShading(vk::CommandBuffer cmd, vk::RenderPass renderPass) {
 	if (!useDeferredShading) {
 		MessageBox(0, L"You dont use deferred shading!", 0, 0);
 		return;
@@ -694,7 +744,7 @@ void Render::BeginDeferredShading(vk::CommandBuffer cmd) {
 		.setClearValueCount(7)
 		.setPClearValues(clearValue)
 		.setFramebuffer(deferredShading.framebuffer)
-		.setRenderPass(deferredShading.renderPass)
+		.setRenderPass(renderPass ? renderPass : deferredShading.renderPass)
 		.setRenderArea(vk::Rect2D(vk::Offset2D(0.0f, 0.0f), vk::Extent2D(vkInfo->width, vkInfo->height)));
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 }
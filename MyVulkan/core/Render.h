@@ -1,5 +1,6 @@
 #pragma once
 #include "../Util/vkUtil.h"
+#include "../Util/PipelineCompiler.h"
 
 class Render {
 public:
@@ -12,10 +13,11 @@ public:
     void PrepareDeferredShading();
 
     void PrepareDescriptor();
-    void PreparePipeline();
+    void PreparePipeline(PipelineCompiler& pipelineCompiler);
 
     void BeginForwardShading(vk::CommandBuffer cmd);
-    void BeginDeferredShading(vk::CommandBuffer cmd);
+    //renderPass为空时使用deferredShading.renderPass，也可以是与它兼容的earlyRenderPass或lateRenderPass
+    void BeginDeferredShading(vk::CommandBuffer cmd, vk::RenderPass renderPass = vk::RenderPass());
 
     Vulkan* vkInfo;
 
@@ -42,11 +44,22 @@ public:
     struct {
         vk::Framebuffer framebuffer;
         vk::RenderPass renderPass;
+        //遮挡剔除把G-Buffer分两次绘制: early保存所有附件，late在其上继续绘制并完成光照
+        vk::RenderPass earlyRenderPass;
+        vk::RenderPass lateRenderPass;
         vk::PipelineLayout pipelineLayout;
         std::vector<vk::Pipeline> outputPipeline;
+        //GPU剔除后间接绘制与自动实例化使用的输出管线，物体常量从存储缓冲读取
+        std::vector<vk::Pipeline> indirectOutputPipeline;
         vk::Pipeline processingPipeline;
     }deferredShading;
 
     bool useForwardShading = false;
     bool useDeferredShading = false;
+    //G-Buffer输出管线使用压缩顶点格式的顶点着色器
+    bool compactVertices = false;
+    //创建间接绘制(也用于实例化绘制)的输出管线，需要vertexIndirect等着色器
+    bool gpuDrivenRendering = false;
+    //深度可被采样以建立层级深度，并创建两段式的G-Buffer渲染通道，在PrepareResource之前设定
+    bool occlusionCulling = false;
 };
\ No newline at end of file
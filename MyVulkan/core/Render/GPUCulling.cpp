@@ -0,0 +1,507 @@
+#include "GPUCulling.h"
+
+#include "../../Util/Meshlet.h"
+#include "../../Util/ShaderLibrary.h"
+
+#include <algorithm>
+
+//容量不足时重新创建，返回true表示换了缓冲，需要重写描述符
+template<typename T>
+static bool ReserveBuffer(Vulkan* vkInfo, std::unique_ptr<Buffer<T>>& buffer, uint32_t& capacity, uint32_t elementCount, vk::BufferUsageFlags usage, bool hostVisible) {
+	//空缓冲无法创建，至少保留一个元素
+	elementCount = std::max(elementCount, 1u);
+	if (buffer != nullptr && capacity >= elementCount)
+		return false;
+
+	if (buffer != nullptr)
+		buffer->DestroyBuffer(&vkInfo->device);
+	//多预留一半，逐个加入物体时不必每次都重建
+	capacity = elementCount + elementCount / 2;
+	if (hostVisible)
+		buffer = std::make_unique<Buffer<T>>(&vkInfo->device, capacity, usage, vkInfo->allocator,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	else
+		buffer = std::make_unique<Buffer<T>>(&vkInfo->device, capacity, usage, vkInfo->allocator, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	return true;
+}
+
+template<typename T>
+static void DestroyBuffer(Vulkan* vkInfo, std::unique_ptr<Buffer<T>>& buffer) {
+	if (buffer != nullptr)
+		buffer->DestroyBuffer(&vkInfo->device);
+	buffer = nullptr;
+}
+
+GPUCulling::~GPUCulling() {
+	if (vkInfo == nullptr)
+		return;
+
+	DestroyBuffer(vkInfo, objectBuffer);
+	DestroyBuffer(vkInfo, drawBuffer);
+	DestroyBuffer(vkInfo, bucketOffsetBuffer);
+	DestroyBuffer(vkInfo, constantBuffer);
+	DestroyBuffer(vkInfo, commandBuffer);
+	DestroyBuffer(vkInfo, countBuffer);
+	DestroyBuffer(vkInfo, occludedBuffer);
+	if (occlusionCulling)
+		DestroyHiZ();
+
+	vkInfo->device.destroy(pipeline);
+	vkInfo->device.destroy(latePipeline);
+	vkInfo->device.destroy(pipelineLayout);
+	vkInfo->device.destroy(cullSetLayout);
+	vkInfo->device.destroy(descPool);
+}
+
+void GPUCulling::Init(Vulkan* vkInfo, vk::DescriptorSetLayout objectSetLayout, const Attachment* depthTarget, UploadBatcher* uploadBatcher) {
+	this->vkInfo = vkInfo;
+	occlusionCulling = depthTarget != nullptr && uploadBatcher != nullptr;
+
+	//层级深度逐级减半(向下取整)直到1x1
+	if (occlusionCulling) {
+		depthWidth = vkInfo->width;
+		depthHeight = vkInfo->height;
+		uint32_t width = std::max(depthWidth / 2, 1u);
+		uint32_t height = std::max(depthHeight / 2, 1u);
+		hiZLevels = 1;
+		while (width > 1 || height > 1) {
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+			hiZLevels++;
+		}
+	}
+
+	//剔除使用的描述符: 物体常量、绘制信息、桶起点、输出的命令与计数、剔除常量，遮挡剔除再加上层级深度与被遮挡的标记
+	const uint32_t bindingCount = occlusionCulling ? 8 : 6;
+	vk::DescriptorSetLayoutBinding cullBindings[8];
+	for (uint32_t i = 0; i < bindingCount; i++) {
+		vk::DescriptorType type = vk::DescriptorType::eStorageBuffer;
+		if (i == 5)
+			type = vk::DescriptorType::eUniformBuffer;
+		else if (i == 6)
+			type = vk::DescriptorType::eSampledImage;
+		cullBindings[i] = vk::DescriptorSetLayoutBinding()
+			.setBinding(i)
+			.setDescriptorCount(1)
+			.setDescriptorType(type)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	}
+	auto setLayoutInfo = vk::DescriptorSetLayoutCreateInfo()
+		.setBindingCount(bindingCount)
+		.setPBindings(cullBindings);
+	vkInfo->device.createDescriptorSetLayout(&setLayoutInfo, 0, &cullSetLayout);
+
+	auto pipelineLayoutInfo = vk::PipelineLayoutCreateInfo()
+		.setSetLayoutCount(1)
+		.setPSetLayouts(&cullSetLayout);
+	vkInfo->device.createPipelineLayout(&pipelineLayoutInfo, 0, &pipelineLayout);
+
+	//计算管线很少，直接同步创建，遮挡剔除的两段由特化常量cullPhase区分
+	uint32_t cullPhases[2] = { 0, 1 };
+	vk::SpecializationMapEntry phaseEntry;
+	phaseEntry.setConstantID(0);
+	phaseEntry.setOffset(0);
+	phaseEntry.setSize(sizeof(uint32_t));
+	vk::SpecializationInfo phaseInfo[2];
+	vk::ComputePipelineCreateInfo pipelineInfo[2];
+	for (uint32_t i = 0; i < 2; i++) {
+		phaseInfo[i].setDataSize(sizeof(uint32_t));
+		phaseInfo[i].setPData(&cullPhases[i]);
+		phaseInfo[i].setMapEntryCount(1);
+		phaseInfo[i].setPMapEntries(&phaseEntry);
+
+		auto shaderInfo = vk::PipelineShaderStageCreateInfo()
+			.setPName("main")
+			.setModule(vkInfo->shaderLibrary->GetShaderModule(occlusionCulling ? "cullDrawsOcclusion" : "cullDraws"))
+			.setStage(vk::ShaderStageFlagBits::eCompute);
+		if (occlusionCulling)
+			shaderInfo.setPSpecializationInfo(&phaseInfo[i]);
+		pipelineInfo[i] = vk::ComputePipelineCreateInfo()
+			.setStage(shaderInfo)
+			.setLayout(pipelineLayout);
+	}
+	vk::Pipeline pipelines[2];
+	if (vkInfo->device.createComputePipelines(vkInfo->pipelineCache, occlusionCulling ? 2 : 1, pipelineInfo, 0, pipelines) != vk::Result::eSuccess)
+		MessageBox(0, L"Create culling pipeline failed!!!", 0, 0);
+	pipeline = pipelines[0];
+	if (occlusionCulling)
+		latePipeline = pipelines[1];
+
+	//每级层级深度一个描述符集
+	vk::DescriptorPoolSize typeCount[] = {
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 7),
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1),
+		vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, 1 + hiZLevels),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, hiZLevels)
+	};
+	auto descriptorPoolInfo = vk::DescriptorPoolCreateInfo()
+		.setMaxSets(2 + hiZLevels)
+		.setPoolSizeCount(occlusionCulling ? 4 : 2)
+		.setPPoolSizes(typeCount);
+	if (vkInfo->device.createDescriptorPool(&descriptorPoolInfo, 0, &descPool) != vk::Result::eSuccess) {
+		MessageBox(0, L"Create descriptor pool failed!!!", 0, 0);
+		return;
+	}
+
+	vk::DescriptorSetLayout setLayouts[] = { cullSetLayout, objectSetLayout };
+	vk::DescriptorSet descSets[2];
+	auto descSetAllocInfo = vk::DescriptorSetAllocateInfo()
+		.setDescriptorPool(descPool)
+		.setDescriptorSetCount(2)
+		.setPSetLayouts(setLayouts);
+	vkInfo->device.allocateDescriptorSets(&descSetAllocInfo, descSets);
+	cullDescSet = descSets[0];
+	objectDescSet = descSets[1];
+
+	if (occlusionCulling)
+		PrepareHiZ(*depthTarget, *uploadBatcher);
+
+	ReserveBuffer(vkInfo, constantBuffer, constantCapacity, 1, vk::BufferUsageFlagBits::eUniformBuffer, true);
+	CullConstants* constants = constantBuffer->GetMappedData();
+	*constants = CullConstants();
+	constants->depthSize = glm::vec2(depthWidth, depthHeight);
+	constants->hiZLevels = hiZLevels;
+	SetDraws(std::vector<DrawInfo>(), 0, 0, 0);
+}
+
+void GPUCulling::PrepareHiZ(const Attachment& depthTarget, UploadBatcher& uploadBatcher) {
+	depthImage = depthTarget.image;
+	depthView = depthTarget.imageView;
+
+	//存储图像在General布局下写入与读取
+	auto imageInfo = vk::ImageCreateInfo()
+		.setArrayLayers(1)
+		.setExtent(vk::Extent3D(std::max(depthWidth / 2, 1u), std::max(depthHeight / 2, 1u), 1))
+		.setFormat(vk::Format::eR32Sfloat)
+		.setImageType(vk::ImageType::e2D)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setMipLevels(hiZLevels)
+		.setSamples(vk::SampleCountFlagBits::e1)
+		.setSharingMode(vk::SharingMode::eExclusive)
+		.setTiling(vk::ImageTiling::eOptimal)
+		.setUsage(vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
+	vkInfo->device.createImage(&imageInfo, 0, &hiZImage);
+	if (!vkInfo->allocator->AllocateImage(hiZImage, vk::MemoryPropertyFlagBits::eDeviceLocal, hiZAllocation)) {
+		MessageBox(0, L"Allocate Hi-Z memory failed!!!", 0, 0);
+		return;
+	}
+
+	auto viewInfo = vk::ImageViewCreateInfo()
+		.setImage(hiZImage)
+		.setFormat(vk::Format::eR32Sfloat)
+		.setViewType(vk::ImageViewType::e2D)
+		.setComponents(vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA))
+		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, hiZLevels, 0, 1));
+	vkInfo->device.createImageView(&viewInfo, 0, &hiZView);
+	hiZLevelViews.resize(hiZLevels);
+	for (uint32_t i = 0; i < hiZLevels; i++) {
+		viewInfo.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1));
+		vkInfo->device.createImageView(&viewInfo, 0, &hiZLevelViews[i]);
+	}
+
+	//建立一级: 输入上一级，输出这一级
+	vk::DescriptorSetLayoutBinding hiZBindings[2];
+	hiZBindings[0] = vk::DescriptorSetLayoutBinding()
+		.setBinding(0)
+		.setDescriptorCount(1)
+		.setDescriptorType(vk::DescriptorType::eSampledImage)
+		.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	hiZBindings[1] = vk::DescriptorSetLayoutBinding()
+		.setBinding(1)
+		.setDescriptorCount(1)
+		.setDescriptorType(vk::DescriptorType::eStorageImage)
+		.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	auto setLayoutInfo = vk::DescriptorSetLayoutCreateInfo()
+		.setBindingCount(2)
+		.setPBindings(hiZBindings);
+	vkInfo->device.createDescriptorSetLayout(&setLayoutInfo, 0, &hiZSetLayout);
+
+	auto pipelineLayoutInfo = vk::PipelineLayoutCreateInfo()
+		.setSetLayoutCount(1)
+		.setPSetLayouts(&hiZSetLayout);
+	vkInfo->device.createPipelineLayout(&pipelineLayoutInfo, 0, &hiZPipelineLayout);
+
+	auto shaderInfo = vk::PipelineShaderStageCreateInfo()
+		.setPName("main")
+		.setModule(vkInfo->shaderLibrary->GetShaderModule("buildHiZ"))
+		.setStage(vk::ShaderStageFlagBits::eCompute);
+	auto pipelineInfo = vk::ComputePipelineCreateInfo()
+		.setStage(shaderInfo)
+		.setLayout(hiZPipelineLayout);
+	if (vkInfo->device.createComputePipelines(vkInfo->pipelineCache, 1, &pipelineInfo, 0, &hiZPipeline) != vk::Result::eSuccess)
+		MessageBox(0, L"Create Hi-Z pipeline failed!!!", 0, 0);
+
+	std::vector<vk::DescriptorSetLayout> setLayouts(hiZLevels, hiZSetLayout);
+	hiZDescSets.resize(hiZLevels);
+	auto descSetAllocInfo = vk::DescriptorSetAllocateInfo()
+		.setDescriptorPool(descPool)
+		.setDescriptorSetCount(hiZLevels)
+		.setPSetLayouts(setLayouts.data());
+	vkInfo->device.allocateDescriptorSets(&descSetAllocInfo, hiZDescSets.data());
+
+	//第0级读取深度附件，建立时深度处于ShaderReadOnlyOptimal
+	std::vector<vk::DescriptorImageInfo> imageInfos(hiZLevels * 2 + 1);
+	std::vector<vk::WriteDescriptorSet> descSetWrites(hiZLevels * 2 + 1);
+	for (uint32_t i = 0; i < hiZLevels; i++) {
+		if (i == 0)
+			imageInfos[i * 2] = vk::DescriptorImageInfo(vk::Sampler(), depthView, vk::ImageLayout::eShaderReadOnlyOptimal);
+		else
+			imageInfos[i * 2] = vk::DescriptorImageInfo(vk::Sampler(), hiZLevelViews[i - 1], vk::ImageLayout::eGeneral);
+		imageInfos[i * 2 + 1] = vk::DescriptorImageInfo(vk::Sampler(), hiZLevelViews[i], vk::ImageLayout::eGeneral);
+
+		for (uint32_t j = 0; j < 2; j++) {
+			descSetWrites[i * 2 + j].setDescriptorCount(1);
+			descSetWrites[i * 2 + j].setDescriptorType(j == 0 ? vk::DescriptorType::eSampledImage : vk::DescriptorType::eStorageImage);
+			descSetWrites[i * 2 + j].setDstArrayElement(0);
+			descSetWrites[i * 2 + j].setDstBinding(j);
+			descSetWrites[i * 2 + j].setDstSet(hiZDescSets[i]);
+			descSetWrites[i * 2 + j].setPImageInfo(&imageInfos[i * 2 + j]);
+		}
+	}
+	//剔除读取整个层级深度
+	imageInfos.back() = vk::DescriptorImageInfo(vk::Sampler(), hiZView, vk::ImageLayout::eGeneral);
+	descSetWrites.back().setDescriptorCount(1);
+	descSetWrites.back().setDescriptorType(vk::DescriptorType::eSampledImage);
+	descSetWrites.back().setDstArrayElement(0);
+	descSetWrites.back().setDstBinding(6);
+	descSetWrites.back().setDstSet(cullDescSet);
+	descSetWrites.back().setPImageInfo(&imageInfos.back());
+	vkInfo->device.updateDescriptorSets(descSetWrites.size(), descSetWrites.data(), 0, 0);
+
+	//之后一直保持General
+	UploadBatcher::Recording recording(uploadBatcher);
+	auto barrier = vk::ImageMemoryBarrier()
+		.setImage(hiZImage)
+		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setNewLayout(vk::ImageLayout::eGeneral)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, hiZLevels, 0, 1))
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+	recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), 0, 0, 0, 0, 1, &barrier);
+}
+
+void GPUCulling::DestroyHiZ() {
+	vkInfo->device.destroy(hiZPipeline);
+	vkInfo->device.destroy(hiZPipelineLayout);
+	vkInfo->device.destroy(hiZSetLayout);
+	for (auto& view : hiZLevelViews)
+		vkInfo->device.destroy(view);
+	vkInfo->device.destroy(hiZView);
+	vkInfo->device.destroy(hiZImage);
+	if (hiZAllocation.allocator != nullptr)
+		hiZAllocation.allocator->Free(hiZAllocation);
+}
+
+void GPUCulling::SetDraws(const std::vector<DrawInfo>& draws, uint32_t mainBucketCount, uint32_t shadowBucketCount, uint32_t objectCount) {
+	drawCount = static_cast<uint32_t>(draws.size());
+	this->mainBucketCount = mainBucketCount;
+	this->shadowBucketCount = shadowBucketCount;
+
+	//每个桶按分到它的绘制数预留命令，全部可见时也放得下，遮挡剔除的late桶排在阴影之后
+	uint32_t lateBucketOffset = mainBucketCount + shadowBucketCount;
+	uint32_t bucketCount = lateBucketOffset + (occlusionCulling ? mainBucketCount : 0);
+	bucketSizes.assign(bucketCount, 0);
+	for (auto& draw : draws) {
+		if (draw.bucket != invalidDrawBucket) {
+			bucketSizes[draw.bucket]++;
+			if (occlusionCulling)
+				bucketSizes[lateBucketOffset + draw.bucket]++;
+		}
+		if (draw.shadowBucket != invalidDrawBucket)
+			bucketSizes[mainBucketCount + draw.shadowBucket]++;
+	}
+	bucketOffsets.assign(bucketCount, 0);
+	uint32_t commandCount = 0;
+	for (uint32_t i = 0; i < bucketCount; i++) {
+		bucketOffsets[i] = commandCount;
+		commandCount += bucketSizes[i];
+	}
+
+	vk::BufferUsageFlags input = vk::BufferUsageFlagBits::eStorageBuffer;
+	vk::BufferUsageFlags output = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst;
+	bool rewrite = false;
+	rewrite |= ReserveBuffer(vkInfo, objectBuffer, objectCapacity, objectCount, input, true);
+	rewrite |= ReserveBuffer(vkInfo, drawBuffer, drawCapacity, drawCount, input, true);
+	rewrite |= ReserveBuffer(vkInfo, bucketOffsetBuffer, bucketCapacity, bucketCount, input, true);
+	rewrite |= ReserveBuffer(vkInfo, commandBuffer, commandCapacity, commandCount, output, false);
+	rewrite |= ReserveBuffer(vkInfo, countBuffer, countCapacity, bucketCount, output, false);
+	if (occlusionCulling)
+		rewrite |= ReserveBuffer(vkInfo, occludedBuffer, occludedCapacity, drawCount, input, false);
+	if (rewrite)
+		WriteDescriptors();
+
+	if (drawCount > 0)
+		drawBuffer->CopyData(&vkInfo->device, 0, drawCount, draws.data());
+	if (bucketCount > 0)
+		bucketOffsetBuffer->CopyData(&vkInfo->device, 0, bucketCount, bucketOffsets.data());
+
+	CullConstants* constants = constantBuffer->GetMappedData();
+	constants->drawCount = drawCount;
+	constants->mainBucketCount = mainBucketCount;
+	constants->shadowBucketCount = shadowBucketCount;
+}
+
+void GPUCulling::UpdateDrawRange(uint32_t drawIndex, uint32_t indexCount, uint32_t firstIndex) {
+	if (drawIndex >= drawCount)
+		return;
+
+	DrawInfo* draw = drawBuffer->GetMappedData() + drawIndex;
+	draw->indexCount = indexCount;
+	draw->firstIndex = firstIndex;
+}
+
+void GPUCulling::UpdateObject(uint32_t objectIndex, const ObjectConstants& objectConstants) {
+	//之后加入、还未分配常量的物体在SetDraws之后写入
+	if (objectIndex >= objectCapacity)
+		return;
+
+	objectBuffer->CopyData(&vkInfo->device, objectIndex, 1, &objectConstants);
+}
+
+void GPUCulling::SetViews(const glm::mat4x4& mainViewProj, const glm::mat4x4& shadowViewProj) {
+	CullConstants* constants = constantBuffer->GetMappedData();
+	ExtractFrustumPlanes(mainViewProj, &constants->planes[0]);
+	ExtractFrustumPlanes(shadowViewProj, &constants->planes[6]);
+
+	//每帧调用一次，上一帧的视图就是层级深度建立时的视图
+	if (occlusionCulling) {
+		constants->hiZViewProj = constants->viewProj;
+		constants->hiZValid = viewsSet ? 1 : 0;
+		constants->viewProj = mainViewProj;
+		viewsSet = true;
+	}
+}
+
+void GPUCulling::WriteDescriptors() {
+	vk::DescriptorBufferInfo bufferInfo[7] = {
+		vk::DescriptorBufferInfo(objectBuffer->GetBuffer(), 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(drawBuffer->GetBuffer(), 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(bucketOffsetBuffer->GetBuffer(), 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(commandBuffer->GetBuffer(), 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(countBuffer->GetBuffer(), 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(constantBuffer->GetBuffer(), 0, sizeof(CullConstants)),
+		vk::DescriptorBufferInfo(occlusionCulling ? occludedBuffer->GetBuffer() : vk::Buffer(), 0, VK_WHOLE_SIZE)
+	};
+
+	vk::WriteDescriptorSet descSetWrites[8];
+	for (uint32_t i = 0; i < 6; i++) {
+		descSetWrites[i].setDescriptorCount(1);
+		descSetWrites[i].setDescriptorType(i < 5 ? vk::DescriptorType::eStorageBuffer : vk::DescriptorType::eUniformBuffer);
+		descSetWrites[i].setDstArrayElement(0);
+		descSetWrites[i].setDstBinding(i);
+		descSetWrites[i].setDstSet(cullDescSet);
+		descSetWrites[i].setPBufferInfo(&bufferInfo[i]);
+	}
+
+	//顶点着色器按SV_InstanceID读取物体常量
+	descSetWrites[6].setDescriptorCount(1);
+	descSetWrites[6].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	descSetWrites[6].setDstArrayElement(0);
+	descSetWrites[6].setDstBinding(0);
+	descSetWrites[6].setDstSet(objectDescSet);
+	descSetWrites[6].setPBufferInfo(&bufferInfo[0]);
+
+	if (occlusionCulling) {
+		descSetWrites[7].setDescriptorCount(1);
+		descSetWrites[7].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		descSetWrites[7].setDstArrayElement(0);
+		descSetWrites[7].setDstBinding(7);
+		descSetWrites[7].setDstSet(cullDescSet);
+		descSetWrites[7].setPBufferInfo(&bufferInfo[6]);
+	}
+
+	vkInfo->device.updateDescriptorSets(occlusionCulling ? 8 : 7, descSetWrites, 0, 0);
+}
+
+void GPUCulling::RecordCulling(vk::CommandBuffer cmd) {
+	if (drawCount == 0 || !pipeline)
+		return;
+
+	//没有计数扩展时每个桶都按容量提交，未写入的命令清零后索引数为0
+	cmd.fillBuffer(countBuffer->GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+	if (vkInfo->cmdDrawIndexedIndirectCount == nullptr)
+		cmd.fillBuffer(commandBuffer->GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+	auto clearBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), 1, &clearBarrier, 0, 0, 0, 0);
+
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, 1, &cullDescSet, 0, 0);
+	cmd.dispatch((drawCount + 63) / 64, 1, 1);
+
+	auto cullBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, vk::DependencyFlags(), 1, &cullBarrier, 0, 0, 0, 0);
+}
+
+void GPUCulling::RecordOcclusionCulling(vk::CommandBuffer cmd) {
+	if (!occlusionCulling || drawCount == 0 || !latePipeline || !hiZPipeline)
+		return;
+
+	//深度转为着色器读取，同时等待第一段剔除读完上一帧的层级深度
+	auto depthRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+	auto depthBarrier = vk::ImageMemoryBarrier()
+		.setImage(depthImage)
+		.setOldLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setSubresourceRange(depthRange)
+		.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), 0, 0, 0, 0, 1, &depthBarrier);
+
+	//逐级建立，每级之后等待写入完成再读取
+	auto levelBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, hiZPipeline);
+	uint32_t width = std::max(depthWidth / 2, 1u);
+	uint32_t height = std::max(depthHeight / 2, 1u);
+	for (uint32_t i = 0; i < hiZLevels; i++) {
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, hiZPipelineLayout, 0, 1, &hiZDescSets[i], 0, 0);
+		cmd.dispatch((width + 7) / 8, (height + 7) / 8, 1);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), 1, &levelBarrier, 0, 0, 0, 0);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+
+	//第二段只处理第一段标记为被遮挡的绘制，写入late桶
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, latePipeline);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, 1, &cullDescSet, 0, 0);
+	cmd.dispatch((drawCount + 63) / 64, 1, 1);
+
+	auto cullBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, vk::DependencyFlags(), 1, &cullBarrier, 0, 0, 0, 0);
+
+	//深度还给late的G-Buffer绘制
+	depthBarrier
+		.setOldLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setNewLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderRead)
+		.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+		vk::DependencyFlags(), 0, 0, 0, 0, 1, &depthBarrier);
+}
+
+void GPUCulling::DrawBucket(vk::CommandBuffer cmd, uint32_t bucket) {
+	if (bucket >= bucketSizes.size() || bucketSizes[bucket] == 0)
+		return;
+
+	const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+	vk::DeviceSize offset = (vk::DeviceSize)bucketOffsets[bucket] * stride;
+	if (vkInfo->cmdDrawIndexedIndirectCount != nullptr) {
+		vkInfo->cmdDrawIndexedIndirectCount(static_cast<VkCommandBuffer>(cmd), static_cast<VkBuffer>(commandBuffer->GetBuffer()), offset,
+			static_cast<VkBuffer>(countBuffer->GetBuffer()), (vk::DeviceSize)bucket * sizeof(uint32_t), bucketSizes[bucket], stride);
+	}
+	else {
+		cmd.drawIndexedIndirect(commandBuffer->GetBuffer(), offset, bucketSizes[bucket], stride);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "../../Util/vkUtil.h"
+#include "../../Util/UploadBatcher.h"
+
+//绘制不属于某一视图时的桶编号
+const uint32_t invalidDrawBucket = 0xffffffff;
+
+/*静态网格的GPU剔除: 计算着色器按主相机与阴影的视锥剔除，把可见的绘制写成间接命令，每个桶(相同管线与绑定)一次间接绘制
+  开启遮挡剔除时主相机的绘制分两段: 先用上一帧的层级深度剔除并绘制(early)，再用这些绘制得到的深度重建层级深度，
+  复查被剔除的绘制，仍然可见的补画(late)，相机移动后新露出的物体不会漏画*/
+class GPUCulling {
+public:
+    //与CullDraws.hlsl中的结构一致
+    struct DrawInfo {
+        uint32_t objectIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t firstIndex = 0;
+        int32_t vertexOffset = 0;
+        //模型空间的包围球
+        glm::vec4 bounds = glm::vec4(0.0f);
+        uint32_t bucket = invalidDrawBucket;
+        uint32_t shadowBucket = invalidDrawBucket;
+        uint32_t padding[2] = {};
+    };
+
+    GPUCulling() {}
+    ~GPUCulling();
+
+    //objectSetLayout为顶点着色器读取物体常量的布局(set 5)
+    //给出深度附件时开启遮挡剔除，深度需要可被采样，层级深度的布局转换记录到uploadBatcher中
+    void Init(Vulkan* vkInfo, vk::DescriptorSetLayout objectSetLayout, const Attachment* depthTarget = nullptr, UploadBatcher* uploadBatcher = nullptr);
+
+    //重建所有绘制与桶，只在GPU用完上一帧之后调用，之后需要重新录制命令
+    void SetDraws(const std::vector<DrawInfo>& draws, uint32_t mainBucketCount, uint32_t shadowBucketCount, uint32_t objectCount);
+    //LOD变化时改写绘制的索引范围
+    void UpdateDrawRange(uint32_t drawIndex, uint32_t indexCount, uint32_t firstIndex);
+    void UpdateObject(uint32_t objectIndex, const ObjectConstants& objectConstants);
+    //主相机与阴影的视图投影矩阵
+    void SetViews(const glm::mat4x4& mainViewProj, const glm::mat4x4& shadowViewProj);
+
+    //在渲染通道之外录制，清空计数后剔除
+    void RecordCulling(vk::CommandBuffer cmd);
+    //early的G-Buffer绘制之后、late之前录制: 由深度建立层级深度，复查被遮挡的绘制
+    void RecordOcclusionCulling(vk::CommandBuffer cmd);
+    //绘制一个桶，调用前绑定好管线、描述符与索引缓冲
+    void DrawMainBucket(vk::CommandBuffer cmd, uint32_t bucket) { DrawBucket(cmd, bucket); }
+    void DrawShadowBucket(vk::CommandBuffer cmd, uint32_t bucket) { DrawBucket(cmd, mainBucketCount + bucket); }
+    void DrawLateBucket(vk::CommandBuffer cmd, uint32_t bucket) { DrawBucket(cmd, mainBucketCount + shadowBucketCount + bucket); }
+
+    vk::DescriptorSet GetObjectDescSet()const { return objectDescSet; }
+    uint32_t GetDrawCount()const { return drawCount; }
+    bool IsOcclusionCulling()const { return occlusionCulling; }
+
+private:
+    struct CullConstants {
+        glm::vec4 planes[12];
+        uint32_t drawCount;
+        uint32_t mainBucketCount;
+        uint32_t shadowBucketCount;
+        uint32_t padding;
+        glm::mat4x4 viewProj;
+        //层级深度建立时的视图，即上一帧的
+        glm::mat4x4 hiZViewProj;
+        glm::vec2 depthSize;
+        uint32_t hiZLevels;
+        uint32_t hiZValid;
+    };
+
+    void DrawBucket(vk::CommandBuffer cmd, uint32_t bucket);
+    void WriteDescriptors();
+    void PrepareHiZ(const Attachment& depthTarget, UploadBatcher& uploadBatcher);
+    void DestroyHiZ();
+
+    Vulkan* vkInfo = nullptr;
+
+    vk::DescriptorPool descPool;
+    vk::DescriptorSetLayout cullSetLayout;
+    vk::DescriptorSet cullDescSet;
+    vk::DescriptorSet objectDescSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+    //遮挡剔除第二段，与pipeline只有特化常量不同
+    vk::Pipeline latePipeline;
+
+    //主机可见，CPU直接改写
+    std::unique_ptr<Buffer<ObjectConstants>> objectBuffer;
+    std::unique_ptr<Buffer<DrawInfo>> drawBuffer;
+    std::unique_ptr<Buffer<uint32_t>> bucketOffsetBuffer;
+    std::unique_ptr<Buffer<CullConstants>> constantBuffer;
+    //由计算着色器写入
+    std::unique_ptr<Buffer<vk::DrawIndexedIndirectCommand>> commandBuffer;
+    std::unique_ptr<Buffer<uint32_t>> countBuffer;
+    //第一段被遮挡的绘制
+    std::unique_ptr<Buffer<uint32_t>> occludedBuffer;
+
+    uint32_t objectCapacity = 0;
+    uint32_t drawCapacity = 0;
+    uint32_t bucketCapacity = 0;
+    uint32_t constantCapacity = 0;
+    uint32_t commandCapacity = 0;
+    uint32_t countCapacity = 0;
+    uint32_t occludedCapacity = 0;
+
+    uint32_t drawCount = 0;
+    uint32_t mainBucketCount = 0;
+    uint32_t shadowBucketCount = 0;
+    //每个桶在命令缓冲中的起点与可容纳的命令数
+    std::vector<uint32_t> bucketOffsets;
+    std::vector<uint32_t> bucketSizes;
+
+    //层级深度: 每级取2x2中最远的深度，第0级为深度附件的一半
+    bool occlusionCulling = false;
+    bool viewsSet = false;
+    vk::Image depthImage;
+    vk::ImageView depthView;
+    uint32_t depthWidth = 0;
+    uint32_t depthHeight = 0;
+    vk::Image hiZImage;
+    MemoryAllocation hiZAllocation;
+    vk::ImageView hiZView;
+    std::vector<vk::ImageView> hiZLevelViews;
+    uint32_t hiZLevels = 0;
+    vk::DescriptorSetLayout hiZSetLayout;
+    vk::PipelineLayout hiZPipelineLayout;
+    vk::Pipeline hiZPipeline;
+    //每级一个描述符，输入上一级(第0级为深度)，输出这一级
+    std::vector<vk::DescriptorSet> hiZDescSets;
+};
@@ -55,7 +55,7 @@ void ParticleSystem::InitSubParticle(uint32_t index) {
 	particle.lifetime = 0.0f;
 }
 
-void ParticleSystem::PrepareParticles(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp) {
+void ParticleSystem::PrepareParticles(vk::Device* device, MemoryAllocator* allocator) {
 	particles.resize(emitter.maxParticleNum);
 	for (auto& particle : particles) {
 		InitParticles(&particle);
@@ -67,7 +67,7 @@ void ParticleSystem::PrepareParticles(vk::Device* device, vk::PhysicalDeviceMemo
 	if (subParticleProperty.used)
 		subParticles.resize(emitter.maxParticleNum);
 
-	particleBuffer = std::make_unique<Buffer<Particle>>(device, subParticleProperty.used ? (emitter.maxParticleNum * 2) : emitter.maxParticleNum, vk::BufferUsageFlagBits::eVertexBuffer, gpuProp, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, true);
+	particleBuffer = std::make_unique<Buffer<Particle>>(device, subParticleProperty.used ? (emitter.maxParticleNum * 2) : emitter.maxParticleNum, vk::BufferUsageFlagBits::eVertexBuffer, allocator, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal);
 }
 
 void ParticleSystem::UpdateParticles(float deltaTime, vk::Device* device) {
@@ -57,7 +57,7 @@ public:
     void SetTextureProperty(Texture texture);
     void SetSubParticle(SubParticle subParticleProperty);
 
-    void PrepareParticles(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp);
+    void PrepareParticles(vk::Device* device, MemoryAllocator* allocator);
     void UpdateParticles(float deltaTime, vk::Device* device);
     void DrawParticles(vk::CommandBuffer* cmd);
     void DrawSubParticles(vk::CommandBuffer* cmd);
@@ -1,4 +1,5 @@
 #include "PostProcessing.h"
+#include "../../Util/ShaderLibrary.h"
 
 void PostProcessing::Bloom::SetHDRProperties(float exposure, float gamma) {
 	PostProcessingProfile::HDR hdrProfile;
@@ -68,8 +69,8 @@ void PostProcessing::Bloom::PrepareRenderPass() {
 }
 
 void PostProcessing::Bloom::PrepareFramebuffers() {
-	renderTarget0 = CreateAttachment(vkInfo->device, vkInfo->gpu.getMemoryProperties(), vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eSampled);
-	renderTarget1 = CreateAttachment(vkInfo->device, vkInfo->gpu.getMemoryProperties(), vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
+	renderTarget0 = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eSampled);
+	renderTarget1 = CreateAttachment(vkInfo->device, vkInfo->allocator, vk::Format::eR16G16B16A16Sfloat, vk::ImageAspectFlagBits::eColor, vkInfo->width, vkInfo->height, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
 
 	vk::ImageView attachment;
 
@@ -185,7 +186,7 @@ void PostProcessing::Bloom::PrepareDescriptorSets(vk::ImageView sourceImage) {
 		.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
 	vkInfo->device.createSampler(&samplerInfo, 0, &sampler);
 
-	hdrProperties = std::make_unique<Buffer<PostProcessingProfile::HDR>>(&vkInfo->device, 1, vk::BufferUsageFlagBits::eUniformBuffer, vkInfo->gpu.getMemoryProperties(), vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, true);
+	hdrProperties = std::make_unique<Buffer<PostProcessingProfile::HDR>>(&vkInfo->device, 1, vk::BufferUsageFlagBits::eUniformBuffer, vkInfo->allocator, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
 
 	//更新描述符
 	std::array<vk::WriteDescriptorSet, 6> updateInfo;
@@ -241,12 +242,12 @@ void PostProcessing::Bloom::PrepareDescriptorSets(vk::ImageView sourceImage) {
 	vkInfo->device.updateDescriptorSets(updateInfo.size(), updateInfo.data(), 0, 0);
 }
 
-void PostProcessing::Bloom::PreparePipelines() {
-	auto vsModule = CreateShaderModule("Shaders\\bloomVS.spv", vkInfo->device);
-	auto psModule = CreateShaderModule("Shaders\\bloomPS.spv", vkInfo->device);
-	auto blurH = CreateShaderModule("Shaders\\blurH.spv", vkInfo->device);
-	auto blurV = CreateShaderModule("Shaders\\blurV.spv", vkInfo->device);
-	auto combineShader = CreateShaderModule("Shaders\\combine.spv", vkInfo->device);
+void PostProcessing::Bloom::PreparePipelines(PipelineCompiler& pipelineCompiler) {
+	auto vsModule = vkInfo->shaderLibrary->GetShaderModule("bloomVS");
+	auto psModule = vkInfo->shaderLibrary->GetShaderModule("bloomPS");
+	auto blurH = vkInfo->shaderLibrary->GetShaderModule("blurH");
+	auto blurV = vkInfo->shaderLibrary->GetShaderModule("blurV");
+	auto combineShader = vkInfo->shaderLibrary->GetShaderModule("combine");
 
 	pipelineLayout.resize(2);
 
@@ -372,7 +373,7 @@ void PostProcessing::Bloom::PreparePipelines() {
 		.setPInputAssemblyState(&iaInfo)
 		.setPVertexInputState(&viInfo);
 
-	vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, nullptr, &pipelines["brightness"]);
+	pipelineCompiler.Add(pipelineInfo, &pipelines["brightness"]);
 
 	std::array<vk::SpecializationMapEntry, 2> blurSME;
 	blurSME[0].setConstantID(0);
@@ -394,7 +395,7 @@ void PostProcessing::Bloom::PreparePipelines() {
 		.setStage(vk::ShaderStageFlagBits::eFragment)
 		.setPSpecializationInfo(&blurSI);
 
-	vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, nullptr, &pipelines["blurH"]);
+	pipelineCompiler.Add(pipelineInfo, &pipelines["blurH"]);
 
 	pipelineShaderInfo[1] = vk::PipelineShaderStageCreateInfo()
 		.setPName("main")
@@ -402,7 +403,7 @@ void PostProcessing::Bloom::PreparePipelines() {
 		.setStage(vk::ShaderStageFlagBits::eFragment)
 		.setPSpecializationInfo(&blurSI);
 
-	vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, nullptr, &pipelines["blurV"]);
+	pipelineCompiler.Add(pipelineInfo, &pipelines["blurV"]);
 
 	//编译用于图像混合的着色器
 	pipelineShaderInfo[1] = vk::PipelineShaderStageCreateInfo()
@@ -422,13 +423,8 @@ void PostProcessing::Bloom::PreparePipelines() {
 	pipelineInfo.setLayout(pipelineLayout[1]);
 	pipelineInfo.setRenderPass(combineRenderPass);
 
-	vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, nullptr, &pipelines["combine"]);
+	pipelineCompiler.Add(pipelineInfo, &pipelines["combine"]);
 
-	vkInfo->device.destroyShaderModule(vsModule);
-	vkInfo->device.destroyShaderModule(psModule);
-	vkInfo->device.destroyShaderModule(blurH);
-	vkInfo->device.destroyShaderModule(blurV);
-	vkInfo->device.destroyShaderModule(combineShader);
 }
 
 void PostProcessing::Bloom::Begin(vk::CommandBuffer cmd, uint32_t currentImage) {
@@ -444,32 +440,40 @@ void PostProcessing::Bloom::Begin(vk::CommandBuffer cmd, uint32_t currentImage)
 		.setPClearValues(clearValue);
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["brightness"]);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[0], 0, 0);
-	cmd.draw(4, 1, 0, 0);
+	if (pipelines["brightness"]) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["brightness"]);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[0], 0, 0);
+		cmd.draw(4, 1, 0, 0);
+	}
 	cmd.endRenderPass();
 
 	renderPassBeginInfo.setFramebuffer(bloomFramebuffers[1]);
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["blurH"]);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[1], 0, 0);
-	cmd.draw(4, 1, 0, 0);
+	if (pipelines["blurH"]) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["blurH"]);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[1], 0, 0);
+		cmd.draw(4, 1, 0, 0);
+	}
 	cmd.endRenderPass();
 
 	renderPassBeginInfo.setFramebuffer(bloomFramebuffers[0]);
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["blurV"]);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[2], 0, 0);
-	cmd.draw(4, 1, 0, 0);
+	if (pipelines["blurV"]) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["blurV"]);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[0], 0, 1, &descSets[2], 0, 0);
+		cmd.draw(4, 1, 0, 0);
+	}
 	cmd.endRenderPass();
 
 	renderPassBeginInfo.setFramebuffer(combineFramebuffers[currentImage]);
 	renderPassBeginInfo.setRenderPass(combineRenderPass);
 	cmd.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["combine"]);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[1], 0, 1, &descSets[3], 0, 0);
-	cmd.draw(4, 1, 0, 0);
+	if (pipelines["combine"]) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines["combine"]);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout[1], 0, 1, &descSets[3], 0, 0);
+		cmd.draw(4, 1, 0, 0);
+	}
 }
\ No newline at end of file
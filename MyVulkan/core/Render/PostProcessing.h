@@ -1,5 +1,6 @@
 #pragma once
 #include "../../Util/vkUtil.h"
+#include "../../Util/PipelineCompiler.h"
 
 class PostProcessingProfile {
 public:
@@ -57,7 +58,7 @@ namespace PostProcessing {
 		void PrepareRenderPass();
 		void PrepareFramebuffers();
 		void PrepareDescriptorSets(vk::ImageView sourceImage);
-		void PreparePipelines();
+		void PreparePipelines(PipelineCompiler& pipelineCompiler);
 
 	private:
 		PostProcessingProfile::Bloom bloomProfile;
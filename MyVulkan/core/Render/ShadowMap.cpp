@@ -1,13 +1,13 @@
 #include "ShadowMap.h"
 
-ShadowMap::ShadowMap(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t width, uint32_t height)
+ShadowMap::ShadowMap(vk::Device* device, MemoryAllocator* allocator, uint32_t width, uint32_t height)
 {
-	Init(device, gpuProp, width, height);
+	Init(device, allocator, width, height);
 	PrepareRenderPass(device);
 	PrepareFramebuffer(device);
 }
 
-void ShadowMap::Init(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t width, uint32_t height) {
+void ShadowMap::Init(vk::Device* device, MemoryAllocator* allocator, uint32_t width, uint32_t height) {
 	this->width = width;
 	this->height = height;
 	
@@ -23,14 +23,7 @@ void ShadowMap::Init(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuP
 		.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
 	device->createImage(&depthImageInfo, 0, &shadowMap);
 
-	vk::MemoryRequirements depthImageReqs;
-	device->getImageMemoryRequirements(shadowMap, &depthImageReqs);
-
-	auto depthMemAlloc = vk::MemoryAllocateInfo()
-		.setAllocationSize(depthImageReqs.size);
-	MemoryTypeFromProperties(gpuProp, depthImageReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, depthMemAlloc.memoryTypeIndex);
-	device->allocateMemory(&depthMemAlloc, 0, &memory);
-	device->bindImageMemory(shadowMap, memory, 0);
+	allocator->AllocateImage(shadowMap, vk::MemoryPropertyFlagBits::eDeviceLocal, allocation);
 
 	auto depthImageViewInfo = vk::ImageViewCreateInfo()
 		.setComponents(vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA))
@@ -4,8 +4,8 @@
 class ShadowMap {
 public:
     ShadowMap(){}
-    ShadowMap(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t width, uint32_t height);
-    void Init(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, uint32_t width, uint32_t height);
+    ShadowMap(vk::Device* device, MemoryAllocator* allocator, uint32_t width, uint32_t height);
+    void Init(vk::Device* device, MemoryAllocator* allocator, uint32_t width, uint32_t height);
 
     void SetLightTransformMatrix(glm::vec3 lightDirection, float radius);
     void PrepareRenderPass(vk::Device* device);
@@ -23,13 +23,13 @@ public:
         device.destroy(shadowMapView);
         device.destroy(renderPass);
         device.destroy(framebuffer);
-        device.free(memory);
+        allocation.allocator->Free(allocation);
     }
 
 private:
     vk::Image shadowMap;
     vk::ImageView shadowMapView;
-    vk::DeviceMemory memory;
+    MemoryAllocation allocation;
 
     uint32_t width, height;
     vk::Format format = vk::Format::eD16Unorm;
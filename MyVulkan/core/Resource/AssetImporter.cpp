@@ -0,0 +1,95 @@
+#include "AssetImporter.h"
+
+AssetImporter::~AssetImporter() {
+	Destroy();
+}
+
+void AssetImporter::Init(TextureCache* textureCache, UploadBatcher* uploadBatcher, uint32_t threadCount) {
+	this->textureCache = textureCache;
+	this->uploadBatcher = uploadBatcher;
+
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	threadPool.SetThreadCount(threadCount);
+	threadIndex = 0;
+}
+
+void AssetImporter::Destroy() {
+	//等待正在导入的资源结束后再销毁线程
+	threadPool.Wait();
+	threadPool.threads.clear();
+
+	textures.clear();
+	models.clear();
+}
+
+template<typename T>
+std::shared_future<T> AssetImporter::Submit(std::function<T()> function) {
+	//线程在Destroy中先结束，任务可以直接引用this
+	auto task = std::make_shared<std::packaged_task<T()>>([this, function]() {
+		T result;
+		{
+			//任务结束时放开本线程保留的暂存空间，不会因为中途失败而让批次一直无法提交
+			UploadBatcher::Scope scope(*uploadBatcher);
+			result = function();
+		}
+		completedCount++;
+		return result;
+	});
+	submittedCount++;
+	std::shared_future<T> result = task->get_future().share();
+
+	//按轮询的方式把任务分配到各个工作线程
+	threadPool.threads[threadIndex]->AddJob([task]() {
+		(*task)();
+	});
+	threadIndex = (threadIndex + 1) % threadPool.threads.size();
+	return result;
+}
+
+std::shared_future<std::shared_ptr<Texture>> AssetImporter::LoadTexture(const std::string& path, TextureUsage usage) {
+	std::string key = path + "|2d|" + std::to_string(static_cast<uint32_t>(usage));
+	auto entry = textures.find(key);
+	if (entry != textures.end())
+		return entry->second;
+
+	TextureCache* textureCache = this->textureCache;
+	auto result = Submit<std::shared_ptr<Texture>>([textureCache, path, usage]() {
+		return textureCache->Load(path, usage);
+	});
+	textures[key] = result;
+	return result;
+}
+
+std::shared_future<std::shared_ptr<Texture>> AssetImporter::LoadCubeMap(const std::string& path) {
+	std::string key = path + "|cube";
+	auto entry = textures.find(key);
+	if (entry != textures.end())
+		return entry->second;
+
+	TextureCache* textureCache = this->textureCache;
+	auto result = Submit<std::shared_ptr<Texture>>([textureCache, path]() {
+		return textureCache->LoadCubeMap(path);
+	});
+	textures[key] = result;
+	return result;
+}
+
+std::shared_future<std::shared_ptr<Model>> AssetImporter::LoadModel(const std::string& path) {
+	auto entry = models.find(path);
+	if (entry != models.end())
+		return entry->second;
+
+	//模型只在CPU上处理，顶点缓冲仍由场景统一上传
+	auto result = Submit<std::shared_ptr<Model>>([path]() {
+		return std::make_shared<Model>(path);
+	});
+	models[path] = result;
+	return result;
+}
+
+void AssetImporter::Wait() {
+	threadPool.Wait();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "TextureCache.h"
+#include "Model.h"
+#include "../Thread.h"
+
+#include <atomic>
+#include <future>
+
+//异步资源的句柄: 导入完成之前返回占位资源，调用者每帧检查IsReady后换成真正的资源
+template<typename T>
+class AssetHandle {
+public:
+    AssetHandle() {}
+    AssetHandle(std::shared_future<std::shared_ptr<T>> future, std::shared_ptr<T> placeholder)
+        : future(std::move(future)), placeholder(std::move(placeholder)) {}
+
+    bool IsValid()const { return future.valid(); }
+    //不阻塞
+    bool IsReady()const {
+        return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    //导入失败(返回空)时也继续使用占位资源
+    std::shared_ptr<T> Get()const {
+        if (IsReady() && future.get())
+            return future.get();
+        return placeholder;
+    }
+
+private:
+    std::shared_future<std::shared_ptr<T>> future;
+    std::shared_ptr<T> placeholder;
+};
+
+/*并行导入资源: 纹理解码与模型处理在线程池中进行，上传命令记录进共用的UploadBatcher批次，
+  调用者只在真正用到某个资源时等待它的future。提交只能在同一个线程中进行*/
+class AssetImporter {
+public:
+    ~AssetImporter();
+
+    //threadCount为0时使用硬件线程数
+    void Init(TextureCache* textureCache, UploadBatcher* uploadBatcher, uint32_t threadCount = 0);
+    void Destroy();
+
+    //同一资源重复提交时返回同一个future
+    std::shared_future<std::shared_ptr<Texture>> LoadTexture(const std::string& path, TextureUsage usage);
+    std::shared_future<std::shared_ptr<Texture>> LoadCubeMap(const std::string& path);
+    std::shared_future<std::shared_ptr<Model>> LoadModel(const std::string& path);
+
+    //等待所有已提交的资源导入完成
+    void Wait();
+
+    //加载进度，供编辑器显示
+    uint32_t GetSubmittedCount()const { return submittedCount; }
+    uint32_t GetCompletedCount()const { return completedCount; }
+    bool IsLoading()const { return completedCount < submittedCount; }
+
+private:
+    template<typename T>
+    std::shared_future<T> Submit(std::function<T()> function);
+
+    TextureCache* textureCache = nullptr;
+    UploadBatcher* uploadBatcher = nullptr;
+
+    ThreadPool threadPool;
+    size_t threadIndex = 0;
+
+    uint32_t submittedCount = 0;
+    std::atomic<uint32_t> completedCount{ 0 };
+
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<Texture>>> textures;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<Model>>> models;
+};
@@ -0,0 +1,122 @@
+#include "MeshFormat.h"
+
+#include <filesystem>
+
+std::string GetBakedMeshPath(const std::string& path) {
+	return path + ".cmesh";
+}
+
+bool IsBakedMeshStale(const std::string& path, const std::string& bakedPath) {
+	namespace fs = std::filesystem;
+
+	std::error_code error;
+	if (!fs::exists(bakedPath, error))
+		return true;
+	//只有烘焙文件时直接使用
+	if (!fs::exists(path, error))
+		return false;
+	return fs::last_write_time(path, error) > fs::last_write_time(bakedPath, error);
+}
+
+void BakedMeshWriter::Write(const void* data, uint64_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	this->data.insert(this->data.end(), bytes, bytes + size);
+}
+
+void BakedMeshWriter::WriteString(const std::string& value) {
+	WriteValue(static_cast<uint32_t>(value.size()));
+	Write(value.data(), value.size());
+}
+
+void BakedMeshWriter::Align() {
+	data.resize((data.size() + bakedMeshAlignment - 1) & ~(bakedMeshAlignment - 1));
+}
+
+bool BakedMeshWriter::Save(const std::string& path)const {
+	std::string tempPath = path + ".tmp";
+	std::ofstream saveFile(tempPath, std::ios::binary | std::ios::trunc);
+	if (!saveFile.is_open())
+		return false;
+	saveFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+	saveFile.close();
+	if (saveFile.fail()) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+BakedMeshReader::~BakedMeshReader() {
+	Close();
+}
+
+bool BakedMeshReader::Open(const std::string& path) {
+	Close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	fileSize = (uint64_t)size.QuadPart;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		mappedData = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mappedData) {
+		Close();
+		return false;
+	}
+
+	offset = 0;
+	return true;
+}
+
+void BakedMeshReader::Close() {
+	if (mappedData)
+		UnmapViewOfFile(mappedData);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	mappedData = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	fileSize = 0;
+	offset = 0;
+}
+
+bool BakedMeshReader::Fail() {
+	//之后的读取都失败
+	offset = fileSize + 1;
+	return false;
+}
+
+bool BakedMeshReader::Read(void* dst, uint64_t size) {
+	if (mappedData == nullptr || offset > fileSize || size > fileSize - offset)
+		return Fail();
+	memcpy(dst, mappedData + offset, size);
+	offset += size;
+	return true;
+}
+
+bool BakedMeshReader::Align() {
+	offset = (offset + bakedMeshAlignment - 1) & ~(bakedMeshAlignment - 1);
+	return offset <= fileSize;
+}
+
+bool BakedMeshReader::ReadString(std::string& value) {
+	uint32_t length = 0;
+	if (!ReadValue(length) || length > fileSize - offset)
+		return Fail();
+	value.assign(reinterpret_cast<const char*>(mappedData + offset), length);
+	offset += length;
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "../../Util/vkUtil.h"
+
+#include <string>
+#include <vector>
+
+/*烘焙网格文件(.cmesh): Header之后依次排列各段，数组都是 数量 | 按16字节对齐的原始数据，
+  顶点与索引直接按GPU使用的布局存储，加载时映射文件后整段拷贝，不再逐顶点处理*/
+struct BakedMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    //0为静态网格，1为蒙皮网格
+    uint32_t kind;
+    //顶点结构体的大小，布局变化后旧文件自动失效
+    uint32_t vertexStride;
+};
+
+static const uint32_t bakedMeshMagic = 0x48534D43; //"CMSH"
+//2: 顶点经过焊接与缓存、过度绘制、读取顺序优化
+//3: 索引之后附带简化生成的LOD
+//4: 每级LOD切分为网格簇，附带包围球与法线锥
+static const uint32_t bakedMeshVersion = 4;
+static const uint64_t bakedMeshAlignment = 16;
+
+//源文件对应的烘焙文件路径
+std::string GetBakedMeshPath(const std::string& path);
+//烘焙文件不存在或比源文件旧
+bool IsBakedMeshStale(const std::string& path, const std::string& bakedPath);
+
+class BakedMeshWriter {
+public:
+    void Write(const void* data, uint64_t size);
+    template<typename T>
+    void WriteValue(const T& value) {
+        Write(&value, sizeof(T));
+    }
+    template<typename T>
+    void WriteArray(const std::vector<T>& values) {
+        WriteValue(static_cast<uint32_t>(values.size()));
+        Align();
+        Write(values.data(), sizeof(T) * values.size());
+    }
+    void WriteString(const std::string& value);
+
+    //先写入临时文件再替换，中途失败不会留下损坏的文件
+    bool Save(const std::string& path)const;
+
+private:
+    void Align();
+
+    std::vector<uint8_t> data;
+};
+
+class BakedMeshReader {
+public:
+    ~BakedMeshReader();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    bool Read(void* dst, uint64_t size);
+    template<typename T>
+    bool ReadValue(T& value) {
+        return Read(&value, sizeof(T));
+    }
+    template<typename T>
+    bool ReadArray(std::vector<T>& values) {
+        uint32_t count = 0;
+        if (!ReadValue(count) || !Align() || sizeof(T) * (uint64_t)count > fileSize - offset)
+            return Fail();
+        values.resize(count);
+        return Read(values.data(), sizeof(T) * (uint64_t)count);
+    }
+    bool ReadString(std::string& value);
+
+private:
+    bool Align();
+    bool Fail();
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const BYTE* mappedData = nullptr;
+    uint64_t fileSize = 0;
+    uint64_t offset = 0;
+};
@@ -1,11 +1,106 @@
 #include "Model.h"
+#include "../Component.h"
 
 Model::Model(std::string path) {
+	std::string bakedPath = GetBakedMeshPath(path);
+	if (!IsBakedMeshStale(path, bakedPath) && LoadBaked(bakedPath))
+		return;
+
+	if (!Import(path)) {
+		MessageBox(0, L"Load model failed!!!", 0, 0);
+		return;
+	}
+	//烘焙失败不影响本次使用，下次启动再导入
+	SaveBaked(bakedPath);
+}
+
+bool Model::Import(const std::string& path) {
+	meshes.clear();
+	materials.clear();
+	renderInfo.clear();
+	texturePath.clear();
+
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	if (scene == nullptr || scene->mRootNode == nullptr)
+		return false;
 	directory = path.substr(0, path.find_last_of('\\')) + '\\';
    	ProcessNode(scene, scene->mRootNode);
 	SetupRenderInfo();
+	return true;
+}
+
+bool Model::SaveBaked(const std::string& path)const {
+	BakedMeshWriter writer;
+
+	BakedMeshHeader header = {};
+	header.magic = bakedMeshMagic;
+	header.version = bakedMeshVersion;
+	header.kind = 0;
+	header.vertexStride = sizeof(Vertex);
+	writer.WriteValue(header);
+
+	writer.WriteValue(static_cast<uint32_t>(texturePath.size()));
+	for (auto& texture : texturePath)
+		writer.WriteString(texture.compare(0, directory.size(), directory) == 0 ? texture.substr(directory.size()) : texture);
+
+	//renderInfo与materials一一对应
+	writer.WriteValue(static_cast<uint32_t>(renderInfo.size()));
+	for (size_t i = 0; i < renderInfo.size(); i++) {
+		writer.WriteValue(materials[i]);
+		writer.WriteValue(renderInfo[i].boundsCenter);
+		writer.WriteValue(renderInfo[i].boundsRadius);
+		writer.WriteArray(renderInfo[i].vertices);
+		writer.WriteArray(renderInfo[i].indices);
+		writer.WriteArray(renderInfo[i].lods);
+		writer.WriteArray(renderInfo[i].meshlets);
+	}
+
+	return writer.Save(path);
+}
+
+bool Model::LoadBaked(const std::string& path) {
+	meshes.clear();
+	materials.clear();
+	renderInfo.clear();
+	texturePath.clear();
+
+	BakedMeshReader reader;
+	if (!reader.Open(path))
+		return false;
+
+	BakedMeshHeader header;
+	if (!reader.ReadValue(header) || header.magic != bakedMeshMagic || header.version != bakedMeshVersion ||
+		header.kind != 0 || header.vertexStride != sizeof(Vertex))
+		return false;
+
+	directory = path.substr(0, path.find_last_of('\\')) + '\\';
+
+	uint32_t textureCount = 0;
+	bool valid = reader.ReadValue(textureCount);
+	texturePath.resize(valid ? textureCount : 0);
+	for (auto& texture : texturePath) {
+		valid = valid && reader.ReadString(texture);
+		texture = directory + texture;
+	}
+
+	//顶点与索引整段拷贝
+	uint32_t renderInfoCount = 0;
+	valid = valid && reader.ReadValue(renderInfoCount);
+	materials.resize(valid ? renderInfoCount : 0);
+	renderInfo.resize(valid ? renderInfoCount : 0);
+	for (size_t i = 0; valid && i < renderInfo.size(); i++) {
+		valid = reader.ReadValue(materials[i]) && reader.ReadValue(renderInfo[i].boundsCenter) && reader.ReadValue(renderInfo[i].boundsRadius) &&
+			reader.ReadArray(renderInfo[i].vertices) && reader.ReadArray(renderInfo[i].indices) &&
+			reader.ReadArray(renderInfo[i].lods) && reader.ReadArray(renderInfo[i].meshlets);
+	}
+
+	if (!valid) {
+		materials.clear();
+		renderInfo.clear();
+		texturePath.clear();
+	}
+	return valid;
 }
 
 void Model::ProcessNode(const aiScene* scene, aiNode* node) {
@@ -24,9 +119,12 @@ void Model::ProcessNode(const aiScene* scene, aiNode* node) {
 Mesh Model::ProcessMesh(const aiScene* scene, aiMesh* mesh) {
 	std::vector<Vertex> vertices;
 	std::vector<UINT> indices;
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve((size_t)mesh->mNumFaces * 3);
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
-		Vertex vertex;
+		//未赋值的成员清零，焊接时按字节比较顶点
+		Vertex vertex = {};
 		vertex.position.x = mesh->mVertices[i].x;
 		vertex.position.y = mesh->mVertices[i].y;
 		vertex.position.z = mesh->mVertices[i].z;
@@ -64,7 +162,7 @@ Mesh Model::ProcessMesh(const aiScene* scene, aiMesh* mesh) {
 	}
 	UINT materialIndex = SetupMaterial(diffuseMaps);
 
-	return Mesh(vertices, indices, materialIndex);
+	return Mesh(std::move(vertices), std::move(indices), materialIndex);
 }
 
 std::vector<UINT> Model::LoadMaterialTextures(aiMaterial* mat, aiTextureType type) {
@@ -127,6 +225,21 @@ void Model::SetupRenderInfo() {
 
 		renderInfo[index].vertices.insert(renderInfo[index].vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
 	}
+
+	//焊接重复顶点并重排三角形与顶点，烘焙文件中保存的就是优化后的结果
+	//LOD在优化之后生成，所有级别共用优化后的顶点，索引追加在原网格之后
+	optimizeStats = MeshOptimizeStats();
+	std::fill(std::begin(lodTriangles), std::end(lodTriangles), 0);
+	for (auto& info : renderInfo) {
+		optimizeStats.Add(OptimizeMesh(info.vertices, info.indices));
+		GenerateMeshLods(info.vertices, info.indices, info.lods);
+		BuildMeshlets(info.vertices, info.indices, info.lods, info.meshlets);
+		ComputeMeshBounds(info.vertices, info.boundsCenter, info.boundsRadius);
+
+		for (size_t i = 0; i < 4; i++)
+			lodTriangles[i] += info.lods[std::min(i, info.lods.size() - 1)].indexCount / 3;
+	}
+
 }
 
 bool CompareMaterial(MaterialInfo dest, MaterialInfo source) {
@@ -6,6 +6,8 @@
 #include "assimp/mesh.h"
 #include "assimp/texture.h"
 #include "Texture.h"
+#include "MeshFormat.h"
+#include "../../Util/Meshlet.h"
 
 struct MaterialInfo {
     UINT diffuseMaps;
@@ -16,6 +18,14 @@ public:
     struct RenderInfo {
         std::vector<Vertex> vertices;
         std::vector<UINT> indices;
+        //各级LOD在indices中的范围，第0级是原网格
+        std::vector<MeshLod> lods;
+        //按LOD依次排列的网格簇
+        std::vector<Meshlet> meshlets;
+
+        //模型空间的包围球
+        glm::vec3 boundsCenter = glm::vec3(0.0f);
+        float boundsRadius = 0.0f;
     };
 
     std::vector<Vertex> vertices;
@@ -23,20 +33,33 @@ public:
     UINT materialIndex;
 	
     Mesh(std::vector<Vertex> vertices, std::vector<UINT> indices, UINT materialIndex) {
-        this->vertices = vertices;
-        this->indices = indices;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
         this->materialIndex = materialIndex;
     }
 };
 
 class Model {
 public:
+    //优先读取烘焙好的.cmesh，不存在或比源文件旧时用Assimp导入并重新烘焙
     Model(std::string path);
+    Model() {}
+
+    //用Assimp导入源文件(烘焙工具使用)
+    bool Import(const std::string& path);
+    //renderInfo、材质与贴图路径写入烘焙文件，贴图按相对模型目录的路径保存
+    bool SaveBaked(const std::string& path)const;
+    bool LoadBaked(const std::string& path);
+
     std::vector<Mesh> meshes;
     std::vector<MaterialInfo> materials;
     std::vector<Mesh::RenderInfo> renderInfo;
     std::vector<std::string> texturePath;
 
+    //导入时优化与各级LOD的三角形数，读取烘焙文件时为空
+    MeshOptimizeStats optimizeStats;
+    uint32_t lodTriangles[4] = {};
+
 private:
     std::string directory;
 
@@ -1,13 +1,150 @@
 #include "SkinnedModel.h"
+#include "../Component.h"
 
 SkinnedModel::SkinnedModel(std::string path) {
+	std::string bakedPath = GetBakedMeshPath(path);
+	if (!IsBakedMeshStale(path, bakedPath) && LoadBaked(bakedPath))
+		return;
+
+	if (!Import(path)) {
+		MessageBox(0, L"Load skinned model failed!!!", 0, 0);
+		return;
+	}
+	//烘焙失败不影响本次使用，下次启动再导入
+	SaveBaked(bakedPath);
+}
+
+void SkinnedModel::Clear() {
+	meshes.clear();
+	materials.clear();
+	renderInfo.clear();
+	texturePath.clear();
+	boneInfo.clear();
+	boneMapping.clear();
+	animations.clear();
+}
+
+bool SkinnedModel::Import(const std::string& path) {
+	Clear();
+
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	if (scene == nullptr || scene->mRootNode == nullptr)
+		return false;
 	directory = path.substr(0, path.find_last_of('\\')) + '\\';
 	ReadNodeHierarchy(scene->mRootNode, -1);
 	ProcessNode(scene, scene->mRootNode);
 	SetupRenderInfo();
 	LoadAnimations(scene);
+	return true;
+}
+
+bool SkinnedModel::SaveBaked(const std::string& path)const {
+	BakedMeshWriter writer;
+
+	BakedMeshHeader header = {};
+	header.magic = bakedMeshMagic;
+	header.version = bakedMeshVersion;
+	header.kind = 1;
+	header.vertexStride = sizeof(SkinnedVertex);
+	writer.WriteValue(header);
+
+	writer.WriteValue(static_cast<uint32_t>(texturePath.size()));
+	for (auto& texture : texturePath)
+		writer.WriteString(texture.compare(0, directory.size(), directory) == 0 ? texture.substr(directory.size()) : texture);
+
+	writer.WriteValue(static_cast<uint32_t>(renderInfo.size()));
+	for (size_t i = 0; i < renderInfo.size(); i++) {
+		writer.WriteValue(materials[i]);
+		writer.WriteValue(renderInfo[i].boundsCenter);
+		writer.WriteValue(renderInfo[i].boundsRadius);
+		writer.WriteArray(renderInfo[i].vertices);
+		writer.WriteArray(renderInfo[i].indices);
+		writer.WriteArray(renderInfo[i].lods);
+	}
+
+	//骨骼层级
+	writer.WriteArray(boneInfo);
+	writer.WriteValue(static_cast<uint32_t>(boneMapping.size()));
+	for (auto& bone : boneMapping) {
+		writer.WriteString(bone.first);
+		writer.WriteValue(bone.second);
+	}
+
+	//动画片段，每个片段按骨骼索引保存三组关键帧
+	writer.WriteValue(static_cast<uint32_t>(animations.size()));
+	for (auto& animation : animations) {
+		writer.WriteString(animation.first);
+		writer.WriteValue(static_cast<uint32_t>(animation.second.boneAnimations.size()));
+		for (auto& boneAnim : animation.second.boneAnimations) {
+			writer.WriteArray(boneAnim.translation);
+			writer.WriteArray(boneAnim.scale);
+			writer.WriteArray(boneAnim.rotationQuat);
+		}
+	}
+
+	return writer.Save(path);
+}
+
+bool SkinnedModel::LoadBaked(const std::string& path) {
+	Clear();
+
+	BakedMeshReader reader;
+	if (!reader.Open(path))
+		return false;
+
+	BakedMeshHeader header;
+	if (!reader.ReadValue(header) || header.magic != bakedMeshMagic || header.version != bakedMeshVersion ||
+		header.kind != 1 || header.vertexStride != sizeof(SkinnedVertex))
+		return false;
+
+	directory = path.substr(0, path.find_last_of('\\')) + '\\';
+
+	uint32_t textureCount = 0;
+	bool valid = reader.ReadValue(textureCount);
+	texturePath.resize(valid ? textureCount : 0);
+	for (auto& texture : texturePath) {
+		valid = valid && reader.ReadString(texture);
+		texture = directory + texture;
+	}
+
+	//顶点与索引整段拷贝
+	uint32_t renderInfoCount = 0;
+	valid = valid && reader.ReadValue(renderInfoCount);
+	materials.resize(valid ? renderInfoCount : 0);
+	renderInfo.resize(valid ? renderInfoCount : 0);
+	for (size_t i = 0; valid && i < renderInfo.size(); i++) {
+		valid = reader.ReadValue(materials[i]) && reader.ReadValue(renderInfo[i].boundsCenter) && reader.ReadValue(renderInfo[i].boundsRadius) &&
+			reader.ReadArray(renderInfo[i].vertices) && reader.ReadArray(renderInfo[i].indices) &&
+			reader.ReadArray(renderInfo[i].lods);
+	}
+
+	uint32_t boneNameCount = 0;
+	valid = valid && reader.ReadArray(boneInfo) && reader.ReadValue(boneNameCount);
+	for (uint32_t i = 0; valid && i < boneNameCount; i++) {
+		std::string name;
+		UINT boneIndex = 0;
+		valid = reader.ReadString(name) && reader.ReadValue(boneIndex) && boneIndex < boneInfo.size();
+		boneMapping[name] = boneIndex;
+	}
+
+	uint32_t clipCount = 0;
+	valid = valid && reader.ReadValue(clipCount);
+	for (uint32_t i = 0; valid && i < clipCount; i++) {
+		std::string name;
+		uint32_t boneCount = 0;
+		valid = reader.ReadString(name) && reader.ReadValue(boneCount) && boneCount == boneInfo.size();
+
+		AnimationClip animation;
+		animation.boneAnimations.resize(valid ? boneCount : 0);
+		for (auto& boneAnim : animation.boneAnimations)
+			valid = valid && reader.ReadArray(boneAnim.translation) && reader.ReadArray(boneAnim.scale) && reader.ReadArray(boneAnim.rotationQuat);
+		animations[name] = std::move(animation);
+	}
+
+	if (!valid)
+		Clear();
+	return valid;
 }
 
 void SkinnedModel::ProcessNode(const aiScene* scene, aiNode* node) {
@@ -26,12 +163,15 @@ void SkinnedModel::ProcessNode(const aiScene* scene, aiNode* node) {
 SkinnedMesh SkinnedModel::ProcessMesh(const aiScene* scene, aiMesh* mesh) {
 	std::vector<SkinnedVertex> vertices;
 	std::vector<UINT> indices;
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve((size_t)mesh->mNumFaces * 3);
 
 	std::vector<BoneData> vertexBoneData(mesh->mNumVertices);
 	LoadBones(mesh, vertexBoneData);
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
-		SkinnedVertex vertex;
+		//未赋值的成员清零，焊接时按字节比较顶点
+		SkinnedVertex vertex = {};
 		vertex.position.x = mesh->mVertices[i].x;
 		vertex.position.y = mesh->mVertices[i].y;
 		vertex.position.z = mesh->mVertices[i].z;
@@ -74,7 +214,7 @@ SkinnedMesh SkinnedModel::ProcessMesh(const aiScene* scene, aiMesh* mesh) {
 	}
 	UINT materialIndex = SetupMaterial(diffuseMaps);
 
-	return SkinnedMesh(vertices, indices, materialIndex);
+	return SkinnedMesh(std::move(vertices), std::move(indices), materialIndex);
 }
 
 void SkinnedModel::LoadBones(const aiMesh* mesh, std::vector<SkinnedModel::BoneData>& boneData) {
@@ -190,6 +330,20 @@ void SkinnedModel::SetupRenderInfo() {
 
 		renderInfo[index].vertices.insert(renderInfo[index].vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
 	}
+
+	//焊接重复顶点并重排三角形与顶点，烘焙文件中保存的就是优化后的结果
+	//LOD在优化之后生成，所有级别共用优化后的顶点，索引追加在原网格之后
+	optimizeStats = MeshOptimizeStats();
+	std::fill(std::begin(lodTriangles), std::end(lodTriangles), 0);
+	for (auto& info : renderInfo) {
+		optimizeStats.Add(OptimizeMesh(info.vertices, info.indices));
+		GenerateMeshLods(info.vertices, info.indices, info.lods);
+		ComputeMeshBounds(info.vertices, info.boundsCenter, info.boundsRadius);
+
+		for (size_t i = 0; i < 4; i++)
+			lodTriangles[i] += info.lods[std::min(i, info.lods.size() - 1)].indexCount / 3;
+	}
+
 }
 
 void SkinnedModel::LoadAnimations(const aiScene* scene) {
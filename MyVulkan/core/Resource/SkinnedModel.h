@@ -8,6 +8,12 @@ public:
 	struct RenderInfo {
 		std::vector<SkinnedVertex> vertices;
 		std::vector<UINT> indices;
+		//各级LOD在indices中的范围，第0级是原网格
+		std::vector<MeshLod> lods;
+
+		//模型空间(绑定姿态)的包围球
+		glm::vec3 boundsCenter = glm::vec3(0.0f);
+		float boundsRadius = 0.0f;
 	};
 
 	std::vector<SkinnedVertex> vertices;
@@ -15,8 +21,8 @@ public:
 	UINT materialIndex;
 
 	SkinnedMesh(std::vector<SkinnedVertex> vertices, std::vector<UINT> indices, UINT materialIndex) {
-		this->vertices = vertices;
-		this->indices = indices;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
 		this->materialIndex = materialIndex;
 	}
 };
@@ -45,12 +51,25 @@ public:
 		int parentIndex;
 	};
 
+	//优先读取烘焙好的.cmesh，不存在或比源文件旧时用Assimp导入并重新烘焙
 	SkinnedModel(std::string path);
+	SkinnedModel() {}
+
+	//用Assimp导入源文件(烘焙工具使用)
+	bool Import(const std::string& path);
+	//除网格外还保存骨骼层级、骨骼名称映射与全部动画片段
+	bool SaveBaked(const std::string& path)const;
+	bool LoadBaked(const std::string& path);
+
 	std::vector<SkinnedMesh> meshes;
 	std::vector<MaterialInfo> materials;
 	std::vector<SkinnedMesh::RenderInfo> renderInfo;
 	std::vector<std::string> texturePath;
 
+	//导入时优化与各级LOD的三角形数，读取烘焙文件时为空
+	MeshOptimizeStats optimizeStats;
+	uint32_t lodTriangles[4] = {};
+
 	void GetBoneMapping(std::unordered_map<std::string, UINT>& boneMapping) {
 		boneMapping = this->boneMapping;
 	}
@@ -87,4 +106,5 @@ private:
 	void LoadBones(const aiMesh* mesh, std::vector<BoneData>& bones);
 	void ReadNodeHierarchy(const aiNode* node, int parentIndex);
 	void LoadAnimations(const aiScene* scene);
+	void Clear();
 };
\ No newline at end of file
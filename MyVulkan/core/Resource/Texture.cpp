@@ -1,74 +1,138 @@
 #include "Texture.h"
+
+/*stb_image的输出缓冲分配重定向: 解码前登记上传缓冲中的目标区域，大小相符的输出分配直接返回该区域，省去一次整图拷贝*/
+struct DecodeTarget {
+	void* data = nullptr;
+	size_t size = 0;
+	bool inUse = false;
+};
+static thread_local DecodeTarget decodeTarget;
+
+static void* DecodeMalloc(size_t size) {
+	if (decodeTarget.data != nullptr && !decodeTarget.inUse && size == decodeTarget.size) {
+		decodeTarget.inUse = true;
+		return decodeTarget.data;
+	}
+	return malloc(size);
+}
+
+static void* DecodeRealloc(void* pointer, size_t size) {
+	//中间缓冲碰巧占用了目标区域时搬回堆上
+	if (pointer != nullptr && pointer == decodeTarget.data) {
+		void* heap = malloc(size);
+		if (heap != nullptr)
+			memcpy(heap, pointer, size < decodeTarget.size ? size : decodeTarget.size);
+		decodeTarget.inUse = false;
+		return heap;
+	}
+	return realloc(pointer, size);
+}
+
+static void DecodeFree(void* pointer) {
+	if (pointer != nullptr && pointer == decodeTarget.data) {
+		decodeTarget.inUse = false;
+		return;
+	}
+	free(pointer);
+}
+
+#define STBI_MALLOC(size) DecodeMalloc(size)
+#define STBI_REALLOC(pointer, size) DecodeRealloc(pointer, size)
+#define STBI_FREE(pointer) DecodeFree(pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
-/*Call this function to copy pixel data from upload buffer to image*/
-void Texture::SetupImage(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::CommandPool& cmdPool, vk::Queue* queue) {
+//把RGBA8图片解码到dst，返回false表示解码失败
+static bool DecodeImageInto(const char* path, void* dst, uint64_t size) {
+	decodeTarget.data = dst;
+	decodeTarget.size = static_cast<size_t>(size);
+	decodeTarget.inUse = false;
+
+	int width, height, channelInFile;
+	stbi_uc* source = stbi_load(path, &width, &height, &channelInFile, 4);
+	if (source != nullptr && source != dst) {
+		memcpy(dst, source, size);
+		stbi_image_free(source);
+	}
+
+	decodeTarget = DecodeTarget();
+	return source != nullptr;
+}
+
+#include <filesystem>
+
+/*Call this function to record the copy from the upload ring to image, the copy is done when the batcher flushes*/
+void Texture::SetupImage(vk::Device* device, MemoryAllocator* allocator, UploadBatcher& uploadBatcher) {
+	uint32_t layerCount = isCubeMap ? 6 : 1;
+
+	//完整的mip链: floor(log2(max(width, height))) + 1
+	mipLevels = 1;
+	if (generateMips) {
+		for (uint32_t size = width > height ? width : height; size > 1; size >>= 1)
+			mipLevels++;
+		if (maxMipLevels > 0 && mipLevels > maxMipLevels)
+			mipLevels = maxMipLevels;
+	}
+	else if (!levelOffsets.empty())
+		mipLevels = static_cast<uint32_t>(levelOffsets.size());
+	uint32_t blitLevels = generateMips ? mipLevels : 1;
+
 	//Create image
 	auto imageInfo = vk::ImageCreateInfo()
-		.setArrayLayers(isCubeMap ? 6 : 1)
+		.setArrayLayers(layerCount)
 		.setExtent(vk::Extent3D(width, height, 1))
 		.setFormat(format)
 		.setImageType(vk::ImageType::e2D)
 		.setInitialLayout(vk::ImageLayout::eUndefined)
-		.setMipLevels(1)
+		.setMipLevels(mipLevels)
 		.setSamples(vk::SampleCountFlagBits::e1)
-		.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+		.setUsage(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
 		.setFlags(isCubeMap ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags())
 		.setTiling(vk::ImageTiling::eOptimal);
 	device->createImage(&imageInfo, 0, &image);
 	
 	//Allocate the memory of image
-	vk::MemoryRequirements imageMemReqs;
-	device->getImageMemoryRequirements(image, &imageMemReqs);
-
-	auto imageMemoryInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(imageMemReqs.size);
-	MemoryTypeFromProperties(gpuProp, imageMemReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, imageMemoryInfo.memoryTypeIndex);
-	device->allocateMemory(&imageMemoryInfo, 0, &imageMemory);
-
-	device->bindImageMemory(image, imageMemory, 0);
+	if (!allocator->AllocateImage(image, vk::MemoryPropertyFlagBits::eDeviceLocal, imageAllocation)) {
+		MessageBox(0, L"Allocate texture memory failed!!!", 0, 0);
+	}
 	
 	//Set copy command
 	std::vector<vk::BufferImageCopy> copyRegion;
-	vk::ImageSubresourceRange subresourceRange;
-	if (isCubeMap) {
-		for (uint32_t i = 0; i < 6; i++) {
+	if (!levelOffsets.empty()) {
+		for (uint32_t i = 0; i < mipLevels; i++) {
 			auto copyRegionIndex = vk::BufferImageCopy()
 				.setBufferImageHeight(0)
 				.setBufferRowLength(0)
-				.setBufferOffset(imageSize * i)
+				.setBufferOffset(uploaderOffset + levelOffsets[i])
 				.setImageOffset(vk::Offset3D(0, 0, 0))
-				.setImageExtent(vk::Extent3D(width, height, 1))
-				.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, i, 1));
+				.setImageExtent(vk::Extent3D(width >> i ? width >> i : 1, height >> i ? height >> i : 1, 1))
+				.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1));
 			copyRegion.push_back(copyRegionIndex);
 		}
-		subresourceRange = vk::ImageSubresourceRange()
-			.setAspectMask(vk::ImageAspectFlagBits::eColor)
-			.setBaseArrayLayer(0)
-			.setBaseMipLevel(0)
-			.setLayerCount(6)
-			.setLevelCount(1);
 	}
 	else {
-		auto copyRegionIndex = vk::BufferImageCopy()
-			.setBufferOffset(0)
-			.setBufferImageHeight(0)
-			.setBufferRowLength(0)
-			.setImageOffset(vk::Offset3D(0, 0, 0))
-			.setImageExtent(vk::Extent3D(width, height, 1))
-			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1));
-		copyRegion.push_back(copyRegionIndex);
-
-		subresourceRange = vk::ImageSubresourceRange()
-			.setAspectMask(vk::ImageAspectFlagBits::eColor)
-			.setBaseArrayLayer(0)
-			.setBaseMipLevel(0)
-			.setLayerCount(1)
-			.setLevelCount(1);
+		for (uint32_t i = 0; i < layerCount; i++) {
+			auto copyRegionIndex = vk::BufferImageCopy()
+				.setBufferImageHeight(0)
+				.setBufferRowLength(0)
+				.setBufferOffset(uploaderOffset + imageSize * i)
+				.setImageOffset(vk::Offset3D(0, 0, 0))
+				.setImageExtent(vk::Extent3D(width, height, 1))
+				.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, i, 1));
+			copyRegion.push_back(copyRegionIndex);
+		}
 	}
 
-	vk::CommandBuffer cmd = BeginSingleTimeCommand(device, cmdPool);
+	auto subresourceRange = vk::ImageSubresourceRange()
+		.setAspectMask(vk::ImageAspectFlagBits::eColor)
+		.setBaseArrayLayer(0)
+		.setBaseMipLevel(0)
+		.setLayerCount(layerCount)
+		.setLevelCount(mipLevels);
+
+	//拷贝与mip生成记录到上传批次中，由UploadBatcher统一提交
+	UploadBatcher::Recording recording(uploadBatcher);
+	vk::CommandBuffer cmd = recording.cmd;
 
 	auto barrier = vk::ImageMemoryBarrier()
 		.setImage(image)
@@ -80,28 +144,75 @@ void Texture::SetupImage(vk::Device* device, vk::PhysicalDeviceMemoryProperties
 		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
 	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, 0, 0, 0, 1, &barrier);
 	
-	cmd.copyBufferToImage(uploader, image, vk::ImageLayout::eTransferDstOptimal, copyRegion.size(), copyRegion.data());
+	if (uploader)
+		cmd.copyBufferToImage(uploader, image, vk::ImageLayout::eTransferDstOptimal, copyRegion.size(), copyRegion.data());
+
+	//逐级生成mip: 上一级转为TransferSrc后线性缩小到下一级，完成后直接转为着色器只读
+	//R8G8B8A8Unorm在optimal tiling下必定支持blit与线性过滤
+	int32_t mipWidth = static_cast<int32_t>(width);
+	int32_t mipHeight = static_cast<int32_t>(height);
+	for (uint32_t i = 1; i < blitLevels; i++) {
+		barrier = vk::ImageMemoryBarrier()
+			.setImage(image)
+			.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+			.setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i - 1, 1, 0, layerCount))
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, 0, 0, 0, 1, &barrier);
+
+		int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+		vk::ImageBlit blit;
+		blit.setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0, layerCount));
+		blit.srcOffsets[1] = vk::Offset3D(mipWidth, mipHeight, 1);
+		blit.setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, layerCount));
+		blit.dstOffsets[1] = vk::Offset3D(nextWidth, nextHeight, 1);
+		cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, 1, &blit, vk::Filter::eLinear);
+
+		barrier = vk::ImageMemoryBarrier()
+			.setImage(image)
+			.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+			.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i - 1, 1, 0, layerCount))
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, 0, 0, 0, 1, &barrier);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
 
+	//最后一级(或直接拷贝进来的所有级)仍处于TransferDst
 	barrier = vk::ImageMemoryBarrier()
 		.setImage(image)
 		.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
 		.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
 		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
 		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-		.setSubresourceRange(subresourceRange)
-		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, blitLevels - 1, mipLevels - blitLevels + 1, 0, layerCount))
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
 		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
 	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, 0, 0, 0, 1, &barrier);
 
-	EndSingleTimeCommand(&cmd, cmdPool, device, queue);
+	uploader = vk::Buffer();
 }
 
-void Texture::CleanUploader(vk::Device* device) {
-	device->destroyBuffer(uploader);
-	device->freeMemory(bufferMemory);
+vk::ImageView Texture::GetImageView(vk::Device* device) {
+	return GetImageView(device, 0, mipLevels);
 }
 
-vk::ImageView Texture::GetImageView(vk::Device* device) {
+vk::ImageView Texture::GetImageView(vk::Device* device, uint32_t baseMipLevel, uint32_t levelCount) {
+	uint64_t key = (uint64_t)baseMipLevel << 32 | levelCount;
+	auto cached = imageViews.find(key);
+	if (cached != imageViews.end())
+		return cached->second;
+
 	vk::ImageView imageView;
 
 	if (isCubeMap) {
@@ -109,24 +220,64 @@ vk::ImageView Texture::GetImageView(vk::Device* device) {
 			.setComponents(vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA))
 			.setFormat(format)
 			.setImage(image)
-			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6))
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, baseMipLevel, levelCount, 0, 6))
 			.setViewType(vk::ImageViewType::eCube);
 		device->createImageView(&texImageViewInfo, 0, &imageView);
 	}
 	else {
+		//BC5法线只有XY，B通道读出1以便未重建Z的着色器也能得到近似的法线
+		vk::ComponentMapping components(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA);
+		if (format == vk::Format::eBc5UnormBlock)
+			components = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eOne, vk::ComponentSwizzle::eOne);
+
 		auto texImageViewInfo = vk::ImageViewCreateInfo()
-			.setComponents(vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA))
+			.setComponents(components)
 			.setFormat(format)
 			.setImage(image)
-			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, baseMipLevel, levelCount, 0, 1))
 			.setViewType(vk::ImageViewType::e2D);
 		device->createImageView(&texImageViewInfo, 0, &imageView);
 	}
-	
+
+	imageViews[key] = imageView;
 	return imageView;
 }
 
-bool LoadPixelWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp) {
+void Texture::ReplaceImage(vk::Image newImage, const MemoryAllocation& newAllocation, uint32_t newWidth, uint32_t newHeight, uint32_t newMipLevels, Texture& retired) {
+	retired.image = image;
+	retired.imageAllocation = imageAllocation;
+	retired.imageViews.swap(imageViews);
+	imageViews.clear();
+
+	image = newImage;
+	imageAllocation = newAllocation;
+	width = newWidth;
+	height = newHeight;
+	mipLevels = newMipLevels;
+}
+
+void Texture::Destroy(vk::Device* device) {
+	for (auto& imageView : imageViews)
+		device->destroyImageView(imageView.second);
+	imageViews.clear();
+
+	device->destroyImage(image);
+	image = vk::Image();
+	if (imageAllocation.allocator)
+		imageAllocation.allocator->Free(imageAllocation);
+}
+
+//十字展开图中+X,-X,+Y,-Y,+Z,-Z各面的左上角，x、y为单个面的尺寸
+static void GetCubeMapFaceOffsets(uint64_t x, uint64_t y, uint64_t offsetX[6], uint64_t offsetY[6]) {
+	const uint64_t cellX[6] = { 2, 0, 1, 1, 1, 3 };
+	const uint64_t cellY[6] = { 1, 1, 0, 2, 1, 1 };
+	for (uint32_t i = 0; i < 6; i++) {
+		offsetX[i] = cellX[i] * x;
+		offsetY[i] = cellY[i] * y;
+	}
+}
+
+bool LoadPixelWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, UploadBatcher& uploadBatcher) {
 	IWICBitmapSource* source;
 
 	IWICImagingFactory* factory;
@@ -160,41 +311,19 @@ bool LoadPixelWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk::
 	uint64_t pixelRowPitch = (uint64_t(texture.width) * uint64_t(texture.BPP) + 7) / 8;
 	texture.imageSize = pixelRowPitch * (uint64_t)texture.height;
 
-	//Create buffer
-	auto bufferInfo = vk::BufferCreateInfo()
-		.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-		.setSize(texture.imageSize);
-	device->createBuffer(&bufferInfo, 0, &texture.uploader);
-
-	//Allocate the memory of buffer
-	vk::MemoryRequirements uploaderMemReqs;
-	device->getBufferMemoryRequirements(texture.uploader, &uploaderMemReqs);
-
-	auto bufferMemoryInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(uploaderMemReqs.size);
-	MemoryTypeFromProperties(gpuProp, uploaderMemReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, bufferMemoryInfo.memoryTypeIndex);
-	device->allocateMemory(&bufferMemoryInfo, 0, &texture.bufferMemory);
-
-	device->bindBufferMemory(texture.uploader, texture.bufferMemory, 0);
-
-	//Copy pixel data to the upload buffer
-	BYTE* dst = nullptr;
-	device->mapMemory(texture.bufferMemory, 0, uploaderMemReqs.size, vk::MemoryMapFlags(), reinterpret_cast<void**>(&dst));
-
-	void* pixel = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, texture.imageSize);
-	if (pixel == nullptr) return false;
-	source->CopyPixels(nullptr, pixelRowPitch, static_cast<UINT>(texture.imageSize), reinterpret_cast<BYTE*>(pixel));
-
-	memcpy(dst, pixel, texture.imageSize);
-
-	device->unmapMemory(texture.bufferMemory);
+	//Reserve space in the upload ring
+	BYTE* dst = static_cast<BYTE*>(uploadBatcher.Reserve(texture.imageSize, 16, texture.uploader, texture.uploaderOffset));
+	if (dst == nullptr)
+		return false;
 
-	HeapFree(GetProcessHeap(), 0, pixel);
+	//直接解码到映射的上传内存
+	res = source->CopyPixels(nullptr, static_cast<UINT>(pixelRowPitch), static_cast<UINT>(texture.imageSize), dst);
+	source->Release();
 
-	return true;
+	return SUCCEEDED(res);
 }
 
-bool LoadCubeMapWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp) {
+bool LoadCubeMapWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, UploadBatcher& uploadBatcher) {
 	IWICBitmapSource* source;
 
 	IWICImagingFactory* factory;
@@ -233,84 +362,270 @@ bool LoadCubeMapWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk
 	texture.width = static_cast<uint32_t>(x);
 	texture.height = static_cast<uint32_t>(y);
 
-	uint64_t offsetX[6] = { 2 * x, 0, x, x, x, 3 * x };
-	uint64_t offsetY[6] = { y, y, 0, 2 * y , y, y };
+	uint64_t offsetX[6], offsetY[6];
+	GetCubeMapFaceOffsets(x, y, offsetX, offsetY);
 
 	uint64_t pixelRowPitch = (x * (uint64_t)texture.BPP + 7) / 8;
 	texture.imageSize = y * pixelRowPitch;
 	uint64_t bufferSize = texture.imageSize * 6;
 
-	//创建用作上传的缓存
-	auto bufferInfo = vk::BufferCreateInfo()
-		.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-		.setSize(bufferSize);
-	device->createBuffer(&bufferInfo, 0, &texture.uploader);
+	//从上传环形缓冲中预留六个面的空间
+	BYTE* dst = static_cast<BYTE*>(uploadBatcher.Reserve(bufferSize, 16, texture.uploader, texture.uploaderOffset));
+	if (dst == nullptr)
+		return false;
 
-	//Allocate the memory of buffer
-	vk::MemoryRequirements uploaderMemReqs;
-	device->getBufferMemoryRequirements(texture.uploader, &uploaderMemReqs);
+	//每个面直接从十字图中裁出写入上传内存
+	for (uint32_t i = 0; i < 6 && SUCCEEDED(res); i++) {
+		WICRect scissor = { static_cast<INT>(offsetX[i]), static_cast<INT>(offsetY[i]), static_cast<INT>(x), static_cast<INT>(y) };
+		res = source->CopyPixels(&scissor, static_cast<UINT>(pixelRowPitch), static_cast<UINT>(texture.imageSize), dst + texture.imageSize * i);
+	}
+	source->Release();
 
-	auto bufferMemoryInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(uploaderMemReqs.size);
-	MemoryTypeFromProperties(gpuProp, uploaderMemReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, bufferMemoryInfo.memoryTypeIndex);
-	device->allocateMemory(&bufferMemoryInfo, 0, &texture.bufferMemory);
+	return SUCCEEDED(res);
+}
 
-	device->bindBufferMemory(texture.uploader, texture.bufferMemory, 0);
+bool LoadPixelWithSTB(const char* path, uint32_t BPP, Texture& texture, UploadBatcher& uploadBatcher) {
+	//先只读文件头得到尺寸
+	int width, height, channelInFile;
+	if (!stbi_info(path, &width, &height, &channelInFile) || width <= 0 || height <= 0)
+		return false;
 
-	//Copy pixel data to the upload buffer
-	BYTE* dst = nullptr;
-	device->mapMemory(texture.bufferMemory, 0, uploaderMemReqs.size, vk::MemoryMapFlags(), reinterpret_cast<void**>(&dst));
+	texture.width = width;
+	texture.height = height;
+	texture.BPP = BPP;
 
-	for (uint32_t i = 0; i < 6; i++) {
-		void* pixel = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, texture.imageSize);
-		if (pixel == nullptr) return false;
+	//Calculate image information to use
+	uint64_t pixelRowPitch = (uint64_t(texture.width) * uint64_t(texture.BPP) + 7) / 8;
+	texture.imageSize = pixelRowPitch * (uint64_t)texture.height;
 
-		WICRect scissor = { offsetX[i], offsetY[i], x, y };
-		source->CopyPixels(&scissor, pixelRowPitch, static_cast<uint32_t>(texture.imageSize), reinterpret_cast<BYTE*>(pixel));
+	//Reserve space in the upload ring and decode into it
+	//解码失败时预留的内存不记录拷贝，由下一次预留或提交释放
+	BYTE* dst = static_cast<BYTE*>(uploadBatcher.Reserve(texture.imageSize, 16, texture.uploader, texture.uploaderOffset));
+	return dst != nullptr && DecodeImageInto(path, dst, texture.imageSize);
+}
 
-		memcpy(dst + texture.imageSize * i, pixel, texture.imageSize);
+bool LoadCubeMapWithSTB(const char* path, Texture& texture, UploadBatcher& uploadBatcher) {
+	int width, height, channelInFile;
+	stbi_uc* source = stbi_load(path, &width, &height, &channelInFile, 4);
+	if (source == nullptr)
+		return false;
+
+	texture.isCubeMap = true;
+	texture.BPP = 32;
+
+	//十字展开图，每个面占4x3网格中的一格
+	uint64_t x = static_cast<uint64_t>(width / 4);
+	uint64_t y = static_cast<uint64_t>(height / 3);
+	texture.width = static_cast<uint32_t>(x);
+	texture.height = static_cast<uint32_t>(y);
+
+	uint64_t offsetX[6], offsetY[6];
+	GetCubeMapFaceOffsets(x, y, offsetX, offsetY);
 
-		HeapFree(GetProcessHeap(), 0, pixel);
+	uint64_t pixelRowPitch = x * 4;
+	uint64_t sourceRowPitch = static_cast<uint64_t>(width) * 4;
+	texture.imageSize = y * pixelRowPitch;
+
+	BYTE* dst = static_cast<BYTE*>(uploadBatcher.Reserve(texture.imageSize * 6, 16, texture.uploader, texture.uploaderOffset));
+	if (dst != nullptr) {
+		//逐行把每个面拷贝到上传内存
+		for (uint32_t i = 0; i < 6; i++) {
+			const stbi_uc* face = source + offsetY[i] * sourceRowPitch + offsetX[i] * 4;
+			BYTE* faceDst = dst + texture.imageSize * i;
+			for (uint64_t row = 0; row < y; row++)
+				memcpy(faceDst + row * pixelRowPitch, face + row * sourceRowPitch, pixelRowPitch);
+		}
 	}
-	device->unmapMemory(texture.bufferMemory);
 
-	return true;
+	stbi_image_free(source);
+	return dst != nullptr;
 }
 
-void LoadPixelWithSTB(const char* path, uint32_t BPP, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp) {
-	int channelInFile;
-	stbi_uc* source = stbi_load(path, reinterpret_cast<int*>(&texture.width), reinterpret_cast<int*>(&texture.height), &channelInFile, 4);
+/*压缩纹理容器，与KTX2一样按级索引: Header | Level[levelCount] | 按16字节对齐的各级数据*/
+struct CompressedTextureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t usage;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t reserved;
+};
+
+struct CompressedTextureLevel {
+	uint64_t offset;
+	uint64_t size;
+};
+
+static const uint32_t compressedTextureMagic = 0x58455443; //"CTEX"
+static const uint32_t compressedTextureVersion = 1;
+static const uint64_t compressedLevelAlignment = 16;
+
+bool BakeCompressedTexture(const char* path, TextureUsage usage, const std::string& outputPath) {
+	int width, height, channelInFile;
+	stbi_uc* source = stbi_load(path, &width, &height, &channelInFile, 4);
+	if (source == nullptr)
+		return false;
 
-	texture.BPP = BPP;
+	vk::Format format = GetCompressedFormat(usage);
+
+	//在CPU上逐级缩小并压缩，块压缩格式无法用blit生成mip
+	std::vector<uint8_t> data;
+	std::vector<CompressedTextureLevel> levels;
+	std::vector<uint8_t> level(source, source + (size_t)width * height * 4);
+	std::vector<uint8_t> nextLevel;
+	uint32_t levelWidth = width, levelHeight = height;
+	while (true) {
+		data.resize((data.size() + compressedLevelAlignment - 1) & ~(compressedLevelAlignment - 1));
+
+		CompressedTextureLevel levelInfo;
+		levelInfo.offset = data.size();
+		CompressImage(level.data(), levelWidth, levelHeight, usage, data);
+		levelInfo.size = data.size() - levelInfo.offset;
+		levels.push_back(levelInfo);
+
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		DownsampleImage(level.data(), levelWidth, levelHeight, nextLevel);
+		level.swap(nextLevel);
+		levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+	stbi_image_free(source);
 
-	//Calculate image information to use
-	uint64_t pixelRowPitch = (uint64_t(texture.width) * uint64_t(texture.BPP) + 7) / 8;
-	texture.imageSize = pixelRowPitch * (uint64_t)texture.height;
+	CompressedTextureHeader header = {};
+	header.magic = compressedTextureMagic;
+	header.version = compressedTextureVersion;
+	header.format = static_cast<uint32_t>(format);
+	header.usage = static_cast<uint32_t>(usage);
+	header.width = width;
+	header.height = height;
+	header.levelCount = static_cast<uint32_t>(levels.size());
+
+	uint64_t dataStart = sizeof(header) + sizeof(CompressedTextureLevel) * levels.size();
+	dataStart = (dataStart + compressedLevelAlignment - 1) & ~(compressedLevelAlignment - 1);
+	for (auto& levelInfo : levels)
+		levelInfo.offset += dataStart;
+
+	std::string tempPath = outputPath + ".tmp";
+	std::ofstream saveFile(tempPath, std::ios::binary | std::ios::trunc);
+	if (!saveFile.is_open())
+		return false;
+	static const char padding[compressedLevelAlignment] = {};
+	saveFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	saveFile.write(reinterpret_cast<const char*>(levels.data()), sizeof(CompressedTextureLevel) * levels.size());
+	saveFile.write(padding, dataStart - sizeof(header) - sizeof(CompressedTextureLevel) * levels.size());
+	saveFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+	saveFile.close();
+	if (saveFile.fail()) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), outputPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
 
-	//Create buffer
-	auto bufferInfo = vk::BufferCreateInfo()
-		.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-		.setSize(texture.imageSize);
-	device->createBuffer(&bufferInfo, 0, &texture.uploader);
+bool OpenCompressedTexture(const char* path, TextureUsage usage, CompressedTextureInfo& info) {
+	namespace fs = std::filesystem;
+
+	//容器比原图旧时重新压缩
+	std::string containerPath = std::string(path) + ".ctex";
+	std::error_code error;
+	bool stale = !fs::exists(containerPath, error);
+	if (!stale && fs::exists(path, error))
+		stale = fs::last_write_time(path, error) > fs::last_write_time(containerPath, error);
+
+	for (uint32_t attempt = 0; attempt < 2; attempt++) {
+		if (stale && !BakeCompressedTexture(path, usage, containerPath))
+			return false;
+
+		std::ifstream loadFile(containerPath, std::ios::binary | std::ios::ate);
+		if (!loadFile.is_open())
+			return false;
+		uint64_t fileSize = static_cast<uint64_t>(loadFile.tellg());
+		loadFile.seekg(0);
+
+		CompressedTextureHeader header = {};
+		loadFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+		std::vector<CompressedTextureLevel> levels;
+		bool valid = !loadFile.fail() && header.magic == compressedTextureMagic && header.version == compressedTextureVersion &&
+			header.usage == static_cast<uint32_t>(usage) && header.format == static_cast<uint32_t>(GetCompressedFormat(usage)) &&
+			header.levelCount > 0 && header.levelCount <= 32;
+		if (valid) {
+			levels.resize(header.levelCount);
+			loadFile.read(reinterpret_cast<char*>(levels.data()), sizeof(CompressedTextureLevel) * levels.size());
+			valid = !loadFile.fail();
+		}
 
-	//Allocate the memory of buffer
-	vk::MemoryRequirements uploaderMemReqs;
-	device->getBufferMemoryRequirements(texture.uploader, &uploaderMemReqs);
+		//检查各级的偏移与大小
+		uint64_t dataStart = UINT64_MAX, dataEnd = 0;
+		for (uint32_t i = 0; valid && i < header.levelCount; i++) {
+			uint32_t levelWidth = header.width >> i ? header.width >> i : 1;
+			uint32_t levelHeight = header.height >> i ? header.height >> i : 1;
+			valid = levels[i].offset % compressedLevelAlignment == 0 && levels[i].offset + levels[i].size <= fileSize &&
+				levels[i].size == GetCompressedLevelSize(static_cast<vk::Format>(header.format), levelWidth, levelHeight);
+			if (levels[i].offset < dataStart) dataStart = levels[i].offset;
+			if (levels[i].offset + levels[i].size > dataEnd) dataEnd = levels[i].offset + levels[i].size;
+		}
 
-	auto bufferMemoryInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(uploaderMemReqs.size);
-	MemoryTypeFromProperties(gpuProp, uploaderMemReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, bufferMemoryInfo.memoryTypeIndex);
-	device->allocateMemory(&bufferMemoryInfo, 0, &texture.bufferMemory);
+		if (!valid) {
+			//旧版本或损坏的容器，重新压缩一次
+			loadFile.close();
+			stale = true;
+			continue;
+		}
 
-	device->bindBufferMemory(texture.uploader, texture.bufferMemory, 0);
+		info.containerPath = containerPath;
+		info.format = static_cast<vk::Format>(header.format);
+		info.width = header.width;
+		info.height = header.height;
+		info.levels.resize(header.levelCount);
+		for (uint32_t i = 0; i < header.levelCount; i++)
+			info.levels[i] = std::make_pair(levels[i].offset, levels[i].size);
+		return true;
+	}
 
-	//Copy pixel data to the upload buffer
-	BYTE* dst = nullptr;
-	device->mapMemory(texture.bufferMemory, 0, uploaderMemReqs.size, vk::MemoryMapFlags(), reinterpret_cast<void**>(&dst));
+	return false;
+}
+
+bool LoadCompressedTexture(const char* path, TextureUsage usage, Texture& texture, UploadBatcher& uploadBatcher) {
+	CompressedTextureInfo info;
+	if (!OpenCompressedTexture(path, usage, info))
+		return false;
 
-	memcpy(dst, source, texture.imageSize);
+	uint64_t dataStart = UINT64_MAX, dataEnd = 0;
+	for (auto& level : info.levels) {
+		if (level.first < dataStart) dataStart = level.first;
+		if (level.first + level.second > dataEnd) dataEnd = level.first + level.second;
+	}
 
-	device->unmapMemory(texture.bufferMemory);
+	texture.format = info.format;
+	texture.width = info.width;
+	texture.height = info.height;
+	texture.BPP = GetCompressedBlockSize(texture.format) / 2;
+	texture.imageSize = dataEnd - dataStart;
+	texture.generateMips = false;
+	texture.levelOffsets.resize(info.levels.size());
+	for (size_t i = 0; i < info.levels.size(); i++)
+		texture.levelOffsets[i] = info.levels[i].first - dataStart;
+
+	//压缩数据不需要解码，直接读进上传环形缓冲
+	std::ifstream loadFile(info.containerPath, std::ios::binary);
+	BYTE* dst = static_cast<BYTE*>(uploadBatcher.Reserve(texture.imageSize, 16, texture.uploader, texture.uploaderOffset));
+	if (dst != nullptr) {
+		loadFile.seekg(dataStart);
+		loadFile.read(reinterpret_cast<char*>(dst), texture.imageSize);
+	}
 
-	stbi_image_free(source);
-}
\ No newline at end of file
+	if (dst == nullptr || loadFile.fail()) {
+		texture = Texture();
+		return false;
+	}
+	return true;
+}
@@ -1,15 +1,23 @@
 #pragma once
 #include <wincodec.h>
+#include <map>
 #include "../../Util/vkUtil.h"
+#include "../../Util/TextureCompressor.h"
+#include "../../Util/UploadBatcher.h"
 
 class Texture {
 public:
     vk::Format format = vk::Format::eR8G8B8A8Unorm;
 
-    void SetupImage(vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp, vk::CommandPool& cmdPool, vk::Queue* queue);
-    void CleanUploader(vk::Device* device);
+    void SetupImage(vk::Device* device, MemoryAllocator* allocator, UploadBatcher& uploadBatcher);
 
+    //视图按子资源范围缓存，同一范围只创建一次，随纹理一起销毁
     vk::ImageView GetImageView(vk::Device* device);
+    vk::ImageView GetImageView(vk::Device* device, uint32_t baseMipLevel, uint32_t levelCount);
+    void Destroy(vk::Device* device);
+
+    //流式加载改变驻留的mip时换成新的图像，旧的图像、内存与视图移交给retired，由调用者在GPU用完后销毁
+    void ReplaceImage(vk::Image newImage, const MemoryAllocation& newAllocation, uint32_t newWidth, uint32_t newHeight, uint32_t newMipLevels, Texture& retired);
     vk::Image GetImage() {
         return image;
     }
@@ -17,16 +25,46 @@ public:
     UINT width, height, BPP;
     uint64_t imageSize;
 
+    //上传缓冲只包含第0级，其余各级在SetupImage中用blit逐级缩小生成
+    bool generateMips = true;
+    uint32_t mipLevels = 1;
+    //生成mip时的层数上限，0表示完整的mip链(图集用它避免相邻图块在低级mip中混色)
+    uint32_t maxMipLevels = 0;
+
+    //预先生成了mip的纹理(如块压缩纹理)，每级数据在上传缓冲中的偏移
+    std::vector<uint64_t> levelOffsets;
+
+    //像素数据在上传环形缓冲中的位置
     vk::Buffer uploader;
-    vk::DeviceMemory bufferMemory;
+    uint64_t uploaderOffset = 0;
 
     bool isCubeMap = false;
 
 private:
     vk::Image image;
-    vk::DeviceMemory imageMemory;
+    MemoryAllocation imageAllocation;
+
+    //键为baseMipLevel << 32 | levelCount
+    std::map<uint64_t, vk::ImageView> imageViews;
 };
 
-bool LoadPixelWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp);
-bool LoadCubeMapWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp);
-void LoadPixelWithSTB(const char* path, uint32_t BPP, Texture& texture, vk::Device* device, vk::PhysicalDeviceMemoryProperties gpuProp);
\ No newline at end of file
+bool LoadPixelWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, UploadBatcher& uploadBatcher);
+bool LoadCubeMapWithWIC(const wchar_t* path, GUID tgFormat, Texture& texture, UploadBatcher& uploadBatcher);
+//文件不存在或无法解码时返回false，不创建图像
+bool LoadPixelWithSTB(const char* path, uint32_t BPP, Texture& texture, UploadBatcher& uploadBatcher);
+//读取4x3十字展开的立方体贴图，不依赖WIC
+bool LoadCubeMapWithSTB(const char* path, Texture& texture, UploadBatcher& uploadBatcher);
+
+//把图片压缩为带完整mip链的块压缩纹理并写入容器文件
+bool BakeCompressedTexture(const char* path, TextureUsage usage, const std::string& outputPath);
+//.ctex容器的描述，levels为各级数据在文件中的偏移与大小
+struct CompressedTextureInfo {
+    std::string containerPath;
+    vk::Format format = vk::Format::eUndefined;
+    uint32_t width = 0, height = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> levels;
+};
+//打开并校验path对应的.ctex容器，不存在或比原图旧时先重新压缩
+bool OpenCompressedTexture(const char* path, TextureUsage usage, CompressedTextureInfo& info);
+//读取path对应的.ctex容器，数据直接读入上传缓冲
+bool LoadCompressedTexture(const char* path, TextureUsage usage, Texture& texture, UploadBatcher& uploadBatcher);
\ No newline at end of file
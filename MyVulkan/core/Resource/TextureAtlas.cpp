@@ -0,0 +1,109 @@
+#include "TextureAtlas.h"
+#include "stb/stb_image.h"
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../../imgui/imstb_rectpack.h"
+
+//把图片复制到图集中rect所在的区域，图块外的填充部分重复边缘像素
+static void CopyTile(const stbi_uc* source, uint32_t width, uint32_t height, const stbrp_rect& rect, uint32_t padding, uint8_t* atlas, uint32_t atlasSize) {
+	for (uint32_t y = 0; y < rect.h; y++) {
+		int32_t sy = static_cast<int32_t>(y) - static_cast<int32_t>(padding);
+		sy = sy < 0 ? 0 : (sy >= static_cast<int32_t>(height) ? height - 1 : sy);
+		const stbi_uc* sourceRow = source + (size_t)sy * width * 4;
+		uint8_t* dstRow = atlas + ((size_t)(rect.y + y) * atlasSize + rect.x) * 4;
+
+		for (uint32_t x = 0; x < padding; x++)
+			memcpy(dstRow + x * 4, sourceRow, 4);
+		memcpy(dstRow + padding * 4, sourceRow, (size_t)width * 4);
+		for (uint32_t x = padding + width; x < rect.w; x++)
+			memcpy(dstRow + x * 4, sourceRow + (width - 1) * 4, 4);
+	}
+}
+
+void BuildTextureAtlas(const std::vector<std::string>& paths, const TextureAtlasOptions& options, std::vector<TextureAtlasRegion>& regions, std::vector<Texture*>& pages,
+	vk::Device* device, MemoryAllocator* allocator, UploadBatcher& uploadBatcher) {
+	regions.assign(paths.size(), TextureAtlasRegion());
+
+	uint32_t padding = 1;
+	while (padding < options.padding)
+		padding <<= 1;
+	uint32_t maxMipLevels = 1;
+	for (uint32_t size = padding; size > 1; size >>= 1)
+		maxMipLevels++;
+
+	//图块尺寸按padding对齐，打包后的位置也都是padding的倍数，前几级mip中图块边界与纹素边界重合
+	std::vector<stbrp_rect> rects;
+	std::vector<uint32_t> sizes(paths.size() * 2);
+	for (size_t i = 0; i < paths.size(); i++) {
+		int width, height, channelInFile;
+		if (!stbi_info(paths[i].c_str(), &width, &height, &channelInFile))
+			continue;
+		if (static_cast<uint32_t>(width) > options.maxTileSize || static_cast<uint32_t>(height) > options.maxTileSize)
+			continue;
+
+		uint32_t rectWidth = (width + padding * 2 + padding - 1) & ~(padding - 1);
+		uint32_t rectHeight = (height + padding * 2 + padding - 1) & ~(padding - 1);
+		if (rectWidth > options.atlasSize || rectHeight > options.atlasSize)
+			continue;
+
+		stbrp_rect rect = {};
+		rect.id = static_cast<int>(i);
+		rect.w = static_cast<stbrp_coord>(rectWidth);
+		rect.h = static_cast<stbrp_coord>(rectHeight);
+		rects.push_back(rect);
+		sizes[i * 2] = width;
+		sizes[i * 2 + 1] = height;
+	}
+
+	std::vector<stbrp_node> nodes(options.atlasSize);
+	while (!rects.empty()) {
+		stbrp_context context;
+		stbrp_init_target(&context, options.atlasSize, options.atlasSize, nodes.data(), static_cast<int>(nodes.size()));
+		stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+
+		std::vector<stbrp_rect> packed, remaining;
+		for (auto& rect : rects)
+			(rect.was_packed ? packed : remaining).push_back(rect);
+		if (packed.empty())
+			break;
+
+		Texture* page = new Texture();
+		page->width = options.atlasSize;
+		page->height = options.atlasSize;
+		page->BPP = 32;
+		page->imageSize = (uint64_t)options.atlasSize * options.atlasSize * 4;
+		page->maxMipLevels = maxMipLevels;
+
+		uint8_t* atlas = static_cast<uint8_t*>(uploadBatcher.Reserve(page->imageSize, 16, page->uploader, page->uploaderOffset));
+		if (atlas == nullptr) {
+			delete page;
+			break;
+		}
+		memset(atlas, 0, page->imageSize);
+
+		int32_t pageIndex = static_cast<int32_t>(pages.size());
+		for (auto& rect : packed) {
+			uint32_t width = sizes[rect.id * 2];
+			uint32_t height = sizes[rect.id * 2 + 1];
+
+			int sourceWidth, sourceHeight, channelInFile;
+			stbi_uc* source = stbi_load(paths[rect.id].c_str(), &sourceWidth, &sourceHeight, &channelInFile, 4);
+			if (source == nullptr)
+				continue;
+			CopyTile(source, width, height, rect, padding, atlas, options.atlasSize);
+			stbi_image_free(source);
+
+			TextureAtlasRegion& region = regions[rect.id];
+			region.page = pageIndex;
+			region.uvScale = glm::vec2(width, height) / static_cast<float>(options.atlasSize);
+			region.uvOffset = glm::vec2(rect.x + padding, rect.y + padding) / static_cast<float>(options.atlasSize);
+		}
+
+		//必须在下一次Reserve之前记录拷贝
+		page->SetupImage(device, allocator, uploadBatcher);
+		pages.push_back(page);
+
+		rects.swap(remaining);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "Texture.h"
+
+struct TextureAtlasOptions {
+    uint32_t atlasSize = 2048;
+    //超过该尺寸的贴图不打包，单独加载
+    uint32_t maxTileSize = 512;
+    //每个图块四周复制边缘像素的宽度(2的幂)，同时限制图集的mip层数为log2(padding) + 1
+    uint32_t padding = 8;
+};
+
+struct TextureAtlasRegion {
+    //-1表示没有打包进图集
+    int32_t page = -1;
+    glm::vec2 uvScale = glm::vec2(1.0f, 1.0f);
+    glm::vec2 uvOffset = glm::vec2(0.0f, 0.0f);
+
+    glm::vec2 Remap(glm::vec2 texCoord)const { return texCoord * uvScale + uvOffset; }
+};
+
+//用imstb_rectpack把paths中的小贴图打包为若干张图集，图块直接拼进上传缓冲并记录上传命令
+//regions与paths一一对应，pages由调用者持有
+void BuildTextureAtlas(const std::vector<std::string>& paths, const TextureAtlasOptions& options, std::vector<TextureAtlasRegion>& regions, std::vector<Texture*>& pages,
+    vk::Device* device, MemoryAllocator* allocator, UploadBatcher& uploadBatcher);
@@ -0,0 +1,182 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <filesystem>
+
+TextureCache::~TextureCache() {
+	Destroy();
+}
+
+void TextureCache::Init(Vulkan* vkInfo, UploadBatcher* uploadBatcher) {
+	this->vkInfo = vkInfo;
+	this->uploadBatcher = uploadBatcher;
+}
+
+void TextureCache::Destroy() {
+	if (vkInfo == nullptr)
+		return;
+
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	//仍被持有的纹理也在这里释放，之后句柄不可再使用
+	for (auto& entry : entries) {
+		if (auto texture = entry.second.lock()) {
+			if (streamer != nullptr)
+				streamer->Release(texture.get());
+			texture->Destroy(&vkInfo->device);
+		}
+	}
+	entries.clear();
+	atlases.clear();
+	Collect();
+
+	vkInfo = nullptr;
+}
+
+std::string TextureCache::MakeKey(const std::string& path, const char* kind, uint32_t option)const {
+	namespace fs = std::filesystem;
+
+	//统一分隔符与大小写，相对路径和绝对路径指向同一文件时得到相同的键
+	std::error_code error;
+	fs::path normalized = fs::weakly_canonical(fs::path(path), error);
+	if (error)
+		normalized = fs::path(path).lexically_normal();
+
+	std::string key = normalized.generic_string();
+	std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+	return key + "|" + kind + "|" + std::to_string(option);
+}
+
+std::shared_ptr<Texture> TextureCache::Find(const std::string& key) {
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	auto entry = entries.find(key);
+	if (entry != entries.end())
+		return entry->second.lock();
+	return nullptr;
+}
+
+std::shared_ptr<Texture> TextureCache::Track(const std::string& key, Texture* texture) {
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	//其他线程先加载完同一张图时沿用已有的句柄，这份等GPU用完后释放
+	if (auto existing = Find(key)) {
+		if (streamer != nullptr)
+			streamer->Release(texture);
+		pendingDestroy.push_back(texture);
+		return existing;
+	}
+
+	//引用计数归零时从缓存中移除，GPU资源延迟到Collect释放
+	std::shared_ptr<Texture> handle(texture, [this, key](Texture* released) {
+		std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+		auto entry = entries.find(key);
+		if (entry != entries.end() && entry->second.expired())
+			entries.erase(entry);
+		if (streamer != nullptr)
+			streamer->Release(released);
+		pendingDestroy.push_back(released);
+	});
+	entries[key] = handle;
+	return handle;
+}
+
+std::shared_ptr<Texture> TextureCache::Load(const std::string& path, TextureUsage usage) {
+	std::string key = MakeKey(path, "2d", static_cast<uint32_t>(usage));
+	if (auto texture = Find(key))
+		return texture;
+
+	Texture* texture = new Texture();
+	if (streamer != nullptr && streamer->Load(path, usage, *texture))
+		return Track(key, texture);
+	//读取失败时不缓存，返回空由调用者继续使用占位纹理
+	if (!(vkInfo->textureCompressionBC && LoadCompressedTexture(path.c_str(), usage, *texture, *uploadBatcher)) &&
+		!LoadPixelWithSTB(path.c_str(), 32, *texture, *uploadBatcher)) {
+		delete texture;
+		return nullptr;
+	}
+	texture->SetupImage(&vkInfo->device, vkInfo->allocator, *uploadBatcher);
+
+	return Track(key, texture);
+}
+
+std::shared_ptr<Texture> TextureCache::LoadCubeMap(const std::string& path) {
+	std::string key = MakeKey(path, "cube", 0);
+	if (auto texture = Find(key))
+		return texture;
+
+	Texture* texture = new Texture();
+	if (!LoadCubeMapWithSTB(path.c_str(), *texture, *uploadBatcher)) {
+		MessageBox(0, L"Load cube map failed!!!", 0, 0);
+		delete texture;
+		return nullptr;
+	}
+	texture->SetupImage(&vkInfo->device, vkInfo->allocator, *uploadBatcher);
+
+	return Track(key, texture);
+}
+
+std::shared_ptr<Texture> TextureCache::GetPlaceholder(uint32_t rgba, bool cubeMap) {
+	std::string key = std::string("placeholder|") + (cubeMap ? "cube" : "2d") + "|" + std::to_string(rgba);
+	if (auto texture = Find(key))
+		return texture;
+
+	Texture* texture = new Texture();
+	texture->width = 1;
+	texture->height = 1;
+	texture->BPP = 32;
+	texture->imageSize = 4;
+	texture->isCubeMap = cubeMap;
+
+	uint32_t faceCount = cubeMap ? 6 : 1;
+	uint32_t* dst = static_cast<uint32_t*>(uploadBatcher->Reserve(texture->imageSize * faceCount, 16, texture->uploader, texture->uploaderOffset));
+	if (dst != nullptr) {
+		for (uint32_t i = 0; i < faceCount; i++)
+			dst[i] = rgba;
+	}
+	texture->SetupImage(&vkInfo->device, vkInfo->allocator, *uploadBatcher);
+
+	return Track(key, texture);
+}
+
+std::vector<std::shared_ptr<Texture>> TextureCache::LoadAtlas(const std::vector<std::string>& paths, const TextureAtlasOptions& options, std::vector<TextureAtlasRegion>& regions) {
+	std::string atlasKey;
+	for (auto& path : paths)
+		atlasKey += MakeKey(path, "tile", 0) + ";";
+	atlasKey += std::to_string(options.atlasSize) + "," + std::to_string(options.maxTileSize) + "," + std::to_string(options.padding);
+
+	//所有图集页都还在使用时直接复用
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	std::vector<std::shared_ptr<Texture>> pages;
+	auto atlas = atlases.find(atlasKey);
+	if (atlas != atlases.end()) {
+		for (auto& page : atlas->second.pages) {
+			if (auto texture = page.lock())
+				pages.push_back(texture);
+		}
+		if (pages.size() == atlas->second.pages.size()) {
+			regions = atlas->second.regions;
+			return pages;
+		}
+		pages.clear();
+	}
+
+	std::vector<Texture*> builtPages;
+	BuildTextureAtlas(paths, options, regions, builtPages, &vkInfo->device, vkInfo->allocator, *uploadBatcher);
+
+	AtlasEntry entry;
+	entry.regions = regions;
+	for (size_t i = 0; i < builtPages.size(); i++) {
+		pages.push_back(Track(atlasKey + "#" + std::to_string(i), builtPages[i]));
+		entry.pages.push_back(pages.back());
+	}
+	atlases[atlasKey] = entry;
+	return pages;
+}
+
+void TextureCache::Collect() {
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	for (Texture* texture : pendingDestroy) {
+		if (vkInfo != nullptr)
+			texture->Destroy(&vkInfo->device);
+		delete texture;
+	}
+	pendingDestroy.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Texture.h"
+#include "TextureAtlas.h"
+#include "TextureStreamer.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*纹理缓存: 以规范化路径加加载选项为键，返回共享的引用计数句柄，同一张图只占一份显存。
+  Load与LoadCubeMap可以在多个导入线程中同时调用，解码在锁外进行*/
+class TextureCache {
+public:
+    ~TextureCache();
+
+    void Init(Vulkan* vkInfo, UploadBatcher* uploadBatcher);
+    void Destroy();
+
+    //设置之后块压缩纹理交给streamer按需加载mip
+    void SetStreamer(TextureStreamer* streamer) { this->streamer = streamer; }
+
+    //设备支持时读取块压缩纹理，否则退回未压缩的RGBA8，读取失败时返回空
+    std::shared_ptr<Texture> Load(const std::string& path, TextureUsage usage);
+    //4x3十字展开的立方体贴图，读取失败时返回空
+    std::shared_ptr<Texture> LoadCubeMap(const std::string& path);
+    //1x1的纯色纹理，rgba按R在最低字节排列，真正的纹理加载完成前作为占位
+    std::shared_ptr<Texture> GetPlaceholder(uint32_t rgba, bool cubeMap = false);
+    //把一组小贴图打包为图集，相同的路径列表与选项返回同一组图集页
+    std::vector<std::shared_ptr<Texture>> LoadAtlas(const std::vector<std::string>& paths, const TextureAtlasOptions& options, std::vector<TextureAtlasRegion>& regions);
+
+    //引用计数归零的纹理先放入待销毁列表，在GPU不再使用时调用此函数真正释放
+    void Collect();
+
+    size_t GetTextureCount() {
+        std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+        return entries.size();
+    }
+
+private:
+    std::string MakeKey(const std::string& path, const char* kind, uint32_t option)const;
+    std::shared_ptr<Texture> Find(const std::string& key);
+    std::shared_ptr<Texture> Track(const std::string& key, Texture* texture);
+
+    Vulkan* vkInfo = nullptr;
+    UploadBatcher* uploadBatcher = nullptr;
+    TextureStreamer* streamer = nullptr;
+
+    std::unordered_map<std::string, std::weak_ptr<Texture>> entries;
+
+    struct AtlasEntry {
+        std::vector<std::weak_ptr<Texture>> pages;
+        std::vector<TextureAtlasRegion> regions;
+    };
+    std::unordered_map<std::string, AtlasEntry> atlases;
+    std::vector<Texture*> pendingDestroy;
+    //释放句柄时删除器会重新进入，所以用递归锁
+    std::recursive_mutex cacheMutex;
+};
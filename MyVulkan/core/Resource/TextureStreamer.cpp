@@ -0,0 +1,292 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+TextureStreamer::~TextureStreamer() {
+	Destroy();
+}
+
+void TextureStreamer::Init(Vulkan* vkInfo, UploadBatcher* uploadBatcher, uint64_t budget) {
+	this->vkInfo = vkInfo;
+	this->uploadBatcher = uploadBatcher;
+	this->budget = budget;
+}
+
+void TextureStreamer::Destroy() {
+	if (vkInfo == nullptr)
+		return;
+
+	Collect();
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	textures.clear();
+	residentBytes = 0;
+
+	vkInfo = nullptr;
+}
+
+uint64_t TextureStreamer::GetLevelBytes(const StreamedTexture& streamed, uint32_t base)const {
+	uint64_t bytes = 0;
+	for (uint32_t i = base; i < streamed.info.levels.size(); i++)
+		bytes += streamed.info.levels[i].second;
+	return bytes;
+}
+
+bool TextureStreamer::Load(const std::string& path, TextureUsage usage, Texture& texture) {
+	StreamedTexture streamed;
+	if (!OpenCompressedTexture(path.c_str(), usage, streamed.info))
+		return false;
+
+	uint32_t levelCount = static_cast<uint32_t>(streamed.info.levels.size());
+	uint32_t base = 0;
+	while (base + 1 < levelCount && std::max(streamed.info.width >> base, streamed.info.height >> base) > initialSize)
+		base++;
+
+	texture.format = streamed.info.format;
+	texture.BPP = GetCompressedBlockSize(texture.format) / 2;
+	texture.generateMips = false;
+	streamed.requestedBase = levelCount;
+
+	//导入线程也会调用，读取容器头之后才加锁
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	streamed.lastUsedFrame = frameIndex;
+
+	auto& entry = textures[&texture];
+	entry = streamed;
+	if (!SetResidency(&texture, entry, base)) {
+		textures.erase(&texture);
+		return false;
+	}
+	return true;
+}
+
+void TextureStreamer::Release(Texture* texture) {
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	auto entry = textures.find(texture);
+	if (entry == textures.end())
+		return;
+	residentBytes -= entry->second.residentBytes;
+	textures.erase(entry);
+}
+
+void TextureStreamer::RequestResolution(Texture* texture, float screenPixels) {
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	auto entry = textures.find(texture);
+	if (entry == textures.end())
+		return;
+
+	StreamedTexture& streamed = entry->second;
+	uint32_t levelCount = static_cast<uint32_t>(streamed.info.levels.size());
+
+	//每个屏幕像素大约对应一个纹素时的级别
+	float texels = static_cast<float>(std::max(streamed.info.width, streamed.info.height));
+	float level = screenPixels > 1.0f ? std::log2(texels / screenPixels) : static_cast<float>(levelCount - 1);
+	uint32_t base = level <= 0.0f ? 0 : std::min(static_cast<uint32_t>(level), levelCount - 1);
+
+	streamed.requestedBase = std::min(streamed.requestedBase, base);
+	streamed.lastUsedFrame = frameIndex;
+}
+
+bool TextureStreamer::SetResidency(Texture* texture, StreamedTexture& streamed, uint32_t base) {
+	vk::Device& device = vkInfo->device;
+	const CompressedTextureInfo& info = streamed.info;
+	uint32_t levelCount = static_cast<uint32_t>(info.levels.size());
+	uint32_t levels = levelCount - base;
+	uint32_t width = std::max(info.width >> base, 1u);
+	uint32_t height = std::max(info.height >> base, 1u);
+
+	auto imageInfo = vk::ImageCreateInfo()
+		.setArrayLayers(1)
+		.setExtent(vk::Extent3D(width, height, 1))
+		.setFormat(info.format)
+		.setImageType(vk::ImageType::e2D)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setMipLevels(levels)
+		.setSamples(vk::SampleCountFlagBits::e1)
+		.setUsage(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+		.setTiling(vk::ImageTiling::eOptimal);
+	vk::Image image;
+	device.createImage(&imageInfo, 0, &image);
+
+	MemoryAllocation allocation;
+	if (!vkInfo->allocator->AllocateImage(image, vk::MemoryPropertyFlagBits::eDeviceLocal, allocation)) {
+		device.destroyImage(image);
+		return false;
+	}
+
+	//旧图像从oldBase开始，两者重叠的级别在GPU上直接拷贝
+	vk::Image oldImage = texture->GetImage();
+	uint32_t oldBase = oldImage ? streamed.residentBase : levelCount;
+
+	vk::ImageMemoryBarrier barriers[2];
+	barriers[0] = vk::ImageMemoryBarrier()
+		.setImage(image)
+		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1))
+		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+	barriers[1] = vk::ImageMemoryBarrier()
+		.setImage(oldImage)
+		.setOldLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levelCount - oldBase, 0, 1))
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderRead)
+		.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+	{
+		UploadBatcher::Recording recording(*uploadBatcher);
+		recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, 0, 0, 0, oldImage ? 2 : 1, barriers);
+
+		for (uint32_t level = std::max(base, oldBase); level < levelCount; level++) {
+			auto copyRegion = vk::ImageCopy()
+				.setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - oldBase, 0, 1))
+				.setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - base, 0, 1))
+				.setExtent(vk::Extent3D(std::max(info.width >> level, 1u), std::max(info.height >> level, 1u), 1));
+			recording.cmd.copyImage(oldImage, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion);
+		}
+	}
+
+	//缺少的级别从容器读进上传缓冲，Reserve可能提交当前批次，所以每级单独记录拷贝
+	std::ifstream loadFile(info.containerPath, std::ios::binary);
+	bool loaded = loadFile.is_open();
+	for (uint32_t level = base; loaded && level < std::min(oldBase, levelCount); level++) {
+		vk::Buffer uploader;
+		uint64_t uploaderOffset;
+		void* dst = uploadBatcher->Reserve(info.levels[level].second, 16, uploader, uploaderOffset);
+		if (dst == nullptr) {
+			loaded = false;
+			break;
+		}
+		loadFile.seekg(info.levels[level].first);
+		loadFile.read(static_cast<char*>(dst), info.levels[level].second);
+		loaded = !loadFile.fail();
+
+		auto copyRegion = vk::BufferImageCopy()
+			.setBufferOffset(uploaderOffset)
+			.setImageExtent(vk::Extent3D(std::max(info.width >> level, 1u), std::max(info.height >> level, 1u), 1))
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - base, 0, 1));
+		UploadBatcher::Recording recording(*uploadBatcher);
+		recording.cmd.copyBufferToImage(uploader, image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion);
+	}
+
+	barriers[0]
+		.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	//加载失败时旧图像已转为TransferSrc，一并转回着色器只读
+	barriers[1]
+		.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+		.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	{
+		UploadBatcher::Recording recording(*uploadBatcher);
+		recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, 0, 0, 0, !loaded && oldImage ? 2 : 1, barriers);
+	}
+
+	if (!loaded) {
+		//新图像已经记录进命令，和旧图像一样等GPU用完再销毁
+		auto failed = std::make_unique<Texture>();
+		Texture unused;
+		failed->ReplaceImage(image, allocation, width, height, levels, unused);
+		retired.push_back(std::move(failed));
+		return false;
+	}
+
+	auto old = std::make_unique<Texture>();
+	texture->ReplaceImage(image, allocation, width, height, levels, *old);
+	if (oldImage)
+		retired.push_back(std::move(old));
+
+	residentBytes -= streamed.residentBytes;
+	streamed.residentBytes = GetLevelBytes(streamed, base);
+	streamed.residentBase = base;
+	residentBytes += streamed.residentBytes;
+	return true;
+}
+
+bool TextureStreamer::EvictLeastRecentlyUsed(Texture* keep) {
+	//本帧没有用到的纹理中最久未使用的一个，降低一级
+	Texture* victim = nullptr;
+	StreamedTexture* victimState = nullptr;
+	for (auto& entry : textures) {
+		StreamedTexture& streamed = entry.second;
+		uint32_t levelCount = static_cast<uint32_t>(streamed.info.levels.size());
+		if (entry.first == keep || streamed.residentBase + 1 >= levelCount || (streamed.lastUsedFrame == frameIndex && streamed.requestedBase <= streamed.residentBase))
+			continue;
+		if (victim == nullptr || streamed.lastUsedFrame < victimState->lastUsedFrame ||
+			(streamed.lastUsedFrame == victimState->lastUsedFrame && streamed.residentBytes > victimState->residentBytes)) {
+			victim = entry.first;
+			victimState = &streamed;
+		}
+	}
+
+	if (victim == nullptr)
+		return false;
+	return SetResidency(victim, *victimState, victimState->residentBase + 1);
+}
+
+bool TextureStreamer::Update() {
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	bool changed = false;
+
+	//按缺少的级别数从多到少提升
+	std::vector<std::pair<Texture*, StreamedTexture*>> promotions;
+	for (auto& entry : textures) {
+		if (entry.second.requestedBase < entry.second.residentBase)
+			promotions.push_back(std::make_pair(entry.first, &entry.second));
+	}
+	std::sort(promotions.begin(), promotions.end(), [](const std::pair<Texture*, StreamedTexture*>& a, const std::pair<Texture*, StreamedTexture*>& b) {
+		return a.second->residentBase - a.second->requestedBase > b.second->residentBase - b.second->requestedBase;
+	});
+
+	uint64_t uploadedBytes = 0;
+	for (auto& promotion : promotions) {
+		StreamedTexture& streamed = *promotion.second;
+
+		//受每帧上传量限制时从低分辨率往上只提升一部分，每帧至少提升一级
+		uint32_t target = streamed.residentBase;
+		while (target > streamed.requestedBase && ((uploadedBytes == 0 && target == streamed.residentBase) ||
+			uploadedBytes + GetLevelBytes(streamed, target - 1) - streamed.residentBytes <= maxUploadPerFrame))
+			target--;
+		if (target == streamed.residentBase)
+			break;
+
+		//超出预算时先降低最久未使用的纹理，仍然放不下就少提升几级
+		uint64_t needed = GetLevelBytes(streamed, target) - streamed.residentBytes;
+		while (residentBytes + needed > budget && EvictLeastRecentlyUsed(promotion.first))
+			changed = true;
+		while (target < streamed.residentBase && residentBytes + GetLevelBytes(streamed, target) - streamed.residentBytes > budget)
+			target++;
+		if (target == streamed.residentBase)
+			continue;
+
+		needed = GetLevelBytes(streamed, target) - streamed.residentBytes;
+		if (SetResidency(promotion.first, streamed, target)) {
+			uploadedBytes += needed;
+			changed = true;
+		}
+	}
+
+	//预算被调小之后也要降下来
+	while (residentBytes > budget && EvictLeastRecentlyUsed(nullptr))
+		changed = true;
+
+	for (auto& entry : textures)
+		entry.second.requestedBase = static_cast<uint32_t>(entry.second.info.levels.size());
+	frameIndex++;
+
+	return changed;
+}
+
+void TextureStreamer::Collect() {
+	std::lock_guard<std::mutex> lock(streamerMutex);
+	for (auto& texture : retired)
+		texture->Destroy(&vkInfo->device);
+	retired.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Texture.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*按mip流式加载块压缩纹理: 先只加载最低的几级，根据屏幕上需要的分辨率逐步提升，超出显存预算时按LRU降低驻留级别*/
+class TextureStreamer {
+public:
+    ~TextureStreamer();
+
+    void Init(Vulkan* vkInfo, UploadBatcher* uploadBatcher, uint64_t budget);
+    void Destroy();
+
+    //只加载尺寸不超过initialSize的mip，容器不可用时返回false，可以在导入线程中调用
+    bool Load(const std::string& path, TextureUsage usage, Texture& texture);
+    void Release(Texture* texture);
+
+    //报告纹理完整的UV范围在屏幕上约占多少像素，同一帧内取最大值
+    void RequestResolution(Texture* texture, float screenPixels);
+
+    //处理本帧的请求，提升或降低驻留级别，返回true表示有纹理换了图像，需要更新描述符并重新录制命令
+    bool Update();
+
+    //销毁被替换的旧图像，在GPU完成上一帧之后调用
+    void Collect();
+
+    uint64_t GetResidentBytes()const { return residentBytes; }
+    uint64_t GetBudget()const { return budget; }
+    void SetBudget(uint64_t budget) { this->budget = budget; }
+
+    //初始加载的最大尺寸，以及每帧最多上传的字节数
+    uint32_t initialSize = 64;
+    uint64_t maxUploadPerFrame = 16ull * 1024 * 1024;
+
+private:
+    struct StreamedTexture {
+        CompressedTextureInfo info;
+        //当前图像的第0级对应容器中的级别
+        uint32_t residentBase = 0;
+        //本帧请求的最高级别，没有请求时为levelCount
+        uint32_t requestedBase = 0;
+        uint64_t lastUsedFrame = 0;
+        uint64_t residentBytes = 0;
+    };
+
+    uint64_t GetLevelBytes(const StreamedTexture& streamed, uint32_t base)const;
+    bool SetResidency(Texture* texture, StreamedTexture& streamed, uint32_t base);
+    bool EvictLeastRecentlyUsed(Texture* keep);
+
+    Vulkan* vkInfo = nullptr;
+    UploadBatcher* uploadBatcher = nullptr;
+
+    uint64_t budget = 0;
+    uint64_t residentBytes = 0;
+    uint64_t frameIndex = 0;
+
+    std::unordered_map<Texture*, StreamedTexture> textures;
+    std::vector<std::unique_ptr<Texture>> retired;
+    std::mutex streamerMutex;
+};
@@ -1,6 +1,14 @@
 #include "Scene.h"
 
 #include "../Util/GeometryGenerator.h"
+#include "../Util/ShaderLibrary.h"
+#include "../Util/VertexCompressor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <tuple>
 
 void Scene::AddGameObject(GameObject& gameObject, GameObject* parent) {
 	if (gameObjects.find(gameObject.name) != gameObjects.end()) {
@@ -25,19 +33,88 @@ void Scene::AddMaterial(Material& material) {
 	materials[material.name] = material;
 }
 
+//顶点与索引分别哈希后合并，相等时再逐字节比较
+static uint64_t HashMeshData(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+	uint64_t vertexHash = HashBytes(vertices.data(), vertices.size() * sizeof(Vertex));
+	uint64_t indexHash = HashBytes(indices.data(), indices.size() * sizeof(uint32_t));
+	return vertexHash ^ (indexHash + 0x9e3779b97f4a7c15ull + (vertexHash << 6) + (vertexHash >> 2));
+}
+
+std::shared_ptr<const MeshGeometry> Scene::RegisterMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+	auto& candidates = meshRegistry[HashMeshData(vertices, indices)];
+	for (auto& weakCandidate : candidates) {
+		std::shared_ptr<const MeshGeometry> candidate = weakCandidate.lock();
+		if (!candidate || candidate->vertices.size() != vertices.size() || candidate->indices != indices)
+			continue;
+		if (!vertices.empty() && memcmp(candidate->vertices.data(), vertices.data(), vertices.size() * sizeof(Vertex)) != 0)
+			continue;
+		return candidate;
+	}
+
+	auto geometry = std::make_shared<MeshGeometry>();
+	geometry->vertices = vertices;
+	geometry->indices = indices;
+	geometry->id = nextMeshId++;
+	candidates.push_back(geometry);
+	uniqueMeshCount++;
+	return geometry;
+}
+
+void Scene::PruneMeshRegistry() {
+	//登记表只持有弱引用，最后一个MeshRenderer移除后几何随之释放，这里清掉失效的条目
+	for (auto it = meshRegistry.begin(); it != meshRegistry.end();) {
+		auto& candidates = it->second;
+		size_t previousCount = candidates.size();
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [](const std::weak_ptr<const MeshGeometry>& candidate) {
+			return candidate.expired();
+		}), candidates.end());
+		uniqueMeshCount -= static_cast<uint32_t>(previousCount - candidates.size());
+		if (candidates.empty())
+			it = meshRegistry.erase(it);
+		else
+			++it;
+	}
+}
+
 void Scene::AddMeshRenderer(GameObject* gameObject, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
 	MeshRenderer meshRenderer;
-	meshRenderer.vertices = vertices;
-	meshRenderer.indices = indices;
+	meshRenderer.geometry = RegisterMesh(vertices, indices);
+	meshRenderer.gameObject = gameObject;
+	ComputeMeshBounds(vertices, meshRenderer.boundsCenter, meshRenderer.boundsRadius);
+	meshRenderers.push_back(meshRenderer);
+	geometryDirty = true;
+}
+
+void Scene::AddMeshRenderer(GameObject* gameObject, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const glm::vec3& boundsCenter, float boundsRadius) {
+	MeshRenderer meshRenderer;
+	meshRenderer.geometry = RegisterMesh(vertices, indices);
+	meshRenderer.gameObject = gameObject;
+	meshRenderer.boundsCenter = boundsCenter;
+	meshRenderer.boundsRadius = boundsRadius;
+	meshRenderers.push_back(meshRenderer);
+	geometryDirty = true;
+}
+
+void Scene::AddMeshRenderer(GameObject* gameObject, const Mesh::RenderInfo& renderInfo) {
+	MeshRenderer meshRenderer;
+	meshRenderer.geometry = RegisterMesh(renderInfo.vertices, renderInfo.indices);
+	meshRenderer.lods = renderInfo.lods;
+	meshRenderer.meshlets = renderInfo.meshlets;
+	meshRenderer.meshletCullData.Build(renderInfo.meshlets);
 	meshRenderer.gameObject = gameObject;
+	meshRenderer.boundsCenter = renderInfo.boundsCenter;
+	meshRenderer.boundsRadius = renderInfo.boundsRadius;
 	meshRenderers.push_back(meshRenderer);
+	geometryDirty = true;
 }
 
-void Scene::AddSkinnedMeshRenderer(GameObject* gameObject, std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices) {
+void Scene::AddSkinnedMeshRenderer(GameObject* gameObject, std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods) {
 	SkinnedMeshRenderer meshRenderer;
 	meshRenderer.vertices = vertices;
 	meshRenderer.indices = indices;
+	meshRenderer.lods = lods;
 	meshRenderer.gameObject = gameObject;
+	ComputeMeshBounds(vertices, meshRenderer.boundsCenter, meshRenderer.boundsRadius);
 	if (skinnedModelInst.size() <= 0) {
 		MessageBox(0, L"No skinned model can be used", 0, 0);
 		return;
@@ -46,6 +123,21 @@ void Scene::AddSkinnedMeshRenderer(GameObject* gameObject, std::vector<SkinnedVe
 	skinnedMeshRenderers.push_back(meshRenderer);
 }
 
+void Scene::RemoveMeshRenderer(GameObject* gameObject) {
+	meshRenderers.erase(std::remove_if(meshRenderers.begin(), meshRenderers.end(), [gameObject](const MeshRenderer& meshRenderer) {
+		return meshRenderer.gameObject == gameObject;
+	}), meshRenderers.end());
+	PruneMeshRegistry();
+	geometryDirty = true;
+}
+
+void Scene::SetOccluder(GameObject* gameObject, bool occluder) {
+	for (auto& meshRenderer : meshRenderers) {
+		if (meshRenderer.gameObject == gameObject)
+			meshRenderer.occluder = occluder;
+	}
+}
+
 void Scene::AddSkinnedModelInstance(SkinnedModelInstance& skinnedModelInst) {
 	this->skinnedModelInst.push_back(skinnedModelInst);
 }
@@ -58,7 +150,7 @@ void Scene::AddParticleSystem(GameObject* particle, GameObject* subParticle, Par
 	particleSystems.back().SetSubParticle(subParticleProperty);
 	particleSystems.back().particle = particle;
 	particleSystems.back().subParticle = subParticle;
-	particleSystems.back().PrepareParticles(&vkInfo->device, vkInfo->gpu.getMemoryProperties());
+	particleSystems.back().PrepareParticles(&vkInfo->device, vkInfo->allocator);
 }
 
 GameObject* Scene::GetGameObject(std::string name) {
@@ -125,7 +217,7 @@ void Scene::SetSpotLight(int index, glm::vec3 position, glm::vec3 direction, glm
 
 void Scene::SetShadowMap(uint32_t width, uint32_t height, glm::vec3 lightDirection, float radius) {
 	//shadowMap = ShadowMap(); 
-	shadowMap.Init(&vkInfo->device, vkInfo->gpu.getMemoryProperties(), width, height);
+	shadowMap.Init(&vkInfo->device, vkInfo->allocator, width, height);
 	shadowMap.PrepareRenderPass(&vkInfo->device);
 	shadowMap.PrepareFramebuffer(&vkInfo->device);
 	shadowMap.SetLightTransformMatrix(lightDirection, radius);
@@ -135,7 +227,7 @@ void Scene::SetMainCamera(Camera* mainCamera) {
 	this->mainCamera = mainCamera;
 }
 
-void Scene::SetSkybox(Texture image, float radius, uint32_t subdivision) {
+void Scene::SetSkybox(Texture* image, float radius, uint32_t subdivision) {
 	SetShadowMap(vkInfo->width, vkInfo->height, glm::normalize(glm::vec3(-1.0f, 0.0f, 1.0f) - glm::vec3(1.0f, 1.0f, 0.0f)), 100.0f);
 
 	skybox.use = true;
@@ -144,6 +236,14 @@ void Scene::SetSkybox(Texture image, float radius, uint32_t subdivision) {
 	skybox.radius = radius;
 }
 
+void Scene::SetSkybox(const AssetHandle<Texture>& image, float radius, uint32_t subdivision) {
+	SetSkybox(image.Get().get(), radius, subdivision);
+	if (image.IsReady())
+		loadedTextures.push_back(image.Get());
+	else
+		pendingTextures.push_back({ nullptr, false, image });
+}
+
 void Scene::SetHDRProperty(float exposure, float gamma) {
 	bloom->SetHDRProperties(exposure, gamma);
 }
@@ -181,12 +281,20 @@ void Scene::UpdateImGUI(float deltaTime) {
 }
 
 void Scene::UpdateObjectConstants() {
+	bool instancesDirty = false;
 	for (auto& gameObject : gameObjects) {
 		if (gameObject.second.dirtyFlag) {
 			frameResources->objCB[gameObject.second.objCBIndex]->CopyData(&vkInfo->device, 0, 1, &gameObject.second.objectConstants);
+			if (gpuCulling != nullptr)
+				gpuCulling->UpdateObject(gameObject.second.objCBIndex, gameObject.second.objectConstants);
 			gameObject.second.dirtyFlag = false;
+			instancesDirty = true;
 		}
 	}
+
+	//实例缓冲按批次排列，有物体变化时整体重写
+	if (instancesDirty && instanceBuffer != nullptr)
+		WriteInstanceData();
 }
 
 void Scene::UpdatePassConstants() {
@@ -201,6 +309,9 @@ void Scene::UpdatePassConstants() {
 	memcpy(passConstants.lights, lights, sizeof(lights));
 	passConstants.ambientLight = glm::vec4(ambientLight, 1.0f);
 	frameResources->passCB[0]->CopyData(&vkInfo->device, 0, 1, &passConstants);
+
+	if (gpuCulling != nullptr)
+		gpuCulling->SetViews(passConstants.projMatrix * passConstants.viewMatrix, shadowMap.GetLightProjMatrix() * shadowMap.GetLightViewMatrix());
 }
 
 void Scene::UpdateMaterialConstants() {
@@ -236,69 +347,716 @@ void Scene::UpdateCPUParticleSystem(float deltaTime) {
 	}
 }
 
+void Scene::RequestTextureMips(TextureStreamer& textureStreamer) {
+	glm::vec3 eyePos = mainCamera->GetPosition3f();
+	float focal = vkInfo->height * 0.5f / std::tan(mainCamera->GetFovY() * 0.5f);
+
+	auto request = [&](GameObject* gameObject, const glm::vec3& boundsCenter, float boundsRadius) {
+		const glm::mat4x4& world = gameObject->objectConstants.worldMatrix;
+		glm::vec3 center = glm::vec3(world * glm::vec4(boundsCenter, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		float radius = boundsRadius * scale;
+
+		//包围球投影到屏幕上的直径，相机在球内时按最近处估计
+		float distance = std::max(glm::length(center - eyePos) - radius, radius * 0.1f);
+		float screenPixels = 2.0f * radius * focal / std::max(distance, 1e-4f);
+
+		//UV被matTransform放大时纹理在物体上重复，每份占的像素相应减少
+		Material* material = gameObject->material;
+		const glm::mat4x4& uvTransform = material->matTransform;
+		float tiling = std::max(glm::length(glm::vec2(uvTransform[0])), glm::length(glm::vec2(uvTransform[1])));
+		screenPixels /= std::max(tiling, 1e-4f);
+
+		textureStreamer.RequestResolution(material->diffuse, screenPixels);
+		if (material->shaderModel == ShaderModel::normalMap)
+			textureStreamer.RequestResolution(material->normal, screenPixels);
+	};
+
+	for (auto& meshRenderer : meshRenderers)
+		request(meshRenderer.gameObject, meshRenderer.boundsCenter, meshRenderer.boundsRadius);
+	for (auto& meshRenderer : skinnedMeshRenderers)
+		request(meshRenderer.gameObject, meshRenderer.boundsCenter, meshRenderer.boundsRadius);
+
+	//粒子贴图是按子区域切分的序列帧，大小随粒子变化，按整屏高度请求
+	for (auto& particleSystem : particleSystems) {
+		textureStreamer.RequestResolution(particleSystem.particle->material->diffuse, static_cast<float>(vkInfo->height));
+		if (particleSystem.subParticle != nullptr)
+			textureStreamer.RequestResolution(particleSystem.subParticle->material->diffuse, static_cast<float>(vkInfo->height));
+	}
+}
+
+bool Scene::SelectLods() {
+	glm::vec3 eyePos = mainCamera->GetPosition3f();
+	float focal = vkInfo->height * 0.5f / std::tan(mainCamera->GetFovY() * 0.5f);
+	bool changed = false;
+
+	auto select = [&](GameObject* gameObject, const glm::vec3& boundsCenter, float boundsRadius, const std::vector<MeshLod>& lods, uint32_t& lodIndex) {
+		if (lods.size() < 2)
+			return;
+
+		const glm::mat4x4& world = gameObject->objectConstants.worldMatrix;
+		glm::vec3 center = glm::vec3(world * glm::vec4(boundsCenter, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		float radius = boundsRadius * scale;
+
+		//模型空间的误差换算为屏幕上的像素，按包围球最近处计算
+		float distance = std::max(glm::length(center - eyePos) - radius, radius * 0.1f);
+		float pixelsPerUnit = scale * focal / std::max(distance, 1e-4f);
+
+		uint32_t index = std::min(lodIndex, static_cast<uint32_t>(lods.size() - 1));
+		while (index > 0 && lods[index].error * pixelsPerUnit > lodErrorPixels)
+			index--;
+		while (index + 1 < lods.size() && lods[index + 1].error * pixelsPerUnit <= lodErrorPixels * (1.0f - lodHysteresis))
+			index++;
+
+		if (index != lodIndex) {
+			lodIndex = index;
+			changed = true;
+		}
+	};
+
+	for (auto& meshRenderer : meshRenderers)
+		select(meshRenderer.gameObject, meshRenderer.boundsCenter, meshRenderer.boundsRadius, meshRenderer.lods, meshRenderer.lodIndex);
+	for (auto& meshRenderer : skinnedMeshRenderers)
+		select(meshRenderer.gameObject, meshRenderer.boundsCenter, meshRenderer.boundsRadius, meshRenderer.lods, meshRenderer.lodIndex);
+
+	//GPU剔除的绘制直接改写索引范围
+	if (changed && gpuCulling != nullptr) {
+		for (uint32_t i = 0; i < meshRenderers.size(); i++)
+			gpuCulling->UpdateDrawRange(i, meshRenderers[i].GetIndexCount(), meshRenderers[i].GetFirstIndex());
+	}
+	//实例化的批次按索引范围划分，换了级别的网格要移到别的批次
+	if (changed && UsesInstancing())
+		BuildInstanceBatches();
+
+	return changed;
+}
+
+void Scene::CullOcclusion() {
+	if (!softwareOcclusionCulling || gpuDrivenRendering || meshletDrawBuffer == nullptr)
+		return;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (occlusionRasterizer.GetWidth() == 0)
+		occlusionRasterizer.Resize(occlusionWidth, occlusionHeight);
+	occlusionRasterizer.Begin(mainCamera->GetProjMatrix4x4() * mainCamera->GetViewMatrix4x4());
+
+	//遮挡物使用当前绘制的LOD，索引相对于网格自己的顶点
+	for (auto& meshRenderer : meshRenderers) {
+		const MeshGeometry& geometry = *meshRenderer.geometry;
+		if (!meshRenderer.occluder || geometry.vertices.empty())
+			continue;
+		uint32_t indexOffset = meshRenderer.lods.empty() ? 0 : meshRenderer.lods[meshRenderer.lodIndex].indexOffset;
+		occlusionRasterizer.AddOccluder(&geometry.vertices[0].position, static_cast<uint32_t>(geometry.vertices.size()), sizeof(Vertex),
+			geometry.indices.data() + indexOffset, meshRenderer.GetIndexCount(), meshRenderer.gameObject->objectConstants.worldMatrix);
+	}
+
+	//块之间互不影响，三角形较少时直接在当前线程光栅化
+	uint32_t tileCount = occlusionRasterizer.GetTileCount();
+	uint32_t jobCount = std::min(tileCount, std::max(1u, std::thread::hardware_concurrency()));
+	if (occlusionRasterizer.GetBinnedTriangleCount() < 1024 || jobCount <= 1) {
+		occlusionRasterizer.RasterizeTiles(0, tileCount);
+	}
+	else {
+		if (cullThreadPool.threads.size() + 1 < jobCount)
+			cullThreadPool.SetThreadCount(jobCount - 1);
+
+		uint32_t tilesPerJob = (tileCount + jobCount - 1) / jobCount;
+		for (uint32_t job = 0; job + 1 < jobCount; job++) {
+			SoftwareOcclusion* rasterizer = &occlusionRasterizer;
+			cullThreadPool.threads[job]->AddJob([rasterizer, job, tilesPerJob]() { rasterizer->RasterizeTiles(job * tilesPerJob, tilesPerJob); });
+		}
+		occlusionRasterizer.RasterizeTiles((jobCount - 1) * tilesPerJob, tilesPerJob);
+		cullThreadPool.Wait();
+	}
+	occlusionRasterTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	//包围球的世界空间包围盒，遮挡物自己的深度不会比包围盒近，不会遮住自己
+	occludedMeshCount = 0;
+	occlusionTestedCount = 0;
+	for (auto& meshRenderer : meshRenderers) {
+		meshRenderer.occluded = false;
+		if (meshRenderer.drawCommandCount == 0)
+			continue;
+
+		const glm::mat4x4& world = meshRenderer.gameObject->objectConstants.worldMatrix;
+		glm::vec3 center = glm::vec3(world * glm::vec4(meshRenderer.boundsCenter, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		glm::vec3 extent(meshRenderer.boundsRadius * scale);
+		meshRenderer.occluded = !occlusionRasterizer.IsVisible(center - extent, center + extent);
+		occlusionTestedCount++;
+		occludedMeshCount += meshRenderer.occluded ? 1 : 0;
+
+		//按簇绘制的网格在CullMeshlets中写入
+		if (!UsesMeshletDraws(meshRenderer)) {
+			uint8_t visible = meshRenderer.occluded ? 0 : 1;
+			WriteMeshletDraws(meshRenderer, &visible);
+		}
+	}
+}
+
+void Scene::CullMeshlets() {
+	if (meshletDrawBuffer == nullptr)
+		return;
+
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(mainCamera->GetProjMatrix4x4() * mainCamera->GetViewMatrix4x4(), planes);
+	glm::vec3 eyePos = mainCamera->GetPosition3f();
+
+	//网格之间互不影响，各自写自己的命令区间，按簇数大致均分给线程
+	std::vector<MeshRenderer*> culled;
+	uint32_t meshletCount = 0;
+	for (auto& meshRenderer : meshRenderers) {
+		if (meshRenderer.drawCommandCount > 0 && UsesMeshletDraws(meshRenderer)) {
+			culled.push_back(&meshRenderer);
+			meshletCount += meshRenderer.GetMeshletCount();
+		}
+	}
+
+	std::atomic<uint32_t> visibleCount(0);
+	auto cullRange = [&](size_t begin, size_t end) {
+		std::vector<uint8_t> visible;
+		uint32_t count = 0;
+		for (size_t i = begin; i < end; i++) {
+			MeshRenderer& meshRenderer = *culled[i];
+			//整个网格被遮挡时所有簇都不绘制
+			if (meshRenderer.occluded) {
+				visible.assign(meshRenderer.GetMeshletCount(), 0);
+				WriteMeshletDraws(meshRenderer, visible.data());
+				continue;
+			}
+			MeshletCullView view = MakeMeshletCullView(planes, eyePos, meshRenderer.gameObject->objectConstants.worldMatrix, meshletConeCulling);
+			visible.resize(meshRenderer.GetMeshletCount());
+			count += ::CullMeshlets(meshRenderer.meshletCullData, meshRenderer.GetFirstMeshlet(), meshRenderer.GetMeshletCount(), view, visible.data());
+			WriteMeshletDraws(meshRenderer, visible.data());
+		}
+		visibleCount += count;
+	};
+
+	//簇较少时线程调度的开销比剔除本身还大
+	const uint32_t meshletsPerJob = 4096;
+	uint32_t jobCount = std::min<uint32_t>((meshletCount + meshletsPerJob - 1) / meshletsPerJob, std::max(1u, std::thread::hardware_concurrency()));
+	if (jobCount <= 1) {
+		cullRange(0, culled.size());
+	}
+	else {
+		if (cullThreadPool.threads.size() + 1 < jobCount)
+			cullThreadPool.SetThreadCount(jobCount - 1);
+
+		size_t begin = 0;
+		uint32_t target = meshletCount / jobCount;
+		for (uint32_t job = 0; job < jobCount && begin < culled.size(); job++) {
+			size_t end = begin;
+			uint32_t jobMeshlets = 0;
+			while (end < culled.size() && (jobMeshlets < target || job + 1 == jobCount))
+				jobMeshlets += culled[end++]->GetMeshletCount();
+
+			//最后一段在当前线程执行
+			if (job + 1 == jobCount)
+				cullRange(begin, end);
+			else
+				cullThreadPool.threads[job]->AddJob([&cullRange, begin, end]() { cullRange(begin, end); });
+			begin = end;
+		}
+		cullThreadPool.Wait();
+	}
+
+	visibleMeshletCount = visibleCount;
+	totalMeshletCount = meshletCount;
+}
+
+void Scene::WriteMeshletDraws(const MeshRenderer& meshRenderer, const uint8_t* visible) {
+	vk::DrawIndexedIndirectCommand* commands = meshletDrawBuffer->GetMappedData() + meshRenderer.drawCommandOffset;
+	if (!UsesMeshletDraws(meshRenderer)) {
+		if (visible[0])
+			commands[0] = vk::DrawIndexedIndirectCommand(meshRenderer.GetIndexCount(), 1, meshRenderer.GetFirstIndex(), meshRenderer.baseVertexLocation, 0);
+		else
+			commands[0] = vk::DrawIndexedIndirectCommand(0, 0, 0, 0, 0);
+		return;
+	}
+
+	uint32_t firstMeshlet = meshRenderer.GetFirstMeshlet();
+	uint32_t meshletCount = meshRenderer.GetMeshletCount();
+
+	uint32_t commandCount = 0;
+	for (uint32_t i = 0; i < meshletCount; i++) {
+		if (!visible[i])
+			continue;
+
+		const Meshlet& meshlet = meshRenderer.meshlets[firstMeshlet + i];
+		uint32_t firstIndex = meshRenderer.startIndexLocation + meshlet.indexOffset;
+		//与上一个可见簇在索引缓冲中相接时合并
+		if (commandCount > 0 && i > 0 && visible[i - 1] && commands[commandCount - 1].firstIndex + commands[commandCount - 1].indexCount == firstIndex) {
+			commands[commandCount - 1].indexCount += meshlet.indexCount;
+			continue;
+		}
+		commands[commandCount++] = vk::DrawIndexedIndirectCommand(meshlet.indexCount, 1, firstIndex, meshRenderer.baseVertexLocation, 0);
+	}
+	for (uint32_t i = commandCount; i < meshRenderer.drawCommandCount; i++)
+		commands[i] = vk::DrawIndexedIndirectCommand(0, 0, 0, 0, 0);
+}
+
+void Scene::WriteMaterialTextures(Material& material) {
+	auto descriptorDiffuseInfo = vk::DescriptorImageInfo()
+		.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setImageView(material.diffuse->GetImageView(&vkInfo->device));
+	auto descriptorNormalInfo = descriptorDiffuseInfo;
+	if (material.shaderModel == ShaderModel::normalMap)
+		descriptorNormalInfo.setImageView(material.normal->GetImageView(&vkInfo->device));
+
+	vk::WriteDescriptorSet descSetWrites[2];
+	descSetWrites[0].setDescriptorCount(1);
+	descSetWrites[0].setDescriptorType(vk::DescriptorType::eSampledImage);
+	descSetWrites[0].setDstArrayElement(0);
+	descSetWrites[0].setDstBinding(2);
+	descSetWrites[0].setDstSet(material.descSet);
+	descSetWrites[0].setPImageInfo(&descriptorDiffuseInfo);
+	descSetWrites[1].setDescriptorCount(1);
+	descSetWrites[1].setDescriptorType(vk::DescriptorType::eSampledImage);
+	descSetWrites[1].setDstArrayElement(0);
+	descSetWrites[1].setDstBinding(3);
+	descSetWrites[1].setDstSet(material.descSet);
+	descSetWrites[1].setPImageInfo(&descriptorNormalInfo);
+
+	vkInfo->device.updateDescriptorSets(2, descSetWrites, 0, 0);
+}
+
+void Scene::WriteObjectDescriptors(GameObject& gameObject) {
+	auto descriptorObjCBInfo = vk::DescriptorBufferInfo()
+		.setBuffer(frameResources->objCB[gameObject.objCBIndex]->GetBuffer())
+		.setOffset(0)
+		.setRange(sizeof(ObjectConstants));
+
+	vk::WriteDescriptorSet descSetWrites[1];
+	descSetWrites[0].setDescriptorCount(1);
+	descSetWrites[0].setDescriptorType(vk::DescriptorType::eUniformBuffer);
+	descSetWrites[0].setDstArrayElement(0);
+	descSetWrites[0].setDstBinding(0);
+	descSetWrites[0].setDstSet(gameObject.descSet);
+	descSetWrites[0].setPBufferInfo(&descriptorObjCBInfo);
+	vkInfo->device.updateDescriptorSets(1, descSetWrites, 0, 0);
+}
+
+void Scene::WriteMaterialDescriptors(Material& material) {
+	auto descriptorMatCBInfo = vk::DescriptorBufferInfo()
+		.setBuffer(frameResources->matCB[material.matCBIndex]->GetBuffer())
+		.setOffset(0)
+		.setRange(sizeof(MaterialConstants));
+
+	vk::DescriptorImageInfo descriptorSamplerInfo;
+	if (material.samplerType == SamplerType::repeat)
+		descriptorSamplerInfo.setSampler(repeatSampler);
+	else if (material.samplerType == SamplerType::border)
+		descriptorSamplerInfo.setSampler(borderSampler);
+
+	vk::WriteDescriptorSet descSetWrites[2];
+	descSetWrites[0].setDescriptorCount(1);
+	descSetWrites[0].setDescriptorType(vk::DescriptorType::eUniformBuffer);
+	descSetWrites[0].setDstArrayElement(0);
+	descSetWrites[0].setDstBinding(0);
+	descSetWrites[0].setDstSet(material.descSet);
+	descSetWrites[0].setPBufferInfo(&descriptorMatCBInfo);
+	descSetWrites[1].setDescriptorCount(1);
+	descSetWrites[1].setDescriptorType(vk::DescriptorType::eSampler);
+	descSetWrites[1].setDstArrayElement(0);
+	descSetWrites[1].setDstBinding(1);
+	descSetWrites[1].setDstSet(material.descSet);
+	descSetWrites[1].setPImageInfo(&descriptorSamplerInfo);
+
+	vkInfo->device.updateDescriptorSets(2, descSetWrites, 0, 0);
+	WriteMaterialTextures(material);
+}
+
+void Scene::WriteSkyboxTexture() {
+	//场景Pass的环境反射与天空盒使用同一张立方体贴图
+	auto descriptrorCubemapInfo = vk::DescriptorImageInfo()
+		.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setImageView(skybox.image->GetImageView(&vkInfo->device))
+		.setSampler(repeatSampler);
+	auto descriptorImageInfo = vk::DescriptorImageInfo()
+		.setImageView(skybox.image->GetImageView(&vkInfo->device))
+		.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+	vk::WriteDescriptorSet descSetWrites[2];
+	descSetWrites[0].setDescriptorCount(1);
+	descSetWrites[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+	descSetWrites[0].setDstArrayElement(0);
+	descSetWrites[0].setDstBinding(1);
+	descSetWrites[0].setDstSet(scenePassDesc);
+	descSetWrites[0].setPImageInfo(&descriptrorCubemapInfo);
+	descSetWrites[1].setDescriptorCount(1);
+	descSetWrites[1].setDescriptorType(vk::DescriptorType::eSampledImage);
+	descSetWrites[1].setDstArrayElement(0);
+	descSetWrites[1].setDstBinding(2);
+	descSetWrites[1].setDstSet(skybox.descSet);
+	descSetWrites[1].setPImageInfo(&descriptorImageInfo);
+	vkInfo->device.updateDescriptorSets(skybox.use ? 2 : 1, descSetWrites, 0, 0);
+}
+
+void Scene::RefreshMaterialTextures() {
+	//只在GPU用完上一帧之后调用，描述符集不再被执行中的命令引用
+	for (auto& material : materials)
+		WriteMaterialTextures(material.second);
+}
+
+void Scene::SetMaterialTexture(Material* material, const AssetHandle<Texture>& texture, bool normalMap) {
+	(normalMap ? material->normal : material->diffuse) = texture.Get().get();
+	if (texture.IsReady())
+		loadedTextures.push_back(texture.Get());
+	else
+		pendingTextures.push_back({ material, normalMap, texture });
+
+	if (material->descSet)
+		WriteMaterialTextures(*material);
+}
+
+bool Scene::ResolveLoadedTextures(UploadBatcher& uploadBatcher) {
+	//导入完成的纹理拷贝已记录进上传批次，请求提交后不等待，提交完成之后的帧才换入
+	bool requested = false;
+	uint64_t ticket = 0;
+	for (auto& pending : pendingTextures) {
+		if (!pending.uploading && pending.texture.IsReady()) {
+			if (!requested) {
+				ticket = uploadBatcher.RequestFlush();
+				requested = true;
+			}
+			pending.uploading = true;
+			pending.uploadTicket = ticket;
+		}
+	}
+
+	//每个元素只判断一次，换入后从列表中移除
+	auto resolved = std::remove_if(pendingTextures.begin(), pendingTextures.end(), [&](PendingTexture& pending) {
+		if (!pending.uploading || !uploadBatcher.IsSubmitted(pending.uploadTicket))
+			return false;
+
+		std::shared_ptr<Texture> texture = pending.texture.Get();
+		loadedTextures.push_back(texture);
+		if (pending.material == nullptr) {
+			skybox.image = texture.get();
+			if (scenePassDesc)
+				WriteSkyboxTexture();
+		}
+		else {
+			(pending.normalMap ? pending.material->normal : pending.material->diffuse) = texture.get();
+			if (pending.material->descSet)
+				WriteMaterialTextures(*pending.material);
+		}
+		return true;
+	});
+
+	bool changed = resolved != pendingTextures.end();
+	pendingTextures.erase(resolved, pendingTextures.end());
+	return changed;
+}
+
 void Scene::SetupRenderEngine() {
+	//没有层级深度与两段式剔除的着色器时只用视锥剔除，渲染通道也不拆成前后两段
+	if (occlusionCulling && !vkInfo->shaderLibrary->HasShaders({ "cullDrawsOcclusion", "buildHiZ" }))
+		occlusionCulling = false;
+	//着色器库中没有剔除与间接绘制的着色器时退回逐个绘制，不创建缺少着色器的管线
+	if (gpuDrivenRendering && !vkInfo->shaderLibrary->HasShaders({ occlusionCulling ? "cullDrawsOcclusion" : "cullDraws", "vertexIndirect", "shadowVSIndirect" }))
+		gpuDrivenRendering = false;
+
 	renderEngine.vkInfo = vkInfo;
+	renderEngine.occlusionCulling = gpuDrivenRendering && occlusionCulling;
 	renderEngine.PrepareResource();
 	renderEngine.PrepareGBuffer();
 	renderEngine.PrepareDeferredShading();
 	renderEngine.PrepareForwardShading();
 }
 
-void Scene::SetupVertexBuffer() {
+void Scene::SetupVertexBuffer(UploadBatcher& uploadBatcher) {
+	//实例化绘制从存储缓冲读取物体常量，没有*Indirect着色器时逐个绘制
+	if (automaticInstancing && !vkInfo->shaderLibrary->HasShaders({ "vertexIndirect", "shadowVSIndirect" }))
+		automaticInstancing = false;
+	//压缩格式的着色器没有编译时仍使用完整的顶点格式
+	if (compactVertices) {
+		ShaderLibrary& shaderLibrary = *vkInfo->shaderLibrary;
+		bool indirect = gpuDrivenRendering || UsesInstancing();
+		if (!shaderLibrary.HasShaders({ "vertexCompact", "skinnedVSCompact", "shadowVSCompact", "shadowSkinnedVSCompact" }) ||
+			(indirect && !shaderLibrary.HasShaders({ "vertexCompactIndirect", "shadowVSCompactIndirect" })))
+			compactVertices = false;
+	}
+
 	std::vector<Vertex> vertices;
 	std::vector<SkinnedVertex> skinnedVertices;
 	std::vector<uint32_t> indices;
+	std::vector<uint16_t> indices16;
+
+	//索引相对于baseVertexLocation，顶点不超过65536个时放进16位索引缓冲
+	auto appendIndices = [&](const std::vector<uint32_t>& meshIndices, size_t vertexCount, vk::IndexType& indexType, int& startIndexLocation) {
+		if (vertexCount <= 65536) {
+			indexType = vk::IndexType::eUint16;
+			startIndexLocation = indices16.size();
+			for (uint32_t index : meshIndices)
+				indices16.push_back(static_cast<uint16_t>(index));
+		}
+		else {
+			indexType = vk::IndexType::eUint32;
+			startIndexLocation = indices.size();
+			indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+		}
+	};
+
+	//压缩格式下每个物体按其网格的包围盒量化位置，还原参数随物体常量传给着色器
+	std::unordered_map<GameObject*, std::pair<glm::vec3, glm::vec3>> objectBounds;
+	auto addBounds = [&](GameObject* gameObject, const glm::vec3& position) {
+		auto bounds = objectBounds.find(gameObject);
+		if (bounds == objectBounds.end())
+			objectBounds[gameObject] = { position, position };
+		else {
+			bounds->second.first = glm::min(bounds->second.first, position);
+			bounds->second.second = glm::max(bounds->second.second, position);
+		}
+	};
+	auto getQuantization = [&](GameObject* gameObject) {
+		auto& bounds = objectBounds[gameObject];
+		VertexQuantization quantization = ComputeVertexQuantization(bounds.first, bounds.second);
+		gameObject->objectConstants.positionScale = glm::vec4(quantization.scale, 0.0f);
+		gameObject->objectConstants.positionBias = glm::vec4(quantization.bias, 0.0f);
+		gameObject->dirtyFlag = true;
+		return quantization;
+	};
+
+	if (compactVertices) {
+		for (auto& meshRenderer : meshRenderers)
+			for (auto& vertex : meshRenderer.geometry->vertices)
+				addBounds(meshRenderer.gameObject, vertex.position);
+		for (auto& meshRenderer : skinnedMeshRenderers)
+			for (auto& vertex : meshRenderer.vertices)
+				addBounds(meshRenderer.gameObject, vertex.position);
+	}
 
+	//同一份几何(见RegisterMesh)只上传一次，位置相同的网格才能合并为实例化绘制。压缩格式下还要求量化的包围盒相同
+	std::unordered_map<const MeshGeometry*, std::vector<const MeshRenderer*>> uploadedMeshes;
+	size_t vertexSize = compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+	sharedMeshBytes = 0;
 	for (auto& meshRenderer : meshRenderers) {
+		const MeshGeometry& geometry = *meshRenderer.geometry;
+		auto& uploaded = uploadedMeshes[&geometry];
+		const MeshRenderer* shared = nullptr;
+		for (const MeshRenderer* candidate : uploaded) {
+			if (!compactVertices || objectBounds[candidate->gameObject] == objectBounds[meshRenderer.gameObject]) {
+				shared = candidate;
+				break;
+			}
+		}
+		if (shared != nullptr) {
+			meshRenderer.baseVertexLocation = shared->baseVertexLocation;
+			meshRenderer.indexType = shared->indexType;
+			meshRenderer.startIndexLocation = shared->startIndexLocation;
+			size_t indexSize = shared->indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+			sharedMeshBytes += geometry.vertices.size() * vertexSize + geometry.indices.size() * indexSize;
+			continue;
+		}
+		uploaded.push_back(&meshRenderer);
+
 		meshRenderer.baseVertexLocation = vertices.size();
-		meshRenderer.startIndexLocation = indices.size();
-		vertices.insert(vertices.end(), meshRenderer.vertices.begin(), meshRenderer.vertices.end());
-		indices.insert(indices.end(), meshRenderer.indices.begin(), meshRenderer.indices.end());
+		appendIndices(geometry.indices, geometry.vertices.size(), meshRenderer.indexType, meshRenderer.startIndexLocation);
+		vertices.insert(vertices.end(), geometry.vertices.begin(), geometry.vertices.end());
+	}
+	for (auto& meshRenderer : skinnedMeshRenderers) {
+		meshRenderer.baseVertexLocation = skinnedVertices.size();
+		appendIndices(meshRenderer.indices, meshRenderer.vertices.size(), meshRenderer.indexType, meshRenderer.startIndexLocation);
+		skinnedVertices.insert(skinnedVertices.end(), meshRenderer.vertices.begin(), meshRenderer.vertices.end());
 	}
+
+	//静态几何放在设备本地内存，经上传缓冲拷贝一次
+	vk::MemoryPropertyFlags memProp = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
 	if (skybox.use) {
 		GeometryGenerator geoGen;
 		GeometryGenerator::MeshData skyboxMesh = geoGen.CreateGeosphere(skybox.radius, skybox.subdivision);
-		skybox.baseVertexLocation = vertices.size();
-		skybox.startIndexLocation = indices.size();
+		skybox.baseVertexLocation = 0;
 		skybox.indexCount = skyboxMesh.indices.size();
-		vertices.insert(vertices.end(), skyboxMesh.vertices.begin(), skyboxMesh.vertices.end());
-		indices.insert(indices.end(), skyboxMesh.indices.begin(), skyboxMesh.indices.end());
-	}
-	for (auto& meshRenderer : skinnedMeshRenderers) {
-		meshRenderer.baseVertexLocation = skinnedVertices.size();
-		meshRenderer.startIndexLocation = indices.size();
-		skinnedVertices.insert(skinnedVertices.end(), meshRenderer.vertices.begin(), meshRenderer.vertices.end());
-		indices.insert(indices.end(), meshRenderer.indices.begin(), meshRenderer.indices.end());
+		appendIndices(skyboxMesh.indices, skyboxMesh.vertices.size(), skybox.indexType, skybox.startIndexLocation);
+
+		if (skyboxVertexBuffer != nullptr)
+			skyboxVertexBuffer->DestroyBuffer(&vkInfo->device);
+		skyboxVertexBuffer = std::make_unique<Buffer<Vertex>>(&vkInfo->device, skyboxMesh.vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vkInfo->allocator, memProp);
+		uploadBatcher.UploadBuffer(skyboxMesh.vertices.data(), skyboxMesh.vertices.size() * sizeof(Vertex), skyboxVertexBuffer->GetBuffer(), 0);
 	}
 
-	vk::MemoryPropertyFlags memProp = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
-	vk::PhysicalDeviceMemoryProperties gpuProp = vkInfo->gpu.getMemoryProperties();
+	std::vector<uint8_t> vertexData;
+	std::vector<uint8_t> skinnedVertexData;
+	if (compactVertices) {
+		vertexData.resize(vertices.size() * sizeof(CompactVertex));
+		CompactVertex* compact = reinterpret_cast<CompactVertex*>(vertexData.data());
+		for (auto& meshRenderer : meshRenderers) {
+			VertexQuantization quantization = getQuantization(meshRenderer.gameObject);
+			const std::vector<Vertex>& meshVertices = meshRenderer.geometry->vertices;
+			for (size_t i = 0; i < meshVertices.size(); i++)
+				compact[meshRenderer.baseVertexLocation + i] = CompressVertex(meshVertices[i], quantization);
+		}
+
+		skinnedVertexData.resize(skinnedVertices.size() * sizeof(CompactSkinnedVertex));
+		CompactSkinnedVertex* compactSkinned = reinterpret_cast<CompactSkinnedVertex*>(skinnedVertexData.data());
+		for (auto& meshRenderer : skinnedMeshRenderers) {
+			VertexQuantization quantization = getQuantization(meshRenderer.gameObject);
+			for (size_t i = 0; i < meshRenderer.vertices.size(); i++)
+				compactSkinned[meshRenderer.baseVertexLocation + i] = CompressVertex(meshRenderer.vertices[i], quantization);
+		}
+	}
+	else {
+		vertexData.assign(reinterpret_cast<const uint8_t*>(vertices.data()), reinterpret_cast<const uint8_t*>(vertices.data() + vertices.size()));
+		skinnedVertexData.assign(reinterpret_cast<const uint8_t*>(skinnedVertices.data()), reinterpret_cast<const uint8_t*>(skinnedVertices.data() + skinnedVertices.size()));
+	}
 
 	if (vertexBuffer != nullptr)
 		vertexBuffer->DestroyBuffer(&vkInfo->device);
-	vertexBuffer = std::make_unique<Buffer<Vertex>>(&vkInfo->device, vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer, gpuProp, memProp, false);
-	vertexBuffer->CopyData(&vkInfo->device, 0, vertices.size(), vertices.data());
+	vertexBuffer = nullptr;
+	if (!vertexData.empty()) {
+		vertexBuffer = std::make_unique<Buffer<uint8_t>>(&vkInfo->device, vertexData.size(), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vkInfo->allocator, memProp);
+		uploadBatcher.UploadBuffer(vertexData.data(), vertexData.size(), vertexBuffer->GetBuffer(), 0);
+	}
 
 	if (skinnedMeshRenderers.size() > 0) {
 		if (skinnedVertexBuffer != nullptr)
 			skinnedVertexBuffer->DestroyBuffer(&vkInfo->device);
-		skinnedVertexBuffer = std::make_unique<Buffer<SkinnedVertex>>(&vkInfo->device, skinnedVertices.size(), vk::BufferUsageFlagBits::eVertexBuffer, gpuProp, memProp, false);
-		skinnedVertexBuffer->CopyData(&vkInfo->device, 0, skinnedVertices.size(), skinnedVertices.data());
+		skinnedVertexBuffer = std::make_unique<Buffer<uint8_t>>(&vkInfo->device, skinnedVertexData.size(), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vkInfo->allocator, memProp);
+		uploadBatcher.UploadBuffer(skinnedVertexData.data(), skinnedVertexData.size(), skinnedVertexBuffer->GetBuffer(), 0);
 	}
 
 	if (indexBuffer != nullptr)
 		indexBuffer->DestroyBuffer(&vkInfo->device);
-	indexBuffer = std::make_unique<Buffer<uint32_t>>(&vkInfo->device, indices.size(), vk::BufferUsageFlagBits::eIndexBuffer, gpuProp, memProp, false);
-	indexBuffer->CopyData(&vkInfo->device, 0, indices.size(), indices.data());
+	indexBuffer = nullptr;
+	if (!indices.empty()) {
+		indexBuffer = std::make_unique<Buffer<uint32_t>>(&vkInfo->device, indices.size(), vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, vkInfo->allocator, memProp);
+		uploadBatcher.UploadBuffer(indices.data(), indices.size() * sizeof(uint32_t), indexBuffer->GetBuffer(), 0);
+	}
+
+	if (index16Buffer != nullptr)
+		index16Buffer->DestroyBuffer(&vkInfo->device);
+	index16Buffer = nullptr;
+	if (!indices16.empty()) {
+		index16Buffer = std::make_unique<Buffer<uint16_t>>(&vkInfo->device, indices16.size(), vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, vkInfo->allocator, memProp);
+		uploadBatcher.UploadBuffer(indices16.data(), indices16.size() * sizeof(uint16_t), index16Buffer->GetBuffer(), 0);
+	}
+
+	//带网格簇的网格在间接绘制缓冲中占用各级LOD中最多的簇数条命令，剔除结果每帧直接写入
+	//软件遮挡剔除时其余的静态网格也各占一条命令，被遮挡时清零
+	bool occlusionDraws = softwareOcclusionCulling && !gpuDrivenRendering;
+	meshletDrawCount = 0;
+	for (auto& meshRenderer : meshRenderers) {
+		meshRenderer.drawCommandOffset = meshletDrawCount;
+		meshRenderer.drawCommandCount = 0;
+		meshRenderer.occluded = false;
+		if (!UsesMeshletDraws(meshRenderer)) {
+			meshRenderer.drawCommandCount = occlusionDraws ? 1 : 0;
+			meshletDrawCount += meshRenderer.drawCommandCount;
+			continue;
+		}
+		if (meshRenderer.lods.empty())
+			meshRenderer.drawCommandCount = static_cast<uint32_t>(meshRenderer.meshlets.size());
+		for (auto& lod : meshRenderer.lods)
+			meshRenderer.drawCommandCount = std::max(meshRenderer.drawCommandCount, lod.meshletCount);
+		meshletDrawCount += meshRenderer.drawCommandCount;
+	}
+
+	if (meshletDrawBuffer != nullptr)
+		meshletDrawBuffer->DestroyBuffer(&vkInfo->device);
+	meshletDrawBuffer = nullptr;
+	if (meshletDrawCount > 0) {
+		meshletDrawBuffer = std::make_unique<Buffer<vk::DrawIndexedIndirectCommand>>(&vkInfo->device, meshletDrawCount, vk::BufferUsageFlagBits::eIndirectBuffer, vkInfo->allocator,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		//第一次剔除之前绘制所有的簇
+		for (auto& meshRenderer : meshRenderers) {
+			if (meshRenderer.drawCommandCount == 0)
+				continue;
+			std::vector<uint8_t> visible(std::max(meshRenderer.GetMeshletCount(), 1u), 1);
+			WriteMeshletDraws(meshRenderer, visible.data());
+		}
+	}
+
+	geometryDirty = false;
+}
+
+bool Scene::SetupLoadedObjects(UploadBatcher& uploadBatcher) {
+	//还没有初始化描述符时由SetupDescriptors统一处理
+	if (frameResources == nullptr)
+		return false;
+
+	//没有描述符的就是之后加入的
+	std::vector<GameObject*> newObjects;
+	for (auto& gameObject : gameObjects) {
+		if (!gameObject.second.descSet)
+			newObjects.push_back(&gameObject.second);
+	}
+	std::vector<Material*> newMaterials;
+	for (auto& material : materials) {
+		if (!material.second.descSet)
+			newMaterials.push_back(&material.second);
+	}
+	if (newObjects.empty() && newMaterials.empty() && !geometryDirty)
+		return false;
+
+	if (!newObjects.empty() || !newMaterials.empty()) {
+		uint32_t objCount = newObjects.size();
+		uint32_t matCount = newMaterials.size();
+		uint32_t objCBIndex = frameResources->objCB.size();
+		uint32_t matCBIndex = frameResources->matCB.size();
+		frameResources->Resize(&vkInfo->device, vkInfo->allocator, objCBIndex + objCount, matCBIndex + matCount);
+
+		//原有的描述符池按初始化时的数量创建，为新加入的部分单独创建一个
+		std::vector<vk::DescriptorPoolSize> typeCount;
+		typeCount.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, objCount + matCount));
+		if (matCount > 0) {
+			typeCount.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, matCount * 2));
+			typeCount.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eSampler, matCount));
+		}
+		auto descriptorPoolInfo = vk::DescriptorPoolCreateInfo()
+			.setMaxSets(objCount + matCount)
+			.setPoolSizeCount(typeCount.size())
+			.setPPoolSizes(typeCount.data());
+		vk::DescriptorPool descPool;
+		if (vkInfo->device.createDescriptorPool(&descriptorPoolInfo, 0, &descPool) != vk::Result::eSuccess) {
+			MessageBox(0, L"Create descriptor pool failed!!!", 0, 0);
+			return false;
+		}
+		loadedDescPools.push_back(descPool);
+
+		vk::DescriptorSetAllocateInfo descSetAllocInfo;
+		for (auto gameObject : newObjects) {
+			descSetAllocInfo = vk::DescriptorSetAllocateInfo()
+				.setDescriptorPool(descPool)
+				.setDescriptorSetCount(1)
+				.setPSetLayouts(&renderEngine.descSetLayout[0]);
+			vkInfo->device.allocateDescriptorSets(&descSetAllocInfo, &gameObject->descSet);
+
+			gameObject->objCBIndex = objCBIndex++;
+			WriteObjectDescriptors(*gameObject);
+		}
+		for (auto material : newMaterials) {
+			descSetAllocInfo = vk::DescriptorSetAllocateInfo()
+				.setDescriptorPool(descPool)
+				.setDescriptorSetCount(1)
+				.setPSetLayouts(&renderEngine.descSetLayout[1]);
+			vkInfo->device.allocateDescriptorSets(&descSetAllocInfo, &material->descSet);
+
+			material->matCBIndex = matCBIndex++;
+			material->dirtyFlag = true;
+			WriteMaterialDescriptors(*material);
+		}
+
+		//父物体先加入时先更新的子物体会在父物体更新时重新计算
+		for (auto gameObject : newObjects)
+			gameObject->UpdateData();
+	}
+
+	//GPU已经用完上一帧，可以直接替换顶点缓冲，拷贝由调用者提交
+	if (geometryDirty)
+		SetupVertexBuffer(uploadBatcher);
+	PrepareShaderModel();
+	return true;
 }
 
-void Scene::SetupDescriptors() {
+void Scene::SetupDescriptors(UploadBatcher& uploadBatcher) {
 	//初始化FrameBuffer
-	frameResources = std::make_unique<FrameResource>(&vkInfo->device, vkInfo->gpu.getMemoryProperties(), 2, gameObjects.size(), materials.size(), skinnedModelInst.size());
+	frameResources = std::make_unique<FrameResource>(&vkInfo->device, vkInfo->allocator, 2, gameObjects.size(), materials.size(), skinnedModelInst.size());
 	
-	//创建通用的采样器
-	vk::Sampler repeatSampler;
-	vk::Sampler borderSampler;
+	//创建通用的采样器，之后加入的材质也使用它们
 	{
 		auto samplerInfo = vk::SamplerCreateInfo()
 			.setAnisotropyEnable(VK_FALSE)
@@ -306,7 +1064,7 @@ void Scene::SetupDescriptors() {
 			.setCompareEnable(VK_FALSE)
 			.setCompareOp(vk::CompareOp::eAlways)
 			.setMagFilter(vk::Filter::eLinear)
-			.setMaxLod(1.0f)
+			.setMaxLod(VK_LOD_CLAMP_NONE)
 			.setMinLod(0.0f)
 			.setMipLodBias(0.0f)
 			.setMinFilter(vk::Filter::eLinear)
@@ -353,7 +1111,7 @@ void Scene::SetupDescriptors() {
 	//创建描述符池
 	uint32_t postprocessingDescCount = bloom ? 4 : 0;
 
-	vk::DescriptorPoolSize typeCount[5];
+	vk::DescriptorPoolSize typeCount[6];
 	typeCount[0].setType(vk::DescriptorType::eUniformBuffer);
 	typeCount[0].setDescriptorCount(matCount + objCount + passCount + skinnedModelInst.size() + (skybox.use ? 1 : 0) + 1);
 	typeCount[1].setType(vk::DescriptorType::eSampledImage);
@@ -364,10 +1122,13 @@ void Scene::SetupDescriptors() {
 	typeCount[3].setDescriptorCount(passCount + (bloom ? 5 : 0));
 	typeCount[4].setType(vk::DescriptorType::eInputAttachment);
 	typeCount[4].setDescriptorCount(5);
+	//自动实例化的实例缓冲
+	typeCount[5].setType(vk::DescriptorType::eStorageBuffer);
+	typeCount[5].setDescriptorCount(1);
 
 	auto descriptorPoolInfo = vk::DescriptorPoolCreateInfo()
-		.setMaxSets(descCount + (skybox.use ? 1 : 0) + postprocessingDescCount + 1)
-		.setPoolSizeCount(5)
+		.setMaxSets(descCount + (skybox.use ? 1 : 0) + postprocessingDescCount + 2)
+		.setPoolSizeCount(6)
 		.setPPoolSizes(typeCount);
 	vkInfo->device.createDescriptorPool(&descriptorPoolInfo, 0, &vkInfo->descPool);
 
@@ -430,109 +1191,32 @@ void Scene::SetupDescriptors() {
 	uint32_t objCBIndex = 0;
 	for (auto& gameObject : gameObjects) {
 		gameObject.second.objCBIndex = objCBIndex;
-
-		auto descriptorObjCBInfo = vk::DescriptorBufferInfo()
-			.setBuffer(frameResources->objCB[objCBIndex]->GetBuffer())
-			.setOffset(0)
-			.setRange(sizeof(ObjectConstants));
-
-		vk::WriteDescriptorSet descSetWrites[1];
-		descSetWrites[0].setDescriptorCount(1);
-		descSetWrites[0].setDescriptorType(vk::DescriptorType::eUniformBuffer);
-		descSetWrites[0].setDstArrayElement(0);
-		descSetWrites[0].setDstBinding(0);
-		descSetWrites[0].setDstSet(gameObject.second.descSet);
-		descSetWrites[0].setPBufferInfo(&descriptorObjCBInfo);
-		vkInfo->device.updateDescriptorSets(1, descSetWrites, 0, 0);
-
+		WriteObjectDescriptors(gameObject.second);
 		objCBIndex++;
 	}
 
 	uint32_t matCBIndex = 0;
 	for (auto& material : materials) {
 		material.second.matCBIndex = matCBIndex;
-
-		auto descriptorMatCBInfo = vk::DescriptorBufferInfo()
-			.setBuffer(frameResources->matCB[matCBIndex]->GetBuffer())
-			.setOffset(0)
-			.setRange(sizeof(MaterialConstants));
-
-		vk::DescriptorImageInfo descriptorSamplerInfo;
-		if (material.second.samplerType == SamplerType::repeat)
-			descriptorSamplerInfo.setSampler(repeatSampler);
-		else if (material.second.samplerType == SamplerType::border)
-			descriptorSamplerInfo.setSampler(borderSampler);
-
-		auto descriptorDiffuseInfo = vk::DescriptorImageInfo()
-			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-			.setImageView(material.second.diffuse->GetImageView(&vkInfo->device));
-
-		vk::WriteDescriptorSet descSetWrites[4];
-		descSetWrites[0].setDescriptorCount(1);
-		descSetWrites[0].setDescriptorType(vk::DescriptorType::eUniformBuffer);
-		descSetWrites[0].setDstArrayElement(0);
-		descSetWrites[0].setDstBinding(0);
-		descSetWrites[0].setDstSet(material.second.descSet);
-		descSetWrites[0].setPBufferInfo(&descriptorMatCBInfo);
-		descSetWrites[1].setDescriptorCount(1);
-		descSetWrites[1].setDescriptorType(vk::DescriptorType::eSampler);
-		descSetWrites[1].setDstArrayElement(0);
-		descSetWrites[1].setDstBinding(1);
-		descSetWrites[1].setDstSet(material.second.descSet);
-		descSetWrites[1].setPImageInfo(&descriptorSamplerInfo);
-		descSetWrites[2].setDescriptorCount(1);
-		descSetWrites[2].setDescriptorType(vk::DescriptorType::eSampledImage);
-		descSetWrites[2].setDstArrayElement(0);
-		descSetWrites[2].setDstBinding(2);
-		descSetWrites[2].setDstSet(material.second.descSet);
-		descSetWrites[2].setPImageInfo(&descriptorDiffuseInfo);
-
-		descSetWrites[3].setDescriptorCount(1);
-		descSetWrites[3].setDescriptorType(vk::DescriptorType::eSampledImage);
-		descSetWrites[3].setDstArrayElement(0);
-		descSetWrites[3].setDstBinding(3);
-		descSetWrites[3].setDstSet(material.second.descSet);
-		descSetWrites[3].setPImageInfo(&descriptorDiffuseInfo);
-
-		if (material.second.shaderModel == ShaderModel::normalMap) {
-			auto descriptorNormalInfo = vk::DescriptorImageInfo()
-				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-				.setImageView(material.second.normal->GetImageView(&vkInfo->device));
-		
-			descSetWrites[3].setPImageInfo(&descriptorNormalInfo);
-		}
-
-		vkInfo->device.updateDescriptorSets(4, descSetWrites, 0, 0);
-		
+		WriteMaterialDescriptors(material.second);
 		matCBIndex++;
 	}
 
-	//场景的Pass
+	//场景的Pass，立方体贴图在WriteSkyboxTexture中写入
 	{
 		auto descriptrorPassCBInfo = vk::DescriptorBufferInfo()
 			.setBuffer(frameResources->passCB[0]->GetBuffer())
 			.setOffset(0)
 			.setRange(sizeof(PassConstants));
 
-		auto descriptrorCubemapInfo = vk::DescriptorImageInfo()
-			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-			.setImageView(skybox.image.GetImageView(&vkInfo->device))
-			.setSampler(repeatSampler);
-
-		vk::WriteDescriptorSet descSetWrites[2];
+		vk::WriteDescriptorSet descSetWrites[1];
 		descSetWrites[0].setDescriptorCount(1);
 		descSetWrites[0].setDescriptorType(vk::DescriptorType::eUniformBuffer);
 		descSetWrites[0].setDstArrayElement(0);
 		descSetWrites[0].setDstBinding(0);
 		descSetWrites[0].setDstSet(scenePassDesc);
 		descSetWrites[0].setPBufferInfo(&descriptrorPassCBInfo);
-		descSetWrites[1].setDescriptorCount(1);
-		descSetWrites[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		descSetWrites[1].setDstArrayElement(0);
-		descSetWrites[1].setDstBinding(1);
-		descSetWrites[1].setDstSet(scenePassDesc);
-		descSetWrites[1].setPImageInfo(&descriptrorCubemapInfo);
-		vkInfo->device.updateDescriptorSets(2, descSetWrites, 0, 0);
+		vkInfo->device.updateDescriptorSets(1, descSetWrites, 0, 0);
 	}
 	//阴影的Pass
 	{
@@ -601,25 +1285,16 @@ void Scene::SetupDescriptors() {
 		auto descriptorSamplerInfo = vk::DescriptorImageInfo()
 			.setSampler(repeatSampler);
 
-		auto descriptorImageInfo = vk::DescriptorImageInfo()
-			.setImageView(skybox.image.GetImageView(&vkInfo->device))
-			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-
-		vk::WriteDescriptorSet descSetWrites[4];
+		vk::WriteDescriptorSet descSetWrites[1];
 		descSetWrites[0].setDescriptorCount(1);
 		descSetWrites[0].setDescriptorType(vk::DescriptorType::eSampler);
 		descSetWrites[0].setDstArrayElement(0);
 		descSetWrites[0].setDstBinding(1);
 		descSetWrites[0].setDstSet(skybox.descSet);
 		descSetWrites[0].setPImageInfo(&descriptorSamplerInfo);
-		descSetWrites[1].setDescriptorCount(1);
-		descSetWrites[1].setDescriptorType(vk::DescriptorType::eSampledImage);
-		descSetWrites[1].setDstArrayElement(0);
-		descSetWrites[1].setDstBinding(2);
-		descSetWrites[1].setDstSet(skybox.descSet);
-		descSetWrites[1].setPImageInfo(&descriptorImageInfo);
-		vkInfo->device.updateDescriptorSets(2, descSetWrites, 0, 0);
+		vkInfo->device.updateDescriptorSets(1, descSetWrites, 0, 0);
 	}
+	WriteSkyboxTexture();
 
 	//后处理
 	bloom->PrepareDescriptorSets(renderEngine.renderTarget.imageView);
@@ -630,79 +1305,91 @@ void Scene::SetupDescriptors() {
 	for (auto& root : rootObjects) {
 		root->UpdateData();
 	}
-}
 
-void Scene::PreparePipeline() {
-	//顶点输入装配属性
-	vkInfo->vertex.binding.setBinding(0);
-	vkInfo->vertex.binding.setInputRate(vk::VertexInputRate::eVertex);
-	vkInfo->vertex.binding.setStride(sizeof(Vertex));
+	if (gpuDrivenRendering) {
+		gpuCulling = std::make_unique<GPUCulling>();
+		//遮挡剔除读取G-Buffer通道的深度
+		if (renderEngine.occlusionCulling)
+			gpuCulling->Init(vkInfo, renderEngine.descSetLayout[5], &renderEngine.depthTarget, &uploadBatcher);
+		else
+			gpuCulling->Init(vkInfo, renderEngine.descSetLayout[5]);
+	}
 
-	vkInfo->vertex.attrib.resize(4);
+	//实例缓冲在PrepareShaderModel分批之后创建并写入描述符
+	if (UsesInstancing()) {
+		descSetAllocInfo = vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(vkInfo->descPool)
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&renderEngine.descSetLayout[5]);
+		vkInfo->device.allocateDescriptorSets(&descSetAllocInfo, &instanceDescSet);
+	}
+}
 
-	vkInfo->vertex.attrib[0].setBinding(0);
-	vkInfo->vertex.attrib[0].setFormat(vk::Format::eR32G32B32Sfloat);
-	vkInfo->vertex.attrib[0].setLocation(0);
-	vkInfo->vertex.attrib[0].setOffset(0);
+//完整与压缩两种顶点格式的输入装配属性，两种格式中蒙皮顶点都是在静态顶点之后追加骨骼权重与索引
+static void MakeVertexInput(bool compact, bool skinned, vk::VertexInputBindingDescription& binding, std::vector<vk::VertexInputAttributeDescription>& attrib) {
+	binding.setBinding(0);
+	binding.setInputRate(vk::VertexInputRate::eVertex);
+
+	//依次为position, texCoord, normal, tangent, boneWeights, boneIndices
+	std::vector<std::pair<vk::Format, uint32_t>> elements;
+	if (compact) {
+		binding.setStride(skinned ? sizeof(CompactSkinnedVertex) : sizeof(CompactVertex));
+		elements = {
+			{ vk::Format::eR16G16B16A16Unorm, offsetof(CompactVertex, position) },
+			{ vk::Format::eR16G16Sfloat, offsetof(CompactVertex, texCoord) },
+			{ vk::Format::eR16G16Snorm, offsetof(CompactVertex, normal) },
+			{ vk::Format::eR16G16Snorm, offsetof(CompactVertex, tangent) }
+		};
+		if (skinned) {
+			elements.push_back({ vk::Format::eR8G8B8A8Unorm, offsetof(CompactSkinnedVertex, boneWeights) });
+			elements.push_back({ vk::Format::eR16G16B16A16Uint, offsetof(CompactSkinnedVertex, boneIndices) });
+		}
+	}
+	else {
+		binding.setStride(skinned ? sizeof(SkinnedVertex) : sizeof(Vertex));
+		elements = {
+			{ vk::Format::eR32G32B32Sfloat, offsetof(Vertex, position) },
+			{ vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord) },
+			{ vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) },
+			{ vk::Format::eR32G32B32Sfloat, offsetof(Vertex, tangent) }
+		};
+		if (skinned) {
+			elements.push_back({ vk::Format::eR32G32B32Sfloat, offsetof(SkinnedVertex, boneWeights) });
+			elements.push_back({ vk::Format::eR32G32B32A32Uint, offsetof(SkinnedVertex, boneIndices) });
+		}
+	}
 
-	vkInfo->vertex.attrib[1].setBinding(0);
-	vkInfo->vertex.attrib[1].setFormat(vk::Format::eR32G32Sfloat);
-	vkInfo->vertex.attrib[1].setLocation(1);
-	vkInfo->vertex.attrib[1].setOffset(sizeof(glm::vec3));
+	attrib.resize(elements.size());
+	for (size_t i = 0; i < elements.size(); i++) {
+		attrib[i].setBinding(0);
+		attrib[i].setFormat(elements[i].first);
+		attrib[i].setLocation(i);
+		attrib[i].setOffset(elements[i].second);
+	}
+}
 
-	vkInfo->vertex.attrib[2].setBinding(0);
-	vkInfo->vertex.attrib[2].setFormat(vk::Format::eR32G32B32Sfloat);
-	vkInfo->vertex.attrib[2].setLocation(2);
-	vkInfo->vertex.attrib[2].setOffset(sizeof(glm::vec3) + sizeof(glm::vec2));
+void Scene::PreparePipeline(bool async) {
+	pipelineCompiler.Init(vkInfo->device, vkInfo->pipelineCache);
 
-	vkInfo->vertex.attrib[3].setBinding(0);
-	vkInfo->vertex.attrib[3].setFormat(vk::Format::eR32G32B32Sfloat);
-	vkInfo->vertex.attrib[3].setLocation(3);
-	vkInfo->vertex.attrib[3].setOffset(2 * sizeof(glm::vec3) + sizeof(glm::vec2));
+	//顶点输入装配属性
+	MakeVertexInput(compactVertices, false, vkInfo->vertex.binding, vkInfo->vertex.attrib);
 
 	//蒙皮网格的顶点输入装配属性
 	vk::VertexInputBindingDescription skinnedBinding;
 	std::vector<vk::VertexInputAttributeDescription> skinnedAttrib;
+	MakeVertexInput(compactVertices, true, skinnedBinding, skinnedAttrib);
 
-	skinnedBinding.setBinding(0);
-	skinnedBinding.setInputRate(vk::VertexInputRate::eVertex);
-	skinnedBinding.setStride(sizeof(SkinnedVertex));
-
-	skinnedAttrib.resize(6);
-
-	skinnedAttrib[0].setBinding(0);
-	skinnedAttrib[0].setFormat(vk::Format::eR32G32B32Sfloat);
-	skinnedAttrib[0].setLocation(0);
-	skinnedAttrib[0].setOffset(0);
-
-	skinnedAttrib[1].setBinding(0);
-	skinnedAttrib[1].setFormat(vk::Format::eR32G32Sfloat);
-	skinnedAttrib[1].setLocation(1);
-	skinnedAttrib[1].setOffset(sizeof(glm::vec3));
-
-	skinnedAttrib[2].setBinding(0);
-	skinnedAttrib[2].setFormat(vk::Format::eR32G32B32Sfloat);
-	skinnedAttrib[2].setLocation(2);
-	skinnedAttrib[2].setOffset(sizeof(glm::vec3) + sizeof(glm::vec2));
-
-	skinnedAttrib[3].setBinding(0);
-	skinnedAttrib[3].setFormat(vk::Format::eR32G32B32Sfloat);
-	skinnedAttrib[3].setLocation(3);
-	skinnedAttrib[3].setOffset(2 * sizeof(glm::vec3) + sizeof(glm::vec2));
+	//天空球的顶点不量化
+	vk::VertexInputBindingDescription skyboxBinding;
+	std::vector<vk::VertexInputAttributeDescription> skyboxAttrib;
+	MakeVertexInput(false, false, skyboxBinding, skyboxAttrib);
 
-	skinnedAttrib[4].setBinding(0);
-	skinnedAttrib[4].setFormat(vk::Format::eR32G32B32Sfloat);
-	skinnedAttrib[4].setLocation(4);
-	skinnedAttrib[4].setOffset(3 * sizeof(glm::vec3) + sizeof(glm::vec2));
-
-	skinnedAttrib[5].setBinding(0);
-	skinnedAttrib[5].setFormat(vk::Format::eR32G32B32A32Uint);
-	skinnedAttrib[5].setLocation(5);
-	skinnedAttrib[5].setOffset(4 * sizeof(glm::vec3) + sizeof(glm::vec2));
+	renderEngine.compactVertices = compactVertices;
+	renderEngine.gpuDrivenRendering = gpuCulling != nullptr || UsesInstancing();
 
 	/*Create pipelines*/
-	auto vsModule = CreateShaderModule("Shaders\\vertex.spv", vkInfo->device);
-	auto psModule = CreateShaderModule("Shaders\\fragment.spv", vkInfo->device);
+	auto vsModule = vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "vertexCompact" : "vertex");
+	auto psModule = vkInfo->shaderLibrary->GetShaderModule("fragment");
 
 	//Create pipeline shader module
 	std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderInfo(2);
@@ -799,6 +1486,7 @@ void Scene::PreparePipeline() {
 		.setOffset(0)
 		.setSize(sizeof(int));
 
+	meshPipeline.resize((int)ShaderModel::shaderModelCount);
 	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
 		auto shaderModelSI = vk::SpecializationInfo()
 			.setDataSize(sizeof(int))
@@ -812,12 +1500,11 @@ void Scene::PreparePipeline() {
 			.setStage(vk::ShaderStageFlagBits::eFragment)
 			.setPSpecializationInfo(&shaderModelSI);
 
-		meshPipeline.push_back(CreateGraphicsPipeline(vkInfo->device, dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass));
+		pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass), &meshPipeline[i]);
 	}
-	vkInfo->device.destroyShaderModule(vsModule);
 
 	//编译用于蒙皮动画的着色器
-	vsModule = CreateShaderModule("Shaders\\skinnedVS.spv", vkInfo->device);
+	vsModule = vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "skinnedVSCompact" : "skinnedVS");
 
 	pipelineShaderInfo[0] = vk::PipelineShaderStageCreateInfo()
 		.setPName("main")
@@ -831,6 +1518,7 @@ void Scene::PreparePipeline() {
 	skinnedviInfo.setVertexAttributeDescriptionCount(skinnedAttrib.size());
 	skinnedviInfo.setPVertexAttributeDescriptions(skinnedAttrib.data());
 
+	skinnedMeshPipeline.resize((int)ShaderModel::shaderModelCount);
 	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
 		auto shaderModelSI = vk::SpecializationInfo()
 			.setDataSize(sizeof(int))
@@ -844,14 +1532,12 @@ void Scene::PreparePipeline() {
 			.setStage(vk::ShaderStageFlagBits::eFragment)
 			.setPSpecializationInfo(&shaderModelSI);
 
-		skinnedMeshPipeline.push_back(CreateGraphicsPipeline(vkInfo->device, dynamicInfo, skinnedviInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass));
+		pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, skinnedviInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass), &skinnedMeshPipeline[i]);
 	}
-	vkInfo->device.destroyShaderModule(vsModule);
-	vkInfo->device.destroyShaderModule(psModule);
 
 	//编译用于天空球的着色器
-	vsModule = CreateShaderModule("Shaders\\skyboxVS.spv", vkInfo->device);
-	psModule = CreateShaderModule("Shaders\\skyboxPS.spv", vkInfo->device);
+	vsModule = vkInfo->shaderLibrary->GetShaderModule("skyboxVS");
+	psModule = vkInfo->shaderLibrary->GetShaderModule("skyboxPS");
 
 	pipelineShaderInfo[0].setModule(vsModule);
 	pipelineShaderInfo[1].setModule(psModule);
@@ -865,14 +1551,16 @@ void Scene::PreparePipeline() {
 		.setSetLayoutCount(2)
 		.setPSetLayouts(descSetLayout);
 	vkInfo->device.createPipelineLayout(&skyboxPipelineInfo, 0, &vkInfo->pipelineLayout["skybox"]);
-	vkInfo->pipelines["skybox"] = CreateGraphicsPipeline(vkInfo->device, dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["skybox"], pipelineShaderInfo, renderEngine.forwardShading.renderPass);
 
-	vkInfo->device.destroyShaderModule(vsModule);
-	vkInfo->device.destroyShaderModule(psModule);
+	auto skyboxviInfo = viInfo;
+	skyboxviInfo.setPVertexBindingDescriptions(&skyboxBinding);
+	skyboxviInfo.setVertexAttributeDescriptionCount(skyboxAttrib.size());
+	skyboxviInfo.setPVertexAttributeDescriptions(skyboxAttrib.data());
+	pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, skyboxviInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["skybox"], pipelineShaderInfo, renderEngine.forwardShading.renderPass), &vkInfo->pipelines["skybox"]);
 
 	//编译用于阴影贴图的着色器
-	vsModule = CreateShaderModule("Shaders\\shadowVS.spv", vkInfo->device);
-	psModule = CreateShaderModule("Shaders\\shadowPS.spv", vkInfo->device);
+	vsModule = vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "shadowVSCompact" : "shadowVS");
+	psModule = vkInfo->shaderLibrary->GetShaderModule("shadowPS");
 
 	pipelineShaderInfo[0] = vk::PipelineShaderStageCreateInfo()
 		.setPName("main")
@@ -891,19 +1579,23 @@ void Scene::PreparePipeline() {
 	cbInfo.setAttachmentCount(0);
 	cbInfo.setPAttachments(0);
 
-	vkInfo->pipelines["shadow"] = CreateGraphicsPipeline(vkInfo->device, dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, shadowMap.GetRenderPass());
-	vkInfo->device.destroyShaderModule(vsModule);
+	pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, shadowMap.GetRenderPass()), &vkInfo->pipelines["shadow"]);
+
+	//GPU剔除后间接绘制与实例化绘制的阴影管线，物体常量从存储缓冲读取
+	if (gpuCulling != nullptr || UsesInstancing()) {
+		pipelineShaderInfo[0].setModule(vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "shadowVSCompactIndirect" : "shadowVSIndirect"));
+		pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, shadowMap.GetRenderPass()), &vkInfo->pipelines["shadowIndirect"]);
+	}
 
 	//编译用于蒙皮动画的阴影着色器
-	vsModule = CreateShaderModule("Shaders\\shadowSkinnedVS.spv", vkInfo->device);
+	vsModule = vkInfo->shaderLibrary->GetShaderModule(compactVertices ? "shadowSkinnedVSCompact" : "shadowSkinnedVS");
 	pipelineShaderInfo[0] = vk::PipelineShaderStageCreateInfo()
 		.setPName("main")
 		.setModule(vsModule)
 		.setStage(vk::ShaderStageFlagBits::eVertex);
 
 	//创建用于蒙皮动画的阴影管线
-	vkInfo->pipelines["skinnedShadow"] = CreateGraphicsPipeline(vkInfo->device, dynamicInfo, skinnedviInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, shadowMap.GetRenderPass());
-	vkInfo->device.destroyShaderModule(psModule);
+	pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, skinnedviInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, shadowMap.GetRenderPass()), &vkInfo->pipelines["skinnedShadow"]);
 
 	//粒子的顶点输入装配属性
 	vk::VertexInputBindingDescription particleBinding;
@@ -940,9 +1632,9 @@ void Scene::PreparePipeline() {
 	particleAttrib[3].setOffset(sizeof(glm::vec4) + sizeof(glm::vec3) + sizeof(float));
 
 	//编译用于粒子效果的着色器
-	vsModule = CreateShaderModule("Shaders\\particleVS.spv", vkInfo->device);
-	vk::ShaderModule gsModule = CreateShaderModule("Shaders\\particleGS.spv", vkInfo->device);
-	psModule = CreateShaderModule("Shaders\\particlePS.spv", vkInfo->device);
+	vsModule = vkInfo->shaderLibrary->GetShaderModule("particleVS");
+	vk::ShaderModule gsModule = vkInfo->shaderLibrary->GetShaderModule("particleGS");
+	psModule = vkInfo->shaderLibrary->GetShaderModule("particlePS");
 
 	pipelineShaderInfo.resize(3);
 	pipelineShaderInfo[0] = vk::PipelineShaderStageCreateInfo()
@@ -988,77 +1680,395 @@ void Scene::PreparePipeline() {
 		.setVertexAttributeDescriptionCount(particleAttrib.size())
 		.setPVertexAttributeDescriptions(particleAttrib.data());
 
-	vkInfo->pipelines["smoke"] = CreateGraphicsPipeline(vkInfo->device, dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass);
+	pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass), &vkInfo->pipelines["smoke"]);
 
 	attState.setDstColorBlendFactor(vk::BlendFactor::eOne);
 
-	vkInfo->pipelines["flame"] = CreateGraphicsPipeline(vkInfo->device, dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass);
+	pipelineCompiler.Add(MakeGraphicsPipelineInfo(dynamicInfo, viInfo, iaInfo, rsInfo, cbInfo, vpInfo, dsInfo, msInfo, vkInfo->pipelineLayout["scene"], pipelineShaderInfo, renderEngine.forwardShading.renderPass), &vkInfo->pipelines["flame"]);
 
-	vkInfo->device.destroyShaderModule(vsModule);
-	vkInfo->device.destroyShaderModule(gsModule);
-	vkInfo->device.destroyShaderModule(psModule);
+	bloom->PreparePipelines(pipelineCompiler);
+	renderEngine.PreparePipeline(pipelineCompiler);
+
+	//异步模式下管线在后台编译，编译完成前相关的绘制会被跳过
+	if (async)
+		pipelineCompiler.CompileAsync();
+	else
+		pipelineCompiler.Compile();
+}
 
-	bloom->PreparePipelines();
-	renderEngine.PreparePipeline();
+bool Scene::UpdatePipelines() {
+	return pipelineCompiler.Update();
 }
 
 void Scene::PrepareShaderModel() {
+	//加入新网格后重新分组，meshRenderers扩容后原来的指针已失效
+	for (auto& list : shaderModel)
+		list.clear();
+	for (auto& list : skinnedShaderModel)
+		list.clear();
+
 	for (auto& meshRenderer : meshRenderers) {
 		shaderModel[(int)meshRenderer.gameObject->material->shaderModel].push_back(&meshRenderer);
 	}
 	for (auto& skinnedMeshRenderer : skinnedMeshRenderers) {
 		skinnedShaderModel[(int)skinnedMeshRenderer.gameObject->material->shaderModel].push_back(&skinnedMeshRenderer);
 	}
+
+	if (gpuCulling != nullptr)
+		BuildIndirectDraws();
+	if (UsesInstancing())
+		BuildInstanceBatches();
+}
+
+void Scene::BuildInstanceBatches() {
+	instanceBatches.clear();
+	instanceRenderers.clear();
+
+	//按着色模型的顺序分批，几何、材质与当前LOD都相同的网格在实例缓冲中相邻
+	std::map<std::tuple<Material*, vk::IndexType, uint32_t, uint32_t, int32_t>, uint32_t> batchIndices;
+	std::vector<std::vector<MeshRenderer*>> batchRenderers;
+	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
+		for (auto meshRenderer : shaderModel[i]) {
+			//按网格簇或遮挡剔除的网格有自己的间接命令，仍然逐个绘制
+			meshRenderer->instanced = meshRenderer->drawCommandCount == 0;
+			if (!meshRenderer->instanced)
+				continue;
+
+			auto key = std::make_tuple(meshRenderer->gameObject->material, meshRenderer->indexType, meshRenderer->GetFirstIndex(), meshRenderer->GetIndexCount(), meshRenderer->baseVertexLocation);
+			auto batch = batchIndices.find(key);
+			if (batch == batchIndices.end()) {
+				batch = batchIndices.emplace(key, static_cast<uint32_t>(instanceBatches.size())).first;
+				instanceBatches.push_back({ meshRenderer->gameObject->material, meshRenderer->indexType, meshRenderer->GetIndexCount(), meshRenderer->GetFirstIndex(), meshRenderer->baseVertexLocation, 0, 0 });
+				batchRenderers.emplace_back();
+			}
+			batchRenderers[batch->second].push_back(meshRenderer);
+		}
+	}
+	for (uint32_t i = 0; i < instanceBatches.size(); i++) {
+		instanceBatches[i].firstInstance = static_cast<uint32_t>(instanceRenderers.size());
+		instanceBatches[i].instanceCount = static_cast<uint32_t>(batchRenderers[i].size());
+		instanceRenderers.insert(instanceRenderers.end(), batchRenderers[i].begin(), batchRenderers[i].end());
+	}
+
+	//容量不足时重建，多预留一半，逐个加入物体时不必每次都重建
+	uint32_t instanceCount = std::max(static_cast<uint32_t>(instanceRenderers.size()), 1u);
+	if (instanceBuffer == nullptr || instanceCapacity < instanceCount) {
+		if (instanceBuffer != nullptr)
+			instanceBuffer->DestroyBuffer(&vkInfo->device);
+		instanceCapacity = instanceCount + instanceCount / 2;
+		instanceBuffer = std::make_unique<Buffer<ObjectConstants>>(&vkInfo->device, instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, vkInfo->allocator,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		auto bufferInfo = vk::DescriptorBufferInfo(instanceBuffer->GetBuffer(), 0, VK_WHOLE_SIZE);
+		auto descSetWrite = vk::WriteDescriptorSet()
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDstArrayElement(0)
+			.setDstBinding(0)
+			.setDstSet(instanceDescSet)
+			.setPBufferInfo(&bufferInfo);
+		vkInfo->device.updateDescriptorSets(1, &descSetWrite, 0, 0);
+	}
+	WriteInstanceData();
+}
+
+void Scene::WriteInstanceData() {
+	ObjectConstants* instances = instanceBuffer->GetMappedData();
+	for (size_t i = 0; i < instanceRenderers.size(); i++)
+		instances[i] = instanceRenderers[i]->gameObject->objectConstants;
+}
+
+void Scene::BuildIndirectDraws() {
+	indirectBuckets.clear();
+	shadowBuckets.clear();
+
+	//按着色模型的顺序建桶，绘制时只在着色模型变化时切换管线
+	std::vector<GPUCulling::DrawInfo> draws(meshRenderers.size());
+	std::map<std::pair<Material*, vk::IndexType>, uint32_t> bucketIndices;
+	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
+		for (auto meshRenderer : shaderModel[i]) {
+			GPUCulling::DrawInfo& draw = draws[meshRenderer - meshRenderers.data()];
+			draw.objectIndex = meshRenderer->gameObject->objCBIndex;
+			draw.indexCount = meshRenderer->GetIndexCount();
+			draw.firstIndex = meshRenderer->GetFirstIndex();
+			draw.vertexOffset = meshRenderer->baseVertexLocation;
+			draw.bounds = glm::vec4(meshRenderer->boundsCenter, meshRenderer->boundsRadius);
+
+			//按网格簇剔除的网格在主相机下仍然逐个绘制
+			if (meshRenderer->drawCommandCount == 0) {
+				auto key = std::make_pair(meshRenderer->gameObject->material, meshRenderer->indexType);
+				auto bucket = bucketIndices.find(key);
+				if (bucket == bucketIndices.end()) {
+					bucket = bucketIndices.emplace(key, static_cast<uint32_t>(indirectBuckets.size())).first;
+					indirectBuckets.push_back({ (ShaderModel)i, meshRenderer->gameObject->material, meshRenderer->indexType });
+				}
+				draw.bucket = bucket->second;
+			}
+
+			auto shadowBucket = std::find(shadowBuckets.begin(), shadowBuckets.end(), meshRenderer->indexType);
+			if (shadowBucket == shadowBuckets.end())
+				shadowBucket = shadowBuckets.insert(shadowBuckets.end(), meshRenderer->indexType);
+			draw.shadowBucket = static_cast<uint32_t>(shadowBucket - shadowBuckets.begin());
+		}
+	}
+
+	gpuCulling->SetDraws(draws, static_cast<uint32_t>(indirectBuckets.size()), static_cast<uint32_t>(shadowBuckets.size()), static_cast<uint32_t>(frameResources->objCB.size()));
+
+	//物体缓冲可能重建过，新加入的物体也还没有写入
+	for (auto& gameObject : gameObjects)
+		gpuCulling->UpdateObject(gameObject.second.objCBIndex, gameObject.second.objectConstants);
+}
+
+void Scene::BuildDrawQueue() {
+	drawQueue.clear();
+
+	//网格编号的最高位为索引类型，同一类型的绘制相邻，索引缓冲切换更少
+	auto meshKey = [](const MeshRenderer& meshRenderer) {
+		uint32_t indexTypeBit = meshRenderer.indexType == vk::IndexType::eUint32 ? 1u << (drawKeyMeshBits - 1) : 0u;
+		return indexTypeBit | (meshRenderer.geometry->id & ((1u << (drawKeyMeshBits - 1)) - 1));
+	};
+
+	//阴影只有一个管线，按材质与网格排序
+	if (gpuCulling == nullptr) {
+		for (uint32_t i = 0; i < meshRenderers.size(); i++) {
+			const MeshRenderer& meshRenderer = meshRenderers[i];
+			if (meshRenderer.instanced)
+				continue;
+			drawQueue.push_back({ MakeDrawKey(shadowDrawPass, 0, meshRenderer.gameObject->material->matCBIndex, meshKey(meshRenderer), 0.0f), i });
+		}
+	}
+
+	//G-Buffer的绘制都不透明，同一状态内由近到远，距离按最远的绘制归一化
+	glm::vec3 eyePos = mainCamera->GetPosition3f();
+	size_t firstGBufferDraw = drawQueue.size();
+	float maxDistance = 0.0f;
+	drawDistances.clear();
+	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
+		for (auto meshRenderer : shaderModel[i]) {
+			//GPU剔除的网格按桶绘制，实例化的网格按批次绘制
+			if ((gpuCulling != nullptr && meshRenderer->drawCommandCount == 0) || meshRenderer->instanced)
+				continue;
+
+			glm::vec3 center = glm::vec3(meshRenderer->gameObject->objectConstants.worldMatrix * glm::vec4(meshRenderer->boundsCenter, 1.0f));
+			float distance = glm::length(center - eyePos);
+			maxDistance = std::max(maxDistance, distance);
+			drawDistances.push_back(distance);
+			drawQueue.push_back({ 0, static_cast<uint32_t>(meshRenderer - meshRenderers.data()) });
+		}
+	}
+	for (size_t i = firstGBufferDraw; i < drawQueue.size(); i++) {
+		const MeshRenderer& meshRenderer = meshRenderers[drawQueue[i].draw];
+		const Material* material = meshRenderer.gameObject->material;
+		float depth = maxDistance > 0.0f ? drawDistances[i - firstGBufferDraw] / maxDistance : 0.0f;
+		drawQueue[i].key = MakeDrawKey(gbufferDrawPass, (uint32_t)material->shaderModel, material->matCBIndex, meshKey(meshRenderer), depth);
+	}
+
+	RadixSortDraws(drawQueue, drawQueueScratch);
 }
 
 void Scene::DrawObject(vk::CommandBuffer cmd, uint32_t currentBuffer) {
+	//GPU剔除写入间接命令，需在渲染通道之外录制
+	if (gpuCulling != nullptr)
+		gpuCulling->RecordCulling(cmd);
+
+	//异步编译时尚未完成的管线为空，使用它的绘制将被跳过
 	shadowMap.BeginRenderPass(&cmd);
 	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 2, 1, &shadowPassDesc, 0, 0);
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["shadow"]);
 
-	vk::DeviceSize offsets[] = { 0 };
-	cmd.bindIndexBuffer(indexBuffer->GetBuffer(), 0, vk::IndexType::eUint32);
-	const vk::Buffer vertexBuffers[1] = { vertexBuffer->GetBuffer() };
-	cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+	//16位与32位索引分在两个缓冲中，类型变化时才重新绑定
+	bool indexBound = false;
+	vk::IndexType boundIndexType = vk::IndexType::eUint32;
+	auto bindIndexBuffer = [&](vk::IndexType indexType) {
+		if (indexBound && boundIndexType == indexType)
+			return;
+		if (indexType == vk::IndexType::eUint16)
+			cmd.bindIndexBuffer(index16Buffer->GetBuffer(), 0, vk::IndexType::eUint16);
+		else
+			cmd.bindIndexBuffer(indexBuffer->GetBuffer(), 0, vk::IndexType::eUint32);
+		indexBound = true;
+		boundIndexType = indexType;
+	};
+
+	//物体(set 0)与材质(set 1)的描述符变化时才重新绑定，各通道都使用scene管线布局
+	vk::DescriptorSet boundSets[2];
+	auto bindDescriptorSet = [&](uint32_t set, vk::DescriptorSet descSet) {
+		if (boundSets[set] == descSet)
+			return;
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], set, 1, &descSet, 0, 0);
+		boundSets[set] = descSet;
+	};
 
-	for (auto& meshRenderer : meshRenderers) {
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 0, 1, &meshRenderer.gameObject->descSet, 0, 0);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 1, 1, &meshRenderer.gameObject->material->descSet, 0, 0);
-		cmd.drawIndexed(meshRenderer.indices.size(), 1, meshRenderer.startIndexLocation, meshRenderer.baseVertexLocation, 1);
+	vk::DeviceSize offsets[] = { 0 };
+	const vk::Buffer vertexBuffers[1] = { vertexBuffer != nullptr ? vertexBuffer->GetBuffer() : vk::Buffer() };
+	if (vertexBuffer != nullptr)
+		cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+
+	if (gpuCulling != nullptr && vkInfo->pipelines["shadowIndirect"]) {
+		//阴影只按索引类型分桶，不需要材质
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["shadowIndirect"]);
+		vk::DescriptorSet objectDescSet = gpuCulling->GetObjectDescSet();
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 5, 1, &objectDescSet, 0, 0);
+		for (uint32_t i = 0; i < shadowBuckets.size(); i++) {
+			bindIndexBuffer(shadowBuckets[i]);
+			gpuCulling->DrawShadowBucket(cmd, i);
+		}
 	}
-	if (skinnedModelInst.size() > 0) {
+	else {
+		//实例化的批次每批一次绘制，其余网格逐个绘制
+		if (!instanceBatches.empty() && vkInfo->pipelines["shadowIndirect"]) {
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["shadowIndirect"]);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 5, 1, &instanceDescSet, 0, 0);
+			for (auto& batch : instanceBatches) {
+				bindIndexBuffer(batch.indexType);
+				cmd.drawIndexed(batch.indexCount, batch.instanceCount, batch.firstIndex, batch.vertexOffset, batch.firstInstance);
+			}
+		}
+		if (vkInfo->pipelines["shadow"]) {
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["shadow"]);
+			//阴影的绘制排在最前
+			for (auto& entry : drawQueue) {
+				if (GetDrawKeyPass(entry.key) != shadowDrawPass)
+					break;
+				MeshRenderer& meshRenderer = meshRenderers[entry.draw];
+				bindDescriptorSet(0, meshRenderer.gameObject->descSet);
+				bindDescriptorSet(1, meshRenderer.gameObject->material->descSet);
+				bindIndexBuffer(meshRenderer.indexType);
+				cmd.drawIndexed(meshRenderer.GetIndexCount(), 1, meshRenderer.GetFirstIndex(), meshRenderer.baseVertexLocation, 1);
+			}
+		}
+	}
+	if (skinnedModelInst.size() > 0 && vkInfo->pipelines["skinnedShadow"]) {
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["skinnedShadow"]);
 		const vk::Buffer skinnedVertexBuffers[1] = { skinnedVertexBuffer->GetBuffer() };
 		cmd.bindVertexBuffers(0, 1, skinnedVertexBuffers, offsets);
 		for (auto& skinnedMeshRenderer : skinnedMeshRenderers) {
-			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 0, 1, &skinnedMeshRenderer.gameObject->descSet, 0, 0);
+			bindDescriptorSet(0, skinnedMeshRenderer.gameObject->descSet);
 			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 4, 1, &skinnedModelInst[skinnedMeshRenderer.skinnedModelIndex].descSet, 0, 0);
-			cmd.drawIndexed(skinnedMeshRenderer.indices.size(), 1, skinnedMeshRenderer.startIndexLocation, skinnedMeshRenderer.baseVertexLocation, 1);
+			bindIndexBuffer(skinnedMeshRenderer.indexType);
+			cmd.drawIndexed(skinnedMeshRenderer.GetIndexCount(), 1, skinnedMeshRenderer.GetFirstIndex(), skinnedMeshRenderer.baseVertexLocation, 1);
 		}
 	}
 
 	cmd.endRenderPass();
 
-	renderEngine.BeginDeferredShading(cmd);
+	//遮挡剔除时G-Buffer分两次绘制，中间由early的深度建立层级深度
+	bool occlusion = gpuCulling != nullptr && gpuCulling->IsOcclusionCulling();
+	renderEngine.BeginDeferredShading(cmd, occlusion ? renderEngine.deferredShading.earlyRenderPass : vk::RenderPass());
 
 	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 2, 1, &scenePassDesc, 0, 0);
-	cmd.bindVertexBuffers(0, 1,vertexBuffers, offsets);
+	if (vertexBuffer != nullptr)
+		cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+
+	//按状态键排序后相邻的绘制大多共用管线与材质，GPU剔除与实例化的网格不在队列中
+	vk::Pipeline boundPipeline;
+	for (auto& entry : drawQueue) {
+		if (GetDrawKeyPass(entry.key) != gbufferDrawPass)
+			continue;
+		MeshRenderer* meshRenderer = &meshRenderers[entry.draw];
+
+		//该着色模型的管线还未编译完成时退回到通用管线
+		vk::Pipeline pipeline = renderEngine.deferredShading.outputPipeline[(int)meshRenderer->gameObject->material->shaderModel];
+		if (!pipeline)
+			pipeline = renderEngine.deferredShading.outputPipeline[(int)ShaderModel::common];
+		if (!pipeline)
+			continue;
+
+		if (pipeline != boundPipeline) {
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+			boundPipeline = pipeline;
+		}
+		bindDescriptorSet(0, meshRenderer->gameObject->descSet);
+		bindDescriptorSet(1, meshRenderer->gameObject->material->descSet);
+		bindIndexBuffer(meshRenderer->indexType);
+		if (meshRenderer->drawCommandCount == 0) {
+			cmd.drawIndexed(meshRenderer->GetIndexCount(), 1, meshRenderer->GetFirstIndex(), meshRenderer->baseVertexLocation, 1);
+			continue;
+		}
 
-	for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
-		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.outputPipeline[i]);
-		for (auto& meshRenderer : shaderModel[i]) {
-			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 0, 1, &meshRenderer->gameObject->descSet, 0, 0);
-			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 1, 1, &meshRenderer->gameObject->material->descSet, 0, 0);
-			cmd.drawIndexed(meshRenderer->indices.size(), 1, meshRenderer->startIndexLocation, meshRenderer->baseVertexLocation, 1);
+		//剔除后的簇，未使用的命令索引数为0
+		const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		vk::DeviceSize offset = (vk::DeviceSize)meshRenderer->drawCommandOffset * stride;
+		if (vkInfo->multiDrawIndirect) {
+			cmd.drawIndexedIndirect(meshletDrawBuffer->GetBuffer(), offset, meshRenderer->drawCommandCount, stride);
+		}
+		else {
+			for (uint32_t j = 0; j < meshRenderer->drawCommandCount; j++)
+				cmd.drawIndexedIndirect(meshletDrawBuffer->GetBuffer(), offset + (vk::DeviceSize)j * stride, 1, stride);
 		}
 	}
 
+	//实例化的批次每批一次绘制，相同的道具无论多少个都只有一次绘制调用
+	if (!instanceBatches.empty()) {
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 5, 1, &instanceDescSet, 0, 0);
+
+		for (auto& batch : instanceBatches) {
+			vk::Pipeline pipeline = renderEngine.deferredShading.indirectOutputPipeline[(int)batch.material->shaderModel];
+			if (!pipeline)
+				pipeline = renderEngine.deferredShading.indirectOutputPipeline[(int)ShaderModel::common];
+			if (!pipeline)
+				continue;
+
+			if (pipeline != boundPipeline) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				boundPipeline = pipeline;
+			}
+			bindDescriptorSet(1, batch.material->descSet);
+			bindIndexBuffer(batch.indexType);
+			cmd.drawIndexed(batch.indexCount, batch.instanceCount, batch.firstIndex, batch.vertexOffset, batch.firstInstance);
+		}
+	}
+
+	//GPU剔除后每个桶一次间接绘制，CPU的开销只与桶数有关
+	auto drawIndirectBuckets = [&](bool late) {
+		vk::DescriptorSet objectDescSet = gpuCulling->GetObjectDescSet();
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 5, 1, &objectDescSet, 0, 0);
+
+		vk::Pipeline bucketPipeline;
+		for (uint32_t i = 0; i < indirectBuckets.size(); i++) {
+			const IndirectBucket& bucket = indirectBuckets[i];
+			vk::Pipeline pipeline = renderEngine.deferredShading.indirectOutputPipeline[(int)bucket.shaderModel];
+			if (!pipeline)
+				pipeline = renderEngine.deferredShading.indirectOutputPipeline[(int)ShaderModel::common];
+			if (!pipeline)
+				continue;
+
+			if (pipeline != bucketPipeline) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				bucketPipeline = pipeline;
+			}
+			bindDescriptorSet(1, bucket.material->descSet);
+			bindIndexBuffer(bucket.indexType);
+			if (late)
+				gpuCulling->DrawLateBucket(cmd, i);
+			else
+				gpuCulling->DrawMainBucket(cmd, i);
+		}
+	};
+	if (gpuCulling != nullptr)
+		drawIndirectBuckets(false);
+
+	//early通道的光照子通道为空，结束后补画被上一帧深度误判为遮挡的绘制，管线与帧缓冲与原通道兼容，绑定的描述符在通道之间保留
+	if (occlusion) {
+		cmd.nextSubpass(vk::SubpassContents::eInline);
+		cmd.endRenderPass();
+
+		gpuCulling->RecordOcclusionCulling(cmd);
+
+		renderEngine.BeginDeferredShading(cmd, renderEngine.deferredShading.lateRenderPass);
+		indexBound = false;
+		drawIndirectBuckets(true);
+	}
+
 	cmd.nextSubpass(vk::SubpassContents::eInline);
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.processingPipeline);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 1, 1, &renderEngine.gbuffer.descSet, 0, 0);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 2, 1, &scenePassDesc, 0, 0);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 3, 1, &drawShadowDesc, 0, 0);
-	cmd.draw(4, 1, 0, 0);
+	if (renderEngine.deferredShading.processingPipeline) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.processingPipeline);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 1, 1, &renderEngine.gbuffer.descSet, 0, 0);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 2, 1, &scenePassDesc, 0, 0);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderEngine.deferredShading.pipelineLayout, 3, 1, &drawShadowDesc, 0, 0);
+		cmd.draw(4, 1, 0, 0);
+		//光照管线布局在set 1绑定了G-Buffer，之后的绘制要重新绑定物体与材质
+		boundSets[0] = boundSets[1] = vk::DescriptorSet();
+	}
 
 	cmd.endRenderPass();
 
@@ -1071,24 +2081,33 @@ void Scene::DrawObject(vk::CommandBuffer cmd, uint32_t currentBuffer) {
 		const vk::Buffer skinnedVertexBuffers[1] = { skinnedVertexBuffer->GetBuffer() };
 		cmd.bindVertexBuffers(0, 1, skinnedVertexBuffers, offsets);
 		for (int i = 0; i < (int)ShaderModel::shaderModelCount; i++) {
-			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, skinnedMeshPipeline[i]);
+			vk::Pipeline pipeline = skinnedMeshPipeline[i];
+			if (!pipeline)
+				pipeline = skinnedMeshPipeline[(int)ShaderModel::common];
+			if (!pipeline)
+				continue;
+
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
 			for (auto& skinnedMeshRenderer : skinnedShaderModel[i]) {
-				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 0, 1, &skinnedMeshRenderer->gameObject->descSet, 0, 0);
-				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 1, 1, &skinnedMeshRenderer->gameObject->material->descSet, 0, 0);
+				bindDescriptorSet(0, skinnedMeshRenderer->gameObject->descSet);
+				bindDescriptorSet(1, skinnedMeshRenderer->gameObject->material->descSet);
 				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 4, 1, &skinnedModelInst[skinnedMeshRenderer->skinnedModelIndex].descSet, 0, 0);
-				cmd.drawIndexed(skinnedMeshRenderer->indices.size(), 1, skinnedMeshRenderer->startIndexLocation, skinnedMeshRenderer->baseVertexLocation, 1);
+				bindIndexBuffer(skinnedMeshRenderer->indexType);
+				cmd.drawIndexed(skinnedMeshRenderer->GetIndexCount(), 1, skinnedMeshRenderer->GetFirstIndex(), skinnedMeshRenderer->baseVertexLocation, 1);
 			}
 		}
 	}
 
 	//绘制天空盒
-	cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
-
-	if (skybox.use) {
+	if (skybox.use && vkInfo->pipelines["skybox"]) {
+		const vk::Buffer skyboxVertexBuffers[1] = { skyboxVertexBuffer->GetBuffer() };
+		cmd.bindVertexBuffers(0, 1, skyboxVertexBuffers, offsets);
+		bindIndexBuffer(skybox.indexType);
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["skybox"]);
 		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["skybox"], 0, 1, &skybox.descSet, 0, 0);
 		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["skybox"], 1, 1, &scenePassDesc, 0, 0);
 		cmd.drawIndexed(skybox.indexCount, 1, skybox.startIndexLocation, skybox.baseVertexLocation, 1);
+		boundSets[0] = boundSets[1] = vk::DescriptorSet();
 	}
 
 	//绘制粒子系统
@@ -1096,6 +2115,9 @@ void Scene::DrawObject(vk::CommandBuffer cmd, uint32_t currentBuffer) {
 	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 3, 1, &drawShadowDesc, 0, 0);
 
 	for (auto& particleSystem : particleSystems) {
+		if (!vkInfo->pipelines["smoke"] || !vkInfo->pipelines["flame"])
+			break;
+
 		if (particleSystem.subParticle) {
 			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, vkInfo->pipelines["smoke"]);
 			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vkInfo->pipelineLayout["scene"], 0, 1, &particleSystem.subParticle->descSet, 0, 0);
@@ -7,7 +7,13 @@
 #include "Render/ParticleSystem.h"
 #include "Render/PostProcessing.h"
 #include "../Util/FrameResoure.h"
+#include "../Util/UploadBatcher.h"
+#include "../Util/SoftwareOcclusion.h"
+#include "../Util/DrawSort.h"
+#include "Resource/TextureStreamer.h"
+#include "Resource/AssetImporter.h"
 #include "Render/ShadowMap.h"
+#include "Render/GPUCulling.h"
 #include "../imGUI.h"
 
 class Scene {
@@ -16,7 +22,15 @@ public:
 	void AddMaterial(Material& material);
 
 	void AddMeshRenderer(GameObject* gameObject, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
-	void AddSkinnedMeshRenderer(GameObject* gameObject, std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices);
+	//包围球已知时(如烘焙网格)不再遍历顶点
+	void AddMeshRenderer(GameObject* gameObject, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const glm::vec3& boundsCenter, float boundsRadius);
+	//导入的网格，附带LOD与网格簇
+	void AddMeshRenderer(GameObject* gameObject, const Mesh::RenderInfo& renderInfo);
+	void AddSkinnedMeshRenderer(GameObject* gameObject, std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods = std::vector<MeshLod>());
+	//移除物体上的网格(如加载完成后的占位包围盒)，之后需要调用SetupLoadedObjects
+	void RemoveMeshRenderer(GameObject* gameObject);
+	//物体上的网格作为软件遮挡剔除的遮挡物，应是大而完整的网格(建筑、墙体)
+	void SetOccluder(GameObject* gameObject, bool occluder = true);
 	void AddParticleSystem(GameObject* particle, GameObject* subParticle, ParticleSystem::Property& property, ParticleSystem::Emitter& emitter, ParticleSystem::Texture& texture, ParticleSystem::SubParticle& subParticleProperty);
 	void AddSkinnedModelInstance(SkinnedModelInstance& skinnedModelInst);
 
@@ -34,7 +48,8 @@ public:
 	void SetMainCamera(Camera* mainCamera);
 
 	//天空盒设定
-	void SetSkybox(Texture image, float radius, uint32_t subdivision);
+	void SetSkybox(Texture* image, float radius, uint32_t subdivision);
+	void SetSkybox(const AssetHandle<Texture>& image, float radius, uint32_t subdivision);
 
 	//后处理设定
 	void SetHDRProperty(float exposure, float gamma);
@@ -50,12 +65,36 @@ public:
 	void UpdateSkinnedModel(float deltaTime);
 	void UpdateCPUParticleSystem(float deltaTime);
 
+	//纹理流式加载: 按物体在屏幕上的大小请求纹理分辨率，纹理换了图像后重写材质描述符
+	void RequestTextureMips(TextureStreamer& textureStreamer);
+	void RefreshMaterialTextures();
+
+	//按简化误差投影到屏幕上的像素数为每个网格选择LOD，返回true表示有网格换了级别，需要重新录制命令
+	bool SelectLods();
+
+	//在CPU上光栅化遮挡物，测试每个静态网格的包围盒，在CullMeshlets之前、GPU用完上一帧之后调用
+	void CullOcclusion();
+	//按主相机的视锥与法线锥剔除网格簇，把可见的簇写入间接绘制缓冲，在GPU用完上一帧之后调用
+	void CullMeshlets();
+
+	//渐进加载: 纹理导入完成前材质使用占位纹理，完成并提交上传之后原地改写描述符，返回true表示需要重新录制命令
+	void SetMaterialTexture(Material* material, const AssetHandle<Texture>& texture, bool normalMap = false);
+	bool ResolveLoadedTextures(UploadBatcher& uploadBatcher);
+	uint32_t GetPendingTextureCount()const { return static_cast<uint32_t>(pendingTextures.size()); }
+
+	//SetupDescriptors之后加入的物体与材质: 追加常量缓冲与描述符，重建顶点缓冲，只在GPU用完上一帧之后调用
+	bool SetupLoadedObjects(UploadBatcher& uploadBatcher);
+
 	void SetupRenderEngine();
-	void SetupVertexBuffer();
-	void SetupDescriptors();
-	void PreparePipeline();
+	void SetupVertexBuffer(UploadBatcher& uploadBatcher);
+	void SetupDescriptors(UploadBatcher& uploadBatcher);
+	void PreparePipeline(bool async = false);
+	bool UpdatePipelines();
 	void PrepareShaderModel();
 
+	//逐个绘制的网格按状态键排序，每次录制命令前调用一次，各交换链图像的命令共用排序结果。
+	//由近到远的顺序只在重新录制时更新
+	void BuildDrawQueue();
 	void DrawObject(vk::CommandBuffer cmd, uint32_t currentBuffer);
 
 	//Get方法（用于编辑器）
@@ -74,7 +113,46 @@ public:
 
 	Vulkan* vkInfo;
 
+	//量化的顶点格式(约为完整格式的一半大小)，需要先编译*Compact着色器，在SetupVertexBuffer之前设定，缺少着色器时SetupVertexBuffer将其关闭
+	bool compactVertices = false;
+
+	//LOD误差在屏幕上允许的像素数，降低级别时要求误差再小lodHysteresis的比例，避免在阈值附近来回切换
+	float lodErrorPixels = 1.0f;
+	float lodHysteresis = 0.25f;
+
+	//网格簇剔除在SetupVertexBuffer之前设定。管线不剔除背面，背面需要可见的网格应关闭法线锥剔除
+	bool meshletCulling = true;
+	bool meshletConeCulling = true;
+	uint32_t GetVisibleMeshletCount()const { return visibleMeshletCount; }
+	uint32_t GetTotalMeshletCount()const { return totalMeshletCount; }
+
+	//不能使用GPU剔除时的遮挡剔除，只在没有gpuDrivenRendering时有效，在SetupVertexBuffer之前设定。开启后所有静态网格都改为间接绘制，遮挡的网格命令清零
+	bool softwareOcclusionCulling = false;
+	uint32_t occlusionWidth = 256;
+	uint32_t occlusionHeight = 128;
+	//上一次CullOcclusion中分块与光栅化的耗时(毫秒)与剔除的网格数
+	float GetOcclusionRasterTime()const { return occlusionRasterTime; }
+	uint32_t GetOccludedMeshCount()const { return occludedMeshCount; }
+	uint32_t GetOcclusionTestedCount()const { return occlusionTestedCount; }
+
+	//静态网格在GPU上按视锥剔除，相同管线与材质的绘制合并为一次间接绘制，需要先编译cullDraws与*Indirect着色器，在SetupRenderEngine之前设定，缺少着色器时SetupRenderEngine将其关闭
+	//带网格簇的网格在主相机下仍按簇剔除，只有阴影由GPU剔除
+	bool gpuDrivenRendering = false;
+	//没有GPU剔除时把几何、材质与LOD都相同的静态网格合并为一次实例化绘制，物体常量按实例从存储缓冲读取，需要*Indirect着色器，在SetupVertexBuffer之前设定，缺少着色器时SetupVertexBuffer将其关闭
+	bool automaticInstancing = false;
+	uint32_t GetInstanceBatchCount()const { return static_cast<uint32_t>(instanceBatches.size()); }
+	//去重后不同网格的数量，以及共用几何少上传的顶点与索引字节数(上一次SetupVertexBuffer)
+	uint32_t GetUniqueMeshCount()const { return uniqueMeshCount; }
+	size_t GetSharedMeshBytes()const { return sharedMeshBytes; }
+	//主相机再按层级深度两段式遮挡剔除，只在gpuDrivenRendering时有效，需要cullDrawsOcclusion与buildHiZ着色器，在SetupRenderEngine之前设定，缺少着色器时退回单段的视锥剔除
+	bool occlusionCulling = false;
+
 private:
+	void WriteObjectDescriptors(GameObject& gameObject);
+	void WriteMaterialDescriptors(Material& material);
+	void WriteMaterialTextures(Material& material);
+	void WriteSkyboxTexture();
+
 	uint32_t passCount = 2;
 
 	std::vector<GameObject*> rootObjects;
@@ -82,23 +160,113 @@ private:
 	std::unordered_map<std::string, GameObject> gameObjects;
 	std::unordered_map<std::string, Material> materials;
 
-	std::unique_ptr<Buffer<Vertex>> vertexBuffer;
-	std::unique_ptr<Buffer<SkinnedVertex>> skinnedVertexBuffer;
+	//顶点按compactVertices选择的格式存放，天空球始终使用完整格式
+	std::unique_ptr<Buffer<uint8_t>> vertexBuffer;
+	std::unique_ptr<Buffer<uint8_t>> skinnedVertexBuffer;
+	std::unique_ptr<Buffer<Vertex>> skyboxVertexBuffer;
 	std::unique_ptr<Buffer<uint32_t>> indexBuffer;
+	std::unique_ptr<Buffer<uint16_t>> index16Buffer;
+	//每个网格簇一条命令，主机可见，每帧由CullMeshlets改写
+	std::unique_ptr<Buffer<vk::DrawIndexedIndirectCommand>> meshletDrawBuffer;
+	uint32_t meshletDrawCount = 0;
+	uint32_t visibleMeshletCount = 0;
+	uint32_t totalMeshletCount = 0;
+	ThreadPool cullThreadPool;
+
+	//把可见的簇写成命令，相邻的簇合并为一条，其余命令的索引数为0。不按簇绘制的网格只有一条命令，visible[0]表示整个网格
+	void WriteMeshletDraws(const MeshRenderer& meshRenderer, const uint8_t* visible);
+	bool UsesMeshletDraws(const MeshRenderer& meshRenderer)const { return meshletCulling && !meshRenderer.meshlets.empty(); }
+
+	SoftwareOcclusion occlusionRasterizer;
+	float occlusionRasterTime = 0.0f;
+	uint32_t occludedMeshCount = 0;
+	uint32_t occlusionTestedCount = 0;
+
+	//GPU剔除，绘制与meshRenderers一一对应
+	std::unique_ptr<GPUCulling> gpuCulling;
+	//主相机的桶按着色模型、材质与索引类型划分，阴影的桶只按索引类型划分
+	struct IndirectBucket {
+		ShaderModel shaderModel;
+		Material* material;
+		vk::IndexType indexType;
+	};
+	std::vector<IndirectBucket> indirectBuckets;
+	std::vector<vk::IndexType> shadowBuckets;
+	void BuildIndirectDraws();
+
+	//自动实例化: 每批一次drawIndexed，firstInstance为批次在实例缓冲中的起点，顶点着色器按SV_InstanceID读取物体常量
+	struct InstanceBatch {
+		Material* material;
+		vk::IndexType indexType;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+	std::vector<InstanceBatch> instanceBatches;
+	//实例缓冲中的顺序
+	std::vector<MeshRenderer*> instanceRenderers;
+	std::unique_ptr<Buffer<ObjectConstants>> instanceBuffer;
+	uint32_t instanceCapacity = 0;
+	vk::DescriptorSet instanceDescSet;
+	bool UsesInstancing()const { return automaticInstancing && !gpuDrivenRendering; }
+	void BuildInstanceBatches();
+	void WriteInstanceData();
+
+	//逐个绘制的静态网格每帧按状态键排序(见DrawSort.h)，录制时只在管线、描述符或索引缓冲变化时重新绑定
+	enum DrawPass : uint32_t {
+		shadowDrawPass = 0,
+		gbufferDrawPass
+	};
+	std::vector<DrawSortEntry> drawQueue;
+	std::vector<DrawSortEntry> drawQueueScratch;
+	std::vector<float> drawDistances;
 
 	std::unique_ptr<FrameResource> frameResources;
 
+	//初始化之后加入的物体与材质使用的描述符池，每次加入单独创建
+	std::vector<vk::DescriptorPool> loadedDescPools;
+	//网格有增删，需要重建顶点缓冲
+	bool geometryDirty = false;
+
+	struct PendingTexture {
+		//为空时对应天空盒
+		Material* material;
+		bool normalMap;
+		AssetHandle<Texture> texture;
+
+		//导入完成后等待上传批次提交
+		bool uploading = false;
+		uint64_t uploadTicket = 0;
+	};
+	std::vector<PendingTexture> pendingTextures;
+	//换入材质的纹理由场景持有
+	std::vector<std::shared_ptr<Texture>> loadedTextures;
+
+	//通用的采样器
+	vk::Sampler repeatSampler;
+	vk::Sampler borderSampler;
+
 	//Pass描述符
 	vk::DescriptorSet scenePassDesc;
 	vk::DescriptorSet shadowPassDesc;
 	vk::DescriptorSet drawShadowDesc;
 
 	//管线
+	PipelineCompiler pipelineCompiler;
 	std::vector<vk::Pipeline> meshPipeline;
 	std::vector<vk::Pipeline> skinnedMeshPipeline;
 
 	//组件池
 	std::vector<MeshRenderer> meshRenderers;
+	//按内容哈希登记的网格，哈希相同时再逐字节比较；只持有弱引用，几何的生命周期由MeshRenderer决定
+	std::unordered_map<uint64_t, std::vector<std::weak_ptr<const MeshGeometry>>> meshRegistry;
+	uint32_t uniqueMeshCount = 0;
+	uint32_t nextMeshId = 0;
+	size_t sharedMeshBytes = 0;
+	std::shared_ptr<const MeshGeometry> RegisterMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	void PruneMeshRegistry();
 	std::vector<SkinnedMeshRenderer> skinnedMeshRenderers;
 	std::vector<ParticleSystem> particleSystems;
 	std::vector<SkinnedModelInstance> skinnedModelInst;
@@ -120,13 +288,14 @@ private:
 	//天空盒
 	struct {
 		bool use = false;
-		Texture image;
+		Texture* image = nullptr;
 		float radius;
 		uint32_t subdivision;
 
 		int startIndexLocation;
 		int baseVertexLocation;
 		int indexCount;
+		vk::IndexType indexType;
 
 		vk::DescriptorSet descSet;
 	}skybox;
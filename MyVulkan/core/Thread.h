@@ -1,18 +1,25 @@
 #pragma once
-#include "vkUtil.h"
+#include "../Util/vkUtil.h"
 #include <thread>
 #include <queue>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
 
 class Thread {
 public:
     Thread() {
-        worker = std::thread(&Thread::QueueLoop);
+        worker = std::thread(&Thread::QueueLoop, this);
     }
     ~Thread() {
         if (worker.joinable()) {
             Wait();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                destroyed = true;
+                condition.notify_one();
+            }
+            worker.join();
         }
     }
     void AddJob(std::function<void()> function) {
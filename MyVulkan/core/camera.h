@@ -10,6 +10,7 @@ public:
     glm::vec3 GetPosition3f() { return position; }
     glm::mat4x4 GetViewMatrix4x4();
     glm::mat4x4 GetProjMatrix4x4();
+    float GetFovY()const { return fovY; }
 
     void SetLens(float fovY, float aspect, float nearZ, float farZ);
     void LookAt(glm::vec3 pos, glm::vec3 target, glm::vec3 worldUp);
@@ -114,7 +114,7 @@ private:
 	uint32_t indexCount = 0;
 
 	vk::Image fontImage;
-	vk::DeviceMemory fontMemory;
+	MemoryAllocation fontAllocation;
 	vk::ImageView fontView;
 
 	vk::Pipeline pipeline;
@@ -139,7 +139,7 @@ public:
 		ImGui::DestroyContext();
 		vkInfo->device.destroyImage(fontImage, 0);
 		vkInfo->device.destroyImageView(fontView, 0);
-		vkInfo->device.freeMemory(fontMemory, 0);
+		vkInfo->allocator->Free(fontAllocation);
 		vkInfo->device.destroySampler(sampler, 0);
 		vkInfo->device.destroyPipeline(pipeline, 0);
 		vkInfo->device.destroyPipelineLayout(pipelineLayout, 0);
@@ -216,13 +216,7 @@ public:
 			.setInitialLayout(vk::ImageLayout::eUndefined);
 		vkInfo->device.createImage(&imageInfo, nullptr, &fontImage);
 
-		vk::MemoryRequirements memReqs;
-		vkInfo->device.getImageMemoryRequirements(fontImage, &memReqs);
-		auto memAllocInfo = vk::MemoryAllocateInfo()
-			.setAllocationSize(memReqs.size);
-		MemoryTypeFromProperties(vkInfo->gpu.getMemoryProperties(), memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, memAllocInfo.memoryTypeIndex);
-		vkInfo->device.allocateMemory(&memAllocInfo, 0, &fontMemory);
-		vkInfo->device.bindImageMemory(fontImage, fontMemory, 0);
+		vkInfo->allocator->AllocateImage(fontImage, vk::MemoryPropertyFlagBits::eDeviceLocal, fontAllocation);
 
 		// Image view
 		auto viewInfo = vk::ImageViewCreateInfo()
@@ -234,7 +228,7 @@ public:
 
 		// Staging buffers for font data upload
 		vk::Buffer stagingBuffer;
-		vk::DeviceMemory bufferMemory;
+		MemoryAllocation stagingAllocation;
 
 		auto bufferInfo = vk::BufferCreateInfo()
 			.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
@@ -242,20 +236,8 @@ public:
 		vkInfo->device.createBuffer(&bufferInfo, 0, &stagingBuffer);
 
 		//Allocate the memory of buffer
-		vk::MemoryRequirements uploaderMemReqs;
-		vkInfo->device.getBufferMemoryRequirements(stagingBuffer, &uploaderMemReqs);
-
-		auto bufferMemoryInfo = vk::MemoryAllocateInfo()
-			.setAllocationSize(uploaderMemReqs.size);
-		MemoryTypeFromProperties(vkInfo->gpu.getMemoryProperties(), uploaderMemReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, bufferMemoryInfo.memoryTypeIndex);
-		vkInfo->device.allocateMemory(&bufferMemoryInfo, 0, &bufferMemory);
-
-		vkInfo->device.bindBufferMemory(stagingBuffer, bufferMemory, 0);
-
-		BYTE* mapPtr;
-		vkInfo->device.mapMemory(bufferMemory, 0, uploadSize, vk::MemoryMapFlags(), reinterpret_cast<void**>(&mapPtr));
-		memcpy(mapPtr, fontData, uploadSize);
-		vkInfo->device.unmapMemory(bufferMemory);
+		vkInfo->allocator->AllocateBuffer(stagingBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlags(), stagingAllocation);
+		memcpy(stagingAllocation.mappedData, fontData, uploadSize);
 
 		// Copy buffer data to font image
 		vk::CommandBuffer copyCmd = BeginSingleTimeCommand(&vkInfo->device, vkInfo->cmdPool);
@@ -304,7 +286,7 @@ public:
 		EndSingleTimeCommand(&copyCmd, vkInfo->cmdPool, &vkInfo->device, &vkInfo->queue);
 
 		vkInfo->device.destroyBuffer(stagingBuffer);
-		vkInfo->device.freeMemory(bufferMemory);
+		vkInfo->allocator->Free(stagingAllocation);
 
 		// Font texture Sampler
 		auto samplerInfo = vk::SamplerCreateInfo()
@@ -515,7 +497,7 @@ public:
 			.setSubpass(subpassIndex)
 			.setPInputAssemblyState(&iaInfo)
 			.setPVertexInputState(&viInfo);
-		vkInfo->device.createGraphicsPipelines(vk::PipelineCache(), 1, &pipelineInfo, 0, &pipeline);
+		vkInfo->device.createGraphicsPipelines(vkInfo->pipelineCache, 1, &pipelineInfo, 0, &pipeline);
 		
 		vkInfo->device.destroyShaderModule(vsModule);
 		vkInfo->device.destroyShaderModule(psModule);
@@ -538,14 +520,14 @@ public:
 		// Vertex buffer
 		if ((vertexBuffer == nullptr) || (vertexCount != imDrawData->TotalVtxCount)) {
 			if (vertexBuffer != nullptr) vertexBuffer->DestroyBuffer(&vkInfo->device);
-			vertexBuffer = std::make_unique<Buffer<ImDrawVert>>(&vkInfo->device, imDrawData->TotalVtxCount, vk::BufferUsageFlagBits::eVertexBuffer, vkInfo->gpu.getMemoryProperties(), vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, false);
+			vertexBuffer = std::make_unique<Buffer<ImDrawVert>>(&vkInfo->device, imDrawData->TotalVtxCount, vk::BufferUsageFlagBits::eVertexBuffer, vkInfo->allocator, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eDeviceLocal);
 			vertexCount = imDrawData->TotalVtxCount;
 		}
 
 		// Index buffer
 		if ((indexBuffer == nullptr) || (indexCount < imDrawData->TotalIdxCount)) {
 			if (indexBuffer != nullptr) indexBuffer->DestroyBuffer(&vkInfo->device);
-			indexBuffer = std::make_unique<Buffer<ImDrawIdx>>(&vkInfo->device, imDrawData->TotalIdxCount, vk::BufferUsageFlagBits::eIndexBuffer, vkInfo->gpu.getMemoryProperties(), vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, false);
+			indexBuffer = std::make_unique<Buffer<ImDrawIdx>>(&vkInfo->device, imDrawData->TotalIdxCount, vk::BufferUsageFlagBits::eIndexBuffer, vkInfo->allocator, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eDeviceLocal);
 			indexCount = imDrawData->TotalIdxCount;
 		}
 
@@ -0,0 +1,182 @@
+#include "../MyVulkan/Util/SoftwareOcclusion.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+/*软件遮挡剔除的基准与检查，只依赖glm，不需要GPU
+  场景与App的cityBlockScene相同: 16x16的建筑作为遮挡物，每个街区4个小物件作为被测试的物体
+  用法: OcclusionBench [迭代次数，默认200]*/
+
+struct Box {
+	glm::vec3 center;
+	glm::vec3 halfSize;
+};
+
+//8个顶点共用的立方体，内部的对角线与棱都是共用边
+static const glm::vec3 boxPositions[8] = {
+	{ -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f },
+	{ -1.0f, -1.0f, 1.0f }, { 1.0f, -1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, { -1.0f, 1.0f, 1.0f }
+};
+static const uint32_t boxIndices[36] = {
+	0, 2, 1, 0, 3, 2,
+	4, 5, 6, 4, 6, 7,
+	0, 1, 5, 0, 5, 4,
+	3, 7, 6, 3, 6, 2,
+	0, 4, 7, 0, 7, 3,
+	1, 2, 6, 1, 6, 5
+};
+
+static glm::mat4x4 BoxWorld(const Box& box) {
+	return glm::scale(glm::translate(glm::mat4x4(1.0f), box.center), box.halfSize);
+}
+
+static bool IsBoxVisible(const SoftwareOcclusion& occlusion, const Box& box) {
+	return occlusion.IsVisible(box.center - box.halfSize, box.center + box.halfSize);
+}
+
+//与Camera::SetLens相同的投影
+static glm::mat4x4 MakeViewProj(const glm::vec3& eye, const glm::vec3& target, float aspect) {
+	glm::mat4x4 proj = glm::perspective(0.25f * glm::pi<float>(), aspect, 0.1f, 1000.0f);
+	proj[1][1] *= -1.0f;
+	return proj * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+static void Rasterize(SoftwareOcclusion& occlusion, const glm::mat4x4& viewProj, const std::vector<Box>& occluders, uint32_t threadCount) {
+	occlusion.Begin(viewProj);
+	for (auto& occluder : occluders)
+		occlusion.AddOccluder(boxPositions, 8, sizeof(glm::vec3), boxIndices, 36, BoxWorld(occluder));
+
+	uint32_t tileCount = occlusion.GetTileCount();
+	if (threadCount <= 1) {
+		occlusion.RasterizeTiles(0, tileCount);
+		return;
+	}
+	std::vector<std::thread> threads;
+	uint32_t tilesPerThread = (tileCount + threadCount - 1) / threadCount;
+	for (uint32_t i = 0; i < threadCount; i++)
+		threads.emplace_back([&occlusion, i, tilesPerThread] { occlusion.RasterizeTiles(i * tilesPerThread, tilesPerThread); });
+	for (auto& thread : threads)
+		thread.join();
+}
+
+static int failures = 0;
+static void Check(bool condition, const char* name) {
+	printf("  %-48s %s\n", name, condition ? "ok" : "FAILED");
+	if (!condition)
+		failures++;
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? std::max(std::stoi(argv[1]), 1) : 200;
+
+	//街区测试场景，与App::Start中的cityBlockScene一致
+	const int blockCount = 16;
+	const float blockSize = 12.0f;
+	const float origin = -blockSize * blockCount * 0.5f;
+	std::vector<Box> buildings;
+	std::vector<Box> props;
+	for (int x = 0; x < blockCount; x++) {
+		for (int z = 0; z < blockCount; z++) {
+			float centerX = origin + (x + 0.5f) * blockSize;
+			float centerZ = origin + (z + 0.5f) * blockSize;
+			float height = 10.0f + static_cast<float>((x * 7 + z * 13) % 5) * 5.0f;
+			buildings.push_back({ glm::vec3(centerX, height * 0.5f - 1.0f, centerZ), glm::vec3(4.0f, height * 0.5f, 4.0f) });
+			for (int i = 0; i < 4; i++)
+				props.push_back({ glm::vec3(centerX + ((i & 1) ? 5.0f : -5.0f), -0.7f, centerZ + ((i & 2) ? 5.0f : -5.0f)), glm::vec3(0.3f) });
+		}
+	}
+
+	//站在街区中间的路口，斜着看向街区，大部分小物件被建筑挡住
+	const glm::vec3 eye(0.0f, 1.7f, 0.0f);
+	const glm::vec3 target(40.0f, 1.7f, 25.0f);
+	glm::mat4x4 viewProj = MakeViewProj(eye, target, 2.0f);
+
+	SoftwareOcclusion occlusion;
+	occlusion.Resize(256, 128);
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	printf("%zu occluders, %zu tested boxes, %ux%u depth, %d iterations\n", buildings.size(), props.size(), occlusion.GetWidth(), occlusion.GetHeight(), iterations);
+
+	//屏幕外的物体IsVisible总是返回可见(由视锥剔除处理)，剔除率只按视野内的物体统计
+	uint32_t inView = 0;
+	for (auto& prop : props) {
+		glm::vec4 clip = viewProj * glm::vec4(prop.center, 1.0f);
+		if (clip.w > 0.0f && std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w)
+			inView++;
+	}
+
+	//单线程与按块多线程的光栅化耗时，测试耗时单独统计
+	double rasterTime[2] = {};
+	double testTime = 0.0;
+	uint32_t culled = 0;
+	for (int i = 0; i < iterations; i++) {
+		for (int threaded = 0; threaded < 2; threaded++) {
+			auto startTime = std::chrono::high_resolution_clock::now();
+			Rasterize(occlusion, viewProj, buildings, threaded ? threadCount : 1);
+			rasterTime[threaded] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		}
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		culled = 0;
+		for (auto& prop : props)
+			culled += IsBoxVisible(occlusion, prop) ? 0 : 1;
+		testTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	printf("binned triangles %u\n", occlusion.GetBinnedTriangleCount());
+	printf("raster %.3f ms (1 thread), %.3f ms (%u threads), test %.3f ms\n", rasterTime[0] / iterations, rasterTime[1] / iterations, threadCount, testTime / iterations);
+	printf("culled %u/%u boxes in view (%.1f%%), %zu boxes in total\n", culled, inView, inView > 0 ? 100.0 * culled / inView : 0.0, props.size());
+
+	printf("checks\n");
+	//路口正前方的街道上没有遮挡
+	Check(IsBoxVisible(occlusion, { eye + glm::normalize(target - eye) * 3.0f - glm::vec3(0.0f, 1.5f, 0.0f), glm::vec3(0.3f) }), "box in the street ahead is visible");
+	//所有建筑上方的物体
+	Check(IsBoxVisible(occlusion, { eye + glm::normalize(target - eye) * 60.0f + glm::vec3(0.0f, 60.0f, 0.0f), glm::vec3(1.0f) }), "box above the roofs is visible");
+	//视线方向上第一栋建筑的正后方
+	{
+		const Box* nearest = nullptr;
+		float nearestDistance = 1e30f;
+		glm::vec3 direction = glm::normalize(target - eye);
+		for (auto& building : buildings) {
+			glm::vec3 toBuilding = building.center - eye;
+			toBuilding.y = 0.0f;
+			float along = glm::dot(toBuilding, direction);
+			float across = glm::length(toBuilding - direction * along);
+			if (along > 0.0f && across < 1.0f && along < nearestDistance) {
+				nearest = &building;
+				nearestDistance = along;
+			}
+		}
+		Check(nearest != nullptr, "found a building on the view ray");
+		if (nearest != nullptr) {
+			glm::vec3 behind = eye + direction * (nearestDistance + 8.0f);
+			Check(!IsBoxVisible(occlusion, { glm::vec3(behind.x, 0.0f, behind.z), glm::vec3(1.0f) }), "box right behind that building is culled");
+		}
+	}
+	Check(culled > 0 && culled < inView, "some but not all props in view are culled");
+
+	//两个三角形的四边形，对角线穿过像素中心，共用边上不能漏掉像素
+	{
+		SoftwareOcclusion quad;
+		quad.Resize(64, 64);
+		quad.Begin(glm::mat4x4(1.0f));
+		const glm::vec3 corners[4] = { { -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f } };
+		const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+		quad.AddOccluder(corners, 4, sizeof(glm::vec3), indices, 6, glm::mat4x4(1.0f));
+		quad.RasterizeTiles(0, quad.GetTileCount());
+		//正交的单位矩阵下一个像素宽1/32，盒子只覆盖对角线附近的像素
+		Check(!quad.IsVisible(glm::vec3(-0.02f, -0.02f, 0.8f), glm::vec3(0.02f, 0.02f, 0.9f)), "box behind the quad's shared edge is culled");
+		Check(quad.IsVisible(glm::vec3(-0.02f, -0.02f, 0.1f), glm::vec3(0.02f, 0.02f, 0.2f)), "box in front of the quad is visible");
+	}
+
+	if (failures > 0) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}